@@ -1074,3 +1074,44 @@ CREATE TABLE proxy_autoreg_host (
 	PRIMARY KEY (id)
 );
 CREATE INDEX proxy_autoreg_host_1 on proxy_autoreg_host (clock);
+CREATE TABLE write_queue (
+	slotid		integer		DEFAULT '0'	NOT NULL,
+	seq		bigint		DEFAULT '0'	NOT NULL,
+	PRIMARY KEY (slotid)
+);
+CREATE TABLE config_changes (
+	table_name		varchar(64)		DEFAULT ''	NOT NULL,
+	recordid		bigint		DEFAULT '0'	NOT NULL
+);
+CREATE INDEX config_changes_1 on config_changes (table_name,recordid);
+CREATE TRIGGER items_changes_ins AFTER INSERT ON items REFERENCING NEW AS n FOR EACH ROW
+	INSERT INTO config_changes VALUES ('items',n.itemid);
+CREATE TRIGGER items_changes_upd AFTER UPDATE OF hostid,type,data_type,value_type,key_,snmp_community,snmp_oid,snmp_port,snmpv3_securityname,
+	snmpv3_securitylevel,snmpv3_authpassphrase,snmpv3_privpassphrase,ipmi_sensor,delay,delay_flex,
+	trapper_hosts,logtimefmt,params,status,authtype,username,password,publickey,privatekey
+	ON items REFERENCING NEW AS n FOR EACH ROW
+	INSERT INTO config_changes VALUES ('items',n.itemid);
+CREATE TRIGGER items_changes_del AFTER DELETE ON items REFERENCING OLD AS o FOR EACH ROW
+	INSERT INTO config_changes VALUES ('items',o.itemid);
+CREATE TRIGGER hosts_changes_ins AFTER INSERT ON hosts REFERENCING NEW AS n FOR EACH ROW
+	INSERT INTO config_changes VALUES ('hosts',n.hostid);
+CREATE TRIGGER hosts_changes_upd AFTER UPDATE OF proxy_hostid,host,useip,ip,dns,port,useipmi,ipmi_ip,ipmi_port,ipmi_authtype,ipmi_privilege,
+	ipmi_username,ipmi_password,maintenance_status,maintenance_type,maintenance_from,status
+	ON hosts REFERENCING NEW AS n FOR EACH ROW
+	INSERT INTO config_changes VALUES ('hosts',n.hostid);
+CREATE TRIGGER hosts_changes_del AFTER DELETE ON hosts REFERENCING OLD AS o FOR EACH ROW
+	INSERT INTO config_changes VALUES ('hosts',o.hostid);
+CREATE TRIGGER triggers_changes_ins AFTER INSERT ON triggers REFERENCING NEW AS n FOR EACH ROW
+	INSERT INTO config_changes VALUES ('triggers',n.triggerid);
+CREATE TRIGGER triggers_changes_upd AFTER UPDATE OF expression,status,type
+	ON triggers REFERENCING NEW AS n FOR EACH ROW
+	INSERT INTO config_changes VALUES ('triggers',n.triggerid);
+CREATE TRIGGER triggers_changes_del AFTER DELETE ON triggers REFERENCING OLD AS o FOR EACH ROW
+	INSERT INTO config_changes VALUES ('triggers',o.triggerid);
+CREATE TRIGGER functions_changes_ins AFTER INSERT ON functions REFERENCING NEW AS n FOR EACH ROW
+	INSERT INTO config_changes VALUES ('triggers',n.triggerid);
+CREATE TRIGGER functions_changes_upd AFTER UPDATE OF itemid,triggerid
+	ON functions REFERENCING OLD AS o NEW AS n FOR EACH ROW
+	INSERT INTO config_changes VALUES ('triggers',o.triggerid),('triggers',n.triggerid);
+CREATE TRIGGER functions_changes_del AFTER DELETE ON functions REFERENCING OLD AS o FOR EACH ROW
+	INSERT INTO config_changes VALUES ('triggers',o.triggerid);
@@ -1540,3 +1540,75 @@ SELECT proxy_history_seq.nextval INTO :new.id FROM dual;
 END;
 /
 
+CREATE TABLE write_queue (
+	slotid		number(10)		DEFAULT '0'	NOT NULL,
+	seq		number(20)		DEFAULT '0'	NOT NULL,
+	PRIMARY KEY (slotid)
+)
+/
+
+CREATE TABLE config_changes (
+	table_name		nvarchar2(64)		DEFAULT '',
+	recordid		number(20)		DEFAULT '0'	NOT NULL
+)
+/
+
+CREATE INDEX config_changes_1 on config_changes (table_name,recordid)
+/
+
+CREATE TRIGGER items_changes
+AFTER INSERT OR DELETE OR UPDATE OF hostid,type,data_type,value_type,key_,snmp_community,snmp_oid,snmp_port,snmpv3_securityname,
+	snmpv3_securitylevel,snmpv3_authpassphrase,snmpv3_privpassphrase,ipmi_sensor,delay,delay_flex,
+	trapper_hosts,logtimefmt,params,status,authtype,username,password,publickey,privatekey
+ON items
+FOR EACH ROW
+BEGIN
+IF DELETING THEN
+	INSERT INTO config_changes VALUES ('items',:old.itemid);
+ELSE
+	INSERT INTO config_changes VALUES ('items',:new.itemid);
+END IF;
+END;
+/
+
+CREATE TRIGGER hosts_changes
+AFTER INSERT OR DELETE OR UPDATE OF proxy_hostid,host,useip,ip,dns,port,useipmi,ipmi_ip,ipmi_port,ipmi_authtype,ipmi_privilege,
+	ipmi_username,ipmi_password,maintenance_status,maintenance_type,maintenance_from,status
+ON hosts
+FOR EACH ROW
+BEGIN
+IF DELETING THEN
+	INSERT INTO config_changes VALUES ('hosts',:old.hostid);
+ELSE
+	INSERT INTO config_changes VALUES ('hosts',:new.hostid);
+END IF;
+END;
+/
+
+CREATE TRIGGER triggers_changes
+AFTER INSERT OR DELETE OR UPDATE OF expression,status,type
+ON triggers
+FOR EACH ROW
+BEGIN
+IF DELETING THEN
+	INSERT INTO config_changes VALUES ('triggers',:old.triggerid);
+ELSE
+	INSERT INTO config_changes VALUES ('triggers',:new.triggerid);
+END IF;
+END;
+/
+
+CREATE TRIGGER functions_changes
+AFTER INSERT OR DELETE OR UPDATE OF itemid,triggerid
+ON functions
+FOR EACH ROW
+BEGIN
+IF NOT INSERTING THEN
+	INSERT INTO config_changes VALUES ('triggers',:old.triggerid);
+END IF;
+IF NOT DELETING THEN
+	INSERT INTO config_changes VALUES ('triggers',:new.triggerid);
+END IF;
+END;
+/
+
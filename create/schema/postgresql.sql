@@ -1074,3 +1074,65 @@ CREATE TABLE proxy_autoreg_host (
 	PRIMARY KEY (id)
 ) with OIDS;
 CREATE INDEX proxy_autoreg_host_1 on proxy_autoreg_host (clock);
+CREATE TABLE write_queue (
+	slotid		integer		DEFAULT '0'	NOT NULL,
+	seq		numeric(20)		DEFAULT '0'	NOT NULL,
+	PRIMARY KEY (slotid)
+) with OIDS;
+CREATE TABLE config_changes (
+	table_name		varchar(64)		DEFAULT ''	NOT NULL,
+	recordid		bigint		DEFAULT '0'	NOT NULL
+) with OIDS;
+CREATE INDEX config_changes_1 on config_changes (table_name,recordid);
+CREATE FUNCTION items_changes() RETURNS trigger AS $$
+BEGIN
+	IF TG_OP = 'DELETE' THEN
+		INSERT INTO config_changes VALUES ('items',OLD.itemid);
+	ELSE
+		INSERT INTO config_changes VALUES ('items',NEW.itemid);
+	END IF;
+	RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+CREATE TRIGGER items_changes AFTER INSERT OR DELETE OR UPDATE OF hostid,type,data_type,value_type,key_,snmp_community,snmp_oid,snmp_port,snmpv3_securityname,
+	snmpv3_securitylevel,snmpv3_authpassphrase,snmpv3_privpassphrase,ipmi_sensor,delay,delay_flex,
+	trapper_hosts,logtimefmt,params,status,authtype,username,password,publickey,privatekey
+	ON items FOR EACH ROW EXECUTE PROCEDURE items_changes();
+CREATE FUNCTION hosts_changes() RETURNS trigger AS $$
+BEGIN
+	IF TG_OP = 'DELETE' THEN
+		INSERT INTO config_changes VALUES ('hosts',OLD.hostid);
+	ELSE
+		INSERT INTO config_changes VALUES ('hosts',NEW.hostid);
+	END IF;
+	RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+CREATE TRIGGER hosts_changes AFTER INSERT OR DELETE OR UPDATE OF proxy_hostid,host,useip,ip,dns,port,useipmi,ipmi_ip,ipmi_port,ipmi_authtype,ipmi_privilege,
+	ipmi_username,ipmi_password,maintenance_status,maintenance_type,maintenance_from,status
+	ON hosts FOR EACH ROW EXECUTE PROCEDURE hosts_changes();
+CREATE FUNCTION triggers_changes() RETURNS trigger AS $$
+BEGIN
+	IF TG_OP = 'DELETE' THEN
+		INSERT INTO config_changes VALUES ('triggers',OLD.triggerid);
+	ELSE
+		INSERT INTO config_changes VALUES ('triggers',NEW.triggerid);
+	END IF;
+	RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+CREATE TRIGGER triggers_changes AFTER INSERT OR DELETE OR UPDATE OF expression,status,type
+	ON triggers FOR EACH ROW EXECUTE PROCEDURE triggers_changes();
+CREATE FUNCTION functions_changes() RETURNS trigger AS $$
+BEGIN
+	IF TG_OP <> 'INSERT' THEN
+		INSERT INTO config_changes VALUES ('triggers',OLD.triggerid);
+	END IF;
+	IF TG_OP <> 'DELETE' THEN
+		INSERT INTO config_changes VALUES ('triggers',NEW.triggerid);
+	END IF;
+	RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+CREATE TRIGGER functions_changes AFTER INSERT OR DELETE OR UPDATE OF itemid,triggerid
+	ON functions FOR EACH ROW EXECUTE PROCEDURE functions_changes();
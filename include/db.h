@@ -532,9 +532,17 @@ DB_RESULT	DBselectN(const char *query, int n);
 DB_ROW		DBfetch(DB_RESULT result);
 int		DBis_null(const char *field);
 void		DBbegin();
-void		DBcommit();
+int		DBcommit();
 void		DBrollback();
 
+#define ZBX_DB_PARAMS_MAX	32
+int	DBexecute_prepared(const char *sql, const char *types, ...);
+
+#ifdef HAVE_BULK_INSERT
+int	DBbulk_insert(const char *table, const char **fields, const unsigned char *types, int fields_num,
+		const zbx_db_value_t *values, int rows_num);
+#endif
+
 const ZBX_TABLE	*DBget_table(const char *tablename);
 const ZBX_FIELD	*DBget_field(const ZBX_TABLE *table, const char *fieldname);
 #define DBget_maxid(table)	DBget_maxid_num(table, 1)
@@ -22,12 +22,15 @@
 
 #include "db.h"
 #include "sysinfo.h"
+#include "zbxalgo.h"
 
 #define ZBX_SYNC_PARTIAL	0
 #define	ZBX_SYNC_FULL		1
 
 #define DC_ITEM struct dc_item
 #define DC_HOST struct dc_host
+#define DC_TRIGGER struct dc_trigger
+#define DC_VALUE_ITEM struct dc_value_item
 
 #define	ZBX_NO_POLLER			255
 #define	ZBX_POLLER_TYPE_NORMAL		0
@@ -42,6 +45,14 @@ extern int	CONFIG_CONF_CACHE_SIZE;
 extern int	CONFIG_HISTORY_CACHE_SIZE;
 extern int	CONFIG_TRENDS_CACHE_SIZE;
 extern int	CONFIG_TEXT_CACHE_SIZE;
+extern int	CONFIG_LASTVALUE_CACHE_SIZE;
+extern int	CONFIG_LASTVALUE_FLUSH_FREQUENCY;
+extern int	CONFIG_VALUE_CACHE_SIZE;
+extern int	CONFIG_HISTORY_CACHE_SHARDS;
+extern char	*CONFIG_HISTORY_JOURNAL_DIR;
+extern int	CONFIG_HISTORY_JOURNAL_HIGH_WATER;
+extern int	CONFIG_HISTORY_JOURNAL_SEGMENT_SIZE;
+extern char	*CONFIG_CONF_CACHE_SNAPSHOT_FILE;
 extern int	CONFIG_POLLER_FORKS;
 extern int	CONFIG_UNREACHABLE_POLLER_FORKS;
 extern int	CONFIG_IPMIPOLLER_FORKS;
@@ -51,9 +62,19 @@ extern int	CONFIG_UNAVAILABLE_DELAY;
 extern int	CONFIG_UNREACHABLE_PERIOD;
 extern int	CONFIG_UNREACHABLE_DELAY;
 extern int	CONFIG_HISTSYNCER_FORKS;
+extern int	CONFIG_DBWRITER_FORKS;
+extern int	CONFIG_HISTSYNCER_BATCH_SIZE;
 extern int	CONFIG_PROXYCONFIG_FREQUENCY;
 extern int	CONFIG_PROXYDATA_FREQUENCY;
 
+typedef union
+{
+	double		value_float;
+	zbx_uint64_t	value_uint64;
+	char		*value_str;
+}
+history_value_t;
+
 DC_HOST
 {
 	zbx_uint64_t	hostid;
@@ -114,9 +135,37 @@ DC_ITEM
 	char		password_orig[ITEM_PASSWORD_LEN_MAX], *password;
 };
 
+/* the part of an item and its host needed to accept a received value */
+DC_VALUE_ITEM
+{
+	zbx_uint64_t	itemid;
+	int		maintenance_from;
+	unsigned char	type;
+	unsigned char	data_type;
+	unsigned char	value_type;
+	unsigned char	maintenance_status;
+	unsigned char	maintenance_type;
+	char		trapper_hosts[ITEM_TRAPPER_HOSTS_LEN_MAX];
+	char		logtimefmt[ITEM_LOGTIMEFMT_LEN_MAX];
+};
+
+DC_TRIGGER
+{
+	zbx_uint64_t	triggerid;
+	char		*expression;
+	int		clock;
+	int		level;
+	unsigned char	type;
+};
+
 void	dc_add_history(zbx_uint64_t itemid, unsigned char value_type, AGENT_RESULT *value, int now,
 		int timestamp, char *source, int severity, int logeventid, int lastlogsize, int mtime);
 int	DCsync_history(int sync_type);
+void	DCprepare_write_queue();
+void	DCstart_write_queue();
+int	DCwrite_history();
+void	DCwait_queued_history(zbx_uint64_t *itemids, int itemids_num);
+void	DCsync_history_journal();
 void	init_database_cache(unsigned char p);
 void	free_database_cache(void);
 
@@ -148,17 +197,31 @@ zbx_uint64_t	DCget_nextid(const char *table_name, int num);
 zbx_uint64_t	DCget_nextid_shared(const char *table_name);
 
 int	DCget_item_lastclock(zbx_uint64_t itemid);
+int	DCget_item_lastvalues(DB_ITEM *item);
+int	DCis_item_in_sync(zbx_uint64_t itemid);
 
 void	DCsync_configuration();
-void	init_configuration_cache();
+void	DCsave_configuration_snapshot();
+int	DCload_configuration_snapshot();
+void	init_configuration_cache(unsigned char p);
 void	free_configuration_cache();
 
 int	DCget_host_by_hostid(DC_HOST *host, zbx_uint64_t hostid);
 int	DCconfig_get_item_by_key(DC_ITEM *item, zbx_uint64_t proxy_hostid, const char *hostname, const char *key);
+void	DCconfig_get_items_by_keys(DC_VALUE_ITEM *items, zbx_uint64_t proxy_hostid, const char **hostnames,
+		const char **keys, int *errcodes, int num);
 int	DCconfig_get_item_by_itemid(DC_ITEM *item, zbx_uint64_t itemid);
 int	DCconfig_get_poller_nextcheck(unsigned char poller_type);
 int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items, int max_items);
 int	DCconfig_get_items(zbx_uint64_t hostid, const char *key, DC_ITEM **items);
+int	DCconfig_get_triggers_by_itemids(DC_TRIGGER **triggers, const zbx_uint64_t *itemids, const int *clocks,
+		int itemids_num);
+unsigned int	DCconfig_get_triggers_revision();
+void	DCconfig_get_removed_triggerids(zbx_vector_uint64_t *triggerids);
+int	DCconfig_check_trigger_dependencies(zbx_uint64_t triggerid);
+void	DCconfig_set_trigger_value(zbx_uint64_t triggerid, unsigned char value);
+void	DCconfig_commit_trigger_values();
+void	DCconfig_rollback_trigger_values();
 
 void	DCrequeue_reachable_item(zbx_uint64_t itemid, unsigned char status, int now);
 void	DCrequeue_unreachable_item(zbx_uint64_t itemid);
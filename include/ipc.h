@@ -28,6 +28,9 @@
 #define ZBX_IPC_HISTORY_ID	'h'
 #define ZBX_IPC_HISTORY_TEXT_ID	'x'
 #define ZBX_IPC_TREND_ID	't'
+#define ZBX_IPC_WRITE_QUEUE_ID	'w'
+#define ZBX_IPC_LASTVALUE_ID	'v'
+#define ZBX_IPC_VALUECACHE_ID	'V'
 #define ZBX_IPC_STRPOOL_ID	's'
 #define ZBX_IPC_COLLECTOR_ID	'l'
 #define ZBX_IPC_SELFMON_ID	'S'
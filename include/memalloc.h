@@ -26,6 +26,7 @@
 typedef struct
 {
 	void		**buckets;
+	uint32_t	*buckets_bitmap;	/* a bit per bucket, set if it is not empty */
 	void		*lo_bound;
 	void		*hi_bound;
 	uint32_t	free_size;
@@ -37,6 +38,9 @@ typedef struct
 	ZBX_MUTEX	mem_lock;
 	const char	*mem_descr;
 	const char	*mem_param;
+	void		*slabs;		/* size classes of small allocations, NULL unless enabled */
+	unsigned char	*slab_pages;	/* a bit per page of shared memory, set if it is a slab page */
+	void		*slab_base;
 }
 zbx_mem_info_t;
 
@@ -51,6 +55,11 @@ void	*__zbx_mem_malloc(const char *file, int line, zbx_mem_info_t *info, const v
 void	*__zbx_mem_realloc(const char *file, int line, zbx_mem_info_t *info, void *old, size_t size);
 void	__zbx_mem_free(const char *file, int line, zbx_mem_info_t *info, void *ptr);
 
+void	*zbx_mem_try_malloc(zbx_mem_info_t *info, size_t size);
+
+void	zbx_mem_enable_slabs(zbx_mem_info_t *info);
+void	zbx_mem_slab_reserve(zbx_mem_info_t *info, size_t size, int num);
+
 void	zbx_mem_clear(zbx_mem_info_t *info);
 
 void	zbx_mem_dump_stats(zbx_mem_info_t *info);
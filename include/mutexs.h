@@ -49,14 +49,31 @@
 #	define ZBX_MUTEX_CACHE		2
 #	define ZBX_MUTEX_TRENDS		3
 #	define ZBX_MUTEX_CACHE_IDS	4
-#	define ZBX_MUTEX_CONFIG		5
+#	define ZBX_MUTEX_CONFIG		5	/* readers of the configuration cache reader-writer lock */
 #	define ZBX_MUTEX_STRPOOL	6
 #	define ZBX_MUTEX_SELFMON	7
 #	define ZBX_MUTEX_CPUSTATS	8
-#	define ZBX_MUTEX_COUNT		9
+#	define ZBX_MUTEX_HISTORY_JOURNAL	9
+#	define ZBX_MUTEX_LASTVALUES	10
+#	define ZBX_MUTEX_VALUECACHE	11
+#	define ZBX_MUTEX_WRITE_QUEUE	12
+#	define ZBX_MUTEX_CONFIG_WRITERS	13	/* writers of the configuration cache reader-writer lock */
+#	define ZBX_MUTEX_CACHE_SHARDS	14	/* history cache shards except the first one, which uses ZBX_MUTEX_CACHE */
+#	define ZBX_MUTEX_COUNT		(ZBX_MUTEX_CACHE_SHARDS + ZBX_HISTORY_SHARDS_MAX - 1)
+
+#	define ZBX_HISTORY_SHARDS_MAX	16
 
 #	define ZBX_MUTEX_MAX_TRIES	20 /* seconds */
 
+#	define ZBX_RWLOCK_READERS_MAX	16384	/* within both SEMVMX and SEMAEM */
+
+	typedef struct
+	{
+		ZBX_MUTEX	readers;	/* ZBX_RWLOCK_READERS_MAX minus the readers inside */
+		ZBX_MUTEX	writers;	/* writers inside or waiting to get in */
+	}
+	ZBX_RWLOCK;
+
 #endif /* _WINDOWS */
 
 #define zbx_mutex_create(mutex, name)		zbx_mutex_create_ext(mutex, name, 0)
@@ -69,6 +86,22 @@ void	__zbx_mutex_lock(const char *filename, int line, ZBX_MUTEX *mutex);
 void	__zbx_mutex_unlock(const char *filename, int line, ZBX_MUTEX *mutex);
 int	zbx_mutex_destroy(ZBX_MUTEX *mutex);
 
+#if !defined(_WINDOWS)
+
+#define zbx_rwlock_rdlock(rwlock)		__zbx_rwlock_rdlock(__FILE__, __LINE__, rwlock)
+#define zbx_rwlock_rdunlock(rwlock)		__zbx_rwlock_rdunlock(__FILE__, __LINE__, rwlock)
+#define zbx_rwlock_wrlock(rwlock)		__zbx_rwlock_wrlock(__FILE__, __LINE__, rwlock)
+#define zbx_rwlock_wrunlock(rwlock)		__zbx_rwlock_wrunlock(__FILE__, __LINE__, rwlock)
+
+int	zbx_rwlock_create(ZBX_RWLOCK *rwlock, ZBX_MUTEX_NAME readers, ZBX_MUTEX_NAME writers);
+void	__zbx_rwlock_rdlock(const char *filename, int line, ZBX_RWLOCK *rwlock);
+void	__zbx_rwlock_rdunlock(const char *filename, int line, ZBX_RWLOCK *rwlock);
+void	__zbx_rwlock_wrlock(const char *filename, int line, ZBX_RWLOCK *rwlock);
+void	__zbx_rwlock_wrunlock(const char *filename, int line, ZBX_RWLOCK *rwlock);
+int	zbx_rwlock_destroy(ZBX_RWLOCK *rwlock);
+
+#endif	/* not _WINDOWS */
+
 #if defined(HAVE_SQLITE3)
 
 /*********************************************************/
@@ -0,0 +1,71 @@
+/*
+** ZABBIX
+** Copyright (C) 2000-2011 SIA Zabbix
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**/
+
+#ifndef ZABBIX_VALUECACHE_H
+#define ZABBIX_VALUECACHE_H
+
+#include "dbcache.h"
+
+/* value of an item as kept in the value cache */
+typedef struct
+{
+	int		clock;
+	history_value_t	value;
+}
+zbx_vc_value_t;
+
+/* value passed to the value cache by history syncers */
+typedef struct
+{
+	zbx_uint64_t	itemid;
+	int		clock;
+	history_value_t	value;
+	unsigned char	value_type;
+}
+zbx_vc_item_value_t;
+
+void	zbx_vc_init();
+void	zbx_vc_destroy();
+
+int	zbx_vc_get_value_range(zbx_uint64_t itemid, int value_type, zbx_vc_value_t **values, int *values_alloc,
+		int *values_num, int seconds, int count, int timestamp);
+void	zbx_vc_add_values(zbx_vc_item_value_t *values, int values_num);
+
+#define ZBX_VC_AGG_SUM		0	/* sum and number of the values */
+#define ZBX_VC_AGG_MIN		1
+#define ZBX_VC_AGG_MAX		2
+#define ZBX_VC_AGG_COUNT	3	/* number of the values matching the pattern */
+
+/* checks whether a value is counted by function count with the specified operator and pattern */
+typedef int	(*zbx_vc_match_func_t)(int op, int value_type, const history_value_t *value,
+		const history_value_t *pattern);
+
+int	zbx_vc_get_aggregate(zbx_uint64_t itemid, int value_type, int func, int seconds, int timestamp, int op,
+		const history_value_t *pattern, zbx_vc_match_func_t match, history_value_t *result, int *num);
+
+#define ZBX_VC_STATS_HITS	0
+#define ZBX_VC_STATS_MISSES	1
+#define ZBX_VC_STATS_ITEMS	2
+#define ZBX_VC_STATS_TOTAL	3
+#define ZBX_VC_STATS_USED	4
+#define ZBX_VC_STATS_FREE	5
+#define ZBX_VC_STATS_PFREE	6
+void	*zbx_vc_get_stats(int request);
+
+#endif
@@ -79,9 +79,12 @@ ZBX_HASHSET_ENTRY_T
 	zbx_hash_t		hash;
 };
 
+/* called for every record moved by an inline hashset when it grows, so that pointers to it can be updated */
+typedef void (*zbx_hashset_move_func_t)(const void *old_data, void *new_data);
+
 typedef struct
 {
-	ZBX_HASHSET_ENTRY_T	**slots;
+	ZBX_HASHSET_ENTRY_T	**slots;	/* chained hashset only */
 	int			num_slots;
 	int			num_data;
 	zbx_hash_func_t		hash_func;
@@ -89,6 +92,12 @@ typedef struct
 	zbx_mem_malloc_func_t	mem_malloc_func;
 	zbx_mem_realloc_func_t	mem_realloc_func;
 	zbx_mem_free_func_t	mem_free_func;
+	/* inline hashset only, records are stored in an open addressing table, 0 record_size otherwise */
+	unsigned char		*ctrl;		/* a control byte per slot, followed by the records */
+	char			*records;
+	size_t			record_size;
+	int			num_deleted;
+	zbx_hashset_move_func_t	move_func;
 }
 zbx_hashset_t;
 
@@ -101,6 +110,13 @@ void	zbx_hashset_create_ext(zbx_hashset_t *hs, size_t init_size,
 				zbx_mem_malloc_func_t mem_malloc_func,
 				zbx_mem_realloc_func_t mem_realloc_func,
 				zbx_mem_free_func_t mem_free_func);
+void	zbx_hashset_create_inline(zbx_hashset_t *hs, size_t init_size, size_t record_size,
+				zbx_hash_func_t hash_func,
+				zbx_compare_func_t compare_func,
+				zbx_hashset_move_func_t move_func,
+				zbx_mem_malloc_func_t mem_malloc_func,
+				zbx_mem_realloc_func_t mem_realloc_func,
+				zbx_mem_free_func_t mem_free_func);
 void	zbx_hashset_destroy(zbx_hashset_t *hs);
 
 void	*zbx_hashset_insert(zbx_hashset_t *hs, const void *data, size_t size);
@@ -216,6 +232,49 @@ void			zbx_binary_heap_remove_direct(zbx_binary_heap_t *heap, zbx_uint64_t key);
 
 void			zbx_binary_heap_clear(zbx_binary_heap_t *heap);
 
+/* timer wheel */
+
+/* hierarchical timer wheel of zbx_uint64_t keys scheduled at integer times (seconds). Level 0 has */
+/* one bucket per second, each next level has buckets 256 times wider. Elements are identified by */
+/* the ids returned from zbx_timer_wheel_insert(), which stay valid until the element is removed.  */
+
+#define	ZBX_TIMER_WHEEL_LEVELS	4
+#define	ZBX_TIMER_WHEEL_BUCKETS	256
+
+typedef struct
+{
+	int			*next;		/* next element in the bucket or in the list of free ids */
+	int			*prev;
+	int			*time;
+	int			*bucket;	/* level * ZBX_TIMER_WHEEL_BUCKETS + bucket index */
+	zbx_uint64_t		*keys;
+	int			ids_num;	/* ids handed out so far, including the free ones */
+	int			ids_alloc;
+	int			free_id;
+	int			elems_num;
+	int			now;		/* time up to which the wheel has been advanced */
+	int			heads[ZBX_TIMER_WHEEL_LEVELS * ZBX_TIMER_WHEEL_BUCKETS];
+	int			counts[ZBX_TIMER_WHEEL_LEVELS];
+	zbx_mem_malloc_func_t	mem_malloc_func;
+	zbx_mem_realloc_func_t	mem_realloc_func;
+	zbx_mem_free_func_t	mem_free_func;
+}
+zbx_timer_wheel_t;
+
+void	zbx_timer_wheel_create(zbx_timer_wheel_t *wheel, int now);
+void	zbx_timer_wheel_create_ext(zbx_timer_wheel_t *wheel, int now,
+					zbx_mem_malloc_func_t mem_malloc_func,
+					zbx_mem_realloc_func_t mem_realloc_func,
+					zbx_mem_free_func_t mem_free_func);
+void	zbx_timer_wheel_destroy(zbx_timer_wheel_t *wheel);
+
+int	zbx_timer_wheel_insert(zbx_timer_wheel_t *wheel, zbx_uint64_t key, int timestamp);
+void	zbx_timer_wheel_update(zbx_timer_wheel_t *wheel, int id, int timestamp);
+void	zbx_timer_wheel_set_key(zbx_timer_wheel_t *wheel, int id, zbx_uint64_t key);
+void	zbx_timer_wheel_remove(zbx_timer_wheel_t *wheel, int id);
+int	zbx_timer_wheel_pop(zbx_timer_wheel_t *wheel, int now, zbx_uint64_t *key);
+int	zbx_timer_wheel_nextcheck(zbx_timer_wheel_t *wheel);
+
 /* vector */
 
 #define	ZBX_VECTOR_DECL(__id, __type)										\
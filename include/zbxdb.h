@@ -180,4 +180,34 @@ DB_RESULT	zbx_db_select_n(const char *query, int n);
 DB_ROW		zbx_db_fetch(DB_RESULT result);
 int		zbx_db_is_null(const char *field);
 
+#define ZBX_DB_TYPE_INT		0
+#define ZBX_DB_TYPE_UINT64	1
+#define ZBX_DB_TYPE_FLOAT	2
+#define ZBX_DB_TYPE_STR		3
+
+typedef union
+{
+	int		i;
+	zbx_uint64_t	ui64;
+	double		dbl;
+	const char	*str;
+}
+zbx_db_value_t;
+
+/* the MySQL statement interface (mysql_stmt_*) is built only on request, */
+/* configure with CFLAGS=-DZBX_MYSQL_STMT to enable it */
+#if defined(HAVE_MYSQL) && defined(ZBX_MYSQL_STMT)
+#	define HAVE_MYSQL_STMT
+#endif
+
+#if defined(HAVE_MYSQL_STMT) || defined(HAVE_POSTGRESQL) || defined(HAVE_SQLITE3)
+#	define HAVE_BULK_INSERT
+#	define HAVE_PREPARED_STATEMENTS
+
+int	zbx_db_bulk_insert(const char *table, const char **fields, const unsigned char *types, int fields_num,
+		const zbx_db_value_t *values, int rows_num);
+int	zbx_db_execute_prepared(const char *sql, const unsigned char *types, const zbx_db_value_t *params,
+		int params_num);
+#endif	/* HAVE_MYSQL_STMT || HAVE_POSTGRESQL || HAVE_SQLITE3 */
+
 #endif
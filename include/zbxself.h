@@ -47,7 +47,8 @@
 #define ZBX_PROCESS_TYPE_CONFSYNCER	16
 #define ZBX_PROCESS_TYPE_HEARTBEAT	17
 #define ZBX_PROCESS_TYPE_SELFMON	18
-#define ZBX_PROCESS_TYPE_COUNT		19	/* number of process types */
+#define ZBX_PROCESS_TYPE_DBWRITER	19
+#define ZBX_PROCESS_TYPE_COUNT		20	/* number of process types */
 #define ZBX_PROCESS_TYPE_UNKNOWN	255
 
 #define ZBX_AGGR_FUNC_ONE		0
@@ -22,11 +22,27 @@
 
 #include "zbxalgo.h"
 
+#ifdef __SSE2__
+#	include <emmintrin.h>
+#endif
+
 static void	__hashset_free_entry(zbx_hashset_t *hs, ZBX_HASHSET_ENTRY_T *entry);
 
 #define	CRIT_LOAD_FACTOR	4/5
 #define	SLOT_GROWTH_FACTOR	3/2
 
+/* inline hashsets keep records in an open addressing table. Slots are probed in groups and every slot has a */
+/* control byte: the low 7 bits of the record hash if the slot is used, EMPTY or DELETED if it is not.      */
+
+#define	INLINE_GROUP		16
+#define	INLINE_EMPTY		0x80
+#define	INLINE_DELETED		0xfe
+#define	INLINE_LOAD_FACTOR	7/8
+
+#define	INLINE_TAG(hash)		((unsigned char)((hash) & 0x7f))
+#define	INLINE_GROUP_START(hs, hash)	((int)(((hash) >> 7) & (zbx_hash_t)((hs)->num_slots / INLINE_GROUP - 1)))
+#define	INLINE_RECORD(hs, slot)		((hs)->records + (size_t)(slot) * (hs)->record_size)
+
 /* private hashset functions */
 
 static void	__hashset_free_entry(zbx_hashset_t *hs, ZBX_HASHSET_ENTRY_T *entry)
@@ -35,6 +51,204 @@ static void	__hashset_free_entry(zbx_hashset_t *hs, ZBX_HASHSET_ENTRY_T *entry)
 	hs->mem_free_func(entry);
 }
 
+/* bit i of the result is set if control byte i of the group is equal to the tag */
+static unsigned int	__hashset_group_match(const unsigned char *ctrl, unsigned char tag)
+{
+#ifdef __SSE2__
+	return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)ctrl),
+			_mm_set1_epi8((char)tag)));
+#else
+	unsigned int	mask = 0;
+	int		i;
+
+	for (i = 0; i < INLINE_GROUP; i++)
+	{
+		if (tag == ctrl[i])
+			mask |= 1 << i;
+	}
+
+	return mask;
+#endif
+}
+
+/* bit i of the result is set if slot i of the group is empty or deleted */
+static unsigned int	__hashset_group_free(const unsigned char *ctrl)
+{
+#ifdef __SSE2__
+	return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+	unsigned int	mask = 0;
+	int		i;
+
+	for (i = 0; i < INLINE_GROUP; i++)
+	{
+		if (0 != (ctrl[i] & 0x80))
+			mask |= 1 << i;
+	}
+
+	return mask;
+#endif
+}
+
+static int	__hashset_lowest_bit(unsigned int mask)
+{
+	int	i;
+
+	for (i = 0; 0 == (mask & 1); i++)
+		mask >>= 1;
+
+	return i;
+}
+
+/* the malloc function of an inline hashset may return NULL, the hashset is left unchanged then */
+static int	__hashset_inline_alloc(zbx_hashset_t *hs, int num_slots)
+{
+	unsigned char	*ctrl;
+
+	if (NULL == (ctrl = hs->mem_malloc_func(NULL, num_slots + num_slots * hs->record_size)))
+		return FAIL;
+
+	hs->ctrl = ctrl;
+	hs->records = (char *)hs->ctrl + num_slots;
+	memset(hs->ctrl, INLINE_EMPTY, num_slots);
+
+	hs->num_slots = num_slots;
+	hs->num_deleted = 0;
+
+	return SUCCEED;
+}
+
+/* slot with the record equal to data, -1 if there is none */
+static int	__hashset_inline_find(zbx_hashset_t *hs, const void *data, zbx_hash_t hash)
+{
+	int		group, step = 0, slot;
+	unsigned int	mask;
+	unsigned char	tag = INLINE_TAG(hash);
+	const unsigned char	*ctrl;
+
+	group = INLINE_GROUP_START(hs, hash);
+
+	while (1)
+	{
+		ctrl = hs->ctrl + group * INLINE_GROUP;
+
+		for (mask = __hashset_group_match(ctrl, tag); 0 != mask; mask &= mask - 1)
+		{
+			slot = group * INLINE_GROUP + __hashset_lowest_bit(mask);
+
+			if (0 == hs->compare_func(INLINE_RECORD(hs, slot), data))
+				return slot;
+		}
+
+		/* probing for a record never goes past a group with an empty slot */
+		if (0 != __hashset_group_match(ctrl, INLINE_EMPTY))
+			return -1;
+
+		group = (group + ++step) & (hs->num_slots / INLINE_GROUP - 1);
+	}
+}
+
+/* first empty or deleted slot on the probe sequence of the hash */
+static int	__hashset_inline_free_slot(zbx_hashset_t *hs, zbx_hash_t hash)
+{
+	int		group, step = 0;
+	unsigned int	mask;
+
+	group = INLINE_GROUP_START(hs, hash);
+
+	while (0 == (mask = __hashset_group_free(hs->ctrl + group * INLINE_GROUP)))
+		group = (group + ++step) & (hs->num_slots / INLINE_GROUP - 1);
+
+	return group * INLINE_GROUP + __hashset_lowest_bit(mask);
+}
+
+static int	__hashset_inline_rehash(zbx_hashset_t *hs, int num_slots)
+{
+	unsigned char	*old_ctrl = hs->ctrl;
+	char		*old_records = hs->records;
+	int		old_num_slots = hs->num_slots, i, slot;
+	zbx_hash_t	hash;
+
+	if (SUCCEED != __hashset_inline_alloc(hs, num_slots))
+		return FAIL;
+
+	for (i = 0; i < old_num_slots; i++)
+	{
+		if (0 != (old_ctrl[i] & 0x80))
+			continue;
+
+		hash = hs->hash_func(old_records + (size_t)i * hs->record_size);
+		slot = __hashset_inline_free_slot(hs, hash);
+
+		hs->ctrl[slot] = INLINE_TAG(hash);
+		memcpy(INLINE_RECORD(hs, slot), old_records + (size_t)i * hs->record_size, hs->record_size);
+
+		if (NULL != hs->move_func)
+			hs->move_func(old_records + (size_t)i * hs->record_size, INLINE_RECORD(hs, slot));
+	}
+
+	hs->mem_free_func(old_ctrl);
+
+	return SUCCEED;
+}
+
+static void	__hashset_inline_remove_slot(zbx_hashset_t *hs, int slot)
+{
+	const unsigned char	*ctrl = hs->ctrl + slot / INLINE_GROUP * INLINE_GROUP;
+
+	/* a group that still has an empty slot has never been probed past, so the slot can become empty too */
+	if (0 != __hashset_group_match(ctrl, INLINE_EMPTY))
+		hs->ctrl[slot] = INLINE_EMPTY;
+	else
+	{
+		hs->ctrl[slot] = INLINE_DELETED;
+		hs->num_deleted++;
+	}
+
+	hs->num_data--;
+}
+
+static void	*__hashset_inline_insert(zbx_hashset_t *hs, const void *data, size_t size, size_t offset)
+{
+	int		slot, rc;
+	zbx_hash_t	hash;
+
+	if (size > hs->record_size)
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "inserting a record of " ZBX_FS_UI64 " bytes into a hashset of "
+				ZBX_FS_UI64 " byte records", (zbx_uint64_t)size, (zbx_uint64_t)hs->record_size);
+		exit(FAIL);
+	}
+
+	hash = hs->hash_func(data);
+
+	if (-1 != (slot = __hashset_inline_find(hs, data, hash)))
+		return INLINE_RECORD(hs, slot);
+
+	/* grow before placing the record, the move function is never called for a record being inserted */
+	if (hs->num_data + hs->num_deleted + 1 > hs->num_slots * INLINE_LOAD_FACTOR)
+	{
+		if (hs->num_data + 1 > hs->num_slots * INLINE_LOAD_FACTOR / 2)
+			rc = __hashset_inline_rehash(hs, hs->num_slots * 2);
+		else
+			rc = __hashset_inline_rehash(hs, hs->num_slots);	/* only purge deleted slots */
+
+		if (SUCCEED != rc)
+			return NULL;
+	}
+
+	slot = __hashset_inline_free_slot(hs, hash);
+
+	if (INLINE_DELETED == hs->ctrl[slot])
+		hs->num_deleted--;
+
+	hs->ctrl[slot] = INLINE_TAG(hash);
+	memcpy(INLINE_RECORD(hs, slot) + offset, (const char *)data + offset, size - offset);
+	hs->num_data++;
+
+	return INLINE_RECORD(hs, slot);
+}
+
 /* public hashset interface */
 
 void	zbx_hashset_create(zbx_hashset_t *hs, size_t init_size,
@@ -65,6 +279,64 @@ void	zbx_hashset_create_ext(zbx_hashset_t *hs, size_t init_size,
 	hs->mem_malloc_func = mem_malloc_func;
 	hs->mem_realloc_func = mem_realloc_func;
 	hs->mem_free_func = mem_free_func;
+
+	hs->ctrl = NULL;
+	hs->records = NULL;
+	hs->record_size = 0;
+	hs->num_deleted = 0;
+	hs->move_func = NULL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_hashset_create_inline                                        *
+ *                                                                            *
+ * Purpose: create a hashset that stores records of up to record_size bytes   *
+ *          inside an open addressing table instead of allocating an entry    *
+ *          and a record for every insert                                     *
+ *                                                                            *
+ * Parameters: move_func - [IN] called for every record moved when the table  *
+ *                         grows, may be NULL                                 *
+ *                                                                            *
+ * Comments: records only move when the table grows, so pointers to records  *
+ *           stay valid until the next insert unless move_func updates them.  *
+ *           move_func must not use the hashset being rehashed, the old       *
+ *           records can still be read until all of them are moved.           *
+ *           mem_malloc_func may return NULL when it runs out of memory, the  *
+ *           insert that needed to grow the table returns NULL then.          *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_hashset_create_inline(zbx_hashset_t *hs, size_t init_size, size_t record_size,
+				zbx_hash_func_t hash_func,
+				zbx_compare_func_t compare_func,
+				zbx_hashset_move_func_t move_func,
+				zbx_mem_malloc_func_t mem_malloc_func,
+				zbx_mem_realloc_func_t mem_realloc_func,
+				zbx_mem_free_func_t mem_free_func)
+{
+	int	num_slots = INLINE_GROUP;
+
+	while ((size_t)(num_slots * INLINE_LOAD_FACTOR) < init_size)
+		num_slots *= 2;
+
+	hs->slots = NULL;
+	hs->num_data = 0;
+
+	hs->hash_func = hash_func;
+	hs->compare_func = compare_func;
+	hs->mem_malloc_func = mem_malloc_func;
+	hs->mem_realloc_func = mem_realloc_func;
+	hs->mem_free_func = mem_free_func;
+
+	hs->record_size = (record_size + 7) & ~(size_t)7;
+	hs->move_func = move_func;
+
+	if (SUCCEED != __hashset_inline_alloc(hs, num_slots))
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "cannot allocate " ZBX_FS_UI64 " slots for an inline hashset",
+				(zbx_uint64_t)num_slots);
+		exit(FAIL);
+	}
 }
 
 void	zbx_hashset_destroy(zbx_hashset_t *hs)
@@ -72,6 +344,14 @@ void	zbx_hashset_destroy(zbx_hashset_t *hs)
 	int			i;
 	ZBX_HASHSET_ENTRY_T	*entry, *next_entry;
 
+	if (0 != hs->record_size)
+	{
+		hs->mem_free_func(hs->ctrl);
+		hs->ctrl = NULL;
+		hs->records = NULL;
+		hs->num_slots = 0;
+	}
+
 	for (i = 0; i < hs->num_slots; i++)
 	{
 		entry = hs->slots[i];
@@ -108,6 +388,9 @@ void	*zbx_hashset_insert_ext(zbx_hashset_t *hs, const void *data, size_t size, s
 	zbx_hash_t		hash;
 	ZBX_HASHSET_ENTRY_T	*entry;
 
+	if (0 != hs->record_size)
+		return __hashset_inline_insert(hs, data, size, offset);
+
 	hash = hs->hash_func(data);
 
 	slot = hash % hs->num_slots;
@@ -179,6 +462,9 @@ void	*zbx_hashset_search(zbx_hashset_t *hs, const void *data)
 
 	hash = hs->hash_func(data);
 
+	if (0 != hs->record_size)
+		return (-1 != (slot = __hashset_inline_find(hs, data, hash)) ? INLINE_RECORD(hs, slot) : NULL);
+
 	slot = hash % hs->num_slots;
 	entry = hs->slots[slot];
 	while (NULL != entry)
@@ -200,6 +486,14 @@ void	zbx_hashset_remove(zbx_hashset_t *hs, const void *data)
 
 	hash = hs->hash_func(data);
 
+	if (0 != hs->record_size)
+	{
+		if (-1 != (slot = __hashset_inline_find(hs, data, hash)))
+			__hashset_inline_remove_slot(hs, slot);
+
+		return;
+	}
+
 	slot = hash % hs->num_slots;
 	entry = hs->slots[slot];
 
@@ -240,6 +534,14 @@ void	zbx_hashset_clear(zbx_hashset_t *hs)
 	int			slot;
 	ZBX_HASHSET_ENTRY_T	*entry;
 
+	if (0 != hs->record_size)
+	{
+		memset(hs->ctrl, INLINE_EMPTY, hs->num_slots);
+		hs->num_data = 0;
+		hs->num_deleted = 0;
+		return;
+	}
+
 	for (slot = 0; slot < hs->num_slots; slot++)
 	{
 		while (NULL != hs->slots[slot])
@@ -260,6 +562,7 @@ void	zbx_hashset_iter_reset(zbx_hashset_t *hs, zbx_hashset_iter_t *iter)
 {
 	iter->hashset = hs;
 	iter->slot = ITER_START;
+	iter->entry = NULL;
 }
 
 void	*zbx_hashset_iter_next(zbx_hashset_iter_t *iter)
@@ -267,6 +570,19 @@ void	*zbx_hashset_iter_next(zbx_hashset_iter_t *iter)
 	if (ITER_FINISH == iter->slot)
 		return NULL;
 
+	if (0 != iter->hashset->record_size)
+	{
+		/* records do not move when they are removed, so iterating over the slots is safe */
+		while (++iter->slot < iter->hashset->num_slots)
+		{
+			if (0 == (iter->hashset->ctrl[iter->slot] & 0x80))
+				return INLINE_RECORD(iter->hashset, iter->slot);
+		}
+
+		iter->slot = ITER_FINISH;
+		return NULL;
+	}
+
 	if (ITER_START != iter->slot && NULL != iter->entry && NULL != iter->entry->next)
 	{
 		iter->entry = iter->entry->next;
@@ -293,7 +609,15 @@ void	*zbx_hashset_iter_next(zbx_hashset_iter_t *iter)
 
 void	zbx_hashset_iter_remove(zbx_hashset_iter_t *iter)
 {
-	if (ITER_START == iter->slot || ITER_FINISH == iter->slot || NULL == iter->entry)
+	if (0 != iter->hashset->record_size && ITER_START != iter->slot && ITER_FINISH != iter->slot &&
+			0 == (iter->hashset->ctrl[iter->slot] & 0x80))
+	{
+		__hashset_inline_remove_slot(iter->hashset, iter->slot);
+		return;
+	}
+
+	if (0 != iter->hashset->record_size || ITER_START == iter->slot || ITER_FINISH == iter->slot ||
+			NULL == iter->entry)
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "removing a hashset entry through a bad iterator");
 		exit(FAIL);
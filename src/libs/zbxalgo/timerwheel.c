@@ -0,0 +1,327 @@
+/*
+** ZABBIX
+** Copyright (C) 2000-2010 SIA Zabbix
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**/
+
+#include "common.h"
+#include "log.h"
+
+#include "zbxalgo.h"
+
+static void	__timer_wheel_ensure_free_id(zbx_timer_wheel_t *wheel);
+
+static void	__timer_wheel_link(zbx_timer_wheel_t *wheel, int id);
+static void	__timer_wheel_unlink(zbx_timer_wheel_t *wheel, int id);
+
+static int	__timer_wheel_find_bucket(zbx_timer_wheel_t *wheel, int level, int from);
+static void	__timer_wheel_advance(zbx_timer_wheel_t *wheel, int now);
+
+#define	ARRAY_GROWTH_FACTOR	3/2
+
+#define	LEVEL_BITS		8
+#define	BUCKET_MASK		(ZBX_TIMER_WHEEL_BUCKETS - 1)
+
+#define	BUCKET_INDEX(time, level)	((int)(((unsigned int)(time) >> (LEVEL_BITS * (level))) & BUCKET_MASK))
+#define	LEVEL_HEAD(wheel, level)	(&(wheel)->heads[(level) * ZBX_TIMER_WHEEL_BUCKETS])
+
+/* an element is kept at the highest level where its time and the current time of the wheel differ, in the */
+/* bucket selected by its time. All elements in a bucket other than at level 0 are due at or after the     */
+/* start of that bucket, and are moved to lower levels when the current time reaches it.                   */
+
+/* private timer wheel functions */
+
+static void	__timer_wheel_ensure_free_id(zbx_timer_wheel_t *wheel)
+{
+	if (-1 != wheel->free_id || wheel->ids_num < wheel->ids_alloc)
+		return;
+
+	wheel->ids_alloc = (0 == wheel->ids_alloc ? 32 : wheel->ids_alloc * ARRAY_GROWTH_FACTOR);
+
+	wheel->next = wheel->mem_realloc_func(wheel->next, wheel->ids_alloc * sizeof(int));
+	wheel->prev = wheel->mem_realloc_func(wheel->prev, wheel->ids_alloc * sizeof(int));
+	wheel->time = wheel->mem_realloc_func(wheel->time, wheel->ids_alloc * sizeof(int));
+	wheel->bucket = wheel->mem_realloc_func(wheel->bucket, wheel->ids_alloc * sizeof(int));
+	wheel->keys = wheel->mem_realloc_func(wheel->keys, wheel->ids_alloc * sizeof(zbx_uint64_t));
+}
+
+static void	__timer_wheel_link(zbx_timer_wheel_t *wheel, int id)
+{
+	unsigned int	placed, diff;
+	int		level, bucket;
+
+	/* elements that are already due are kept in the bucket of the current time */
+	placed = (unsigned int)MAX(wheel->time[id], wheel->now);
+	diff = placed ^ (unsigned int)wheel->now;
+
+	for (level = 0; level < ZBX_TIMER_WHEEL_LEVELS - 1 && 0 != (diff >> (LEVEL_BITS * (level + 1))); level++)
+		;
+
+	bucket = level * ZBX_TIMER_WHEEL_BUCKETS + BUCKET_INDEX(placed, level);
+
+	wheel->bucket[id] = bucket;
+	wheel->prev[id] = -1;
+	wheel->next[id] = wheel->heads[bucket];
+
+	if (-1 != wheel->heads[bucket])
+		wheel->prev[wheel->heads[bucket]] = id;
+
+	wheel->heads[bucket] = id;
+	wheel->counts[level]++;
+}
+
+static void	__timer_wheel_unlink(zbx_timer_wheel_t *wheel, int id)
+{
+	int	bucket = wheel->bucket[id];
+
+	if (-1 == wheel->prev[id])
+		wheel->heads[bucket] = wheel->next[id];
+	else
+		wheel->next[wheel->prev[id]] = wheel->next[id];
+
+	if (-1 != wheel->next[id])
+		wheel->prev[wheel->next[id]] = wheel->prev[id];
+
+	wheel->counts[bucket / ZBX_TIMER_WHEEL_BUCKETS]--;
+}
+
+/* returns the first non-empty bucket of the level starting with index "from" or FAIL if there is none */
+static int	__timer_wheel_find_bucket(zbx_timer_wheel_t *wheel, int level, int from)
+{
+	const int	*heads = LEVEL_HEAD(wheel, level);
+	int		index;
+
+	for (index = from; index < ZBX_TIMER_WHEEL_BUCKETS; index++)
+	{
+		if (-1 != heads[index])
+			return index;
+	}
+
+	return FAIL;
+}
+
+/* moves the current time of the wheel to the start of the next non-empty bucket, but not further than now */
+static void	__timer_wheel_advance(zbx_timer_wheel_t *wheel, int now)
+{
+	unsigned int	target, block_mask;
+	int		level, index, id, next;
+
+	for (level = 0; level < ZBX_TIMER_WHEEL_LEVELS && 0 == wheel->counts[level]; level++)
+		;
+
+	if (ZBX_TIMER_WHEEL_LEVELS == level)
+	{
+		wheel->now = now;
+		return;
+	}
+
+	/* elements of the lowest non-empty level are all in buckets after the one of the current time */
+	index = __timer_wheel_find_bucket(wheel, level, BUCKET_INDEX(wheel->now, level) + 1);
+
+	if (ZBX_TIMER_WHEEL_LEVELS - 1 == level)
+		block_mask = 0;
+	else
+		block_mask = ~((1u << (LEVEL_BITS * (level + 1))) - 1);
+
+	target = ((unsigned int)wheel->now & block_mask) | ((unsigned int)index << (LEVEL_BITS * level));
+
+	if ((unsigned int)now < target)
+	{
+		wheel->now = now;
+		return;
+	}
+
+	wheel->now = (int)target;
+
+	if (0 == level)
+		return;
+
+	/* the bucket has been reached, distribute its elements among the lower levels */
+	id = LEVEL_HEAD(wheel, level)[index];
+	LEVEL_HEAD(wheel, level)[index] = -1;
+
+	for (; -1 != id; id = next)
+	{
+		next = wheel->next[id];
+		wheel->counts[level]--;
+		__timer_wheel_link(wheel, id);
+	}
+}
+
+/* public timer wheel interface */
+
+void	zbx_timer_wheel_create(zbx_timer_wheel_t *wheel, int now)
+{
+	zbx_timer_wheel_create_ext(wheel, now,
+					ZBX_DEFAULT_MEM_MALLOC_FUNC,
+					ZBX_DEFAULT_MEM_REALLOC_FUNC,
+					ZBX_DEFAULT_MEM_FREE_FUNC);
+}
+
+void	zbx_timer_wheel_create_ext(zbx_timer_wheel_t *wheel, int now,
+					zbx_mem_malloc_func_t mem_malloc_func,
+					zbx_mem_realloc_func_t mem_realloc_func,
+					zbx_mem_free_func_t mem_free_func)
+{
+	int	i;
+
+	wheel->next = NULL;
+	wheel->prev = NULL;
+	wheel->time = NULL;
+	wheel->bucket = NULL;
+	wheel->keys = NULL;
+	wheel->ids_num = 0;
+	wheel->ids_alloc = 0;
+	wheel->free_id = -1;
+	wheel->elems_num = 0;
+	wheel->now = now;
+
+	for (i = 0; i < ZBX_TIMER_WHEEL_LEVELS * ZBX_TIMER_WHEEL_BUCKETS; i++)
+		wheel->heads[i] = -1;
+
+	for (i = 0; i < ZBX_TIMER_WHEEL_LEVELS; i++)
+		wheel->counts[i] = 0;
+
+	wheel->mem_malloc_func = mem_malloc_func;
+	wheel->mem_realloc_func = mem_realloc_func;
+	wheel->mem_free_func = mem_free_func;
+}
+
+void	zbx_timer_wheel_destroy(zbx_timer_wheel_t *wheel)
+{
+	if (NULL != wheel->next)
+	{
+		wheel->mem_free_func(wheel->next);
+		wheel->mem_free_func(wheel->prev);
+		wheel->mem_free_func(wheel->time);
+		wheel->mem_free_func(wheel->bucket);
+		wheel->mem_free_func(wheel->keys);
+
+		wheel->next = NULL;
+		wheel->prev = NULL;
+		wheel->time = NULL;
+		wheel->bucket = NULL;
+		wheel->keys = NULL;
+	}
+
+	wheel->ids_num = 0;
+	wheel->ids_alloc = 0;
+	wheel->free_id = -1;
+	wheel->elems_num = 0;
+
+	wheel->mem_malloc_func = NULL;
+	wheel->mem_realloc_func = NULL;
+	wheel->mem_free_func = NULL;
+}
+
+int	zbx_timer_wheel_insert(zbx_timer_wheel_t *wheel, zbx_uint64_t key, int timestamp)
+{
+	int	id;
+
+	__timer_wheel_ensure_free_id(wheel);
+
+	if (-1 != wheel->free_id)
+	{
+		id = wheel->free_id;
+		wheel->free_id = wheel->next[id];
+	}
+	else
+		id = wheel->ids_num++;
+
+	wheel->keys[id] = key;
+	wheel->time[id] = timestamp;
+	__timer_wheel_link(wheel, id);
+
+	wheel->elems_num++;
+
+	return id;
+}
+
+void	zbx_timer_wheel_update(zbx_timer_wheel_t *wheel, int id, int timestamp)
+{
+	__timer_wheel_unlink(wheel, id);
+
+	wheel->time[id] = timestamp;
+	__timer_wheel_link(wheel, id);
+}
+
+void	zbx_timer_wheel_set_key(zbx_timer_wheel_t *wheel, int id, zbx_uint64_t key)
+{
+	wheel->keys[id] = key;
+}
+
+void	zbx_timer_wheel_remove(zbx_timer_wheel_t *wheel, int id)
+{
+	__timer_wheel_unlink(wheel, id);
+
+	wheel->next[id] = wheel->free_id;
+	wheel->free_id = id;
+
+	wheel->elems_num--;
+}
+
+/* removes an element that is due at or before now and returns its key; returns FAIL if there are none. If */
+/* the system clock is set back, elements already due at the previous time are only returned once it is   */
+/* reached again.                                                                                         */
+int	zbx_timer_wheel_pop(zbx_timer_wheel_t *wheel, int now, zbx_uint64_t *key)
+{
+	int	id;
+
+	while (-1 == (id = wheel->heads[BUCKET_INDEX(wheel->now, 0)]))
+	{
+		if (wheel->now >= now)
+			return FAIL;
+
+		__timer_wheel_advance(wheel, now);
+	}
+
+	if (wheel->now > now)
+		return FAIL;
+
+	*key = wheel->keys[id];
+	zbx_timer_wheel_remove(wheel, id);
+
+	return SUCCEED;
+}
+
+/* returns the time of the earliest element or FAIL if the wheel is empty. For elements above level 0 the */
+/* start of their bucket is returned, which is not later than their actual time.                          */
+int	zbx_timer_wheel_nextcheck(zbx_timer_wheel_t *wheel)
+{
+	unsigned int	block_mask;
+	int		level, index;
+
+	if (0 == wheel->elems_num)
+		return FAIL;
+
+	if (0 != wheel->counts[0])
+	{
+		index = __timer_wheel_find_bucket(wheel, 0, BUCKET_INDEX(wheel->now, 0));
+		return (int)(((unsigned int)wheel->now & ~(unsigned int)BUCKET_MASK) | (unsigned int)index);
+	}
+
+	for (level = 1; 0 == wheel->counts[level]; level++)
+		;
+
+	index = __timer_wheel_find_bucket(wheel, level, BUCKET_INDEX(wheel->now, level) + 1);
+
+	if (ZBX_TIMER_WHEEL_LEVELS - 1 == level)
+		block_mask = 0;
+	else
+		block_mask = ~((1u << (LEVEL_BITS * (level + 1))) - 1);
+
+	return (int)(((unsigned int)wheel->now & block_mask) | ((unsigned int)index << (LEVEL_BITS * level)));
+}
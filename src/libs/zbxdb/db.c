@@ -41,6 +41,40 @@ static int	txn_init = 0;
 	PHP_MUTEX	sqlite_access;
 #endif
 
+#ifdef HAVE_PREPARED_STATEMENTS
+/* prepared statements, kept until the connection is closed */
+#define ZBX_DB_STMT_CACHE_SIZE	32
+
+#if defined(HAVE_MYSQL)
+typedef MYSQL_STMT	zbx_db_stmt_t;
+#elif defined(HAVE_POSTGRESQL)
+typedef char		zbx_db_stmt_t;	/* name of the server side statement */
+#else
+typedef sqlite3_stmt	zbx_db_stmt_t;
+#endif
+
+typedef struct
+{
+	char		*sql;
+	zbx_db_stmt_t	*stmt;
+}
+zbx_db_stmt_cache_t;
+
+static zbx_db_stmt_cache_t	stmt_cache[ZBX_DB_STMT_CACHE_SIZE];
+static int			stmt_cache_num = 0;
+static int			stmt_cache_next = 0;
+#if defined(HAVE_POSTGRESQL)
+static int			stmt_seq = 0;
+#endif
+
+static void	zbx_db_stmt_cache_clear();
+#endif	/* HAVE_PREPARED_STATEMENTS */
+
+#if defined(HAVE_MYSQL_STMT) || defined(HAVE_POSTGRESQL)
+/* rows sent per multi-row statement (MySQL) or per COPY data message (PostgreSQL) */
+#define ZBX_DB_BULK_ROWS	128
+#endif
+
 /*
  * Connect to the database.
  */
@@ -360,6 +394,9 @@ void	zbx_db_close()
 
 	memset(&ibm_db2, 0, sizeof(ibm_db2));
 #elif defined(HAVE_MYSQL)
+#ifdef HAVE_MYSQL_STMT
+	zbx_db_stmt_cache_clear();
+#endif
 	mysql_close(conn);
 	conn = NULL;
 #elif defined(HAVE_ORACLE)
@@ -387,9 +424,11 @@ void	zbx_db_close()
 		oracle.srvhp = NULL;
 	}
 #elif defined(HAVE_POSTGRESQL)
+	zbx_db_stmt_cache_clear();
 	PQfinish(conn);
 	conn = NULL;
 #elif defined(HAVE_SQLITE3)
+	zbx_db_stmt_cache_clear();
 	sqlite3_close(conn);
 	conn = NULL;
 #endif
@@ -832,6 +871,821 @@ lbl_exec:
 	return ret;
 }
 
+#if defined(HAVE_MYSQL_STMT)
+static int	zbx_mysql_status(unsigned int err)
+{
+	switch (err)
+	{
+		case CR_CONN_HOST_ERROR:
+		case CR_SERVER_GONE_ERROR:
+		case CR_CONNECTION_ERROR:
+		case CR_SERVER_LOST:
+		case ER_SERVER_SHUTDOWN:
+		case ER_ACCESS_DENIED_ERROR: /* wrong user or password */
+		case ER_ILLEGAL_GRANT_FOR_TABLE: /* user without any privileges */
+		case ER_TABLEACCESS_DENIED_ERROR:/* user without some privilege */
+		case ER_UNKNOWN_ERROR:
+			return ZBX_DB_DOWN;
+		default:
+			return ZBX_DB_FAIL;
+	}
+}
+#elif defined(HAVE_SQLITE3)
+static int	zbx_sqlite3_status(int err)
+{
+	switch (err)
+	{
+		case SQLITE_ERROR:	/* SQL error or missing database */
+		case SQLITE_NOMEM:	/* A malloc() failed */
+		case SQLITE_TOOBIG:	/* String or BLOB exceeds size limit */
+		case SQLITE_CONSTRAINT:	/* Abort due to constraint violation */
+		case SQLITE_MISMATCH:	/* Data type mismatch */
+			return ZBX_DB_FAIL;
+		default:
+			return ZBX_DB_DOWN;
+	}
+}
+#endif
+
+#ifdef HAVE_PREPARED_STATEMENTS
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_db_stmt_free                                                 *
+ *                                                                            *
+ * Purpose: release a prepared statement                                      *
+ *                                                                            *
+ * Parameters: stmt       - [IN] prepared statement                           *
+ *             deallocate - [IN] 1 if the server side statement must be       *
+ *                               removed as well (PostgreSQL)                 *
+ *                                                                            *
+ ******************************************************************************/
+static void	zbx_db_stmt_free(zbx_db_stmt_t *stmt, int deallocate)
+{
+#if defined(HAVE_MYSQL)
+	mysql_stmt_close(stmt);
+#elif defined(HAVE_POSTGRESQL)
+	char	*sql;
+
+	if (0 != deallocate)
+	{
+		sql = zbx_dsprintf(NULL, "deallocate %s", stmt);
+		PQclear(PQexec(conn, sql));
+		zbx_free(sql);
+	}
+
+	zbx_free(stmt);
+#else
+	sqlite3_finalize(stmt);
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_db_stmt_cache_clear                                          *
+ *                                                                            *
+ * Purpose: release cached prepared statements                                *
+ *                                                                            *
+ * Comments: must be called before the connection is closed                   *
+ *                                                                            *
+ ******************************************************************************/
+static void	zbx_db_stmt_cache_clear()
+{
+	int	i;
+
+	for (i = 0; i < stmt_cache_num; i++)
+	{
+		zbx_db_stmt_free(stmt_cache[i].stmt, 0);
+		zbx_free(stmt_cache[i].sql);
+	}
+
+	stmt_cache_num = 0;
+	stmt_cache_next = 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_db_stmt_prepare                                              *
+ *                                                                            *
+ * Purpose: prepare a statement without caching it                            *
+ *                                                                            *
+ * Parameters: sql    - [IN] SQL text with '?' placeholders                   *
+ *             status - [OUT] ZBX_DB_FAIL or ZBX_DB_DOWN on failure           *
+ *                                                                            *
+ * Return value: prepared statement or NULL if the statement cannot be        *
+ *               prepared                                                     *
+ *                                                                            *
+ * Comments: the statement must be released with zbx_db_stmt_free(). For      *
+ *           PostgreSQL placeholders are renumbered to $1, $2, ..., so the    *
+ *           SQL text must not contain '?' elsewhere.                         *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_db_stmt_t	*zbx_db_stmt_prepare(const char *sql, int *status)
+{
+	zbx_db_stmt_t	*stmt;
+#if defined(HAVE_POSTGRESQL)
+	char		*sql_pg = NULL, *error = NULL;
+	int		sql_pg_allocated, sql_pg_offset = 0, params_num = 0;
+	const char	*p;
+	PGresult	*result;
+#elif defined(HAVE_SQLITE3)
+	int		err;
+#endif
+
+#if defined(HAVE_MYSQL)
+	if (NULL == (stmt = mysql_stmt_init(conn)))
+	{
+		zabbix_errlog(ERR_Z3005, mysql_errno(conn), mysql_error(conn), sql);
+		*status = ZBX_DB_FAIL;
+		return NULL;
+	}
+
+	if (0 != mysql_stmt_prepare(stmt, sql, strlen(sql)))
+	{
+		zabbix_errlog(ERR_Z3005, mysql_stmt_errno(stmt), mysql_stmt_error(stmt), sql);
+		*status = zbx_mysql_status(mysql_stmt_errno(stmt));
+		mysql_stmt_close(stmt);
+		return NULL;
+	}
+#elif defined(HAVE_POSTGRESQL)
+	sql_pg_allocated = strlen(sql) + 64;
+	sql_pg = zbx_malloc(sql_pg, sql_pg_allocated);
+
+	for (p = sql; '\0' != *p; p++)
+	{
+		if ('?' == *p)
+			zbx_snprintf_alloc(&sql_pg, &sql_pg_allocated, &sql_pg_offset, 16, "$%d", ++params_num);
+		else
+			zbx_chrcpy_alloc(&sql_pg, &sql_pg_allocated, &sql_pg_offset, *p);
+	}
+	sql_pg[sql_pg_offset] = '\0';
+
+	stmt = zbx_dsprintf(NULL, "zbx_stmt_%d", ++stmt_seq);
+
+	result = PQprepare(conn, stmt, sql_pg, 0, NULL);
+
+	if (PGRES_COMMAND_OK != PQresultStatus(result))
+	{
+		error = zbx_dsprintf(error, "%s:%s",
+				PQresStatus(PQresultStatus(result)),
+				PQresultErrorMessage(result));
+		zabbix_errlog(ERR_Z3005, 0, error, sql_pg);
+		zbx_free(error);
+
+		*status = (CONNECTION_OK == PQstatus(conn) ? ZBX_DB_FAIL : ZBX_DB_DOWN);
+
+		PQclear(result);
+		zbx_free(sql_pg);
+		zbx_free(stmt);
+		return NULL;
+	}
+
+	PQclear(result);
+	zbx_free(sql_pg);
+#else
+	while (SQLITE_BUSY == (err = sqlite3_prepare_v2(conn, sql, -1, &stmt, NULL)))
+		;	/* attention deadlock!!! */
+
+	if (SQLITE_OK != err)
+	{
+		zabbix_errlog(ERR_Z3005, 0, sqlite3_errmsg(conn), sql);
+		*status = zbx_sqlite3_status(err);
+		return NULL;
+	}
+#endif
+
+	return stmt;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_db_stmt_get                                                  *
+ *                                                                            *
+ * Purpose: get a prepared statement for the SQL text, preparing it on first  *
+ *          use                                                               *
+ *                                                                            *
+ * Parameters: sql    - [IN] SQL text with '?' placeholders                   *
+ *             status - [OUT] ZBX_DB_FAIL or ZBX_DB_DOWN on failure           *
+ *                                                                            *
+ * Return value: prepared statement or NULL if the statement cannot be        *
+ *               prepared                                                     *
+ *                                                                            *
+ * Comments: when the cache is full, cached statements are replaced in        *
+ *           round-robin order                                                *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_db_stmt_t	*zbx_db_stmt_get(const char *sql, int *status)
+{
+	zbx_db_stmt_t	*stmt;
+	int		i;
+
+	for (i = 0; i < stmt_cache_num; i++)
+	{
+		if (0 == strcmp(stmt_cache[i].sql, sql))
+			return stmt_cache[i].stmt;
+	}
+
+	if (NULL == (stmt = zbx_db_stmt_prepare(sql, status)))
+		return NULL;
+
+	if (ZBX_DB_STMT_CACHE_SIZE == stmt_cache_num)
+	{
+		i = stmt_cache_next;
+		stmt_cache_next = (stmt_cache_next + 1) % ZBX_DB_STMT_CACHE_SIZE;
+
+		zbx_db_stmt_free(stmt_cache[i].stmt, 1);
+		zbx_free(stmt_cache[i].sql);
+	}
+	else
+		i = stmt_cache_num++;
+
+	stmt_cache[i].sql = zbx_strdup(NULL, sql);
+	stmt_cache[i].stmt = stmt;
+
+	return stmt;
+}
+#endif	/* HAVE_PREPARED_STATEMENTS */
+
+#if defined(HAVE_MYSQL_STMT)
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_mysql_bind_values                                            *
+ *                                                                            *
+ * Purpose: bind statement parameters directly to the value array             *
+ *                                                                            *
+ * Parameters: bind       - [OUT] parameter bindings, values_num elements     *
+ *             types      - [IN] value types (ZBX_DB_TYPE_*), repeated every  *
+ *                               types_num values                             *
+ *             types_num  - [IN] number of types                              *
+ *             values     - [IN] values                                       *
+ *             values_num - [IN] number of values                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	zbx_mysql_bind_values(MYSQL_BIND *bind, const unsigned char *types, int types_num,
+		const zbx_db_value_t *values, int values_num)
+{
+	int	i;
+
+	memset(bind, 0, sizeof(MYSQL_BIND) * values_num);
+
+	for (i = 0; i < values_num; i++)
+	{
+		switch (types[i % types_num])
+		{
+			case ZBX_DB_TYPE_INT:
+				bind[i].buffer_type = MYSQL_TYPE_LONG;
+				bind[i].buffer = (void *)&values[i].i;
+				break;
+			case ZBX_DB_TYPE_UINT64:
+				bind[i].buffer_type = MYSQL_TYPE_LONGLONG;
+				bind[i].buffer = (void *)&values[i].ui64;
+				bind[i].is_unsigned = 1;
+				break;
+			case ZBX_DB_TYPE_FLOAT:
+				bind[i].buffer_type = MYSQL_TYPE_DOUBLE;
+				bind[i].buffer = (void *)&values[i].dbl;
+				break;
+			case ZBX_DB_TYPE_STR:
+				bind[i].buffer_type = MYSQL_TYPE_STRING;
+				bind[i].buffer = (void *)values[i].str;
+				bind[i].buffer_length = strlen(values[i].str);
+				break;
+		}
+	}
+}
+#elif defined(HAVE_POSTGRESQL)
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_pg_format_values                                             *
+ *                                                                            *
+ * Purpose: convert values to text parameters of a prepared statement         *
+ *                                                                            *
+ * Parameters: types      - [IN] value types (ZBX_DB_TYPE_*)                  *
+ *             values     - [IN] values                                       *
+ *             values_num - [IN] number of values                             *
+ *                                                                            *
+ * Return value: array of parameters, must be released with                   *
+ *               zbx_pg_free_values()                                         *
+ *                                                                            *
+ ******************************************************************************/
+static char	**zbx_pg_format_values(const unsigned char *types, const zbx_db_value_t *values, int values_num)
+{
+	char	**params;
+	int	i;
+
+	params = zbx_malloc(NULL, sizeof(char *) * (values_num + 1));
+
+	for (i = 0; i < values_num; i++)
+	{
+		switch (types[i])
+		{
+			case ZBX_DB_TYPE_INT:
+				params[i] = zbx_dsprintf(NULL, "%d", values[i].i);
+				break;
+			case ZBX_DB_TYPE_UINT64:
+				params[i] = zbx_dsprintf(NULL, ZBX_FS_UI64, values[i].ui64);
+				break;
+			case ZBX_DB_TYPE_FLOAT:
+				params[i] = zbx_dsprintf(NULL, ZBX_FS_DBL, values[i].dbl);
+				break;
+			case ZBX_DB_TYPE_STR:
+				params[i] = zbx_strdup(NULL, values[i].str);
+				break;
+		}
+	}
+
+	return params;
+}
+
+static void	zbx_pg_free_values(char **params, int params_num)
+{
+	int	i;
+
+	for (i = 0; i < params_num; i++)
+		zbx_free(params[i]);
+
+	zbx_free(params);
+}
+#elif defined(HAVE_SQLITE3)
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_sqlite3_bind_values                                          *
+ *                                                                            *
+ * Purpose: bind values to the parameters of a prepared statement             *
+ *                                                                            *
+ * Parameters: stmt       - [IN] prepared statement                           *
+ *             types      - [IN] value types (ZBX_DB_TYPE_*)                  *
+ *             values     - [IN] values                                       *
+ *             values_num - [IN] number of values                             *
+ *                                                                            *
+ * Comments: strings are not copied and must stay valid until the statement   *
+ *           is executed                                                      *
+ *                                                                            *
+ ******************************************************************************/
+static void	zbx_sqlite3_bind_values(sqlite3_stmt *stmt, const unsigned char *types, const zbx_db_value_t *values,
+		int values_num)
+{
+	int	i;
+
+	for (i = 0; i < values_num; i++)
+	{
+		switch (types[i])
+		{
+			case ZBX_DB_TYPE_INT:
+				sqlite3_bind_int(stmt, i + 1, values[i].i);
+				break;
+			case ZBX_DB_TYPE_UINT64:
+				/* SQLite stores integer literals above the signed range as reals */
+				if (0 != (values[i].ui64 >> 63))
+					sqlite3_bind_double(stmt, i + 1, (double)values[i].ui64);
+				else
+					sqlite3_bind_int64(stmt, i + 1, (sqlite3_int64)values[i].ui64);
+				break;
+			case ZBX_DB_TYPE_FLOAT:
+				sqlite3_bind_double(stmt, i + 1, values[i].dbl);
+				break;
+			case ZBX_DB_TYPE_STR:
+				sqlite3_bind_text(stmt, i + 1, values[i].str, -1, SQLITE_STATIC);
+				break;
+		}
+	}
+}
+#endif
+
+#ifdef HAVE_PREPARED_STATEMENTS
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_db_execute_prepared                                          *
+ *                                                                            *
+ * Purpose: execute a non-select statement with '?' placeholders through the  *
+ *          per-connection prepared statement cache                           *
+ *                                                                            *
+ * Parameters: sql        - [IN] SQL text with '?' placeholders               *
+ *             types      - [IN] parameter types (ZBX_DB_TYPE_*)              *
+ *             params     - [IN] parameter values                             *
+ *             params_num - [IN] number of parameters                         *
+ *                                                                            *
+ * Return value: number of affected rows, ZBX_DB_FAIL or ZBX_DB_DOWN          *
+ *                                                                            *
+ * Comments: string parameters are sent as is and must not be escaped         *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_db_execute_prepared(const char *sql, const unsigned char *types, const zbx_db_value_t *params,
+		int params_num)
+{
+	int		ret = ZBX_DB_OK;
+	double		sec = 0;
+	zbx_db_stmt_t	*stmt;
+#if defined(HAVE_MYSQL)
+	MYSQL_BIND	*bind;
+#elif defined(HAVE_POSTGRESQL)
+	PGresult	*result;
+	char		**values, *error = NULL;
+#elif defined(HAVE_SQLITE3)
+	int		err;
+#endif
+
+	if (CONFIG_LOG_SLOW_QUERIES)
+		sec = zbx_time();
+
+	if (0 == txn_init && 0 == txn_level)
+		zabbix_log(LOG_LEVEL_DEBUG, "Query without transaction detected");
+
+	zabbix_log(LOG_LEVEL_DEBUG, "Query [txnlev:%d] [%s] params:%d", txn_level, sql, params_num);
+
+#if defined(HAVE_MYSQL)
+	if (NULL == conn)
+	{
+		zabbix_errlog(ERR_Z3003);
+		ret = ZBX_DB_FAIL;
+	}
+	else if (NULL != (stmt = zbx_db_stmt_get(sql, &ret)))
+	{
+		bind = zbx_malloc(NULL, sizeof(MYSQL_BIND) * (params_num + 1));
+		zbx_mysql_bind_values(bind, types, params_num, params, params_num);
+
+		if (0 != mysql_stmt_bind_param(stmt, bind) || 0 != mysql_stmt_execute(stmt))
+		{
+			zabbix_errlog(ERR_Z3005, mysql_stmt_errno(stmt), mysql_stmt_error(stmt), sql);
+			ret = zbx_mysql_status(mysql_stmt_errno(stmt));
+		}
+		else
+			ret = (int)mysql_stmt_affected_rows(stmt);
+
+		zbx_free(bind);
+	}
+#elif defined(HAVE_POSTGRESQL)
+	if (NULL != (stmt = zbx_db_stmt_get(sql, &ret)))
+	{
+		values = zbx_pg_format_values(types, params, params_num);
+
+		result = PQexecPrepared(conn, stmt, params_num, (const char * const *)values, NULL, NULL, 0);
+
+		if (PGRES_COMMAND_OK != PQresultStatus(result))
+		{
+			error = zbx_dsprintf(error, "%s:%s",
+					PQresStatus(PQresultStatus(result)),
+					PQresultErrorMessage(result));
+			zabbix_errlog(ERR_Z3005, 0, error, sql);
+			zbx_free(error);
+
+			ret = (CONNECTION_OK == PQstatus(conn) ? ZBX_DB_FAIL : ZBX_DB_DOWN);
+		}
+		else
+			ret = atoi(PQcmdTuples(result));
+
+		PQclear(result);
+		zbx_pg_free_values(values, params_num);
+	}
+#elif defined(HAVE_SQLITE3)
+	if (0 == txn_level)
+	{
+		if (PHP_MUTEX_OK != php_sem_acquire(&sqlite_access))
+		{
+			zabbix_log(LOG_LEVEL_CRIT, "ERROR: Unable to create lock on SQLite database.");
+			exit(FAIL);
+		}
+	}
+
+	if (NULL != (stmt = zbx_db_stmt_get(sql, &ret)))
+	{
+		zbx_sqlite3_bind_values(stmt, types, params, params_num);
+
+		/* bindings survive the reset, so a busy statement can be simply stepped again */
+		while (SQLITE_BUSY == (err = sqlite3_step(stmt)))
+			sqlite3_reset(stmt);	/* attention deadlock!!! */
+
+		if (SQLITE_DONE != err)
+		{
+			zabbix_errlog(ERR_Z3005, 0, sqlite3_errmsg(conn), sql);
+			ret = zbx_sqlite3_status(err);
+		}
+		else
+			ret = sqlite3_changes(conn);
+
+		sqlite3_reset(stmt);
+	}
+
+	if (0 == txn_level)
+	{
+		php_sem_release(&sqlite_access);
+	}
+#endif
+
+	if (CONFIG_LOG_SLOW_QUERIES)
+	{
+		sec = zbx_time() - sec;
+		if (sec > (double)CONFIG_LOG_SLOW_QUERIES / 1000.0)
+			zabbix_log(LOG_LEVEL_WARNING, "Slow query: " ZBX_FS_DBL " sec, \"%s\"", sec, sql);
+	}
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_db_bulk_sql                                                  *
+ *                                                                            *
+ * Purpose: build the statement used for bulk insert                          *
+ *                                                                            *
+ * Parameters: table      - [IN] table name                                   *
+ *             fields     - [IN] column names                                 *
+ *             fields_num - [IN] number of columns                            *
+ *             rows_num   - [IN] number of rows per statement (ignored for    *
+ *                               COPY)                                        *
+ *                                                                            *
+ * Return value: dynamically allocated SQL text                               *
+ *                                                                            *
+ ******************************************************************************/
+static char	*zbx_db_bulk_sql(const char *table, const char **fields, int fields_num, int rows_num)
+{
+	char	*sql = NULL;
+	int	sql_allocated = 256, sql_offset = 0, i;
+#if !defined(HAVE_POSTGRESQL)
+	int	j;
+#endif
+
+	sql = zbx_malloc(sql, sql_allocated);
+
+#if defined(HAVE_POSTGRESQL)
+	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 16 + strlen(table), "copy %s (", table);
+#else
+	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 16 + strlen(table), "insert into %s (", table);
+#endif
+
+	for (i = 0; i < fields_num; i++)
+	{
+		if (0 != i)
+			zbx_chrcpy_alloc(&sql, &sql_allocated, &sql_offset, ',');
+		zbx_strcpy_alloc(&sql, &sql_allocated, &sql_offset, fields[i]);
+	}
+
+#if defined(HAVE_POSTGRESQL)
+	zbx_strcpy_alloc(&sql, &sql_allocated, &sql_offset, ") from stdin");
+#else
+	zbx_strcpy_alloc(&sql, &sql_allocated, &sql_offset, ") values ");
+
+	for (i = 0; i < rows_num; i++)
+	{
+		if (0 != i)
+			zbx_chrcpy_alloc(&sql, &sql_allocated, &sql_offset, ',');
+		zbx_chrcpy_alloc(&sql, &sql_allocated, &sql_offset, '(');
+
+		for (j = 0; j < fields_num; j++)
+			zbx_strcpy_alloc(&sql, &sql_allocated, &sql_offset, 0 == j ? "?" : ",?");
+
+		zbx_chrcpy_alloc(&sql, &sql_allocated, &sql_offset, ')');
+	}
+#endif
+
+	return sql;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_db_bulk_insert                                               *
+ *                                                                            *
+ * Purpose: insert rows of numeric values without formatting them as SQL text *
+ *                                                                            *
+ * Parameters: table      - [IN] table name                                   *
+ *             fields     - [IN] column names                                 *
+ *             types      - [IN] column value types (ZBX_DB_TYPE_*)           *
+ *             fields_num - [IN] number of columns                            *
+ *             values     - [IN] row values, fields_num values per row        *
+ *             rows_num   - [IN] number of rows                               *
+ *                                                                            *
+ * Return value: number of inserted rows, ZBX_DB_FAIL or ZBX_DB_DOWN          *
+ *                                                                            *
+ * Comments: PostgreSQL uses COPY FROM STDIN in text format, MySQL executes a *
+ *           cached multi-row prepared statement with ZBX_DB_BULK_ROWS rows   *
+ *           and one statement with the row count of the remainder, SQLite    *
+ *           executes a cached single-row prepared statement for every row.   *
+ *           The caller is expected to run it inside a transaction.           *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_db_bulk_insert(const char *table, const char **fields, const unsigned char *types, int fields_num,
+		const zbx_db_value_t *values, int rows_num)
+{
+	int		ret = ZBX_DB_OK, i;
+	double		sec = 0;
+#if defined(HAVE_MYSQL)
+	char		*sql_bulk = NULL, *sql_tail = NULL, *sql;
+	MYSQL_STMT	*stmt, *stmt_tail = NULL;
+	MYSQL_BIND	*bind;
+	int		rows;
+#elif defined(HAVE_POSTGRESQL)
+	char		*sql, *buffer = NULL, *error = NULL;
+	int		buffer_allocated = 4096, buffer_offset = 0, j;
+	PGresult	*result;
+	const char	*abort_msg = NULL;
+#elif defined(HAVE_SQLITE3)
+	char		*sql;
+	sqlite3_stmt	*stmt;
+	int		err;
+#endif
+
+	if (CONFIG_LOG_SLOW_QUERIES)
+		sec = zbx_time();
+
+	if (0 == txn_init && 0 == txn_level)
+		zabbix_log(LOG_LEVEL_DEBUG, "Query without transaction detected");
+
+	zabbix_log(LOG_LEVEL_DEBUG, "Bulk insert [txnlev:%d] [%s] rows:%d", txn_level, table, rows_num);
+
+#if defined(HAVE_MYSQL)
+	if (NULL == conn)
+	{
+		zabbix_errlog(ERR_Z3003);
+		return ZBX_DB_FAIL;
+	}
+
+	/* parameters are bound directly to the value array, a chunk is selected by offset into it */
+	bind = zbx_malloc(NULL, sizeof(MYSQL_BIND) * fields_num * rows_num);
+	zbx_mysql_bind_values(bind, types, fields_num, values, fields_num * rows_num);
+
+	for (i = 0; i < rows_num; i += rows)
+	{
+		/* the remainder gets a statement of its own row count, it is not cached */
+		/* as its size changes from call to call                                */
+		if (ZBX_DB_BULK_ROWS <= rows_num - i)
+		{
+			rows = ZBX_DB_BULK_ROWS;
+			if (NULL == sql_bulk)
+				sql_bulk = zbx_db_bulk_sql(table, fields, fields_num, rows);
+			sql = sql_bulk;
+			stmt = zbx_db_stmt_get(sql, &ret);
+		}
+		else
+		{
+			rows = rows_num - i;
+			sql = sql_tail = zbx_db_bulk_sql(table, fields, fields_num, rows);
+			stmt = stmt_tail = zbx_db_stmt_prepare(sql, &ret);
+		}
+
+		if (NULL == stmt)
+			break;
+
+		if (0 != mysql_stmt_bind_param(stmt, &bind[i * fields_num]) || 0 != mysql_stmt_execute(stmt))
+		{
+			zabbix_errlog(ERR_Z3005, mysql_stmt_errno(stmt), mysql_stmt_error(stmt), sql);
+			ret = zbx_mysql_status(mysql_stmt_errno(stmt));
+			break;
+		}
+
+		ret += (int)mysql_stmt_affected_rows(stmt);
+	}
+
+	if (NULL != stmt_tail)
+		zbx_db_stmt_free(stmt_tail, 1);
+
+	zbx_free(sql_tail);
+	zbx_free(sql_bulk);
+	zbx_free(bind);
+#elif defined(HAVE_POSTGRESQL)
+	sql = zbx_db_bulk_sql(table, fields, fields_num, rows_num);
+
+	result = PQexec(conn, sql);
+
+	if (PGRES_COPY_IN != PQresultStatus(result))
+	{
+		error = zbx_dsprintf(error, "%s:%s",
+				PQresStatus(PQresultStatus(result)),
+				PQresultErrorMessage(result));
+		zabbix_errlog(ERR_Z3005, 0, error, sql);
+		zbx_free(error);
+
+		ret = (CONNECTION_OK == PQstatus(conn) ? ZBX_DB_FAIL : ZBX_DB_DOWN);
+		PQclear(result);
+	}
+	else
+	{
+		PQclear(result);
+
+		buffer = zbx_malloc(buffer, buffer_allocated);
+
+		for (i = 0; i < rows_num; i++)
+		{
+			for (j = 0; j < fields_num; j++)
+			{
+				const zbx_db_value_t	*value = &values[i * fields_num + j];
+				char			delim = (fields_num - 1 == j ? '\n' : '\t');
+
+				switch (types[j])
+				{
+					case ZBX_DB_TYPE_INT:
+						zbx_snprintf_alloc(&buffer, &buffer_allocated, &buffer_offset, 32,
+								"%d%c", value->i, delim);
+						break;
+					case ZBX_DB_TYPE_UINT64:
+						zbx_snprintf_alloc(&buffer, &buffer_allocated, &buffer_offset, 32,
+								ZBX_FS_UI64 "%c", value->ui64, delim);
+						break;
+					case ZBX_DB_TYPE_FLOAT:
+						zbx_snprintf_alloc(&buffer, &buffer_allocated, &buffer_offset, 512,
+								ZBX_FS_DBL "%c", value->dbl, delim);
+						break;
+				}
+			}
+
+			if (0 != (i + 1) % ZBX_DB_BULK_ROWS && rows_num != i + 1)
+				continue;
+
+			if (1 != PQputCopyData(conn, buffer, buffer_offset))
+			{
+				zabbix_errlog(ERR_Z3005, 0, PQerrorMessage(conn), sql);
+				ret = (CONNECTION_OK == PQstatus(conn) ? ZBX_DB_FAIL : ZBX_DB_DOWN);
+				abort_msg = "sending data failed";
+				break;
+			}
+
+			buffer_offset = 0;
+		}
+
+		zbx_free(buffer);
+
+		if (1 != PQputCopyEnd(conn, abort_msg) && ZBX_DB_OK == ret)
+		{
+			zabbix_errlog(ERR_Z3005, 0, PQerrorMessage(conn), sql);
+			ret = (CONNECTION_OK == PQstatus(conn) ? ZBX_DB_FAIL : ZBX_DB_DOWN);
+		}
+
+		while (NULL != (result = PQgetResult(conn)))
+		{
+			if (PGRES_COMMAND_OK != PQresultStatus(result) && ZBX_DB_OK == ret)
+			{
+				error = zbx_dsprintf(error, "%s:%s",
+						PQresStatus(PQresultStatus(result)),
+						PQresultErrorMessage(result));
+				zabbix_errlog(ERR_Z3005, 0, error, sql);
+				zbx_free(error);
+
+				ret = (CONNECTION_OK == PQstatus(conn) ? ZBX_DB_FAIL : ZBX_DB_DOWN);
+			}
+
+			PQclear(result);
+		}
+
+		if (ZBX_DB_OK == ret)
+			ret = rows_num;
+	}
+
+	zbx_free(sql);
+#elif defined(HAVE_SQLITE3)
+	sql = zbx_db_bulk_sql(table, fields, fields_num, 1);
+
+	if (0 == txn_level)
+	{
+		if (PHP_MUTEX_OK != php_sem_acquire(&sqlite_access))
+		{
+			zabbix_log(LOG_LEVEL_CRIT, "ERROR: Unable to create lock on SQLite database.");
+			exit(FAIL);
+		}
+	}
+
+	if (NULL != (stmt = zbx_db_stmt_get(sql, &ret)))
+	{
+		for (i = 0; i < rows_num; i++)
+		{
+			zbx_sqlite3_bind_values(stmt, types, &values[i * fields_num], fields_num);
+
+			/* bindings survive the reset, so a busy statement can be simply stepped again */
+			while (SQLITE_BUSY == (err = sqlite3_step(stmt)))
+				sqlite3_reset(stmt);	/* attention deadlock!!! */
+
+			if (SQLITE_DONE != err)
+			{
+				zabbix_errlog(ERR_Z3005, 0, sqlite3_errmsg(conn), sql);
+				ret = zbx_sqlite3_status(err);
+				sqlite3_reset(stmt);
+				break;
+			}
+
+			sqlite3_reset(stmt);
+			ret++;
+		}
+	}
+
+	if (0 == txn_level)
+	{
+		php_sem_release(&sqlite_access);
+	}
+
+	zbx_free(sql);
+#endif
+
+	if (CONFIG_LOG_SLOW_QUERIES)
+	{
+		sec = zbx_time() - sec;
+		if (sec > (double)CONFIG_LOG_SLOW_QUERIES / 1000.0)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "Slow query: " ZBX_FS_DBL " sec, bulk insert of %d rows into \"%s\"",
+					sec, rows_num, table);
+		}
+	}
+
+	return ret;
+}
+#endif	/* HAVE_PREPARED_STATEMENTS */
+
 /*
  * Execute SQL statement. For select statements only.
  */
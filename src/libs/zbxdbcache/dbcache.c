@@ -30,21 +30,35 @@
 
 #include "memalloc.h"
 #include "zbxalgo.h"
+#include "valuecache.h"
+
+#include <sys/mman.h>
 
 static zbx_mem_info_t	*history_mem = NULL;
 static zbx_mem_info_t	*history_text_mem = NULL;
 static zbx_mem_info_t	*trend_mem = NULL;
+static zbx_mem_info_t	*lastvalue_mem = NULL;
+static zbx_mem_info_t	*write_queue_mem = NULL;
 
-#define	LOCK_CACHE	zbx_mutex_lock(&cache_lock)
-#define	UNLOCK_CACHE	zbx_mutex_unlock(&cache_lock)
+#define	LOCK_SHARD(shard)	zbx_mutex_lock(&shard_locks[(shard)->num])
+#define	UNLOCK_SHARD(shard)	zbx_mutex_unlock(&shard_locks[(shard)->num])
 #define	LOCK_TRENDS	zbx_mutex_lock(&trends_lock)
 #define	UNLOCK_TRENDS	zbx_mutex_unlock(&trends_lock)
 #define	LOCK_CACHE_IDS		zbx_mutex_lock(&cache_ids_lock)
 #define	UNLOCK_CACHE_IDS	zbx_mutex_unlock(&cache_ids_lock)
-
-static ZBX_MUTEX	cache_lock;
+#define	LOCK_JOURNAL	zbx_mutex_lock(&journal_lock)
+#define	UNLOCK_JOURNAL	zbx_mutex_unlock(&journal_lock)
+#define	LOCK_LASTVALUES		zbx_mutex_lock(&lastvalues_lock)
+#define	UNLOCK_LASTVALUES	zbx_mutex_unlock(&lastvalues_lock)
+#define	LOCK_WRITE_QUEUE	zbx_mutex_lock(&write_queue_lock)
+#define	UNLOCK_WRITE_QUEUE	zbx_mutex_unlock(&write_queue_lock)
+
+static ZBX_MUTEX	shard_locks[ZBX_HISTORY_SHARDS_MAX];
 static ZBX_MUTEX	trends_lock;
 static ZBX_MUTEX	cache_ids_lock;
+static ZBX_MUTEX	journal_lock;
+static ZBX_MUTEX	lastvalues_lock;
+static ZBX_MUTEX	write_queue_lock;
 
 static char		*sql = NULL;
 static int		sql_allocated = 65536;
@@ -52,40 +66,49 @@ static int		sql_allocated = 65536;
 static unsigned char	zbx_process;
 
 extern int		CONFIG_HISTSYNCER_FREQUENCY;
+extern int		process_num;
 
-static int		ZBX_HISTORY_SIZE = 0;
-int			ZBX_SYNC_MAX = 1000;	/* Must be less than ZBX_HISTORY_SIZE */
+static int		ZBX_HISTORY_SIZE = 0;	/* per shard */
+static int		ZBX_TEXTBUFFER_SIZE = 0;	/* per shard */
+int			ZBX_SYNC_MAX = 1000;	/* HistorySyncBatchSize, must not exceed ZBX_HISTORY_SIZE */
 static int		ZBX_ITEMIDS_SIZE = 0;
 
-#define ZBX_IDS_SIZE	8
+static zbx_vector_uint64_t	*sync_itemids = NULL;	/* items of the batch being synced by this process */
+
+#define ZBX_TRENDS_FLUSH_MAX	1000	/* trends written to the database with one statement */
+#define ZBX_TRENDS_SLICE_TIME	0.1	/* seconds each history batch may spend flushing completed trends */
+
 #define ZBX_DC_ID	struct zbx_dc_id_type
 #define ZBX_DC_IDS	struct zbx_dc_ids_type
 
+#define ZBX_RESERVE_MIN		256
+#define ZBX_RESERVE_MAX		65536
+#define ZBX_RESERVE_FAST	1	/* a reservation used up within so many seconds is doubled */
+#define ZBX_RESERVE_SLOW	60	/* a reservation lasting longer is halved */
+
 ZBX_DC_ID
 {
-	char		table_name[16];
+	char		table_name[64];
 	zbx_uint64_t	lastid;
 	int		reserved;
+	int		reserve;	/* size of the next reservation in the ids table */
+	int		reserve_time;	/* when the current reservation was taken */
 };
 
+/* open addressing by table name, there is a slot for every table of the schema */
 ZBX_DC_IDS
 {
-	ZBX_DC_ID	id[ZBX_IDS_SIZE];
+	ZBX_DC_ID	*id;
+	int		size;
 };
 
 ZBX_DC_IDS		*ids = NULL;
 
-typedef union
-{
-	double		value_float;
-	zbx_uint64_t	value_uint64;
-	char		*value_str;
-}
-history_value_t;
-
 #define ZBX_DC_HISTORY	struct zbx_dc_history_type
 #define ZBX_DC_TREND	struct zbx_dc_trend_type
+#define ZBX_DC_TREND_BUCKET	struct zbx_dc_trend_bucket_type
 #define ZBX_DC_STATS	struct zbx_dc_stats_type
+#define ZBX_DC_SHARD	struct zbx_dc_shard_type
 #define ZBX_DC_CACHE	struct zbx_dc_cache_type
 
 ZBX_DC_HISTORY
@@ -116,6 +139,16 @@ ZBX_DC_TREND
 	int		num;
 	int		disable_from;
 	unsigned char	value_type;
+	ZBX_DC_TREND	*next;		/* next pending trend of the same bucket */
+};
+
+/* completed trends of the same hour and value type, waiting to be flushed */
+ZBX_DC_TREND_BUCKET
+{
+	int		clock;
+	unsigned char	value_type;
+	ZBX_DC_TREND	*trends;
+	int		trends_num;
 };
 
 ZBX_DC_STATS
@@ -128,22 +161,195 @@ ZBX_DC_STATS
 	zbx_uint64_t	history_text_counter;	/* Number of saved text values in the DB */
 };
 
-ZBX_DC_CACHE
+/* values of an item always go to the same shard, each shard has its own lock */
+ZBX_DC_SHARD
 {
-	zbx_hashset_t	trends;
 	ZBX_DC_STATS	stats;
 	ZBX_DC_HISTORY	*history;	/* [ZBX_HISTORY_SIZE] */
 	char		*text;		/* [ZBX_TEXTBUFFER_SIZE] */
 	zbx_uint64_t	*itemids;	/* items, processed by other syncers */
 	char		*last_text;
+	int		text_in_sync;	/* number of syncers reading values directly from the text buffer */
+	unsigned char	text_vacuum;	/* text buffer vacuuming is postponed until syncers release it */
 	int		history_first;
 	int		history_num;
-	int		trends_num;
 	int		itemids_alloc, itemids_num;
+	int		num;
+};
+
+ZBX_DC_CACHE
+{
+	zbx_hashset_t	trends;
+	ZBX_DC_TREND_BUCKET	*buckets;	/* pending trends by (clock, value_type), newest first */
+	ZBX_DC_SHARD	*shards;	/* [CONFIG_HISTORY_CACHE_SHARDS] */
+	int		trends_num;
+	int		trends_pending_num;
+	int		buckets_num;
+	int		buckets_alloc;
+	unsigned char	trends_flushing;	/* a syncer is flushing pending trends */
 };
 
 ZBX_DC_CACHE		*cache = NULL;
 
+/* last value cache, keeps the item fields updated with every value until they are flushed to the database */
+
+#define ZBX_DC_LASTVALUE	struct zbx_dc_lastvalue_type
+#define ZBX_DC_LASTVALUES	struct zbx_dc_lastvalues_type
+
+#define ZBX_LASTVALUE_EXPIRE	600	/* clean entries are removed after not being used for so many seconds */
+
+#define ZBX_LASTVALUE_NULL	0x01
+#define ZBX_PREVVALUE_NULL	0x02
+#define ZBX_PREVORGVALUE_NULL	0x04
+#define ZBX_LASTVALUE_DIRTY	0x08	/* not flushed to the database yet */
+
+/* how a value changes prevorgvalue of the item */
+#define ZBX_PREVORGVALUE_KEEP	0
+#define ZBX_PREVORGVALUE_RESET	1
+#define ZBX_PREVORGVALUE_UPDATE	2
+
+ZBX_DC_LASTVALUE
+{
+	zbx_uint64_t	itemid;
+	history_value_t	lastvalue;
+	history_value_t	prevvalue;
+	history_value_t	prevorgvalue;
+	int		lastclock;
+	int		lastlogsize;
+	int		mtime;
+	int		lastuse;
+	unsigned char	value_type;
+	unsigned char	flags;
+};
+
+ZBX_DC_LASTVALUES
+{
+	zbx_hashset_t	items;
+	int		last_flush;
+	unsigned char	flushing;
+};
+
+static ZBX_DC_LASTVALUES	*lastvalues = NULL;
+
+ZBX_MEM_FUNC_DECL(__lastvalue);
+
+/* numeric history handed over by history syncers to DB writers, so that the next batch */
+/* can be processed while the previous one is being inserted                            */
+
+#define ZBX_DC_WRITE_ROW	struct zbx_dc_write_row_type
+#define ZBX_DC_WRITE_SLOT	struct zbx_dc_write_slot_type
+#define ZBX_DC_WRITE_QUEUE	struct zbx_dc_write_queue_type
+
+#define ZBX_WRITE_SLOT_FREE	0
+#define ZBX_WRITE_SLOT_READY	1	/* waiting for a DB writer */
+#define ZBX_WRITE_SLOT_WRITING	2
+
+#define ZBX_WRITE_QUEUE_WAIT	10000	/* microseconds between checks for queued values of an item */
+#define ZBX_WRITE_QUEUE_WARNING	60	/* seconds between warnings about values queued for too long */
+
+ZBX_DC_WRITE_ROW
+{
+	zbx_uint64_t	itemid;
+	history_value_t	value;
+	int		clock;
+	unsigned char	value_type;
+};
+
+ZBX_DC_WRITE_SLOT
+{
+	ZBX_DC_WRITE_ROW	*rows;		/* [ZBX_SYNC_MAX] */
+	int			rows_num;
+	unsigned int		seq;		/* the oldest ready slot is written first */
+	pid_t			writer;		/* process writing the slot */
+	unsigned char		state;
+	unsigned char		orphaned;	/* the writer died, the slot may be committed already */
+};
+
+ZBX_DC_WRITE_QUEUE
+{
+	ZBX_DC_WRITE_SLOT	*slots;		/* [2 * CONFIG_HISTSYNCER_FORKS] */
+	int			slots_num;
+	unsigned int		seq;
+	unsigned char		stopped;	/* no DB writer runs, syncers insert history themselves */
+};
+
+static ZBX_DC_WRITE_QUEUE	*write_queue = NULL;
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCget_shard                                                      *
+ *                                                                            *
+ * Purpose: find the history cache shard holding values of the item          *
+ *                                                                            *
+ ******************************************************************************/
+static ZBX_DC_SHARD	*DCget_shard(zbx_uint64_t itemid)
+{
+	return &cache->shards[ZBX_DEFAULT_UINT64_HASH_FUNC(&itemid) % CONFIG_HISTORY_CACHE_SHARDS];
+}
+
+/* history journal, values are spilled to it when the history cache is above the high-water mark */
+
+#define ZBX_JOURNAL_MAGIC	0x4c4a425a	/* "ZBJL" */
+#define ZBX_JOURNAL_ALIGN(size)	(((size) + 7) & ~(size_t)7)
+#define ZBX_JOURNAL_FLUSH_PERIOD	1	/* seconds between flushes of the segment being written */
+
+#define ZBX_DC_JOURNAL			struct zbx_dc_journal_type
+#define ZBX_DC_JOURNAL_HEADER		struct zbx_dc_journal_header_type
+#define ZBX_DC_JOURNAL_RECORD		struct zbx_dc_journal_record_type
+#define ZBX_DC_JOURNAL_SEGMENT		struct zbx_dc_journal_segment_type
+
+ZBX_DC_JOURNAL
+{
+	int		first_seq;	/* oldest segment with values not replayed yet */
+	int		last_seq;	/* segment being written */
+	int		read_offset;	/* in the first segment */
+	int		write_offset;	/* in the last segment */
+	zbx_uint64_t	values_num;	/* number of values in the journal */
+	int		spilling;	/* the journal is not empty, can be read with just a shard locked */
+	int		flushed_seq;	/* segments below it are on disk */
+	int		flushed;	/* time of the last flush */
+};
+
+/* stored at the beginning of every segment file */
+ZBX_DC_JOURNAL_HEADER
+{
+	int		magic;
+	int		seq;
+	int		read_offset;	/* persisted position of the replay */
+};
+
+/* the record size is written last, a zero size marks the end of data in a segment */
+ZBX_DC_JOURNAL_RECORD
+{
+	int		size;
+	int		clock;
+	zbx_uint64_t	itemid;
+	history_value_t	value;		/* value_str is not used, string follows the record */
+	int		timestamp;
+	int		severity;
+	int		logeventid;
+	int		lastlogsize;
+	int		mtime;
+	int		value_len;
+	int		source_len;
+	unsigned char	value_type;
+};
+
+/* segment mapped by the current process */
+ZBX_DC_JOURNAL_SEGMENT
+{
+	int		seq;
+	char		*addr;
+	size_t		size;
+};
+
+static ZBX_DC_JOURNAL		*journal = NULL;
+static ZBX_DC_JOURNAL_SEGMENT	journal_read = {0, NULL, 0};
+static ZBX_DC_JOURNAL_SEGMENT	journal_write = {0, NULL, 0};
+
+static void	DCjournal_flush();
+static void	DCjournal_replay();
+
 /******************************************************************************
  *                                                                            *
  * Function: DCget_stats                                                      *
@@ -163,70 +369,89 @@ void	*DCget_stats(int request)
 {
 	static zbx_uint64_t	value_uint;
 	static double		value_double;
-	char			*first_text = NULL;
+	ZBX_DC_SHARD		*shard;
+	ZBX_DC_STATS		stats;
+	char			*first_text;
 	size_t			free_len = 0;
-	int			i, index;
+	int			i, index, s, history_num = 0;
 
-	switch (request)
+	memset(&stats, 0, sizeof(ZBX_DC_STATS));
+
+	for (s = 0; s < CONFIG_HISTORY_CACHE_SHARDS; s++)
 	{
-	case ZBX_STATS_TEXT_USED:
-	case ZBX_STATS_TEXT_FREE:
-	case ZBX_STATS_TEXT_PFREE:
-		free_len = CONFIG_TEXT_CACHE_SIZE;
+		shard = &cache->shards[s];
 
-		LOCK_CACHE;
+		stats.history_counter += shard->stats.history_counter;
+		stats.history_float_counter += shard->stats.history_float_counter;
+		stats.history_uint_counter += shard->stats.history_uint_counter;
+		stats.history_str_counter += shard->stats.history_str_counter;
+		stats.history_log_counter += shard->stats.history_log_counter;
+		stats.history_text_counter += shard->stats.history_text_counter;
+		history_num += shard->history_num;
 
-		for (i = 0; i < cache->history_num; i++)
+		switch (request)
 		{
-			index = (cache->history_first + i) % ZBX_HISTORY_SIZE;
-			if (cache->history[index].value_type == ITEM_VALUE_TYPE_STR
-					|| cache->history[index].value_type == ITEM_VALUE_TYPE_TEXT
-					|| cache->history[index].value_type == ITEM_VALUE_TYPE_LOG)
+		case ZBX_STATS_TEXT_USED:
+		case ZBX_STATS_TEXT_FREE:
+		case ZBX_STATS_TEXT_PFREE:
+			free_len += ZBX_TEXTBUFFER_SIZE;
+			first_text = NULL;
+
+			LOCK_SHARD(shard);
+
+			for (i = 0; i < shard->history_num; i++)
 			{
-				first_text = cache->history[index].value_orig.value_str;
-				break;
+				index = (shard->history_first + i) % ZBX_HISTORY_SIZE;
+				if (shard->history[index].value_type == ITEM_VALUE_TYPE_STR
+						|| shard->history[index].value_type == ITEM_VALUE_TYPE_TEXT
+						|| shard->history[index].value_type == ITEM_VALUE_TYPE_LOG)
+				{
+					first_text = shard->history[index].value_orig.value_str;
+					break;
+				}
 			}
-		}
 
-		if (NULL != first_text)
-			free_len -= cache->last_text - first_text;
+			if (NULL != first_text)
+				free_len -= shard->last_text - first_text;
 
-		UNLOCK_CACHE;
+			UNLOCK_SHARD(shard);
 
-		break;
+			break;
+		}
 	}
 
 	switch (request)
 	{
 	case ZBX_STATS_HISTORY_COUNTER:
-		value_uint = cache->stats.history_counter;
+		value_uint = stats.history_counter;
 		return &value_uint;
 	case ZBX_STATS_HISTORY_FLOAT_COUNTER:
-		value_uint = cache->stats.history_float_counter;
+		value_uint = stats.history_float_counter;
 		return &value_uint;
 	case ZBX_STATS_HISTORY_UINT_COUNTER:
-		value_uint = cache->stats.history_uint_counter;
+		value_uint = stats.history_uint_counter;
 		return &value_uint;
 	case ZBX_STATS_HISTORY_STR_COUNTER:
-		value_uint = cache->stats.history_str_counter;
+		value_uint = stats.history_str_counter;
 		return &value_uint;
 	case ZBX_STATS_HISTORY_LOG_COUNTER:
-		value_uint = cache->stats.history_log_counter;
+		value_uint = stats.history_log_counter;
 		return &value_uint;
 	case ZBX_STATS_HISTORY_TEXT_COUNTER:
-		value_uint = cache->stats.history_text_counter;
+		value_uint = stats.history_text_counter;
 		return &value_uint;
 	case ZBX_STATS_HISTORY_TOTAL:
 		value_uint = CONFIG_HISTORY_CACHE_SIZE;
 		return &value_uint;
 	case ZBX_STATS_HISTORY_USED:
-		value_uint = cache->history_num * sizeof(ZBX_DC_HISTORY);
+		value_uint = history_num * sizeof(ZBX_DC_HISTORY);
 		return &value_uint;
 	case ZBX_STATS_HISTORY_FREE:
-		value_uint = CONFIG_HISTORY_CACHE_SIZE - cache->history_num * sizeof(ZBX_DC_HISTORY);
+		value_uint = CONFIG_HISTORY_CACHE_SIZE - history_num * sizeof(ZBX_DC_HISTORY);
 		return &value_uint;
 	case ZBX_STATS_HISTORY_PFREE:
-		value_double = 100 * ((double)(ZBX_HISTORY_SIZE - cache->history_num) / ZBX_HISTORY_SIZE);
+		value_double = 100 * ((double)(ZBX_HISTORY_SIZE * CONFIG_HISTORY_CACHE_SHARDS - history_num) /
+				(ZBX_HISTORY_SIZE * CONFIG_HISTORY_CACHE_SHARDS));
 		return &value_double;
 	case ZBX_STATS_TREND_TOTAL:
 		value_uint = trend_mem->orig_size;
@@ -241,16 +466,16 @@ void	*DCget_stats(int request)
 		value_double = 100 * ((double)trend_mem->free_size / trend_mem->orig_size);
 		return &value_double;
 	case ZBX_STATS_TEXT_TOTAL:
-		value_uint = CONFIG_TEXT_CACHE_SIZE;
+		value_uint = ZBX_TEXTBUFFER_SIZE * CONFIG_HISTORY_CACHE_SHARDS;
 		return &value_uint;
 	case ZBX_STATS_TEXT_USED:
-		value_uint = CONFIG_TEXT_CACHE_SIZE - free_len;
+		value_uint = ZBX_TEXTBUFFER_SIZE * CONFIG_HISTORY_CACHE_SHARDS - free_len;
 		return &value_uint;
 	case ZBX_STATS_TEXT_FREE:
 		value_uint = free_len;
 		return &value_uint;
 	case ZBX_STATS_TEXT_PFREE:
-		value_double = 100.0 * ((double)free_len / CONFIG_TEXT_CACHE_SIZE);
+		value_double = 100.0 * ((double)free_len / (ZBX_TEXTBUFFER_SIZE * CONFIG_HISTORY_CACHE_SHARDS));
 		return &value_double;
 	default:
 		return NULL;
@@ -265,7 +490,8 @@ void	*DCget_stats(int request)
  *                                                                            *
  * Parameters:                                                                *
  *                                                                            *
- * Return value: pointer to a trend structure                                 *
+ * Return value: pointer to a trend structure, NULL if the trend cache is    *
+ *               too full to add a new one                                    *
  *                                                                            *
  * Author: Alexander Vladishev                                                *
  *                                                                            *
@@ -287,36 +513,96 @@ static ZBX_DC_TREND	*DCget_trend(zbx_uint64_t itemid)
 	return ptr;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: DCtrend_compare                                                  *
+ *                                                                            *
+ * Purpose: sort trends by hour, value type and item                          *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCtrend_compare(const void *d1, const void *d2)
+{
+	const ZBX_DC_TREND	*t1 = (const ZBX_DC_TREND *)d1;
+	const ZBX_DC_TREND	*t2 = (const ZBX_DC_TREND *)d2;
+
+	if (t1->clock < t2->clock) return -1;
+	if (t1->clock > t2->clock) return +1;
+	if (t1->value_type < t2->value_type) return -1;
+	if (t1->value_type > t2->value_type) return +1;
+	if (t1->itemid < t2->itemid) return -1;
+	if (t1->itemid > t2->itemid) return +1;
+	return 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCmerge_trend                                                    *
+ *                                                                            *
+ * Purpose: merge trend statistics of the same item and hour                  *
+ *                                                                            *
+ * Parameters: trend - [IN/OUT] trend to update                               *
+ *             num, value_min, value_avg, value_max - [IN] other trend        *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCmerge_trend(ZBX_DC_TREND *trend, int num, const history_value_t *value_min,
+		const history_value_t *value_avg, const history_value_t *value_max)
+{
+	if (trend->value_type == ITEM_VALUE_TYPE_FLOAT)
+	{
+		if (value_min->value_float < trend->value_min.value_float)
+			trend->value_min.value_float = value_min->value_float;
+		if (value_max->value_float > trend->value_max.value_float)
+			trend->value_max.value_float = value_max->value_float;
+		trend->value_avg.value_float = (trend->num * trend->value_avg.value_float
+				+ num * value_avg->value_float) / (trend->num + num);
+	}
+	else
+	{
+		if (value_min->value_uint64 < trend->value_min.value_uint64)
+			trend->value_min.value_uint64 = value_min->value_uint64;
+		if (value_max->value_uint64 > trend->value_max.value_uint64)
+			trend->value_max.value_uint64 = value_max->value_uint64;
+		trend->value_avg.value_uint64 = (trend->num * trend->value_avg.value_uint64
+				+ num * value_avg->value_uint64) / (trend->num + num);
+	}
+
+	trend->num += num;
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: DCflush_trends                                                   *
  *                                                                            *
- * Purpose: flush trend to the database                                       *
+ * Purpose: flush trends of the same hour and value type to the database      *
  *                                                                            *
- * Parameters:                                                                *
+ * Parameters: trends - [IN] trends sorted by itemid, at most                 *
+ *                      ZBX_TRENDS_FLUSH_MAX of them                          *
+ *             trends_num - [IN] number of trends                             *
+ *             update_cache - [IN] update disable_from in the trend cache     *
  *                                                                            *
  * Return value:                                                              *
  *                                                                            *
  * Author: Alexander Vladishev                                                *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: trends are found by binary search, the batch is built by         *
+ *           DCflush_trends_array()                                           *
  *                                                                            *
  ******************************************************************************/
-static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cache)
+static void	DCflush_trends(ZBX_DC_TREND *trends, int trends_num, int update_cache)
 {
 	const char	*__function_name = "DCflush_trends";
 	DB_RESULT	result;
 	DB_ROW		row;
 	int		num, i, clock, sql_offset;
 	history_value_t	value_min, value_avg, value_max;
-	unsigned char	value_type;
+	unsigned char	value_type, *found;
 	zbx_uint64_t	*ids = NULL, itemid;
-	int		ids_alloc = ZBX_SYNC_MAX, ids_num = 0, trends_to = *trends_num;
+	int		ids_num = 0;
 	ZBX_DC_TREND	*trend = NULL;
 	const char	*table_name;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() trends_num:%d",
-			__function_name, *trends_num);
+			__function_name, trends_num);
 
 	clock = trends[0].clock;
 	value_type = trends[0].value_type;
@@ -329,25 +615,22 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 		assert(0 == 1);
 	}
 
-	ids = zbx_malloc(ids, ids_alloc * sizeof(zbx_uint64_t));
+	ids = zbx_malloc(ids, trends_num * sizeof(zbx_uint64_t));
+
+	/* 1 - item has trends in the database since 'clock', 2 - trend of 'clock' was updated */
+	found = zbx_malloc(NULL, trends_num);
+	memset(found, 0, trends_num);
+
+	/* items known to have no trends since 'disable_from' are not looked up in the database */
 
-	for (i = 0; i < *trends_num; i++)
+	for (i = 0; i < trends_num; i++)
 	{
 		trend = &trends[i];
 
-		if (clock != trend->clock || value_type != trend->value_type)
-			continue;
-
 		if (trend->disable_from != 0 && trend->disable_from <= clock)
 			continue;
 
-		uint64_array_add(&ids, &ids_alloc, &ids_num, trend->itemid, 64);
-
-		if (ZBX_SYNC_MAX == ids_num)
-		{
-			trends_to = i + 1;
-			break;
-		}
+		ids[ids_num++] = trend->itemid;
 	}
 
 	if (0 != ids_num)
@@ -368,39 +651,36 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 		{
 			ZBX_STR2UINT64(itemid, row[0]);
 
-			uint64_array_remove(ids, &ids_num, &itemid, 1);
+			if (NULL == (trend = bsearch(&itemid, trends, trends_num, sizeof(ZBX_DC_TREND),
+					ZBX_DEFAULT_UINT64_COMPARE_FUNC)))
+			{
+				THIS_SHOULD_NEVER_HAPPEN;
+				continue;
+			}
+
+			found[trend - trends] = 1;
 		}
 		DBfree_result(result);
 
-		while (0 != ids_num)
+		for (i = 0; i < trends_num; i++)
 		{
-			itemid = ids[--ids_num];
-
-			for (i = 0; i < trends_to; i++)
-			{
-				trend = &trends[i];
-
-				if (itemid == trend->itemid && clock == trend->clock &&
-						value_type == trend->value_type)
-					break;
-			}
+			trend = &trends[i];
 
-			if (i == trends_to)
-			{
-				THIS_SHOULD_NEVER_HAPPEN;
+			if (0 != found[i] || (trend->disable_from != 0 && trend->disable_from <= clock))
 				continue;
-			}
 
 			trend->disable_from = clock;
 
 			/* if 'trends' is not a primary trends buffer */
 			if (0 != update_cache)
 			{
+				ZBX_DC_TREND	*trend_cache;
+
 				LOCK_TRENDS;
 
 				/* we update it too */
-				if (NULL != (trend = zbx_hashset_search(&cache->trends, &itemid)))
-					trend->disable_from = clock;
+				if (NULL != (trend_cache = zbx_hashset_search(&cache->trends, &trend->itemid)))
+					trend_cache->disable_from = clock;
 
 				UNLOCK_TRENDS;
 			}
@@ -409,17 +689,14 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 
 	ids_num = 0;
 
-	for (i = 0; i < trends_to; i++)
+	for (i = 0; i < trends_num; i++)
 	{
 		trend = &trends[i];
 
-		if (clock != trend->clock || value_type != trend->value_type)
-			continue;
-
 		if (trend->disable_from != 0 && trend->disable_from <= clock)
 			continue;
 
-		uint64_array_add(&ids, &ids_alloc, &ids_num, trend->itemid, 64);
+		ids[ids_num++] = trend->itemid;
 	}
 
 	if (0 != ids_num)
@@ -445,16 +722,8 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 		{
 			ZBX_STR2UINT64(itemid, row[0]);
 
-			for (i = 0; i < trends_to; i++)
-			{
-				trend = &trends[i];
-
-				if (itemid == trend->itemid && clock == trend->clock &&
-						value_type == trend->value_type)
-					break;
-			}
-
-			if (i == trends_to)
+			if (NULL == (trend = bsearch(&itemid, trends, trends_num, sizeof(ZBX_DC_TREND),
+					ZBX_DEFAULT_UINT64_COMPARE_FUNC)))
 			{
 				THIS_SHOULD_NEVER_HAPPEN;
 				continue;
@@ -468,13 +737,7 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 				value_avg.value_float = atof(row[3]);
 				value_max.value_float = atof(row[4]);
 
-				if (value_min.value_float < trend->value_min.value_float)
-					trend->value_min.value_float = value_min.value_float;
-				if (value_max.value_float > trend->value_max.value_float)
-					trend->value_max.value_float = value_max.value_float;
-				trend->value_avg.value_float = (trend->num * trend->value_avg.value_float
-						+ num * value_avg.value_float) / (trend->num + num);
-				trend->num += num;
+				DCmerge_trend(trend, num, &value_min, &value_avg, &value_max);
 
 				zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
 						"update trends set num=%d,value_min=" ZBX_FS_DBL ",value_avg=" ZBX_FS_DBL
@@ -492,13 +755,7 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 				ZBX_STR2UINT64(value_avg.value_uint64, row[3]);
 				ZBX_STR2UINT64(value_max.value_uint64, row[4]);
 
-				if (value_min.value_uint64 < trend->value_min.value_uint64)
-					trend->value_min.value_uint64 = value_min.value_uint64;
-				if (value_max.value_uint64 > trend->value_max.value_uint64)
-					trend->value_max.value_uint64 = value_max.value_uint64;
-				trend->value_avg.value_uint64 = (trend->num * trend->value_avg.value_uint64
-						+ num * value_avg.value_uint64) / (trend->num + num);
-				trend->num += num;
+				DCmerge_trend(trend, num, &value_min, &value_avg, &value_max);
 
 				zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
 						"update trends_uint set num=%d,value_min=" ZBX_FS_UI64 ",value_avg=" ZBX_FS_UI64
@@ -511,7 +768,7 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 						trend->clock);
 			}
 
-			trend->itemid = 0;
+			found[trend - trends] = 2;
 
 			DBexecute_overflowed_sql(&sql, &sql_allocated, &sql_offset);
 		}
@@ -531,14 +788,11 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 
 	if (value_type == ITEM_VALUE_TYPE_FLOAT)
 	{
-		for (i = 0; i < trends_to; i++)
+		for (i = 0; i < trends_num; i++)
 		{
 			trend = &trends[i];
 
-			if (0 == trend->itemid)
-				continue;
-
-			if (clock != trend->clock || value_type != trend->value_type)
+			if (2 == found[i])
 				continue;
 
 			if (0 == sql_offset)
@@ -572,21 +826,16 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 					trend->value_avg.value_float,
 					trend->value_max.value_float);
 #endif
-			trend->itemid = 0;
-
 			DBexecute_overflowed_sql(&sql, &sql_allocated, &sql_offset);
 		}
 	}
 	else
 	{
-		for (i = 0; i < trends_to; i++)
+		for (i = 0; i < trends_num; i++)
 		{
 			trend = &trends[i];
 
-			if (0 == trend->itemid)
-				continue;
-
-			if (clock != trend->clock || value_type != trend->value_type)
+			if (2 == found[i])
 				continue;
 
 			if (0 == sql_offset)
@@ -620,8 +869,6 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 					trend->value_avg.value_uint64,
 					trend->value_max.value_uint64);
 #endif
-			trend->itemid = 0;
-
 			DBexecute_overflowed_sql(&sql, &sql_allocated, &sql_offset);
 		}
 	}
@@ -638,17 +885,59 @@ static void	DCflush_trends(ZBX_DC_TREND *trends, int *trends_num, int update_cac
 		DBexecute("%s", sql);
 	}
 
-	/* clean trends */
-	for (i = 0, num = 0; i < *trends_num; i++)
+	zbx_free(found);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCflush_trends_array                                             *
+ *                                                                            *
+ * Purpose: flush an arbitrary array of trends to the database                *
+ *                                                                            *
+ * Parameters: trends - [IN] array of trends, reordered by the function       *
+ *             trends_num - [IN] number of trends                             *
+ *             update_cache - [IN] update disable_from in the trend cache     *
+ *                                                                            *
+ * Comments: trends are sorted once and flushed in batches of the same hour   *
+ *           and value type; trends of the same item and hour are merged      *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCflush_trends_array(ZBX_DC_TREND *trends, int trends_num, int update_cache)
+{
+	int	i, num, first;
+
+	if (0 == trends_num)
+		return;
+
+	qsort(trends, trends_num, sizeof(ZBX_DC_TREND), DCtrend_compare);
+
+	for (i = 1, num = 1; i < trends_num; i++)
 	{
-		if (0 == trends[i].itemid)
+		if (0 == DCtrend_compare(&trends[num - 1], &trends[i]))
+		{
+			DCmerge_trend(&trends[num - 1], trends[i].num,
+					&trends[i].value_min, &trends[i].value_avg, &trends[i].value_max);
 			continue;
+		}
 
-		memcpy(&trends[num++], &trends[i], sizeof(ZBX_DC_TREND));
+		if (num != i)
+			memcpy(&trends[num], &trends[i], sizeof(ZBX_DC_TREND));
+		num++;
 	}
-	*trends_num = num;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+	for (i = 0, first = 0; i <= num; i++)
+	{
+		if (i < num && i - first < ZBX_TRENDS_FLUSH_MAX && trends[i].clock == trends[first].clock &&
+				trends[i].value_type == trends[first].value_type)
+		{
+			continue;
+		}
+
+		DCflush_trends(&trends[first], i - first, update_cache);
+		first = i;
+	}
 }
 
 /******************************************************************************
@@ -676,80 +965,224 @@ static void	DCflush_trend(ZBX_DC_TREND *trend, ZBX_DC_TREND **trends, int *trend
 
 	memcpy(&(*trends)[*trends_num], trend, sizeof(ZBX_DC_TREND));
 	(*trends_num)++;
-
-	trend->clock = 0;
-	trend->num = 0;
-	memset(&trend->value_min, 0, sizeof(history_value_t));
-	memset(&trend->value_avg, 0, sizeof(history_value_t));
-	memset(&trend->value_max, 0, sizeof(history_value_t));
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: DCadd_trend                                                      *
- *                                                                            *
- * Purpose: add new value to the trends                                       *
+ * Function: DCpend_trend                                                     *
  *                                                                            *
- * Parameters:                                                                *
+ * Purpose: add completed trend to the pending trends of its hour and value   *
+ *          type                                                              *
  *                                                                            *
- * Return value:                                                              *
+ * Parameters: trend - [IN] completed trend                                   *
  *                                                                            *
- * Author: Alexander Vladishev                                                *
+ * Return value: SUCCEED - trend will be flushed by DCget_pending_trends()    *
+ *               FAIL - trend cache is full                                   *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: must be called with trend cache locked                           *
  *                                                                            *
  ******************************************************************************/
-static void	DCadd_trend(ZBX_DC_HISTORY *history, ZBX_DC_TREND **trends, int *trends_alloc, int *trends_num)
+static int	DCpend_trend(const ZBX_DC_TREND *trend)
 {
-	ZBX_DC_TREND	*trend = NULL;
-	int		hour;
+	ZBX_DC_TREND_BUCKET	*bucket, *buckets;
+	ZBX_DC_TREND		*pending;
+	int			index, lo = 0, hi;
 
-	hour = history->clock - history->clock % 3600;
+	/* the buckets are sorted newest first, find the first one not newer than the trend */
+	for (hi = cache->buckets_num; lo < hi;)
+	{
+		index = (lo + hi) / 2;
+		bucket = &cache->buckets[index];
+
+		if (bucket->clock > trend->clock || (bucket->clock == trend->clock &&
+				bucket->value_type > trend->value_type))
+		{
+			lo = index + 1;
+		}
+		else
+			hi = index;
+	}
 
-	trend = DCget_trend(history->itemid);
+	if (lo == cache->buckets_num || cache->buckets[lo].clock != trend->clock ||
+			cache->buckets[lo].value_type != trend->value_type)
+	{
+		if (cache->buckets_num == cache->buckets_alloc)
+		{
+			if (NULL == (buckets = zbx_mem_try_malloc(trend_mem,
+					(cache->buckets_alloc + 8) * sizeof(ZBX_DC_TREND_BUCKET))))
+			{
+				return FAIL;
+			}
 
-	if (trend->num > 0 && (trend->clock != hour || trend->value_type != history->value_type))
-		DCflush_trend(trend, trends, trends_alloc, trends_num);
+			if (NULL != cache->buckets)
+			{
+				memcpy(buckets, cache->buckets, cache->buckets_num * sizeof(ZBX_DC_TREND_BUCKET));
+				zbx_mem_free(trend_mem, cache->buckets);
+			}
 
-	trend->value_type = history->value_type;
-	trend->clock = hour;
+			cache->buckets = buckets;
+			cache->buckets_alloc += 8;
+		}
 
-	switch (trend->value_type)
+		memmove(&cache->buckets[lo + 1], &cache->buckets[lo],
+				(cache->buckets_num - lo) * sizeof(ZBX_DC_TREND_BUCKET));
+		cache->buckets_num++;
+
+		bucket = &cache->buckets[lo];
+		bucket->clock = trend->clock;
+		bucket->value_type = trend->value_type;
+		bucket->trends = NULL;
+		bucket->trends_num = 0;
+	}
+	else
+		bucket = &cache->buckets[lo];
+
+	if (NULL == (pending = zbx_mem_try_malloc(trend_mem, sizeof(ZBX_DC_TREND))))
 	{
-		case ITEM_VALUE_TYPE_FLOAT:
-			if (trend->num == 0 || history->value.value_float < trend->value_min.value_float)
-				trend->value_min.value_float = history->value.value_float;
-			if (trend->num == 0 || history->value.value_float > trend->value_max.value_float)
-				trend->value_max.value_float = history->value.value_float;
-			trend->value_avg.value_float = (trend->num * trend->value_avg.value_float
-				+ history->value.value_float) / (trend->num + 1);
-			break;
-		case ITEM_VALUE_TYPE_UINT64:
-			if (trend->num == 0 || history->value.value_uint64 < trend->value_min.value_uint64)
-				trend->value_min.value_uint64 = history->value.value_uint64;
-			if (trend->num == 0 || history->value.value_uint64 > trend->value_max.value_uint64)
-				trend->value_max.value_uint64 = history->value.value_uint64;
-			trend->value_avg.value_uint64 = (trend->num * trend->value_avg.value_uint64
-				+ history->value.value_uint64) / (trend->num + 1);
-			break;
+		/* the bucket is left empty, it is removed when the older buckets are flushed */
+		return FAIL;
 	}
-	trend->num++;
+
+	memcpy(pending, trend, sizeof(ZBX_DC_TREND));
+
+	pending->next = bucket->trends;
+	bucket->trends = pending;
+	bucket->trends_num++;
+
+	cache->trends_pending_num++;
+
+	return SUCCEED;
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: DCmass_update_trends                                             *
+ * Function: DCget_pending_trends                                             *
  *                                                                            *
- * Purpose:                                                                   *
+ * Purpose: take pending trends of the oldest hour for flushing to DB         *
  *                                                                            *
- * Parameters: history - array of history data                                *
- *             history_num - number of history structures                     *
+ * Parameters: trends, trends_alloc, trends_num - [IN/OUT] array of trends    *
+ *             max_num - [IN] maximum number of trends to take, 0 - all       *
  *                                                                            *
- * Return value:                                                              *
+ * Comments: must be called with trend cache locked. The oldest bucket is the  *
+ *           last one.                                                        *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCget_pending_trends(ZBX_DC_TREND **trends, int *trends_alloc, int *trends_num, int max_num)
+{
+	ZBX_DC_TREND_BUCKET	*oldest;
+	ZBX_DC_TREND		*pending;
+	int			num = 0;
+
+	while (0 != cache->buckets_num)
+	{
+		oldest = &cache->buckets[cache->buckets_num - 1];
+
+		while (NULL != (pending = oldest->trends) && (0 == max_num || num < max_num))
+		{
+			oldest->trends = pending->next;
+			oldest->trends_num--;
+			cache->trends_pending_num--;
+
+			DCflush_trend(pending, trends, trends_alloc, trends_num);
+			zbx_mem_free(trend_mem, pending);
+			num++;
+		}
+
+		if (NULL == oldest->trends)
+			cache->buckets_num--;
+
+		if (0 != max_num && num == max_num)
+			break;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCadd_trend                                                      *
+ *                                                                            *
+ * Purpose: add new value to the trends                                       *
+ *                                                                            *
+ * Parameters:                                                                *
+ *                                                                            *
+ * Return value:                                                              *
  *                                                                            *
  * Author: Alexander Vladishev                                                *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: completed trends are left for the incremental trend writer,      *
+ *           they are only flushed right away if the trend cache is full.     *
+ *           If there is no room for the trend of a new item either, the      *
+ *           value itself is flushed as a trend of one value.                 *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCadd_trend(ZBX_DC_HISTORY *history, ZBX_DC_TREND **trends, int *trends_alloc, int *trends_num)
+{
+	ZBX_DC_TREND	*trend = NULL, uncached;
+	int		hour;
+
+	hour = history->clock - history->clock % 3600;
+
+	if (NULL == (trend = DCget_trend(history->itemid)))
+	{
+		/* the trend cache is full, the value is flushed as a trend of its own and merged in the database */
+		memset(&uncached, 0, sizeof(ZBX_DC_TREND));
+		uncached.itemid = history->itemid;
+		trend = &uncached;
+	}
+
+	if (trend->num > 0 && (trend->clock != hour || trend->value_type != history->value_type))
+	{
+		if (SUCCEED != DCpend_trend(trend))
+			DCflush_trend(trend, trends, trends_alloc, trends_num);
+
+		trend->clock = 0;
+		trend->num = 0;
+		memset(&trend->value_min, 0, sizeof(history_value_t));
+		memset(&trend->value_avg, 0, sizeof(history_value_t));
+		memset(&trend->value_max, 0, sizeof(history_value_t));
+	}
+
+	trend->value_type = history->value_type;
+	trend->clock = hour;
+
+	switch (trend->value_type)
+	{
+		case ITEM_VALUE_TYPE_FLOAT:
+			if (trend->num == 0 || history->value.value_float < trend->value_min.value_float)
+				trend->value_min.value_float = history->value.value_float;
+			if (trend->num == 0 || history->value.value_float > trend->value_max.value_float)
+				trend->value_max.value_float = history->value.value_float;
+			trend->value_avg.value_float = (trend->num * trend->value_avg.value_float
+				+ history->value.value_float) / (trend->num + 1);
+			break;
+		case ITEM_VALUE_TYPE_UINT64:
+			if (trend->num == 0 || history->value.value_uint64 < trend->value_min.value_uint64)
+				trend->value_min.value_uint64 = history->value.value_uint64;
+			if (trend->num == 0 || history->value.value_uint64 > trend->value_max.value_uint64)
+				trend->value_max.value_uint64 = history->value.value_uint64;
+			trend->value_avg.value_uint64 = (trend->num * trend->value_avg.value_uint64
+				+ history->value.value_uint64) / (trend->num + 1);
+			break;
+	}
+	trend->num++;
+
+	if (&uncached == trend)
+		DCflush_trend(trend, trends, trends_alloc, trends_num);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCmass_update_trends                                             *
+ *                                                                            *
+ * Purpose:                                                                   *
+ *                                                                            *
+ * Parameters: history - array of history data                                *
+ *             history_num - number of history structures                     *
+ *                                                                            *
+ * Return value:                                                              *
+ *                                                                            *
+ * Author: Alexander Vladishev                                                *
+ *                                                                            *
+ * Comments: completed trends are left for DCflush_pending_trends()          *
  *                                                                            *
  ******************************************************************************/
 static void	DCmass_update_trends(ZBX_DC_HISTORY *history, int history_num)
@@ -779,14 +1212,78 @@ static void	DCmass_update_trends(ZBX_DC_HISTORY *history, int history_num)
 
 	UNLOCK_TRENDS;
 
-	while (trends_num > 0)
-		DCflush_trends(trends, &trends_num, 1);
+	/* trends that did not fit into the trend cache */
+	DCflush_trends_array(trends, trends_num, 1);
 
 	zbx_free(trends);
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: DCflush_pending_trends                                           *
+ *                                                                            *
+ * Purpose: flush completed trends, oldest hour first, in chunks until        *
+ *          ZBX_TRENDS_SLICE_TIME is used up                                  *
+ *                                                                            *
+ * Comments: called after every history batch, so that the hourly roll-over   *
+ *           is written to the database gradually. Pending trends are not     *
+ *           tied to the items of the batch, so only one syncer at a time     *
+ *           flushes them and commits before the next one can: a trend of the *
+ *           same item and hour pended again is then updated, not inserted    *
+ *           twice.                                                           *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCflush_pending_trends()
+{
+	const char	*__function_name = "DCflush_pending_trends";
+	ZBX_DC_TREND	*trends = NULL;
+	int		trends_alloc = 0, trends_num, total_num = 0;
+	double		sec;
+
+	LOCK_TRENDS;
+
+	if (0 == cache->trends_pending_num || 0 != cache->trends_flushing)
+	{
+		UNLOCK_TRENDS;
+		return;
+	}
+
+	cache->trends_flushing = 1;
+
+	UNLOCK_TRENDS;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	sec = zbx_time();
+
+	DBbegin();
+
+	do
+	{
+		trends_num = 0;
+
+		LOCK_TRENDS;
+		DCget_pending_trends(&trends, &trends_alloc, &trends_num, ZBX_TRENDS_FLUSH_MAX);
+		UNLOCK_TRENDS;
+
+		DCflush_trends_array(trends, trends_num, 1);
+		total_num += trends_num;
+	}
+	while (0 != trends_num && ZBX_TRENDS_SLICE_TIME > zbx_time() - sec);
+
+	DBcommit();
+
+	LOCK_TRENDS;
+	cache->trends_flushing = 0;
+	UNLOCK_TRENDS;
+
+	zbx_free(trends);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() flushed:%d", __function_name, total_num);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: DCsync_trends                                                    *
@@ -809,32 +1306,62 @@ static void	DCsync_trends()
 	ZBX_DC_TREND		*trends = NULL, *trend;
 	int			trends_alloc = 0, trends_num = 0;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s() trends_num:%d",
-			__function_name, cache->trends_num);
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() trends_num:%d pending:%d",
+			__function_name, cache->trends_num, cache->trends_pending_num);
 
 	zabbix_log(LOG_LEVEL_WARNING, "Syncing trends data...");
 
 	LOCK_TRENDS;
 
+	DCget_pending_trends(&trends, &trends_alloc, &trends_num, 0);
+
 	zbx_hashset_iter_reset(&cache->trends, &iter);
 
 	while (NULL != (trend = (ZBX_DC_TREND *)zbx_hashset_iter_next(&iter)))
-		DCflush_trend(trend, &trends, &trends_alloc, &trends_num);
+	{
+		if (0 != trend->num)
+			DCflush_trend(trend, &trends, &trends_alloc, &trends_num);
+	}
 
 	UNLOCK_TRENDS;
 
 	DBbegin();
 
-	while (trends_num > 0)
-		DCflush_trends(trends, &trends_num, 0);
+	DCflush_trends_array(trends, trends_num, 0);
 
 	DBcommit();
 
+	zbx_free(trends);
+
 	zabbix_log(LOG_LEVEL_WARNING, "Syncing trends data... done.");
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
+typedef struct zbx_trigger_s
+{
+	zbx_uint64_t	triggerid;
+	char		*exp;
+	char		*error;
+	int		clock;
+	int		level;
+	unsigned char	type;
+	unsigned char	value;
+} zbx_trigger_t;
+
+/* triggers that others depend on are evaluated first, so that dependent triggers see their new values */
+static int	DCtrigger_level_compare(const void *d1, const void *d2)
+{
+	const zbx_trigger_t	*t1 = (const zbx_trigger_t *)d1;
+	const zbx_trigger_t	*t2 = (const zbx_trigger_t *)d2;
+
+	if (t1->level < t2->level) return -1;
+	if (t1->level > t2->level) return +1;
+	if (t1->triggerid < t2->triggerid) return -1;
+	if (t1->triggerid > t2->triggerid) return +1;
+	return 0;
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: DCmass_update_triggers                                           *
@@ -855,99 +1382,98 @@ static void	DCmass_update_triggers(ZBX_DC_HISTORY *history, int history_num)
 {
 	const char	*__function_name = "DCmass_update_triggers";
 
-	typedef struct zbx_trigger_s
-	{
-		zbx_uint64_t	triggerid;
-		char		*exp;
-		char		*error;
-		int		clock;
-		unsigned char	type;
-		unsigned char	value;
-	} zbx_trigger_t;
-
-	zbx_trigger_t	*tr = NULL, *tr_last = NULL;
-	int		tr_alloc, tr_num = 0;
+	zbx_trigger_t	*tr = NULL, tr_local;
+	int		tr_num = 0;
 
+	DC_TRIGGER	*triggers = NULL;
+	int		triggers_num;
 	char		error[MAX_STRING_LEN];
 	int		exp_value;
 	DB_RESULT	result;
 	DB_ROW		row;
-	int		sql_offset = 0, i;
-	zbx_uint64_t	itemid, triggerid;
+	int		sql_offset = 0, i, *clocks = NULL;
+	zbx_uint64_t	*ids = NULL;
+	int		ids_num = 0;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
-	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 1024,
-			"select distinct t.triggerid,t.type,t.value,t.error,t.expression,f.itemid"
-			" from triggers t,functions f,items i"
-			" where t.triggerid=f.triggerid"
-				" and f.itemid=i.itemid"
-				" and t.status=%d"
-				" and f.itemid in (",
-			TRIGGER_STATUS_ENABLED);
+	ids = zbx_malloc(ids, history_num * sizeof(zbx_uint64_t));
+	clocks = zbx_malloc(clocks, history_num * sizeof(int));
 
 	for (i = 0; i < history_num; i++)
 	{
 		if (0 != history[i].value_null)
 			continue;
 
-		zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 22, ZBX_FS_UI64 ",",
-				history[i].itemid);
+		ids[ids_num] = history[i].itemid;
+		clocks[ids_num++] = history[i].clock;
 	}
 
-	if (sql[--sql_offset] == ',')
-	{
-		zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 23, ") order by t.triggerid");
-	}
-	else
+	/* triggers are found through the itemid index of the configuration cache */
+	if (0 == ids_num || 0 == (triggers_num = DCconfig_get_triggers_by_itemids(&triggers, ids, clocks, ids_num)))
 	{
 		zabbix_log(LOG_LEVEL_DEBUG, "%s():no items with triggers", __function_name);
 		goto exit;
 	}
 
+	tr = zbx_malloc(tr, triggers_num * sizeof(zbx_trigger_t));
+
+	/* value and error are changed outside of configuration sync, so they are read from the database */
+	if (triggers_num > history_num)
+		ids = zbx_realloc(ids, triggers_num * sizeof(zbx_uint64_t));
+
+	ids_num = 0;
+
+	for (i = 0; i < triggers_num; i++)
+		ids[ids_num++] = triggers[i].triggerid;
+
+	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 128,
+			"select triggerid,value,error"
+			" from triggers"
+			" where status=%d"
+				" and",
+			TRIGGER_STATUS_ENABLED);
+
+	/* large batches are split into several "in" lists */
+	DBadd_condition_alloc(&sql, &sql_allocated, &sql_offset, "triggerid", ids, ids_num);
+
 	result = DBselect("%s", sql);
 
 	sql_offset = 0;
 
-	tr_alloc = history_num;
-	tr = zbx_malloc(tr, tr_alloc * sizeof(zbx_trigger_t));
-
 	while (NULL != (row = DBfetch(result)))
 	{
-		ZBX_STR2UINT64(triggerid, row[0]);
+		DC_TRIGGER	*trigger;
 
-		if (NULL == tr_last || tr_last->triggerid != triggerid)
-		{
-			if (tr_num == tr_alloc)
-			{
-				tr_alloc += 64;
-				tr = zbx_realloc(tr, tr_alloc * sizeof(zbx_trigger_t));
-			}
+		ZBX_STR2UINT64(tr_local.triggerid, row[0]);
 
-			tr_last = &tr[tr_num++];
-			tr_last->triggerid = triggerid;
-			tr_last->type = (unsigned char)atoi(row[1]);
-			tr_last->value = (unsigned char)atoi(row[2]);
-			tr_last->error = strdup(row[3]);
-			tr_last->exp = strdup(row[4]);
-			tr_last->clock = 0;
+		if (NULL == (trigger = bsearch(&tr_local.triggerid, triggers, triggers_num, sizeof(DC_TRIGGER),
+				ZBX_DEFAULT_UINT64_COMPARE_FUNC)))
+		{
+			continue;
 		}
 
-		ZBX_STR2UINT64(itemid, row[5]);
+		tr_local.type = trigger->type;
+		tr_local.value = (unsigned char)atoi(row[1]);
+		tr_local.error = strdup(row[2]);
+		tr_local.exp = trigger->expression;
+		tr_local.clock = trigger->clock;
+		tr_local.level = trigger->level;
 
-		for (i = 0; i < history_num; i++)
-		{
-			if (itemid == history[i].itemid)
-			{
-				if (tr_last->clock < history[i].clock)
-					tr_last->clock = history[i].clock;
-				break;
-			}
-		}
+		trigger->expression = NULL;
+
+		tr[tr_num++] = tr_local;
 	}
 
 	DBfree_result(result);
 
+	for (i = 0; i < triggers_num; i++)
+		zbx_free(triggers[i].expression);
+
+	zbx_free(triggers);
+
+	qsort(tr, tr_num, sizeof(zbx_trigger_t), DCtrigger_level_compare);
+
 	for (i = 0; i < tr_num; i++)
 	{
 		if (0 == tr[i].clock)
@@ -974,6 +1500,9 @@ static void	DCmass_update_triggers(ZBX_DC_HISTORY *history, int history_num)
 
 	zbx_free(tr);
 exit:
+	zbx_free(clocks);
+	zbx_free(ids);
+
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
@@ -991,101 +1520,469 @@ static int	DBchk_double(double value)
 
 /******************************************************************************
  *                                                                            *
- * Function: DCmass_update_items                                              *
- *                                                                            *
- * Purpose: update items info after new value is received                     *
+ * Function: DClastvalue_from_row                                             *
  *                                                                            *
- * Parameters: history - array of history data                                *
- *             history_num - number of history structures                     *
+ * Purpose: initialize last values of an item from the items table            *
  *                                                                            *
- * Author: Alexei Vladishev, Eugene Grigorjev, Alexander Vladishev            *
+ * Parameters: lastvalue  - [OUT] last values of the item                     *
+ *             itemid     - [IN] item identifier                              *
+ *             value_type - [IN] type of the item values                      *
+ *             row        - [IN] row selected by DCmass_update_items()        *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: only numeric values are parsed, string values are never cached  *
  *                                                                            *
  ******************************************************************************/
-static void	DCmass_update_items(ZBX_DC_HISTORY *history, int history_num)
+static void	DClastvalue_from_row(ZBX_DC_LASTVALUE *lastvalue, zbx_uint64_t itemid, unsigned char value_type,
+		DB_ROW row)
 {
-	DB_RESULT	result;
-	DB_ROW		row;
-	DB_ITEM		item;
-	char		*value_esc, *message = NULL;
-	int		sql_offset = 0, i;
-	ZBX_DC_HISTORY	*h;
-	zbx_uint64_t	*ids = NULL;
-	int		ids_alloc, ids_num = 0;
-	unsigned char	status;
+	memset(lastvalue, 0, sizeof(ZBX_DC_LASTVALUE));
 
-	zabbix_log( LOG_LEVEL_DEBUG, "In DCmass_update_items()");
+	lastvalue->itemid = itemid;
+	lastvalue->value_type = value_type;
+	lastvalue->flags = ZBX_LASTVALUE_NULL | ZBX_PREVVALUE_NULL | ZBX_PREVORGVALUE_NULL;
 
-	ids_alloc = history_num;
-	ids = zbx_malloc(ids, ids_alloc * sizeof(zbx_uint64_t));
+	if (SUCCEED != DBis_null(row[2]))
+		lastvalue->lastclock = atoi(row[2]);
 
-	for (i = 0; i < history_num; i++)
-		uint64_array_add(&ids, &ids_alloc, &ids_num, history[i].itemid, 64);
+	switch (value_type) {
+	case ITEM_VALUE_TYPE_FLOAT:
+		if (SUCCEED != DBis_null(row[3]))
+		{
+			lastvalue->prevorgvalue.value_float = atof(row[3]);
+			lastvalue->flags &= ~ZBX_PREVORGVALUE_NULL;
+		}
+		if (SUCCEED != DBis_null(row[9]))
+		{
+			lastvalue->lastvalue.value_float = atof(row[9]);
+			lastvalue->flags &= ~ZBX_LASTVALUE_NULL;
+		}
+		if (SUCCEED != DBis_null(row[10]))
+		{
+			lastvalue->prevvalue.value_float = atof(row[10]);
+			lastvalue->flags &= ~ZBX_PREVVALUE_NULL;
+		}
+		break;
+	case ITEM_VALUE_TYPE_UINT64:
+		if (SUCCEED != DBis_null(row[3]))
+		{
+			ZBX_STR2UINT64(lastvalue->prevorgvalue.value_uint64, row[3]);
+			lastvalue->flags &= ~ZBX_PREVORGVALUE_NULL;
+		}
+		if (SUCCEED != DBis_null(row[9]))
+		{
+			ZBX_STR2UINT64(lastvalue->lastvalue.value_uint64, row[9]);
+			lastvalue->flags &= ~ZBX_LASTVALUE_NULL;
+		}
+		if (SUCCEED != DBis_null(row[10]))
+		{
+			ZBX_STR2UINT64(lastvalue->prevvalue.value_uint64, row[10]);
+			lastvalue->flags &= ~ZBX_PREVVALUE_NULL;
+		}
+		break;
+	}
+}
 
-	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 128,
-			"select itemid,status,lastclock,prevorgvalue,delta,multiplier,formula,history,trends"
-			" from items"
-			" where");
+/******************************************************************************
+ *                                                                            *
+ * Function: DCget_lastvalue                                                  *
+ *                                                                            *
+ * Purpose: copy last values of an item from the last value cache            *
+ *                                                                            *
+ * Parameters: lastvalue  - [OUT] last values of the item                     *
+ *             itemid     - [IN] item identifier                              *
+ *             value_type - [IN] type of the item values                      *
+ *                                                                            *
+ * Return value: SUCCEED - the item is cached, FAIL - otherwise               *
+ *                                                                            *
+ * Comments: values cached for another value type are ignored                 *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCget_lastvalue(ZBX_DC_LASTVALUE *lastvalue, zbx_uint64_t itemid, unsigned char value_type)
+{
+	ZBX_DC_LASTVALUE	*lv;
+	int			ret = FAIL;
 
-	DBadd_condition_alloc(&sql, &sql_allocated, &sql_offset, "itemid", ids, ids_num);
+	LOCK_LASTVALUES;
 
-	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 20, " order by itemid");
+	if (NULL != (lv = zbx_hashset_search(&lastvalues->items, &itemid)) && value_type == lv->value_type)
+	{
+		memcpy(lastvalue, lv, sizeof(ZBX_DC_LASTVALUE));
+		ret = SUCCEED;
+	}
 
-	zbx_free(ids);
+	UNLOCK_LASTVALUES;
 
-	result = DBselect("%s", sql);
+	return ret;
+}
 
-	sql_offset = 0;
+/******************************************************************************
+ *                                                                            *
+ * Function: DCput_lastvalue                                                  *
+ *                                                                            *
+ * Purpose: store updated last values of an item in the last value cache      *
+ *                                                                            *
+ * Parameters: lastvalue - [IN] last values of the item                       *
+ *                                                                            *
+ * Return value: SUCCEED - the values will be flushed to the database later,  *
+ *               FAIL - the cache is full, the item must be updated directly  *
+ *                                                                            *
+ * Comments: the hashset is not allowed to grow, its slots are allocated once *
+ *           and running out of shared memory is fatal                        *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCput_lastvalue(ZBX_DC_LASTVALUE *lastvalue)
+{
+	ZBX_DC_LASTVALUE	*lv;
+	int			ret = SUCCEED;
 
-#ifdef HAVE_ORACLE
-	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 8, "begin\n");
-#endif
+	LOCK_LASTVALUES;
 
-	while (NULL != (row = DBfetch(result)))
+	if (NULL == (lv = zbx_hashset_search(&lastvalues->items, &lastvalue->itemid)))
 	{
-		ZBX_STR2UINT64(item.itemid, row[0]);
-
-		h = NULL;
-
-		for (i = 0; i < history_num; i++)
+		if (lastvalues->items.num_data + 1 >= lastvalues->items.num_slots * 4 / 5 ||
+				lastvalue_mem->free_size < lastvalue_mem->orig_size / 32 + ZBX_KIBIBYTE)
 		{
-			if (item.itemid == history[i].itemid)
-			{
-				h = &history[i];
-				break;
-			}
+			ret = FAIL;
+			goto unlock;
 		}
 
-		if (NULL == h)
-			continue;
+		lv = zbx_hashset_insert(&lastvalues->items, lastvalue, sizeof(ZBX_DC_LASTVALUE));
+	}
+	else
+		memcpy(lv, lastvalue, sizeof(ZBX_DC_LASTVALUE));
 
-		item.status	= atoi(row[1]);
-		if (SUCCEED != DBis_null(row[2]))
-			item.lastclock	= atoi(row[2]);
-		else
-			item.lastclock	= 0;
-		if (SUCCEED != DBis_null(row[3]))
-		{
-			item.prevorgvalue_null	= 0;
-			switch (h->value_type) {
-			case ITEM_VALUE_TYPE_FLOAT:
-				item.prevorgvalue_dbl = atof(row[3]);
-				break;
-			case ITEM_VALUE_TYPE_UINT64:
-				ZBX_STR2UINT64(item.prevorgvalue_uint64, row[3]);
-				break;
-			}
-		}
-		else
-			item.prevorgvalue_null = 1;
-		item.delta	= atoi(row[4]);
-		item.multiplier	= atoi(row[5]);
-		item.formula	= row[6];
-		item.history	= atoi(row[7]);
-		item.trends	= atoi(row[8]);
+	lv->flags |= ZBX_LASTVALUE_DIRTY;
+	lv->lastuse = (int)time(NULL);
+unlock:
+	UNLOCK_LASTVALUES;
 
-		if (0 != (zbx_process & ZBX_PROCESS_PROXY))
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCtouch_lastvalues                                               *
+ *                                                                            *
+ * Purpose: keep cached values of the batch items from being expired while    *
+ *          the batch is processed                                            *
+ *                                                                            *
+ * Parameters: itemids - [IN] identifiers of the items in the batch           *
+ *                                                                            *
+ * Comments: an entry missing from the cache must stay missing until the      *
+ *           batch is done, otherwise the item row selected for the batch     *
+ *           could be older than the flushed values                           *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCtouch_lastvalues(zbx_vector_uint64_t *itemids)
+{
+	ZBX_DC_LASTVALUE	*lv;
+	int			i, now;
+
+	now = (int)time(NULL);
+
+	LOCK_LASTVALUES;
+
+	for (i = 0; i < itemids->values_num; i++)
+	{
+		if (NULL != (lv = zbx_hashset_search(&lastvalues->items, &itemids->values[i])))
+			lv->lastuse = now;
+	}
+
+	UNLOCK_LASTVALUES;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DClastvalue_sql                                                  *
+ *                                                                            *
+ * Purpose: format a cached value for an SQL statement                        *
+ *                                                                            *
+ * Parameters: buffer     - [OUT] the formatted value                         *
+ *             size       - [IN] size of the buffer                           *
+ *             value_type - [IN] type of the value                            *
+ *             value      - [IN] the value                                    *
+ *             is_null    - [IN] 0 - the value is set, otherwise it is NULL   *
+ *                                                                            *
+ ******************************************************************************/
+static void	DClastvalue_sql(char *buffer, size_t size, unsigned char value_type, history_value_t *value, int is_null)
+{
+	if (0 != is_null)
+		zbx_strlcpy(buffer, "NULL", size);
+	else if (ITEM_VALUE_TYPE_FLOAT == value_type)
+		zbx_snprintf(buffer, size, "'" ZBX_FS_DBL "'", value->value_float);
+	else
+		zbx_snprintf(buffer, size, "'" ZBX_FS_UI64 "'", value->value_uint64);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCflush_lastvalues                                               *
+ *                                                                            *
+ * Purpose: write changed last values of items to the database                *
+ *                                                                            *
+ * Parameters: sync_type - [IN] ZBX_SYNC_PARTIAL - only if the flush is due   *
+ *                              and no other syncer is flushing,              *
+ *                              ZBX_SYNC_FULL - unconditionally (shutdown)    *
+ *                                                                            *
+ * Comments: every item changed since the previous flush is written with a    *
+ *           single update, however many values it has received               *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCflush_lastvalues(int sync_type)
+{
+	const char		*__function_name = "DCflush_lastvalues";
+	ZBX_DC_LASTVALUE	*lv, *flush = NULL;
+	zbx_hashset_iter_t	iter;
+	int			i, now, flush_num = 0, sql_offset = 0;
+	char			lastvalue[MAX_STRING_LEN], prevvalue[MAX_STRING_LEN], prevorgvalue[MAX_STRING_LEN];
+
+	if (NULL == lastvalues)
+		return;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	now = (int)time(NULL);
+
+	LOCK_LASTVALUES;
+
+	if (ZBX_SYNC_FULL != sync_type && (0 != lastvalues->flushing ||
+			lastvalues->last_flush + CONFIG_LASTVALUE_FLUSH_FREQUENCY > now))
+	{
+		UNLOCK_LASTVALUES;
+		goto exit;
+	}
+
+	if (ZBX_SYNC_FULL == sync_type)
+		zabbix_log(LOG_LEVEL_WARNING, "Syncing last values of items...");
+
+	lastvalues->flushing = 1;
+	lastvalues->last_flush = now;
+
+	flush = zbx_malloc(flush, (lastvalues->items.num_data + 1) * sizeof(ZBX_DC_LASTVALUE));
+
+	zbx_hashset_iter_reset(&lastvalues->items, &iter);
+
+	while (NULL != (lv = zbx_hashset_iter_next(&iter)))
+	{
+		if (0 != (lv->flags & ZBX_LASTVALUE_DIRTY))
+		{
+			memcpy(&flush[flush_num++], lv, sizeof(ZBX_DC_LASTVALUE));
+			lv->flags &= ~ZBX_LASTVALUE_DIRTY;
+		}
+		else if (lv->lastuse + ZBX_LASTVALUE_EXPIRE < now)
+			zbx_hashset_iter_remove(&iter);
+	}
+
+	UNLOCK_LASTVALUES;
+
+	if (0 != flush_num)
+	{
+		/* rows are locked in the same order as by the history syncers */
+		qsort(flush, flush_num, sizeof(ZBX_DC_LASTVALUE), ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+		DBbegin();
+
+#ifdef HAVE_ORACLE
+		zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 8, "begin\n");
+#endif
+
+		for (i = 0; i < flush_num; i++)
+		{
+			lv = &flush[i];
+
+			DClastvalue_sql(lastvalue, sizeof(lastvalue), lv->value_type, &lv->lastvalue,
+					lv->flags & ZBX_LASTVALUE_NULL);
+			DClastvalue_sql(prevvalue, sizeof(prevvalue), lv->value_type, &lv->prevvalue,
+					lv->flags & ZBX_PREVVALUE_NULL);
+			DClastvalue_sql(prevorgvalue, sizeof(prevorgvalue), lv->value_type, &lv->prevorgvalue,
+					lv->flags & ZBX_PREVORGVALUE_NULL);
+
+			zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 256,
+					"update items set lastclock=%d,lastvalue=%s,prevvalue=%s,prevorgvalue=%s"
+					" where itemid=" ZBX_FS_UI64 ";\n",
+					lv->lastclock, lastvalue, prevvalue, prevorgvalue, lv->itemid);
+
+			DBexecute_overflowed_sql(&sql, &sql_allocated, &sql_offset);
+		}
+
+#ifdef HAVE_ORACLE
+		zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 8, "end;\n");
+#endif
+
+		if (sql_offset > 16) /* In ORACLE always present begin..end; */
+			DBexecute("%s", sql);
+
+		DBcommit();
+	}
+
+	zbx_free(flush);
+
+	LOCK_LASTVALUES;
+	lastvalues->flushing = 0;
+	UNLOCK_LASTVALUES;
+
+	if (ZBX_SYNC_FULL == sync_type)
+		zabbix_log(LOG_LEVEL_WARNING, "Syncing last values of items... done.");
+exit:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() flushed:%d", __function_name, flush_num);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCadd_update_item_sql                                            *
+ *                                                                            *
+ * Purpose: update an item, which is not in the last value cache, directly    *
+ *                                                                            *
+ * Parameters: sql_offset - [IN/OUT] offset in the sql buffer                 *
+ *             h          - [IN] the value                                    *
+ *             value_set  - [IN] 1 - the value replaces lastvalue             *
+ *             prevorg    - [IN] how prevorgvalue changes                     *
+ *             supported  - [IN] 1 - the item became supported                *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCadd_update_item_sql(int *sql_offset, ZBX_DC_HISTORY *h, int value_set, int prevorg, int supported)
+{
+	char	*value_esc;
+
+	zbx_snprintf_alloc(&sql, &sql_allocated, sql_offset, 128, "update items set lastclock=%d", h->clock);
+
+	if (0 != value_set)
+	{
+		switch (h->value_type) {
+		case ITEM_VALUE_TYPE_FLOAT:
+			zbx_snprintf_alloc(&sql, &sql_allocated, sql_offset, 512,
+					",prevvalue=lastvalue,lastvalue='" ZBX_FS_DBL "'",
+					h->value.value_float);
+			break;
+		case ITEM_VALUE_TYPE_UINT64:
+			zbx_snprintf_alloc(&sql, &sql_allocated, sql_offset, 512,
+					",prevvalue=lastvalue,lastvalue='" ZBX_FS_UI64 "'",
+					h->value.value_uint64);
+			break;
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			value_esc = DBdyn_escape_string_len(h->value_orig.value_str, ITEM_LASTVALUE_LEN);
+			zbx_snprintf_alloc(&sql, &sql_allocated, sql_offset, 576,
+					",prevvalue=lastvalue,lastvalue='%s'",
+					value_esc);
+			zbx_free(value_esc);
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			value_esc = DBdyn_escape_string_len(h->value_orig.value_str, ITEM_LASTVALUE_LEN);
+			zbx_snprintf_alloc(&sql, &sql_allocated, sql_offset, 600,
+					",prevvalue=lastvalue,lastvalue='%s',lastlogsize=%d,mtime=%d",
+					value_esc,
+					h->lastlogsize,
+					h->mtime);
+			zbx_free(value_esc);
+			break;
+		}
+	}
+
+	if (ZBX_PREVORGVALUE_RESET == prevorg)
+	{
+		zbx_snprintf_alloc(&sql, &sql_allocated, sql_offset, 20, ",prevorgvalue=NULL");
+	}
+	else if (ZBX_PREVORGVALUE_UPDATE == prevorg)
+	{
+		if (ITEM_VALUE_TYPE_FLOAT == h->value_type)
+			zbx_snprintf_alloc(&sql, &sql_allocated, sql_offset, 512, ",prevorgvalue='" ZBX_FS_DBL "'",
+					h->value_orig.value_float);
+		else
+			zbx_snprintf_alloc(&sql, &sql_allocated, sql_offset, 512, ",prevorgvalue='" ZBX_FS_UI64 "'",
+					h->value_orig.value_uint64);
+	}
+
+	if (0 != supported)
+		zbx_snprintf_alloc(&sql, &sql_allocated, sql_offset, 32, ",status=%d,error=''", ITEM_STATUS_ACTIVE);
+
+	zbx_snprintf_alloc(&sql, &sql_allocated, sql_offset, 128, " where itemid=" ZBX_FS_UI64 ";\n", h->itemid);
+
+	DBexecute_overflowed_sql(&sql, &sql_allocated, sql_offset);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCmass_update_items                                              *
+ *                                                                            *
+ * Purpose: update items info after new value is received                     *
+ *                                                                            *
+ * Parameters: history - array of history data                                *
+ *             history_index - itemid -> index in the history array           *
+ *             itemids - sorted identifiers of the items in the batch         *
+ *                                                                            *
+ * Author: Alexei Vladishev, Eugene Grigorjev, Alexander Vladishev            *
+ *                                                                            *
+ * Comments:                                                                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCmass_update_items(ZBX_DC_HISTORY *history, zbx_hashmap_t *history_index, zbx_vector_uint64_t *itemids)
+{
+	DB_RESULT		result;
+	DB_ROW			row;
+	DB_ITEM			item;
+	char			*message = NULL;
+	int			sql_offset = 0, i, value_set, prevorg, cached, supported;
+	ZBX_DC_HISTORY		*h;
+	ZBX_DC_LASTVALUE	lastvalue;
+	unsigned char		status;
+
+	zabbix_log( LOG_LEVEL_DEBUG, "In DCmass_update_items()");
+
+	if (NULL != lastvalues)
+		DCtouch_lastvalues(itemids);
+
+	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 128,
+			"select itemid,status,lastclock,prevorgvalue,delta,multiplier,formula,history,trends,"
+				"lastvalue,prevvalue"
+			" from items"
+			" where");
+
+	DBadd_condition_alloc(&sql, &sql_allocated, &sql_offset, "itemid", itemids->values, itemids->values_num);
+
+	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 20, " order by itemid");
+
+	result = DBselect("%s", sql);
+
+	sql_offset = 0;
+
+#ifdef HAVE_ORACLE
+	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 8, "begin\n");
+#endif
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		ZBX_STR2UINT64(item.itemid, row[0]);
+
+		if (FAIL == (i = zbx_hashmap_get(history_index, item.itemid)))
+			continue;
+
+		h = &history[i];
+
+		/* numeric items are kept in the last value cache, the values in the row may be outdated */
+		cached = (NULL != lastvalues &&
+				(ITEM_VALUE_TYPE_FLOAT == h->value_type || ITEM_VALUE_TYPE_UINT64 == h->value_type));
+
+		if (0 == cached || SUCCEED != DCget_lastvalue(&lastvalue, item.itemid, h->value_type))
+			DClastvalue_from_row(&lastvalue, item.itemid, h->value_type, row);
+
+		item.status	= atoi(row[1]);
+		item.lastclock	= lastvalue.lastclock;
+		if (0 == (lastvalue.flags & ZBX_PREVORGVALUE_NULL))
+		{
+			item.prevorgvalue_null	= 0;
+			item.prevorgvalue_dbl	= lastvalue.prevorgvalue.value_float;
+			item.prevorgvalue_uint64	= lastvalue.prevorgvalue.value_uint64;
+		}
+		else
+			item.prevorgvalue_null = 1;
+		item.delta	= atoi(row[4]);
+		item.multiplier	= atoi(row[5]);
+		item.formula	= row[6];
+		item.history	= atoi(row[7]);
+		item.trends	= atoi(row[8]);
+
+		if (0 != (zbx_process & ZBX_PROCESS_PROXY))
 		{
 			item.delta = ITEM_STORE_AS_IS;
 			h->keep_history = 1;
@@ -1098,9 +1995,8 @@ static void	DCmass_update_items(ZBX_DC_HISTORY *history, int history_num)
 		}
 
 		status = ITEM_STATUS_ACTIVE;
-
-		zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 128, "update items set lastclock=%d",
-				h->clock);
+		value_set = 0;
+		prevorg = ZBX_PREVORGVALUE_KEEP;
 
 		switch (h->value_type) {
 		case ITEM_VALUE_TYPE_FLOAT:
@@ -1110,9 +2006,8 @@ static void	DCmass_update_items(ZBX_DC_HISTORY *history, int history_num)
 
 				if (SUCCEED == DBchk_double(h->value.value_float))
 				{
-					zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-							",prevvalue=lastvalue,prevorgvalue=NULL,lastvalue='" ZBX_FS_DBL "'",
-							h->value.value_float);
+					value_set = 1;
+					prevorg = ZBX_PREVORGVALUE_RESET;
 				}
 				else
 				{
@@ -1121,66 +2016,42 @@ static void	DCmass_update_items(ZBX_DC_HISTORY *history, int history_num)
 				}
 				break;
 			case ITEM_STORE_SPEED_PER_SECOND:
+				prevorg = ZBX_PREVORGVALUE_UPDATE;
+
 				if (item.prevorgvalue_null == 0 && item.prevorgvalue_dbl <= h->value_orig.value_float && item.lastclock < h->clock)
 				{
 					h->value.value_float = (h->value_orig.value_float - item.prevorgvalue_dbl) / (h->clock - item.lastclock);
 					h->value.value_float = DBmultiply_value_float(&item, h->value.value_float);
 
 					if (SUCCEED == DBchk_double(h->value.value_float))
-					{
-						zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-								",prevvalue=lastvalue,prevorgvalue='" ZBX_FS_DBL "'"
-								",lastvalue='" ZBX_FS_DBL "'",
-								h->value_orig.value_float,
-								h->value.value_float);
-					}
+						value_set = 1;
 					else
 					{
-						zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-								",prevorgvalue='" ZBX_FS_DBL "'",
-								h->value_orig.value_float);
 						status = ITEM_STATUS_NOTSUPPORTED;
 						h->value_null = 1;
 					}
 				}
 				else
-				{
-					zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-							",prevorgvalue='" ZBX_FS_DBL "'",
-							h->value_orig.value_float);
 					h->value_null = 1;
-				}
 				break;
 			case ITEM_STORE_SIMPLE_CHANGE:
+				prevorg = ZBX_PREVORGVALUE_UPDATE;
+
 				if (item.prevorgvalue_null == 0 && item.prevorgvalue_dbl <= h->value_orig.value_float)
 				{
 					h->value.value_float = h->value_orig.value_float - item.prevorgvalue_dbl;
 					h->value.value_float = DBmultiply_value_float(&item, h->value.value_float);
 
 					if (SUCCEED == DBchk_double(h->value.value_float))
-					{
-						zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-								",prevvalue=lastvalue,prevorgvalue='" ZBX_FS_DBL "'"
-								",lastvalue='" ZBX_FS_DBL "'",
-								h->value_orig.value_float,
-								h->value.value_float);
-					}
+						value_set = 1;
 					else
 					{
-						zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-								",prevorgvalue='" ZBX_FS_DBL "'",
-								h->value_orig.value_float);
 						status = ITEM_STATUS_NOTSUPPORTED;
 						h->value_null = 1;
 					}
 				}
 				else
-				{
-					zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-							",prevorgvalue='" ZBX_FS_DBL "'",
-							h->value_orig.value_float);
 					h->value_null = 1;
-				}
 				break;
 			}
 
@@ -1210,83 +2081,84 @@ static void	DCmass_update_items(ZBX_DC_HISTORY *history, int history_num)
 			switch (item.delta) {
 			case ITEM_STORE_AS_IS:
 				h->value.value_uint64 = DBmultiply_value_uint64(&item, h->value_orig.value_uint64);
-				zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-						",prevvalue=lastvalue,prevorgvalue=NULL,lastvalue='" ZBX_FS_UI64 "'",
-						h->value.value_uint64);
+				value_set = 1;
+				prevorg = ZBX_PREVORGVALUE_RESET;
 				break;
 			case ITEM_STORE_SPEED_PER_SECOND:
+				prevorg = ZBX_PREVORGVALUE_UPDATE;
+
 				if (item.prevorgvalue_null == 0 && item.prevorgvalue_uint64 <= h->value_orig.value_uint64 && item.lastclock < h->clock)
 				{
 					h->value.value_uint64 = (h->value_orig.value_uint64 - item.prevorgvalue_uint64) / (h->clock - item.lastclock);
 					h->value.value_uint64 = DBmultiply_value_uint64(&item, h->value.value_uint64);
-					zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-							",prevvalue=lastvalue,prevorgvalue='" ZBX_FS_UI64 "'"
-							",lastvalue='" ZBX_FS_UI64 "'",
-							h->value_orig.value_uint64,
-							h->value.value_uint64);
+					value_set = 1;
 				}
 				else
-				{
-					zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-							",prevorgvalue='" ZBX_FS_UI64 "'",
-							h->value_orig.value_uint64);
 					h->value_null = 1;
-				}
 				break;
 			case ITEM_STORE_SIMPLE_CHANGE:
+				prevorg = ZBX_PREVORGVALUE_UPDATE;
+
 				if (item.prevorgvalue_null == 0 && item.prevorgvalue_uint64 <= h->value_orig.value_uint64)
 				{
 					h->value.value_uint64 = h->value_orig.value_uint64 - item.prevorgvalue_uint64;
 					h->value.value_uint64 = DBmultiply_value_uint64(&item, h->value.value_uint64);
-					zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-							",prevvalue=lastvalue,prevorgvalue='" ZBX_FS_UI64 "'"
-							",lastvalue='" ZBX_FS_UI64 "'",
-							h->value_orig.value_uint64,
-							h->value.value_uint64);
+					value_set = 1;
 				}
 				else
-				{
-					zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 512,
-							",prevorgvalue='" ZBX_FS_UI64 "'",
-							h->value_orig.value_uint64);
 					h->value_null = 1;
-				}
 				break;
 			}
 			break;
 		case ITEM_VALUE_TYPE_STR:
 		case ITEM_VALUE_TYPE_TEXT:
-			value_esc = DBdyn_escape_string_len(h->value_orig.value_str, ITEM_LASTVALUE_LEN);
-			zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 576,
-					",prevvalue=lastvalue,lastvalue='%s'",
-					value_esc);
-			zbx_free(value_esc);
-			break;
 		case ITEM_VALUE_TYPE_LOG:
-			value_esc = DBdyn_escape_string_len(h->value_orig.value_str, ITEM_LASTVALUE_LEN);
-			zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 600,
-					",prevvalue=lastvalue,lastvalue='%s',lastlogsize=%d,mtime=%d",
-					value_esc,
-					h->lastlogsize,
-					h->mtime);
-			zbx_free(value_esc);
+			value_set = 1;
 			break;
 		}
 
 		/* Update item status if required */
-		if (item.status == ITEM_STATUS_NOTSUPPORTED && status == ITEM_STATUS_ACTIVE)
-		{
+		if (0 != (supported = (item.status == ITEM_STATUS_NOTSUPPORTED && status == ITEM_STATUS_ACTIVE)))
 			zabbix_log(LOG_LEVEL_WARNING, "Item [%s] became supported", zbx_host_key_string(item.itemid));
 
-			item.status = ITEM_STATUS_ACTIVE;
-			zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 32, ",status=%d,error=''",
-					item.status);
+		if (0 != cached)
+		{
+			lastvalue.lastclock = h->clock;
+
+			if (0 != value_set)
+			{
+				lastvalue.prevvalue = lastvalue.lastvalue;
+
+				if (0 != (lastvalue.flags & ZBX_LASTVALUE_NULL))
+					lastvalue.flags |= ZBX_PREVVALUE_NULL;
+				else
+					lastvalue.flags &= ~ZBX_PREVVALUE_NULL;
+
+				lastvalue.lastvalue = h->value;
+				lastvalue.flags &= ~ZBX_LASTVALUE_NULL;
+			}
+
+			if (ZBX_PREVORGVALUE_RESET == prevorg)
+				lastvalue.flags |= ZBX_PREVORGVALUE_NULL;
+			else if (ZBX_PREVORGVALUE_UPDATE == prevorg)
+			{
+				lastvalue.prevorgvalue = h->value_orig;
+				lastvalue.flags &= ~ZBX_PREVORGVALUE_NULL;
+			}
+
+			cached = (SUCCEED == DCput_lastvalue(&lastvalue));
 		}
 
-		zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 128, " where itemid=" ZBX_FS_UI64 ";\n",
-				item.itemid);
+		if (0 == cached)
+			DCadd_update_item_sql(&sql_offset, h, value_set, prevorg, supported);
+		else if (0 != supported)
+		{
+			zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 128,
+					"update items set status=%d,error='' where itemid=" ZBX_FS_UI64 ";\n",
+					ITEM_STATUS_ACTIVE, item.itemid);
 
-		DBexecute_overflowed_sql(&sql, &sql_allocated, &sql_offset);
+			DBexecute_overflowed_sql(&sql, &sql_allocated, &sql_offset);
+		}
 	}
 	DBfree_result(result);
 
@@ -1306,58 +2178,55 @@ static void	DCmass_update_items(ZBX_DC_HISTORY *history, int history_num)
  *                                                                            *
  * Parameters: history - array of history data                                *
  *             history_num - number of history structures                     *
+ *             history_index - itemid -> index of the first item value in the *
+ *                             history array                                  *
  *                                                                            *
  * Author: Alexei Vladishev, Eugene Grigorjev, Alexander Vladishev            *
  *                                                                            *
  * Comments:                                                                  *
  *                                                                            *
  ******************************************************************************/
-static void	DCmass_proxy_update_items(ZBX_DC_HISTORY *history, int history_num)
+static void	DCmass_proxy_update_items(ZBX_DC_HISTORY *history, int history_num, zbx_hashmap_t *history_index)
 {
 	int		sql_offset = 0, i, j;
-	zbx_uint64_t	*ids = NULL;
-	int		ids_alloc, ids_num = 0;
-	int		lastlogsize, mtime;
+	int		*lastlogsize = NULL, *mtime = NULL;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In DCmass_proxy_update_items()");
 
-	ids_alloc = history_num;
-	ids = zbx_malloc(ids, ids_alloc * sizeof(zbx_uint64_t));
+	/* the latest log position of an item is collected at the index of its first value */
+	lastlogsize = zbx_malloc(lastlogsize, history_num * sizeof(int));
+	mtime = zbx_malloc(mtime, history_num * sizeof(int));
 
 	for (i = 0; i < history_num; i++)
-		if (history[i].value_type == ITEM_VALUE_TYPE_LOG)
-			uint64_array_add(&ids, &ids_alloc, &ids_num, history[i].itemid, 64);
-
-#ifdef HAVE_ORACLE
-	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 8, "begin\n");
-#endif
+		lastlogsize[i] = mtime[i] = -1;
 
-	for (i = 0; i < ids_num; i++)
+	for (i = 0; i < history_num; i++)
 	{
-		lastlogsize = mtime = -1;
+		if (history[i].value_type != ITEM_VALUE_TYPE_LOG)
+			continue;
 
-		for (j = 0; j < history_num; j++)
-		{
-			if (history[j].itemid != ids[i])
-				continue;
+		j = zbx_hashmap_get(history_index, history[i].itemid);
 
-			if (history[j].value_type != ITEM_VALUE_TYPE_LOG)
-				continue;
+		if (lastlogsize[j] < history[i].lastlogsize)
+			lastlogsize[j] = history[i].lastlogsize;
+		if (mtime[j] < history[i].mtime)
+			mtime[j] = history[i].mtime;
+	}
 
-			if (lastlogsize < history[j].lastlogsize)
-				lastlogsize = history[j].lastlogsize;
-			if (mtime < history[j].mtime)
-				mtime = history[j].mtime;
-		}
+#ifdef HAVE_ORACLE
+	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 8, "begin\n");
+#endif
 
-		if (-1 == lastlogsize || -1 == mtime)
+	for (i = 0; i < history_num; i++)
+	{
+		if (-1 == lastlogsize[i] || -1 == mtime[i])
 			continue;
 
 		zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 128,
 				"update items set lastlogsize=%d, mtime=%d where itemid=" ZBX_FS_UI64 ";\n",
-				lastlogsize,
-				mtime,
-				ids[i]);
+				lastlogsize[i],
+				mtime[i],
+				history[i].itemid);
 
 		DBexecute_overflowed_sql(&sql, &sql_allocated, &sql_offset);
 	}
@@ -1366,19 +2235,475 @@ static void	DCmass_proxy_update_items(ZBX_DC_HISTORY *history, int history_num)
 	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 8, "end;\n");
 #endif
 
-	zbx_free(ids);
+	zbx_free(mtime);
+	zbx_free(lastlogsize);
 
 	if (sql_offset > 16) /* In ORACLE always present begin..end; */
 		DBexecute("%s", sql);
 }
 
+#ifdef HAVE_BULK_INSERT
 /******************************************************************************
  *                                                                            *
- * Function: DCmass_add_history                                               *
+ * Function: DCbulk_add_history                                               *
  *                                                                            *
- * Purpose: inserting new history data after new value is received            *
+ * Purpose: insert numeric history values using the bulk insert path of the   *
+ *          database instead of SQL text                                      *
  *                                                                            *
- * Parameters: history - array of history data                                *
+ * Parameters: history     - array of history data                            *
+ *             history_num - number of history structures                     *
+ *             value_type  - ITEM_VALUE_TYPE_FLOAT or ITEM_VALUE_TYPE_UINT64  *
+ *             table_name  - history table                                    *
+ *             sync        - 1 if the table has nodeid column (history_sync)  *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCbulk_add_history(ZBX_DC_HISTORY *history, int history_num, unsigned char value_type,
+		const char *table_name, int sync)
+{
+	const char	*fields[] = {"nodeid", "itemid", "clock", "value"};
+	unsigned char	types[] = {ZBX_DB_TYPE_INT, ZBX_DB_TYPE_UINT64, ZBX_DB_TYPE_INT, ZBX_DB_TYPE_UINT64};
+	zbx_db_value_t	*values, *value;
+	int		i, rows_num = 0, first = (0 != sync ? 0 : 1);
+
+	if (ITEM_VALUE_TYPE_FLOAT == value_type)
+		types[3] = ZBX_DB_TYPE_FLOAT;
+
+	value = values = zbx_malloc(NULL, history_num * 4 * sizeof(zbx_db_value_t));
+
+	for (i = 0; i < history_num; i++)
+	{
+		if (0 == history[i].keep_history)
+			continue;
+
+		if (history[i].value_type != value_type)
+			continue;
+
+		if (0 != history[i].value_null)
+			continue;
+
+		if (0 != sync)
+			value++->i = get_nodeid_by_id(history[i].itemid);
+
+		value++->ui64 = history[i].itemid;
+		value++->i = history[i].clock;
+
+		if (ITEM_VALUE_TYPE_FLOAT == value_type)
+			value++->dbl = history[i].value.value_float;
+		else
+			value++->ui64 = history[i].value.value_uint64;
+
+		rows_num++;
+	}
+
+	if (0 != rows_num)
+		DBbulk_insert(table_name, fields + first, types + first, 4 - first, values, rows_num);
+
+	zbx_free(values);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCmass_add_history_numeric                                       *
+ *                                                                            *
+ * Purpose: insert float and unsigned history values                          *
+ *                                                                            *
+ * Parameters: history     - array of history data                            *
+ *             history_num - number of history structures                     *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCmass_add_history_numeric(ZBX_DC_HISTORY *history, int history_num)
+{
+	DCbulk_add_history(history, history_num, ITEM_VALUE_TYPE_FLOAT, "history", 0);
+	DCbulk_add_history(history, history_num, ITEM_VALUE_TYPE_UINT64, "history_uint", 0);
+
+	if (CONFIG_NODE_NOHISTORY == 0 && CONFIG_MASTER_NODEID > 0)
+	{
+		DCbulk_add_history(history, history_num, ITEM_VALUE_TYPE_FLOAT, "history_sync", 1);
+		DCbulk_add_history(history, history_num, ITEM_VALUE_TYPE_UINT64, "history_uint_sync", 1);
+	}
+}
+#endif	/* HAVE_BULK_INSERT */
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCqueue_history                                                  *
+ *                                                                            *
+ * Purpose: hand numeric history values of the batch over to DB writers       *
+ *                                                                            *
+ * Parameters: history     - array of history data                            *
+ *             history_num - number of history structures                     *
+ *                                                                            *
+ * Return value: SUCCEED - the values are queued or there are none            *
+ *               FAIL - DB writers are not running or all slots are taken,    *
+ *                      the caller must insert the values itself              *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCqueue_history(ZBX_DC_HISTORY *history, int history_num)
+{
+	ZBX_DC_WRITE_SLOT	*slot = NULL;
+	ZBX_DC_WRITE_ROW	*row;
+	int			i, ret = FAIL;
+
+	if (NULL == write_queue)
+		return FAIL;
+
+	LOCK_WRITE_QUEUE;
+
+	if (0 != write_queue->stopped)
+		goto unlock;
+
+	for (i = 0; i < write_queue->slots_num; i++)
+	{
+		if (ZBX_WRITE_SLOT_FREE == write_queue->slots[i].state)
+		{
+			slot = &write_queue->slots[i];
+			break;
+		}
+	}
+
+	if (NULL == slot)
+		goto unlock;
+
+	slot->rows_num = 0;
+
+	for (i = 0; i < history_num; i++)
+	{
+		if (0 == history[i].keep_history)
+			continue;
+
+		if (history[i].value_type != ITEM_VALUE_TYPE_FLOAT && history[i].value_type != ITEM_VALUE_TYPE_UINT64)
+			continue;
+
+		if (0 != history[i].value_null)
+			continue;
+
+		row = &slot->rows[slot->rows_num++];
+		row->itemid = history[i].itemid;
+		row->value = history[i].value;
+		row->clock = history[i].clock;
+		row->value_type = history[i].value_type;
+	}
+
+	if (0 != slot->rows_num)
+	{
+		/* zero is the sequence number of a slot never written */
+		if (0 == (slot->seq = write_queue->seq++))
+			slot->seq = write_queue->seq++;
+
+		slot->state = ZBX_WRITE_SLOT_READY;
+		slot->orphaned = 0;
+	}
+
+	ret = SUCCEED;
+unlock:
+	UNLOCK_WRITE_QUEUE;
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCwrite_slot                                                     *
+ *                                                                            *
+ * Purpose: insert history values of a write queue slot in one transaction    *
+ *                                                                            *
+ * Parameters: slot - [IN] slot owned by the caller                           *
+ *                                                                            *
+ * Return value: SUCCEED - the values are in the database                     *
+ *               FAIL - the transaction was lost, the slot must be written    *
+ *                      again                                                 *
+ *                                                                            *
+ * Comments: the sequence number of the slot is recorded in the same          *
+ *           transaction, so that a slot orphaned by a dead writer is not     *
+ *           inserted twice if the writer managed to commit it; the row of    *
+ *           the slot is created by DCprepare_write_queue()                   *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCwrite_slot(ZBX_DC_WRITE_SLOT *slot)
+{
+	static ZBX_DC_HISTORY	*history = NULL;
+	int			i, ret = SUCCEED;
+#ifdef HAVE_BULK_INSERT
+	DB_RESULT		result;
+	DB_ROW			row;
+	zbx_uint64_t		seq;
+	int			slotid, committed = 0;
+#endif
+
+	if (NULL == history)
+		history = zbx_malloc(history, ZBX_SYNC_MAX * sizeof(ZBX_DC_HISTORY));
+
+	memset(history, 0, slot->rows_num * sizeof(ZBX_DC_HISTORY));
+
+	for (i = 0; i < slot->rows_num; i++)
+	{
+		history[i].itemid = slot->rows[i].itemid;
+		history[i].value = slot->rows[i].value;
+		history[i].clock = slot->rows[i].clock;
+		history[i].value_type = slot->rows[i].value_type;
+		history[i].keep_history = 1;
+	}
+
+	/* DB writers are started only with the bulk insert path, see init_config() of the server */
+#ifdef HAVE_BULK_INSERT
+	slotid = (int)(slot - write_queue->slots);
+
+	DBbegin();
+
+	if (0 != slot->orphaned)
+	{
+		result = DBselect("select seq from write_queue where slotid=%d", slotid);
+
+		if (NULL != (row = DBfetch(result)))
+		{
+			ZBX_STR2UINT64(seq, row[0]);
+			committed = ((unsigned int)seq == slot->seq);
+		}
+		DBfree_result(result);
+
+		zabbix_log(LOG_LEVEL_WARNING, "slot %d of the DB writer queue was left by a dead writer,"
+				" its %d values are %s", slotid, slot->rows_num,
+				0 != committed ? "already inserted" : "inserted again");
+	}
+
+	if (0 == committed)
+	{
+		DCmass_add_history_numeric(history, slot->rows_num);
+
+		DBexecute("update write_queue set seq=%u where slotid=%d", slot->seq, slotid);
+	}
+
+	ret = DBcommit();
+#endif
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCprepare_write_queue                                            *
+ *                                                                            *
+ * Purpose: create a row of table write_queue for every slot of the queue     *
+ *                                                                            *
+ * Comments: called by the main process before DB writers are started, so    *
+ *           that writers only update the sequence number of their slot      *
+ *                                                                            *
+ ******************************************************************************/
+void	DCprepare_write_queue()
+{
+	int	i;
+
+	if (NULL == write_queue)
+		return;
+
+	DBbegin();
+
+	DBexecute("delete from write_queue");
+
+	for (i = 0; i < write_queue->slots_num; i++)
+		DBexecute("insert into write_queue (slotid,seq) values (%d,0)", i);
+
+	DBcommit();
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCstart_write_queue                                              *
+ *                                                                            *
+ * Purpose: let history syncers hand batches over to DB writers               *
+ *                                                                            *
+ * Comments: called by DB writers once they are connected to the database.    *
+ *           Until then syncers, and the history journal replay in the main   *
+ *           process, insert history themselves.                              *
+ *                                                                            *
+ ******************************************************************************/
+void	DCstart_write_queue()
+{
+	if (NULL == write_queue)
+		return;
+
+	LOCK_WRITE_QUEUE;
+	write_queue->stopped = 0;
+	UNLOCK_WRITE_QUEUE;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCwrite_history                                                  *
+ *                                                                            *
+ * Purpose: insert the oldest batch of history values queued by syncers       *
+ *                                                                            *
+ * Return value: number of inserted values                                    *
+ *                                                                            *
+ * Comments: called by DB writers. A batch whose transaction was lost is      *
+ *           put back to the queue.                                           *
+ *                                                                            *
+ ******************************************************************************/
+int	DCwrite_history()
+{
+	const char		*__function_name = "DCwrite_history";
+	ZBX_DC_WRITE_SLOT	*slot = NULL;
+	int			i, num = 0;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	if (NULL == write_queue)
+		goto out;
+
+	LOCK_WRITE_QUEUE;
+
+	for (i = 0; i < write_queue->slots_num; i++)
+	{
+		if (ZBX_WRITE_SLOT_READY != write_queue->slots[i].state)
+			continue;
+
+		if (NULL == slot || 0 > (int)(write_queue->slots[i].seq - slot->seq))
+			slot = &write_queue->slots[i];
+	}
+
+	if (NULL != slot)
+	{
+		slot->state = ZBX_WRITE_SLOT_WRITING;
+		slot->writer = getpid();
+	}
+
+	UNLOCK_WRITE_QUEUE;
+
+	if (NULL == slot)
+		goto out;
+
+	if (SUCCEED == DCwrite_slot(slot))
+		num = slot->rows_num;
+
+	LOCK_WRITE_QUEUE;
+	slot->state = (0 != num ? ZBX_WRITE_SLOT_FREE : ZBX_WRITE_SLOT_READY);
+	UNLOCK_WRITE_QUEUE;
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __function_name, num);
+
+	return num;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCwait_queued_history                                            *
+ *                                                                            *
+ * Purpose: wait until the queued history values of the items are inserted   *
+ *                                                                            *
+ * Parameters: itemids     - [IN] sorted item ids                             *
+ *             itemids_num - [IN] number of the item ids                      *
+ *                                                                            *
+ * Comments: called before reading the item history from the database.        *
+ *           A slot left by a dead writer is put back to the queue. The wait  *
+ *           does not give up, so that the history is never read without the  *
+ *           queued values, a warning is logged every ZBX_WRITE_QUEUE_WARNING *
+ *           seconds instead.                                                 *
+ *                                                                            *
+ ******************************************************************************/
+void	DCwait_queued_history(zbx_uint64_t *itemids, int itemids_num)
+{
+	ZBX_DC_WRITE_SLOT	*slot;
+	zbx_uint64_t		itemid = 0;
+	int			i, j, queued;
+	time_t			start, warned;
+
+	if (NULL == write_queue || 0 == itemids_num)
+		return;
+
+	start = warned = time(NULL);
+
+	do
+	{
+		queued = 0;
+
+		LOCK_WRITE_QUEUE;
+
+		for (i = 0; 0 == write_queue->stopped && 0 == queued && i < write_queue->slots_num; i++)
+		{
+			slot = &write_queue->slots[i];
+
+			if (ZBX_WRITE_SLOT_FREE == slot->state)
+				continue;
+
+			for (j = 0; j < slot->rows_num; j++)
+			{
+				if (SUCCEED == uint64_array_exists(itemids, itemids_num, slot->rows[j].itemid))
+				{
+					itemid = slot->rows[j].itemid;
+					queued = 1;
+					break;
+				}
+			}
+
+			if (0 != queued && ZBX_WRITE_SLOT_WRITING == slot->state &&
+					-1 == kill(slot->writer, 0) && ESRCH == errno)
+			{
+				slot->state = ZBX_WRITE_SLOT_READY;
+				slot->orphaned = 1;
+			}
+		}
+
+		UNLOCK_WRITE_QUEUE;
+
+		if (0 != queued)
+		{
+			if (ZBX_WRITE_QUEUE_WARNING <= time(NULL) - warned)
+			{
+				zabbix_log(LOG_LEVEL_WARNING, "history of item [" ZBX_FS_UI64 "] is still queued for"
+						" DB writers after %d seconds", itemid, (int)(time(NULL) - start));
+				warned = time(NULL);
+			}
+
+			usleep(ZBX_WRITE_QUEUE_WAIT);
+		}
+	}
+	while (0 != queued);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCflush_write_queue                                              *
+ *                                                                            *
+ * Purpose: insert the values left in the write queue by DB writers on exit   *
+ *                                                                            *
+ * Comments: a slot being written when its writer was terminated is only      *
+ *           inserted if the writer did not manage to commit it               *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCflush_write_queue()
+{
+	ZBX_DC_WRITE_SLOT	*slot;
+	int			i;
+
+	if (NULL == write_queue)
+		return;
+
+	LOCK_WRITE_QUEUE;
+	write_queue->stopped = 1;
+	UNLOCK_WRITE_QUEUE;
+
+	for (i = 0; i < write_queue->slots_num; i++)
+	{
+		slot = &write_queue->slots[i];
+
+		if (ZBX_WRITE_SLOT_FREE == slot->state)
+			continue;
+
+		if (ZBX_WRITE_SLOT_WRITING == slot->state)
+			slot->orphaned = 1;
+
+		DCwrite_slot(slot);
+		slot->state = ZBX_WRITE_SLOT_FREE;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCmass_add_history                                               *
+ *                                                                            *
+ * Purpose: inserting new history data after new value is received            *
+ *                                                                            *
+ * Parameters: history - array of history data                                *
  *             history_num - number of history structures                     *
  *                                                                            *
  * Author: Alexander Vladishev                                                *
@@ -1402,6 +2727,10 @@ static void	DCmass_add_history(ZBX_DC_HISTORY *history, int history_num)
 	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 8, "begin\n");
 #endif
 
+#ifdef HAVE_BULK_INSERT
+	if (SUCCEED != DCqueue_history(history, history_num))
+		DCmass_add_history_numeric(history, history_num);
+#else
 /*
  * history
  */
@@ -1589,6 +2918,7 @@ static void	DCmass_add_history(ZBX_DC_HISTORY *history, int history_num)
 			sql_offset = tmp_offset;
 #endif
 	}
+#endif	/* HAVE_BULK_INSERT */
 
 /*
  * history_str
@@ -2074,138 +3404,314 @@ static void	DCmass_proxy_add_history(ZBX_DC_HISTORY *history, int history_num)
 
 /******************************************************************************
  *                                                                            *
- * Function: DCsync                                                           *
- *                                                                            *
- * Purpose: writes updates and new data from pool to database                 *
- *                                                                            *
- * Parameters:                                                                *
+ * Function: DCmass_add_valuecache                                            *
  *                                                                            *
- * Return value: number of synced values                                      *
+ * Purpose: pass new numeric values to the value cache                        *
  *                                                                            *
- * Author: Alexei Vladishev                                                   *
+ * Parameters: history     - [IN] array of history data                       *
+ *             history_num - [IN] number of history structures                *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: must be called after the values are inserted into history       *
+ *           tables and before triggers are evaluated                         *
  *                                                                            *
  ******************************************************************************/
-int	DCsync_history(int sync_type)
+static void	DCmass_add_valuecache(ZBX_DC_HISTORY *history, int history_num)
 {
-	static ZBX_DC_HISTORY	*history = NULL;
-	int			i, j, history_num, n, f;
-	int			syncs;
-	int			total_num = 0;
-	int			skipped_clock, max_delay;
-	time_t			now = 0;
+	static zbx_vc_item_value_t	*values = NULL;
+	static int			values_alloc = 0;
+	int				i, values_num = 0;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "In DCsync_history(history_first:%d history_num:%d)",
-			cache->history_first,
-			cache->history_num);
+	for (i = 0; i < history_num; i++)
+	{
+		if (0 == history[i].keep_history || 0 != history[i].value_null)
+			continue;
 
-	/* disable processing of the zabbix_syslog() calls */
-	CONFIG_ENABLE_LOG = 0;
+		if (ITEM_VALUE_TYPE_FLOAT != history[i].value_type && ITEM_VALUE_TYPE_UINT64 != history[i].value_type)
+			continue;
 
-	if (ZBX_SYNC_FULL == sync_type)
-	{
-		zabbix_log(LOG_LEVEL_WARNING, "Syncing history data...");
+		if (values_num == values_alloc)
+		{
+			values_alloc = MAX(values_alloc * 3 / 2, 64);
+			values = zbx_realloc(values, values_alloc * sizeof(zbx_vc_item_value_t));
+		}
+
+		values[values_num].itemid = history[i].itemid;
+		values[values_num].clock = history[i].clock;
+		values[values_num].value = history[i].value;
+		values[values_num].value_type = history[i].value_type;
+		values_num++;
+	}
+
+	zbx_vc_add_values(values, values_num);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCadd_sync_itemids                                               *
+ *                                                                            *
+ * Purpose: mark items of a batch as being synced                             *
+ *                                                                            *
+ * Parameters: shard   - [IN] history cache shard                             *
+ *             itemids - [IN] sorted identifiers of the items in the batch    *
+ *                                                                            *
+ * Comments: the batch is merged from the end, so that every identifier is    *
+ *           moved only once                                                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCadd_sync_itemids(ZBX_DC_SHARD *shard, zbx_vector_uint64_t *itemids)
+{
+	int	i, j, k;
+
+	assert(shard->itemids_num + itemids->values_num <= shard->itemids_alloc);
+
+	i = shard->itemids_num - 1;
+	j = itemids->values_num - 1;
+	k = shard->itemids_num + itemids->values_num - 1;
+
+	shard->itemids_num += itemids->values_num;
+
+	while (0 <= j)
+	{
+		if (0 <= i && shard->itemids[i] > itemids->values[j])
+			shard->itemids[k--] = shard->itemids[i--];
+		else
+			shard->itemids[k--] = itemids->values[j--];
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCremove_sync_itemids                                            *
+ *                                                                            *
+ * Purpose: unmark items of a synced batch                                    *
+ *                                                                            *
+ * Parameters: shard   - [IN] history cache shard                             *
+ *             itemids - [IN] sorted identifiers of the items in the batch    *
+ *                                                                            *
+ * Comments:                                                                  *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCremove_sync_itemids(ZBX_DC_SHARD *shard, zbx_vector_uint64_t *itemids)
+{
+	int	i, j = 0, k = 0;
+
+	for (i = 0; i < shard->itemids_num; i++)
+	{
+		while (j < itemids->values_num && itemids->values[j] < shard->itemids[i])
+			j++;
+
+		if (j < itemids->values_num && itemids->values[j] == shard->itemids[i])
+			continue;
+
+		shard->itemids[k++] = shard->itemids[i];
+	}
+
+	shard->itemids_num = k;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCsync_shard                                                     *
+ *                                                                            *
+ * Purpose: writes updates and new data from one shard of the history cache   *
+ *          to database                                                       *
+ *                                                                            *
+ * Parameters: shard     - [IN] history cache shard                           *
+ *             sync_type - [IN] ZBX_SYNC_PARTIAL or ZBX_SYNC_FULL             *
+ *             home      - [IN] 0 - the shard belongs to another syncer, it   *
+ *                              is only helped with when it has a backlog     *
+ *                                                                            *
+ * Return value: number of synced values                                      *
+ *                                                                            *
+ * Comments:                                                                  *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCsync_shard(ZBX_DC_SHARD *shard, int sync_type, int home)
+{
+	static ZBX_DC_HISTORY	*history = NULL;
+	static zbx_hashmap_t	history_index;
+	static zbx_vector_uint64_t	itemids;
+	int			i, j, history_num, n, f, index;
+	zbx_uint64_t		itemid;
+	int			syncs, text_in_sync, text_num;
+	int			total_num = 0;
+	int			skipped_clock, max_delay;
+	time_t			now = 0;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In DCsync_shard(shard:%d history_first:%d history_num:%d)",
+			shard->num,
+			shard->history_first,
+			shard->history_num);
+
+	if (ZBX_SYNC_FULL == sync_type)
+	{
 		now = time(NULL);
-		cache->itemids_num = 0;
+		shard->itemids_num = 0;
 	}
 
-	if (0 == cache->history_num)
+	if (0 == shard->history_num || (0 == home && ZBX_SYNC_MAX > shard->history_num))
 		goto finish;
 
 	if (NULL == history)
+	{
 		history = zbx_malloc(history, ZBX_SYNC_MAX * sizeof(ZBX_DC_HISTORY));
+		zbx_hashmap_create(&history_index, ZBX_SYNC_MAX);
+		zbx_vector_uint64_create(&itemids);
+		zbx_vector_uint64_reserve(&itemids, ZBX_SYNC_MAX);
+	}
 
-	syncs = cache->history_num / ZBX_SYNC_MAX;
+	syncs = shard->history_num / ZBX_SYNC_MAX;
 	max_delay = (int)time(NULL) - CONFIG_HISTSYNCER_FREQUENCY;
 
+	/* one batch is enough to help with a foreign shard */
+	if (0 == home)
+		syncs = 1;
+
 	do
 	{
-		LOCK_CACHE;
+		/* refill the cache from the journal as it drains */
+		if (0 != total_num)
+			DCjournal_replay();
+
+		LOCK_SHARD(shard);
 
 		history_num = 0;
-		n = cache->history_num;
-		f = cache->history_first;
+		text_num = 0;
+		n = shard->history_num;
+		f = shard->history_first;
 		skipped_clock = 0;
 
+		zbx_hashmap_clear(&history_index);
+		zbx_vector_uint64_clear(&itemids);
+
+		/* string values are read in place unless a writer is waiting for the text buffer to be vacuumed */
+		text_in_sync = (0 == shard->text_vacuum);
+
 		while (n > 0 && history_num < ZBX_SYNC_MAX)
 		{
-			if (0 != (zbx_process & ZBX_PROCESS_PROXY) ||
-					FAIL == uint64_array_exists(cache->itemids, cache->itemids_num, cache->history[f].itemid))
+			itemid = shard->history[f].itemid;
+			index = zbx_hashmap_get(&history_index, itemid);
+
+			/* the server takes one value per item, the next one may depend on it */
+			if (0 != (zbx_process & ZBX_PROCESS_PROXY) || (FAIL == index &&
+					FAIL == uint64_array_exists(shard->itemids, shard->itemids_num, itemid)))
 			{
-				uint64_array_add(&cache->itemids, &cache->itemids_alloc,
-						&cache->itemids_num, cache->history[f].itemid, 0);
+				if (FAIL == index)
+				{
+					zbx_hashmap_set(&history_index, itemid, history_num);
+					zbx_vector_uint64_append(&itemids, itemid);
+				}
 
-				memcpy(&history[history_num], &cache->history[f], sizeof(ZBX_DC_HISTORY));
+				memcpy(&history[history_num], &shard->history[f], sizeof(ZBX_DC_HISTORY));
 				if (history[history_num].value_type == ITEM_VALUE_TYPE_STR
 						|| history[history_num].value_type == ITEM_VALUE_TYPE_TEXT
 						|| history[history_num].value_type == ITEM_VALUE_TYPE_LOG)
 				{
-					history[history_num].value_orig.value_str = strdup(cache->history[f].value_orig.value_str);
+					text_num++;
 
-					if (history[history_num].value_type == ITEM_VALUE_TYPE_LOG)
+					/* otherwise the value and its source are left in the text buffer until commit */
+					if (0 == text_in_sync)
 					{
-						if (NULL != cache->history[f].source)
-							history[history_num].source = strdup(cache->history[f].source);
-						else
-							history[history_num].source = NULL;
+						history[history_num].value_orig.value_str =
+								strdup(shard->history[f].value_orig.value_str);
+
+						if (history[history_num].value_type == ITEM_VALUE_TYPE_LOG)
+						{
+							if (NULL != shard->history[f].source)
+								history[history_num].source = strdup(shard->history[f].source);
+							else
+								history[history_num].source = NULL;
+						}
 					}
 				}
 
-				for (j = f; j != cache->history_first; j = (j == 0 ? ZBX_HISTORY_SIZE : j) - 1)
-				{
-					i = (j == 0 ? ZBX_HISTORY_SIZE : j) - 1;
-					memcpy(&cache->history[j], &cache->history[i], sizeof(ZBX_DC_HISTORY));
-				}
-
-				cache->history_num--;
-				cache->history_first++;
-				cache->history_first = cache->history_first % ZBX_HISTORY_SIZE;
+				/* taken values are removed from the ring after the scan */
+				shard->history[f].itemid = 0;
 
 				history_num++;
 			}
 			else if (skipped_clock == 0)
-				skipped_clock = cache->history[f].clock;
+				skipped_clock = shard->history[f].clock;
 
 			n--;
 			f++;
 			f = f % ZBX_HISTORY_SIZE;
 		}
 
-		UNLOCK_CACHE;
+		/* move the skipped values to the end of the scanned part of the ring, keeping their order */
+		for (n = shard->history_num - n, i = j = f; n > 0; n--)
+		{
+			i = (i == 0 ? ZBX_HISTORY_SIZE : i) - 1;
+
+			if (0 == shard->history[i].itemid)
+				continue;
+
+			j = (j == 0 ? ZBX_HISTORY_SIZE : j) - 1;
+
+			if (i != j)
+				memcpy(&shard->history[j], &shard->history[i], sizeof(ZBX_DC_HISTORY));
+		}
+
+		shard->history_num -= history_num;
+		shard->history_first = (shard->history_first + history_num) % ZBX_HISTORY_SIZE;
+
+		if (0 == (zbx_process & ZBX_PROCESS_PROXY))
+		{
+			zbx_vector_uint64_sort(&itemids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+			DCadd_sync_itemids(shard, &itemids);
+		}
+
+		/* mark the text buffer as being in sync, so that it is not vacuumed under our feet */
+		if (0 == text_num)
+			text_in_sync = 0;
+		else if (0 != text_in_sync)
+			shard->text_in_sync++;
+
+		UNLOCK_SHARD(shard);
 
 		if (0 == history_num)
 			break;
 
 		DCinit_nextchecks();
 
+		sync_itemids = &itemids;
+
 		DBbegin();
 
 		if (0 != (zbx_process & ZBX_PROCESS_SERVER))
 		{
-			DCmass_update_items(history, history_num);
+			DCmass_update_items(history, &history_index, &itemids);
 			DCmass_add_history(history, history_num);
+			DCmass_add_valuecache(history, history_num);
 			DCmass_update_triggers(history, history_num);
 			DCmass_update_trends(history, history_num);
 		}
 		else
 		{
 			DCmass_proxy_add_history(history, history_num);
-			DCmass_proxy_update_items(history, history_num);
+			DCmass_proxy_update_items(history, history_num, &history_index);
 		}
 
 		DBcommit();
 
+		sync_itemids = NULL;
+
+		if (0 != (zbx_process & ZBX_PROCESS_SERVER))
+			DCflush_pending_trends();
+
 		DCflush_nextchecks();
 
-		LOCK_CACHE;
+		LOCK_SHARD(shard);
 
-		for (i = 0; i < history_num; i ++)
-			uint64_array_remove(cache->itemids, &cache->itemids_num, &history[i].itemid, 1);
+		if (0 == (zbx_process & ZBX_PROCESS_PROXY))
+			DCremove_sync_itemids(shard, &itemids);
 
-		UNLOCK_CACHE;
+		if (0 != text_in_sync)
+			shard->text_in_sync--;
 
-		for (i = 0; i < history_num; i++)
+		UNLOCK_SHARD(shard);
+
+		for (i = 0; 0 == text_in_sync && i < history_num; i++)
 		{
 			if (history[i].value_type == ITEM_VALUE_TYPE_STR
 					|| history[i].value_type == ITEM_VALUE_TYPE_TEXT
@@ -2222,12 +3728,65 @@ int	DCsync_history(int sync_type)
 		if (ZBX_SYNC_FULL == sync_type && time(NULL) - now >= 10)
 		{
 			zabbix_log(LOG_LEVEL_WARNING, "Syncing history data... " ZBX_FS_DBL "%%",
-					(double)total_num / (cache->history_num + total_num) * 100);
+					(double)total_num / (shard->history_num + total_num) * 100);
 			now = time(NULL);
 		}
 	}
 	while (--syncs > 0 || sync_type == ZBX_SYNC_FULL || (skipped_clock != 0 && skipped_clock < max_delay));
 finish:
+	return total_num;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCsync_history                                                   *
+ *                                                                            *
+ * Purpose: writes updates and new data from pool to database                 *
+ *                                                                            *
+ * Parameters: sync_type - [IN] ZBX_SYNC_PARTIAL or ZBX_SYNC_FULL             *
+ *                                                                            *
+ * Return value: number of synced values                                      *
+ *                                                                            *
+ * Comments: every shard has home syncers which sync it first; the other      *
+ *           syncers only take a batch from it when it has a backlog          *
+ *                                                                            *
+ ******************************************************************************/
+int	DCsync_history(int sync_type)
+{
+	int	s, n, home, shift, syncers, pending, total_num = 0;
+
+	/* disable processing of the zabbix_syslog() calls */
+	CONFIG_ENABLE_LOG = 0;
+
+	if (ZBX_SYNC_FULL == sync_type)
+		zabbix_log(LOG_LEVEL_WARNING, "Syncing history data...");
+
+	syncers = MIN(CONFIG_HISTORY_CACHE_SHARDS, CONFIG_HISTSYNCER_FORKS);
+	shift = (0 < process_num ? process_num - 1 : 0);
+
+	do
+	{
+		DCjournal_replay();
+
+		for (s = 0; s < CONFIG_HISTORY_CACHE_SHARDS; s++)
+		{
+			n = (s + shift) % CONFIG_HISTORY_CACHE_SHARDS;
+			home = (ZBX_SYNC_FULL == sync_type || n % syncers == shift % syncers);
+			total_num += DCsync_shard(&cache->shards[n], sync_type, home);
+		}
+
+		/* the journal may have been replayed into shards which were already synced */
+		pending = (NULL != journal ? (int)journal->values_num : 0);
+
+		for (s = 0; s < CONFIG_HISTORY_CACHE_SHARDS; s++)
+			pending += cache->shards[s].history_num;
+	}
+	while (ZBX_SYNC_FULL == sync_type && 0 != pending);
+
+	/* on shutdown the last values are flushed once by DCsync_all() */
+	if (ZBX_SYNC_PARTIAL == sync_type)
+		DCflush_lastvalues(ZBX_SYNC_PARTIAL);
+
 	if (ZBX_SYNC_FULL == sync_type)
 		zabbix_log(LOG_LEVEL_WARNING, "Syncing history data... done.");
 
@@ -2249,7 +3808,7 @@ finish:
  * Comments:                                                                  *
  *                                                                            *
  ******************************************************************************/
-static void DCvacuum_text()
+static void	DCvacuum_text(ZBX_DC_SHARD *shard)
 {
 	char	*first_text;
 	int	i, index;
@@ -2257,44 +3816,53 @@ static void DCvacuum_text()
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In DCvacuum_text()");
 
+	/* syncers are reading string values in place, the buffer cannot be moved until they are done */
+	if (0 != shard->text_in_sync)
+	{
+		shard->text_vacuum = 1;
+		goto quit;
+	}
+
+	shard->text_vacuum = 0;
+
 	/* vacuuming text buffer */
 	first_text = NULL;
-	for (i = 0; i < cache->history_num; i++)
+	for (i = 0; i < shard->history_num; i++)
 	{
-		index = (cache->history_first + i) % ZBX_HISTORY_SIZE;
-		if (cache->history[index].value_type == ITEM_VALUE_TYPE_STR
-				|| cache->history[index].value_type == ITEM_VALUE_TYPE_TEXT
-				|| cache->history[index].value_type == ITEM_VALUE_TYPE_LOG)
+		index = (shard->history_first + i) % ZBX_HISTORY_SIZE;
+		if (shard->history[index].value_type == ITEM_VALUE_TYPE_STR
+				|| shard->history[index].value_type == ITEM_VALUE_TYPE_TEXT
+				|| shard->history[index].value_type == ITEM_VALUE_TYPE_LOG)
 		{
-			first_text = cache->history[index].value_orig.value_str;
+			first_text = shard->history[index].value_orig.value_str;
 			break;
 		}
 	}
 
 	if (NULL != first_text)
 	{
-		if (0 == (offset = first_text - cache->text))
+		if (0 == (offset = first_text - shard->text))
 			goto quit;
 
-		memmove(cache->text, first_text, CONFIG_TEXT_CACHE_SIZE - offset);
+		memmove(shard->text, first_text, ZBX_TEXTBUFFER_SIZE - offset);
 
-		for (i = 0; i < cache->history_num; i++)
+		for (i = 0; i < shard->history_num; i++)
 		{
-			index = (cache->history_first + i) % ZBX_HISTORY_SIZE;
-			if (cache->history[index].value_type == ITEM_VALUE_TYPE_STR
-					|| cache->history[index].value_type == ITEM_VALUE_TYPE_TEXT
-					|| cache->history[index].value_type == ITEM_VALUE_TYPE_LOG)
+			index = (shard->history_first + i) % ZBX_HISTORY_SIZE;
+			if (shard->history[index].value_type == ITEM_VALUE_TYPE_STR
+					|| shard->history[index].value_type == ITEM_VALUE_TYPE_TEXT
+					|| shard->history[index].value_type == ITEM_VALUE_TYPE_LOG)
 			{
-				cache->history[index].value_orig.value_str -= offset;
+				shard->history[index].value_orig.value_str -= offset;
 
-				if (cache->history[index].value_type == ITEM_VALUE_TYPE_LOG && NULL != cache->history[index].source)
-					cache->history[index].source -= offset;
+				if (shard->history[index].value_type == ITEM_VALUE_TYPE_LOG && NULL != shard->history[index].source)
+					shard->history[index].source -= offset;
 			}
 		}
-		cache->last_text -= offset;
+		shard->last_text -= offset;
 	}
 	else
-		cache->last_text = cache->text;
+		shard->last_text = shard->text;
 
 quit:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of DCvacuum_text()");
@@ -2315,59 +3883,59 @@ quit:
  * Comments:                                                                  *
  *                                                                            *
  ******************************************************************************/
-static ZBX_DC_HISTORY	*DCget_history_ptr(zbx_uint64_t itemid, size_t text_len)
+static ZBX_DC_HISTORY	*DCget_history_ptr(ZBX_DC_SHARD *shard, size_t text_len)
 {
 	ZBX_DC_HISTORY	*history;
 	int		index;
 	size_t		free_len;
 
 retry:
-	if (cache->history_num >= ZBX_HISTORY_SIZE)
+	if (shard->history_num >= ZBX_HISTORY_SIZE)
 	{
-		UNLOCK_CACHE;
+		UNLOCK_SHARD(shard);
 
 		zabbix_log(LOG_LEVEL_DEBUG, "History buffer is full. Sleeping for 1 second.");
 		sleep(1);
 
-		LOCK_CACHE;
+		LOCK_SHARD(shard);
 
 		goto retry;
 	}
 
 	if (0 != text_len)
 	{
-		if (text_len > CONFIG_TEXT_CACHE_SIZE)
+		if (text_len > ZBX_TEXTBUFFER_SIZE)
 		{
 			zabbix_log(LOG_LEVEL_ERR, "Insufficient shared memory for text cache");
 			exit(-1);
 		}
 
-		free_len = CONFIG_TEXT_CACHE_SIZE - (cache->last_text - cache->text);
+		free_len = ZBX_TEXTBUFFER_SIZE - (shard->last_text - shard->text);
 
 		if (text_len > free_len)
 		{
-			DCvacuum_text();
+			DCvacuum_text(shard);
 
-			free_len = CONFIG_TEXT_CACHE_SIZE - (cache->last_text - cache->text);
+			free_len = ZBX_TEXTBUFFER_SIZE - (shard->last_text - shard->text);
 
 			if (text_len > free_len)
 			{
-				UNLOCK_CACHE;
+				UNLOCK_SHARD(shard);
 
 				zabbix_log(LOG_LEVEL_DEBUG, "History text buffer is full. Sleeping for 1 second.");
 				sleep(1);
 
-				LOCK_CACHE;
+				LOCK_SHARD(shard);
 
 				goto retry;
 			}
 		}
 	}
 
-	index = (cache->history_first + cache->history_num) % ZBX_HISTORY_SIZE;
-	history = &cache->history[index];
+	index = (shard->history_first + shard->history_num) % ZBX_HISTORY_SIZE;
+	history = &shard->history[index];
 
-	cache->history_num++;
+	shard->history_num++;
 
 	return history;
 }
@@ -2384,16 +3952,14 @@ retry:
  *                                                                            *
  * Author: Alexander Vladishev                                                *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: must be called with the shard locked                             *
  *                                                                            *
  ******************************************************************************/
-static void	DCadd_history(zbx_uint64_t itemid, double value_orig, int clock)
+static void	DCadd_history(ZBX_DC_SHARD *shard, zbx_uint64_t itemid, double value_orig, int clock)
 {
 	ZBX_DC_HISTORY	*history;
 
-	LOCK_CACHE;
-
-	history = DCget_history_ptr(itemid, 0);
+	history = DCget_history_ptr(shard, 0);
 
 	history->itemid			= itemid;
 	history->clock			= clock;
@@ -2404,10 +3970,8 @@ static void	DCadd_history(zbx_uint64_t itemid, double value_orig, int clock)
 	history->keep_history		= 0;
 	history->keep_trends		= 0;
 
-	cache->stats.history_counter++;
-	cache->stats.history_float_counter++;
-
-	UNLOCK_CACHE;
+	shard->stats.history_counter++;
+	shard->stats.history_float_counter++;
 }
 
 /******************************************************************************
@@ -2422,16 +3986,14 @@ static void	DCadd_history(zbx_uint64_t itemid, double value_orig, int clock)
  *                                                                            *
  * Author: Alexander Vladishev                                                *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: must be called with the shard locked                             *
  *                                                                            *
  ******************************************************************************/
-static void	DCadd_history_uint(zbx_uint64_t itemid, zbx_uint64_t value_orig, int clock)
+static void	DCadd_history_uint(ZBX_DC_SHARD *shard, zbx_uint64_t itemid, zbx_uint64_t value_orig, int clock)
 {
 	ZBX_DC_HISTORY	*history;
 
-	LOCK_CACHE;
-
-	history = DCget_history_ptr(itemid, 0);
+	history = DCget_history_ptr(shard, 0);
 
 	history->itemid				= itemid;
 	history->clock				= clock;
@@ -2442,10 +4004,8 @@ static void	DCadd_history_uint(zbx_uint64_t itemid, zbx_uint64_t value_orig, int
 	history->keep_history			= 0;
 	history->keep_trends			= 0;
 
-	cache->stats.history_counter++;
-	cache->stats.history_uint_counter++;
-
-	UNLOCK_CACHE;
+	shard->stats.history_counter++;
+	shard->stats.history_uint_counter++;
 }
 
 /******************************************************************************
@@ -2460,35 +4020,31 @@ static void	DCadd_history_uint(zbx_uint64_t itemid, zbx_uint64_t value_orig, int
  *                                                                            *
  * Author: Alexander Vladishev                                                *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: must be called with the shard locked                             *
  *                                                                            *
  ******************************************************************************/
-static void	DCadd_history_str(zbx_uint64_t itemid, char *value_orig, int clock)
+static void	DCadd_history_str(ZBX_DC_SHARD *shard, zbx_uint64_t itemid, char *value_orig, int clock)
 {
 	ZBX_DC_HISTORY	*history;
 	size_t		len;
 
-	LOCK_CACHE;
-
 	if (HISTORY_STR_VALUE_LEN_MAX < (len = strlen(value_orig) + 1))
 		len = HISTORY_STR_VALUE_LEN_MAX;
-	history = DCget_history_ptr(itemid, len);
+	history = DCget_history_ptr(shard, len);
 
 	history->itemid			= itemid;
 	history->clock			= clock;
 	history->value_type		= ITEM_VALUE_TYPE_STR;
-	history->value_orig.value_str	= cache->last_text;
+	history->value_orig.value_str	= shard->last_text;
 	history->value.value_str	= NULL;
-	zbx_strlcpy(cache->last_text, value_orig, len);
+	zbx_strlcpy(shard->last_text, value_orig, len);
 	history->value_null		= 0;
-	cache->last_text		+= len;
+	shard->last_text		+= len;
 	history->keep_history		= 0;
 	history->keep_trends		= 0;
 
-	cache->stats.history_counter++;
-	cache->stats.history_str_counter++;
-
-	UNLOCK_CACHE;
+	shard->stats.history_counter++;
+	shard->stats.history_str_counter++;
 }
 
 /******************************************************************************
@@ -2503,96 +4059,792 @@ static void	DCadd_history_str(zbx_uint64_t itemid, char *value_orig, int clock)
  *                                                                            *
  * Author: Alexander Vladishev                                                *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: must be called with the shard locked                             *
  *                                                                            *
  ******************************************************************************/
-static void	DCadd_history_text(zbx_uint64_t itemid, char *value_orig, int clock)
+static void	DCadd_history_text(ZBX_DC_SHARD *shard, zbx_uint64_t itemid, char *value_orig, int clock)
 {
 	ZBX_DC_HISTORY	*history;
 	size_t		len;
 
-	LOCK_CACHE;
+	if (HISTORY_TEXT_VALUE_LEN_MAX < (len = strlen(value_orig) + 1))
+		len = HISTORY_TEXT_VALUE_LEN_MAX;
+	history = DCget_history_ptr(shard, len);
+
+	history->itemid			= itemid;
+	history->clock			= clock;
+	history->value_type		= ITEM_VALUE_TYPE_TEXT;
+	history->value_orig.value_str	= shard->last_text;
+	history->value.value_str	= NULL;
+	zbx_strlcpy(shard->last_text, value_orig, len);
+	history->value_null		= 0;
+	shard->last_text		+= len;
+	history->keep_history		= 0;
+	history->keep_trends		= 0;
+
+	shard->stats.history_counter++;
+	shard->stats.history_text_counter++;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCadd_history_log                                                *
+ *                                                                            *
+ * Purpose:                                                                   *
+ *                                                                            *
+ * Parameters:                                                                *
+ *                                                                            *
+ * Return value:                                                              *
+ *                                                                            *
+ * Author: Alexander Vladishev                                                *
+ *                                                                            *
+ * Comments: must be called with the shard locked                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCadd_history_log(ZBX_DC_SHARD *shard, zbx_uint64_t itemid, char *value_orig, int clock, int timestamp, char *source, int severity,
+			int logeventid, int lastlogsize, int mtime)
+{
+	ZBX_DC_HISTORY	*history;
+	size_t		len1, len2;
+
+	if (HISTORY_LOG_VALUE_LEN_MAX < (len1 = strlen(value_orig) + 1))
+		len1 = HISTORY_LOG_VALUE_LEN_MAX;
+	if (HISTORY_LOG_SOURCE_LEN_MAX < (len2 = (NULL != source && *source != '\0') ? strlen(source) + 1 : 0))
+		len2 = HISTORY_LOG_SOURCE_LEN_MAX;
+	history = DCget_history_ptr(shard, len1 + len2);
+
+	history->itemid			= itemid;
+	history->clock			= clock;
+	history->value_type		= ITEM_VALUE_TYPE_LOG;
+	history->value_orig.value_str	= shard->last_text;
+	history->value.value_str	= NULL;
+	zbx_strlcpy(shard->last_text, value_orig, len1);
+	history->value_null		= 0;
+	shard->last_text		+= len1;
+	history->timestamp		= timestamp;
+
+	if (0 != len2)
+	{
+		history->source		= shard->last_text;
+		zbx_strlcpy(shard->last_text, source, len2);
+		shard->last_text	+= len2;
+	}
+	else
+		history->source		= NULL;
+
+	history->severity		= severity;
+	history->logeventid		= logeventid;
+	history->lastlogsize		= lastlogsize;
+	history->mtime			= mtime;
+	history->keep_history		= 0;
+	history->keep_trends		= 0;
+
+	shard->stats.history_counter++;
+	shard->stats.history_log_counter++;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCjournal_get_path                                               *
+ *                                                                            *
+ * Purpose: get the file name of the history journal segment                  *
+ *                                                                            *
+ * Parameters: seq  - [IN] segment sequence number                            *
+ *             path - [OUT] file name                                         *
+ *             len  - [IN] size of the path buffer                            *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCjournal_get_path(int seq, char *path, size_t len)
+{
+	zbx_snprintf(path, len, "%s/history_%010d.journal", CONFIG_HISTORY_JOURNAL_DIR, seq);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCjournal_unmap                                                  *
+ *                                                                            *
+ * Purpose: unmap the history journal segment from the current process        *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCjournal_unmap(ZBX_DC_JOURNAL_SEGMENT *segment)
+{
+	if (NULL != segment->addr)
+		munmap(segment->addr, segment->size);
+
+	segment->seq = 0;
+	segment->addr = NULL;
+	segment->size = 0;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCjournal_map                                                    *
+ *                                                                            *
+ * Purpose: map the history journal segment into the current process          *
+ *                                                                            *
+ * Parameters: segment - [IN/OUT] segment mapping of the current process      *
+ *             seq     - [IN] segment sequence number                         *
+ *             create  - [IN] 1 - create a new segment file                   *
+ *                                                                            *
+ * Return value: SUCCEED - the segment is mapped                              *
+ *               FAIL - the segment cannot be created or opened               *
+ *                                                                            *
+ * Comments: new segments are filled with zeros instead of being truncated to *
+ *           size, so that running out of disk space is reported here and not *
+ *           by SIGBUS when the mapped pages are written                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCjournal_map(ZBX_DC_JOURNAL_SEGMENT *segment, int seq, int create)
+{
+	char			path[MAX_STRING_LEN], *buffer = NULL;
+	int			fd, ret = FAIL;
+	size_t			size, offset, len;
+	struct stat		st;
+	ZBX_DC_JOURNAL_HEADER	*header;
+
+	if (seq == segment->seq)
+		return SUCCEED;
+
+	DCjournal_unmap(segment);
+
+	DCjournal_get_path(seq, path, sizeof(path));
+
+	if (-1 == (fd = open(path, 0 != create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600)))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "Cannot open history journal segment [%s]: %s", path, strerror(errno));
+		return FAIL;
+	}
+
+	if (0 != create)
+	{
+		size = CONFIG_HISTORY_JOURNAL_SEGMENT_SIZE;
+		buffer = zbx_malloc(buffer, 64 * ZBX_KIBIBYTE);
+		memset(buffer, 0, 64 * ZBX_KIBIBYTE);
+
+		header = (ZBX_DC_JOURNAL_HEADER *)buffer;
+		header->magic = ZBX_JOURNAL_MAGIC;
+		header->seq = seq;
+		header->read_offset = ZBX_JOURNAL_ALIGN(sizeof(ZBX_DC_JOURNAL_HEADER));
+
+		for (offset = 0; offset < size; offset += len)
+		{
+			len = MIN(size - offset, 64 * ZBX_KIBIBYTE);
+
+			if (-1 == write(fd, buffer, len))
+			{
+				zabbix_log(LOG_LEVEL_ERR, "Cannot write history journal segment [%s]: %s",
+						path, strerror(errno));
+				unlink(path);
+				goto out;
+			}
+
+			if (0 == offset)
+				memset(buffer, 0, sizeof(ZBX_DC_JOURNAL_HEADER));
+		}
+	}
+	else
+	{
+		if (0 != fstat(fd, &st))
+		{
+			zabbix_log(LOG_LEVEL_ERR, "Cannot stat history journal segment [%s]: %s", path, strerror(errno));
+			goto out;
+		}
+
+		if ((size = (size_t)st.st_size) < ZBX_JOURNAL_ALIGN(sizeof(ZBX_DC_JOURNAL_HEADER)))
+		{
+			zabbix_log(LOG_LEVEL_ERR, "History journal segment [%s] is truncated", path);
+			goto out;
+		}
+	}
+
+	if (MAP_FAILED == (segment->addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "Cannot map history journal segment [%s]: %s", path, strerror(errno));
+		segment->addr = NULL;
+		goto out;
+	}
+
+	header = (ZBX_DC_JOURNAL_HEADER *)segment->addr;
+
+	if (ZBX_JOURNAL_MAGIC != header->magic || seq != header->seq)
+	{
+		zabbix_log(LOG_LEVEL_ERR, "History journal segment [%s] is corrupted", path);
+		munmap(segment->addr, size);
+		segment->addr = NULL;
+		goto out;
+	}
+
+	segment->seq = seq;
+	segment->size = size;
+
+	ret = SUCCEED;
+out:
+	zbx_free(buffer);
+	close(fd);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCjournal_high_water                                             *
+ *                                                                            *
+ * Purpose: check if the history cache shard is filled above the high-water   *
+ *          mark                                                              *
+ *                                                                            *
+ * Parameters: shard    - [IN] history cache shard of the item                *
+ *             text_len - [IN] size of the string value to be added           *
+ *                                                                            *
+ * Return value: SUCCEED - the value should go to the journal                 *
+ *               FAIL - there is room in the history cache                    *
+ *                                                                            *
+ * Comments: must be called with the shard locked; an empty shard always      *
+ *           accepts the value, so that the journal cannot get stuck on a     *
+ *           value larger than the high-water mark                            *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCjournal_high_water(ZBX_DC_SHARD *shard, size_t text_len)
+{
+	zbx_uint64_t	limit;
+
+	if (0 == shard->history_num)
+		return FAIL;
+
+	limit = (zbx_uint64_t)ZBX_HISTORY_SIZE * CONFIG_HISTORY_JOURNAL_HIGH_WATER / 100;
+
+	if ((zbx_uint64_t)shard->history_num >= limit)
+		return SUCCEED;
+
+	if (0 == text_len)
+		return FAIL;
+
+	limit = (zbx_uint64_t)ZBX_TEXTBUFFER_SIZE * CONFIG_HISTORY_JOURNAL_HIGH_WATER / 100;
+
+	if ((zbx_uint64_t)(shard->last_text - shard->text + text_len) <= limit)
+		return FAIL;
+
+	DCvacuum_text(shard);
+
+	if ((zbx_uint64_t)(shard->last_text - shard->text + text_len) <= limit)
+		return FAIL;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCjournal_text_len                                               *
+ *                                                                            *
+ * Purpose: get the size of the strings of a value in the history cache       *
+ *                                                                            *
+ ******************************************************************************/
+static size_t	DCjournal_text_len(unsigned char value_type, AGENT_RESULT *value, const char *source)
+{
+	size_t	len = 0;
+
+	switch (value_type)
+	{
+		case ITEM_VALUE_TYPE_STR:
+			if (NULL != GET_STR_RESULT(value))
+				len = MIN(strlen(value->str) + 1, HISTORY_STR_VALUE_LEN_MAX);
+			break;
+		case ITEM_VALUE_TYPE_TEXT:
+			if (NULL != GET_TEXT_RESULT(value))
+				len = MIN(strlen(value->text) + 1, HISTORY_TEXT_VALUE_LEN_MAX);
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			if (NULL != GET_STR_RESULT(value))
+				len = MIN(strlen(value->str) + 1, HISTORY_LOG_VALUE_LEN_MAX);
+			if (NULL != source && '\0' != *source)
+				len += MIN(strlen(source) + 1, HISTORY_LOG_SOURCE_LEN_MAX);
+			break;
+	}
+
+	return len;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCjournal_add                                                    *
+ *                                                                            *
+ * Purpose: append new value to the history journal                           *
+ *                                                                            *
+ * Parameters: shard - [IN] history cache shard of the item                   *
+ *             the rest are the same as for dc_add_history()                  *
+ *                                                                            *
+ * Return value: SUCCEED - the value is stored in the journal                 *
+ *               FAIL - the value must be added to the history cache          *
+ *                                                                            *
+ * Comments: must be called with the journal and the shard locked, and the    *
+ *           shard must stay locked until the value is added to the cache,    *
+ *           so that a value cannot overtake an earlier value of the item     *
+ *           which is on its way to the cache or the journal                  *
+ *                                                                            *
+ *           once the journal is not empty all new values are appended to it *
+ *           until syncers have replayed it, so that values of an item are    *
+ *           never synced out of order                                        *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCjournal_add(ZBX_DC_SHARD *shard, zbx_uint64_t itemid, unsigned char value_type, AGENT_RESULT *value,
+		int now, int timestamp, char *source, int severity, int logeventid, int lastlogsize, int mtime)
+{
+	ZBX_DC_JOURNAL_RECORD	record, *ptr;
+	char			*value_str = NULL;
+	size_t			value_len = 0, source_len = 0, size;
+
+	memset(&record, 0, sizeof(ZBX_DC_JOURNAL_RECORD));
+
+	switch (value_type)
+	{
+		case ITEM_VALUE_TYPE_FLOAT:
+			if (NULL == GET_DBL_RESULT(value))
+				return FAIL;
+			record.value.value_float = value->dbl;
+			break;
+		case ITEM_VALUE_TYPE_UINT64:
+			if (NULL == GET_UI64_RESULT(value))
+				return FAIL;
+			record.value.value_uint64 = value->ui64;
+			break;
+		case ITEM_VALUE_TYPE_STR:
+			if (NULL == GET_STR_RESULT(value))
+				return FAIL;
+			value_str = value->str;
+			if (HISTORY_STR_VALUE_LEN_MAX < (value_len = strlen(value_str) + 1))
+				value_len = HISTORY_STR_VALUE_LEN_MAX;
+			break;
+		case ITEM_VALUE_TYPE_TEXT:
+			if (NULL == GET_TEXT_RESULT(value))
+				return FAIL;
+			value_str = value->text;
+			if (HISTORY_TEXT_VALUE_LEN_MAX < (value_len = strlen(value_str) + 1))
+				value_len = HISTORY_TEXT_VALUE_LEN_MAX;
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			if (NULL == GET_STR_RESULT(value))
+				return FAIL;
+			value_str = value->str;
+			if (HISTORY_LOG_VALUE_LEN_MAX < (value_len = strlen(value_str) + 1))
+				value_len = HISTORY_LOG_VALUE_LEN_MAX;
+			if (HISTORY_LOG_SOURCE_LEN_MAX < (source_len = (NULL != source && *source != '\0') ? strlen(source) + 1 : 0))
+				source_len = HISTORY_LOG_SOURCE_LEN_MAX;
+			break;
+		default:
+			return FAIL;
+	}
+
+	if (0 == journal->values_num && SUCCEED != DCjournal_high_water(shard, value_len + source_len))
+		return FAIL;
+
+	size = ZBX_JOURNAL_ALIGN(sizeof(ZBX_DC_JOURNAL_RECORD) + value_len + source_len);
+
+	if (FAIL == DCjournal_map(&journal_write, journal->last_seq, 0))
+		return FAIL;
+
+	/* leave room for the zero size marking the end of the segment */
+	if (journal->write_offset + size + sizeof(int) > journal_write.size)
+	{
+		msync(journal_write.addr, journal_write.size, MS_ASYNC);
+
+		if (FAIL == DCjournal_map(&journal_write, journal->last_seq + 1, 1))
+			return FAIL;
+
+		journal->last_seq++;
+		journal->write_offset = ZBX_JOURNAL_ALIGN(sizeof(ZBX_DC_JOURNAL_HEADER));
+
+		if (journal->write_offset + size + sizeof(int) > journal_write.size)
+		{
+			zabbix_log(LOG_LEVEL_ERR, "Value of item [" ZBX_FS_UI64 "] does not fit into"
+					" history journal segment", itemid);
+			return FAIL;
+		}
+	}
+
+	ptr = (ZBX_DC_JOURNAL_RECORD *)(journal_write.addr + journal->write_offset);
+
+	record.clock = now;
+	record.itemid = itemid;
+	record.timestamp = timestamp;
+	record.severity = severity;
+	record.logeventid = logeventid;
+	record.lastlogsize = lastlogsize;
+	record.mtime = mtime;
+	record.value_len = (int)value_len;
+	record.source_len = (int)source_len;
+	record.value_type = value_type;
+
+	memcpy(ptr, &record, sizeof(ZBX_DC_JOURNAL_RECORD));
+
+	if (0 != value_len)
+		zbx_strlcpy((char *)(ptr + 1), value_str, value_len);
+
+	if (0 != source_len)
+		zbx_strlcpy((char *)(ptr + 1) + value_len, source, source_len);
+
+	/* publish the record */
+	ptr->size = (int)size;
+
+	journal->write_offset += size;
+	journal->values_num++;
+	journal->spilling = 1;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCjournal_replay                                                 *
+ *                                                                            *
+ * Purpose: move values from the history journal back to the history cache    *
+ *                                                                            *
+ * Comments: values are moved in order until the cache reaches the            *
+ *           high-water mark or one sync batch is moved; the journal is       *
+ *           locked for one value at a time, so that writers are not kept     *
+ *           waiting for the whole batch, and fully replayed segments are     *
+ *           removed with the journal unlocked                                *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCjournal_replay()
+{
+	const char		*__function_name = "DCjournal_replay";
+	ZBX_DC_JOURNAL_RECORD	*record;
+	ZBX_DC_SHARD		*shard;
+	char			path[MAX_STRING_LEN], *value_str, *source;
+	int			replayed = 0, full = 0;
+
+	if (NULL == journal || 0 == journal->values_num)
+		return;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	DCjournal_flush();
+
+	while (0 == full && replayed < ZBX_SYNC_MAX)
+	{
+		*path = '\0';
+
+		LOCK_JOURNAL;
+
+		if (0 == journal->values_num)
+		{
+			UNLOCK_JOURNAL;
+			break;
+		}
+
+		if (FAIL == DCjournal_map(&journal_read, journal->first_seq, 0))
+		{
+			if (journal->first_seq == journal->last_seq)
+			{
+				zabbix_log(LOG_LEVEL_ERR, "Cannot replay history journal, " ZBX_FS_UI64 " values are lost",
+						journal->values_num);
+				journal->values_num = 0;
+				journal->spilling = 0;
+			}
+			else
+			{
+				journal->first_seq++;
+				journal->read_offset = ZBX_JOURNAL_ALIGN(sizeof(ZBX_DC_JOURNAL_HEADER));
+			}
+
+			UNLOCK_JOURNAL;
+			continue;
+		}
+
+		record = (ZBX_DC_JOURNAL_RECORD *)(journal_read.addr + journal->read_offset);
+
+		if (journal->read_offset + sizeof(ZBX_DC_JOURNAL_RECORD) > journal_read.size || 0 == record->size)
+		{
+			if (journal->first_seq == journal->last_seq)
+			{
+				zabbix_log(LOG_LEVEL_ERR, "Unexpected end of history journal, " ZBX_FS_UI64 " values are lost",
+						journal->values_num);
+				journal->values_num = 0;
+				journal->spilling = 0;
+			}
+			else
+			{
+				DCjournal_get_path(journal->first_seq, path, sizeof(path));
+
+				journal->first_seq++;
+				journal->read_offset = ZBX_JOURNAL_ALIGN(sizeof(ZBX_DC_JOURNAL_HEADER));
+			}
+
+			UNLOCK_JOURNAL;
+
+			/* nobody maps a segment below first_seq any more */
+			if ('\0' != *path)
+			{
+				DCjournal_unmap(&journal_read);
+				unlink(path);
+			}
+
+			continue;
+		}
+
+		shard = DCget_shard(record->itemid);
+
+		LOCK_SHARD(shard);
+
+		if (SUCCEED == DCjournal_high_water(shard, record->value_len + record->source_len))
+		{
+			full = 1;
+		}
+		else
+		{
+			value_str = (char *)(record + 1);
+			source = (0 != record->source_len ? value_str + record->value_len : NULL);
+
+			switch (record->value_type)
+			{
+				case ITEM_VALUE_TYPE_FLOAT:
+					DCadd_history(shard, record->itemid, record->value.value_float, record->clock);
+					break;
+				case ITEM_VALUE_TYPE_UINT64:
+					DCadd_history_uint(shard, record->itemid, record->value.value_uint64,
+							record->clock);
+					break;
+				case ITEM_VALUE_TYPE_STR:
+					DCadd_history_str(shard, record->itemid, value_str, record->clock);
+					break;
+				case ITEM_VALUE_TYPE_TEXT:
+					DCadd_history_text(shard, record->itemid, value_str, record->clock);
+					break;
+				case ITEM_VALUE_TYPE_LOG:
+					DCadd_history_log(shard, record->itemid, value_str, record->clock,
+							record->timestamp, source, record->severity, record->logeventid,
+							record->lastlogsize, record->mtime);
+					break;
+			}
+
+			journal->read_offset += record->size;
+
+			/* replayed values are now as safe as any other value in the history cache */
+			((ZBX_DC_JOURNAL_HEADER *)journal_read.addr)->read_offset = journal->read_offset;
+
+			if (0 == --journal->values_num)
+				journal->spilling = 0;
+
+			replayed++;
+		}
+
+		UNLOCK_SHARD(shard);
+
+		UNLOCK_JOURNAL;
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __function_name, replayed);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCjournal_flush                                                  *
+ *                                                                            *
+ * Purpose: write the history journal segments to disk                        *
+ *                                                                            *
+ * Comments: called by history syncers before each replay. Segments sealed   *
+ *           since the last flush are flushed at once, the segment being      *
+ *           written once every ZBX_JOURNAL_FLUSH_PERIOD seconds. The journal *
+ *           is unlocked while the files are flushed, a segment replayed and  *
+ *           removed meanwhile needs no flush.                                *
+ *                                                                            *
+ *           Pages modified through the mappings of other processes are in    *
+ *           the same page cache, so fsync() of the file writes them too.     *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCjournal_flush()
+{
+	const char	*__function_name = "DCjournal_flush";
+	char		path[MAX_STRING_LEN];
+	int		seq, first_seq, last_seq, fd, now;
+
+	if (NULL == journal || 0 == journal->values_num)
+		return;
+
+	now = (int)time(NULL);
+
+	LOCK_JOURNAL;
+
+	if (0 == journal->values_num || (journal->flushed_seq == journal->last_seq &&
+			ZBX_JOURNAL_FLUSH_PERIOD > now - journal->flushed))
+	{
+		UNLOCK_JOURNAL;
+		return;
+	}
+
+	first_seq = MAX(journal->first_seq, journal->flushed_seq);
+	last_seq = journal->last_seq;
+
+	journal->flushed_seq = last_seq;
+	journal->flushed = now;
+
+	UNLOCK_JOURNAL;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() first_seq:%d last_seq:%d", __function_name, first_seq, last_seq);
+
+	for (seq = first_seq; seq <= last_seq; seq++)
+	{
+		DCjournal_get_path(seq, path, sizeof(path));
+
+		if (-1 == (fd = open(path, O_RDWR)))
+			continue;
+
+		if (0 != fsync(fd))
+		{
+			zabbix_log(LOG_LEVEL_ERR, "Cannot flush history journal segment [%s]: %s",
+					path, strerror(errno));
+		}
+
+		close(fd);
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCjournal_load                                                   *
+ *                                                                            *
+ * Purpose: find segments left by the previous run of the server and count    *
+ *          values which were not replayed                                    *
+ *                                                                            *
+ * Comments: will terminate process if the journal directory cannot be read   *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCjournal_load()
+{
+	const char		*__function_name = "DCjournal_load";
+	DIR			*dir;
+	struct dirent		*entries;
+	ZBX_DC_JOURNAL_RECORD	*record;
+	int			seq, offset;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	if (NULL == (dir = opendir(CONFIG_HISTORY_JOURNAL_DIR)))
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "Cannot open history journal directory [%s]: %s",
+				CONFIG_HISTORY_JOURNAL_DIR, strerror(errno));
+		exit(FAIL);
+	}
+
+	journal->first_seq = 0;
+	journal->last_seq = 0;
+	journal->values_num = 0;
+	journal->spilling = 0;
+	journal->flushed_seq = 0;
+	journal->flushed = 0;
+
+	while (NULL != (entries = readdir(dir)))
+	{
+		if (1 != sscanf(entries->d_name, "history_%d.journal", &seq) || 0 >= seq)
+			continue;
+
+		if (0 == journal->first_seq || seq < journal->first_seq)
+			journal->first_seq = seq;
+
+		if (seq > journal->last_seq)
+			journal->last_seq = seq;
+	}
+
+	closedir(dir);
+
+	if (0 == journal->first_seq)
+	{
+		journal->first_seq = journal->last_seq = 1;
+		journal->read_offset = journal->write_offset = ZBX_JOURNAL_ALIGN(sizeof(ZBX_DC_JOURNAL_HEADER));
+
+		if (FAIL == DCjournal_map(&journal_write, journal->last_seq, 1))
+		{
+			zabbix_log(LOG_LEVEL_CRIT, "Cannot create history journal in [%s]", CONFIG_HISTORY_JOURNAL_DIR);
+			exit(FAIL);
+		}
+
+		goto out;
+	}
+
+	journal->read_offset = ZBX_JOURNAL_ALIGN(sizeof(ZBX_DC_JOURNAL_HEADER));
+
+	for (seq = journal->first_seq; seq <= journal->last_seq; seq++)
+	{
+		if (FAIL == DCjournal_map(&journal_read, seq, 0))
+			continue;
+
+		offset = ZBX_JOURNAL_ALIGN(sizeof(ZBX_DC_JOURNAL_HEADER));
+
+		if (seq == journal->first_seq)
+		{
+			if (offset < ((ZBX_DC_JOURNAL_HEADER *)journal_read.addr)->read_offset)
+				offset = ((ZBX_DC_JOURNAL_HEADER *)journal_read.addr)->read_offset;
+			journal->read_offset = offset;
+		}
+
+		while (offset + sizeof(ZBX_DC_JOURNAL_RECORD) <= journal_read.size)
+		{
+			record = (ZBX_DC_JOURNAL_RECORD *)(journal_read.addr + offset);
+
+			if (0 >= record->size || offset + record->size > journal_read.size)
+				break;
+
+			offset += record->size;
+			journal->values_num++;
+		}
+
+		if (seq == journal->last_seq)
+			journal->write_offset = offset;
+	}
 
-	if (HISTORY_TEXT_VALUE_LEN_MAX < (len = strlen(value_orig) + 1))
-		len = HISTORY_TEXT_VALUE_LEN_MAX;
-	history = DCget_history_ptr(itemid, len);
+	DCjournal_unmap(&journal_read);
 
-	history->itemid			= itemid;
-	history->clock			= clock;
-	history->value_type		= ITEM_VALUE_TYPE_TEXT;
-	history->value_orig.value_str	= cache->last_text;
-	history->value.value_str	= NULL;
-	zbx_strlcpy(cache->last_text, value_orig, len);
-	history->value_null		= 0;
-	cache->last_text		+= len;
-	history->keep_history		= 0;
-	history->keep_trends		= 0;
+	if (FAIL == DCjournal_map(&journal_write, journal->last_seq, 0))
+	{
+		/* start a new segment after the broken one */
+		journal->last_seq++;
+		journal->write_offset = ZBX_JOURNAL_ALIGN(sizeof(ZBX_DC_JOURNAL_HEADER));
+
+		if (FAIL == DCjournal_map(&journal_write, journal->last_seq, 1))
+		{
+			zabbix_log(LOG_LEVEL_CRIT, "Cannot create history journal in [%s]", CONFIG_HISTORY_JOURNAL_DIR);
+			exit(FAIL);
+		}
+	}
 
-	cache->stats.history_counter++;
-	cache->stats.history_text_counter++;
+	journal->spilling = (0 != journal->values_num);
 
-	UNLOCK_CACHE;
+	if (0 != journal->values_num)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "History journal contains " ZBX_FS_UI64 " values in %d segment(s)",
+				journal->values_num, journal->last_seq - journal->first_seq + 1);
+	}
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
 /******************************************************************************
  *                                                                            *
- * Function: DCadd_history_log                                                *
- *                                                                            *
- * Purpose:                                                                   *
- *                                                                            *
- * Parameters:                                                                *
- *                                                                            *
- * Return value:                                                              *
+ * Function: DCsync_history_journal                                           *
  *                                                                            *
- * Author: Alexander Vladishev                                                *
+ * Purpose: write values left in the history journal by the previous run of   *
+ *          the server to the database                                        *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: must be called before the processes adding values are started.  *
+ *           The configuration cache snapshot holds only items and hosts, so  *
+ *           the server loads the whole configuration first, otherwise the    *
+ *           replayed values would not evaluate triggers.                     *
  *                                                                            *
  ******************************************************************************/
-static void	DCadd_history_log(zbx_uint64_t itemid, char *value_orig, int clock, int timestamp, char *source, int severity,
-			int logeventid, int lastlogsize, int mtime)
+void	DCsync_history_journal()
 {
-	ZBX_DC_HISTORY	*history;
-	size_t		len1, len2;
-
-	LOCK_CACHE;
+	if (NULL == journal || 0 == journal->values_num)
+		return;
 
-	if (HISTORY_LOG_VALUE_LEN_MAX < (len1 = strlen(value_orig) + 1))
-		len1 = HISTORY_LOG_VALUE_LEN_MAX;
-	if (HISTORY_LOG_SOURCE_LEN_MAX < (len2 = (NULL != source && *source != '\0') ? strlen(source) + 1 : 0))
-		len2 = HISTORY_LOG_SOURCE_LEN_MAX;
-	history = DCget_history_ptr(itemid, len1 + len2);
-
-	history->itemid			= itemid;
-	history->clock			= clock;
-	history->value_type		= ITEM_VALUE_TYPE_LOG;
-	history->value_orig.value_str	= cache->last_text;
-	history->value.value_str	= NULL;
-	zbx_strlcpy(cache->last_text, value_orig, len1);
-	history->value_null		= 0;
-	cache->last_text		+= len1;
-	history->timestamp		= timestamp;
-
-	if (0 != len2)
-	{
-		history->source		= cache->last_text;
-		zbx_strlcpy(cache->last_text, source, len2);
-		cache->last_text	+= len2;
-	}
-	else
-		history->source		= NULL;
+	if (0 != (zbx_process & ZBX_PROCESS_SERVER))
+		DCsync_configuration();
 
-	history->severity		= severity;
-	history->logeventid		= logeventid;
-	history->lastlogsize		= lastlogsize;
-	history->mtime			= mtime;
-	history->keep_history		= 0;
-	history->keep_trends		= 0;
+	zabbix_log(LOG_LEVEL_WARNING, "Replaying history journal...");
 
-	cache->stats.history_counter++;
-	cache->stats.history_log_counter++;
+	DCsync_history(ZBX_SYNC_FULL);
 
-	UNLOCK_CACHE;
+	zabbix_log(LOG_LEVEL_WARNING, "Replaying history journal... done.");
 }
 
 /******************************************************************************
@@ -2611,34 +4863,67 @@ static void	DCadd_history_log(zbx_uint64_t itemid, char *value_orig, int clock,
 void	dc_add_history(zbx_uint64_t itemid, unsigned char value_type, AGENT_RESULT *value, int now,
 		int timestamp, char *source, int severity, int logeventid, int lastlogsize, int mtime)
 {
+	ZBX_DC_SHARD	*shard;
+	int		ret = FAIL;
+
+	shard = DCget_shard(itemid);
+
+	/* the shard stays locked from choosing between the journal and the cache until */
+	/* the value is added, the journal is released before the value can wait for   */
+	/* room in the cache, as syncers need it to replay                              */
+
+	LOCK_SHARD(shard);
+
+	/* the journal is locked only while it is not empty or the cache is filling up, */
+	/* a value of the item is appended to the journal with this shard locked, so    */
+	/* the flag cannot be seen clear while the journal holds values of the item     */
+	if (NULL != journal && (0 != journal->spilling ||
+			SUCCEED == DCjournal_high_water(shard, DCjournal_text_len(value_type, value, source))))
+	{
+		UNLOCK_SHARD(shard);
+
+		LOCK_JOURNAL;
+		LOCK_SHARD(shard);
+
+		ret = DCjournal_add(shard, itemid, value_type, value, now, timestamp, source, severity, logeventid,
+				lastlogsize, mtime);
+
+		UNLOCK_JOURNAL;
+	}
+
+	if (SUCCEED == ret)
+		goto unlock;
+
 	switch (value_type)
 	{
 		case ITEM_VALUE_TYPE_FLOAT:
 			if (GET_DBL_RESULT(value))
-				DCadd_history(itemid, value->dbl, now);
+				DCadd_history(shard, itemid, value->dbl, now);
 			break;
 		case ITEM_VALUE_TYPE_STR:
 			if (GET_STR_RESULT(value))
-				DCadd_history_str(itemid, value->str, now);
+				DCadd_history_str(shard, itemid, value->str, now);
 			break;
 		case ITEM_VALUE_TYPE_LOG:
 			if (GET_STR_RESULT(value))
-				DCadd_history_log(itemid, value->str, now, timestamp, source, severity,
+				DCadd_history_log(shard, itemid, value->str, now, timestamp, source, severity,
 						logeventid, lastlogsize, mtime);
 			break;
 		case ITEM_VALUE_TYPE_UINT64:
 			if (GET_UI64_RESULT(value))
-				DCadd_history_uint(itemid, value->ui64, now);
+				DCadd_history_uint(shard, itemid, value->ui64, now);
 			break;
 		case ITEM_VALUE_TYPE_TEXT:
 			if (GET_TEXT_RESULT(value))
-				DCadd_history_text(itemid, value->text, now);
+				DCadd_history_text(shard, itemid, value->text, now);
 			break;
 		default:
 			zabbix_log(LOG_LEVEL_ERR, "Unknown value type [%d] for itemid [" ZBX_FS_UI64 "]",
 				value_type,
 				itemid);
 	}
+unlock:
+	UNLOCK_SHARD(shard);
 }
 
 /******************************************************************************
@@ -2659,13 +4944,25 @@ void	dc_add_history(zbx_uint64_t itemid, unsigned char value_type, AGENT_RESULT
 
 ZBX_MEM_FUNC1_IMPL_MALLOC(__history, history_mem);
 ZBX_MEM_FUNC1_IMPL_MALLOC(__history_text, history_text_mem);
-ZBX_MEM_FUNC_IMPL(__trend, trend_mem);
+ZBX_MEM_FUNC1_IMPL_REALLOC(__trend, trend_mem);
+ZBX_MEM_FUNC1_IMPL_FREE(__trend, trend_mem);
+
+/* trends are kept in a hashset that may fail to grow, the value is flushed to the database then */
+static void	*__trend_mem_try_malloc_func(void *old, size_t size)
+{
+	return zbx_mem_try_malloc(trend_mem, size);
+}
+
+ZBX_MEM_FUNC_IMPL(__lastvalue, lastvalue_mem);
+ZBX_MEM_FUNC1_IMPL_MALLOC(__write_queue, write_queue_mem);
 
 void	init_database_cache(unsigned char p)
 {
 	const char	*__function_name = "init_database_cache";
 	key_t		history_shm_key, history_text_shm_key, trend_shm_key;
 	size_t		sz;
+	int		s, ids_size;
+	ZBX_DC_SHARD	*shard;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -2679,10 +4976,15 @@ void	init_database_cache(unsigned char p)
 		exit(FAIL);
 	}
 
-	if (ZBX_MUTEX_ERROR == zbx_mutex_create_force(&cache_lock, ZBX_MUTEX_CACHE))
+	/* the first shard keeps the original history cache mutex */
+	for (s = 0; s < CONFIG_HISTORY_CACHE_SHARDS; s++)
 	{
-		zbx_error("Unable to create mutex for history cache");
-		exit(FAIL);
+		if (ZBX_MUTEX_ERROR == zbx_mutex_create_force(&shard_locks[s],
+				0 == s ? ZBX_MUTEX_CACHE : ZBX_MUTEX_CACHE_SHARDS + s - 1))
+		{
+			zbx_error("Unable to create mutex for history cache");
+			exit(FAIL);
+		}
 	}
 
 	if (ZBX_MUTEX_ERROR == zbx_mutex_create_force(&trends_lock, ZBX_MUTEX_TRENDS))
@@ -2697,42 +4999,89 @@ void	init_database_cache(unsigned char p)
 		exit(FAIL);
 	}
 
-	ZBX_HISTORY_SIZE = CONFIG_HISTORY_CACHE_SIZE / sizeof(ZBX_DC_HISTORY);
+	if (ZBX_MUTEX_ERROR == zbx_mutex_create_force(&journal_lock, ZBX_MUTEX_HISTORY_JOURNAL))
+	{
+		zbx_error("Unable to create mutex for history journal");
+		exit(FAIL);
+	}
+
+	ZBX_HISTORY_SIZE = CONFIG_HISTORY_CACHE_SIZE / sizeof(ZBX_DC_HISTORY) / CONFIG_HISTORY_CACHE_SHARDS;
+	ZBX_SYNC_MAX = CONFIG_HISTSYNCER_BATCH_SIZE;
 	if (ZBX_SYNC_MAX > ZBX_HISTORY_SIZE)
 		ZBX_SYNC_MAX = ZBX_HISTORY_SIZE;
 	ZBX_ITEMIDS_SIZE = CONFIG_HISTSYNCER_FORKS * ZBX_SYNC_MAX;
 
+	/* every shard must be able to hold the largest log value with its source */
+	ZBX_TEXTBUFFER_SIZE = CONFIG_TEXT_CACHE_SIZE / CONFIG_HISTORY_CACHE_SHARDS;
+	if (HISTORY_LOG_VALUE_LEN_MAX + HISTORY_LOG_SOURCE_LEN_MAX > ZBX_TEXTBUFFER_SIZE)
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "HistoryTextCacheSize is too small for %d history cache shards",
+				CONFIG_HISTORY_CACHE_SHARDS);
+		exit(FAIL);
+	}
+
 	/* history cache */
 
 	sz = sizeof(ZBX_DC_CACHE);
-	sz += ZBX_HISTORY_SIZE * sizeof(ZBX_DC_HISTORY);
-	sz += ZBX_ITEMIDS_SIZE * sizeof(zbx_uint64_t);
+	sz += CONFIG_HISTORY_CACHE_SHARDS * sizeof(ZBX_DC_SHARD);
+	sz += CONFIG_HISTORY_CACHE_SHARDS * ZBX_HISTORY_SIZE * sizeof(ZBX_DC_HISTORY);
+	sz += CONFIG_HISTORY_CACHE_SHARDS * ZBX_ITEMIDS_SIZE * sizeof(zbx_uint64_t);
+	for (ids_size = 0; NULL != tables[ids_size].table; ids_size++)
+		;
+	ids_size *= 2;
+
 	sz += sizeof(ZBX_DC_IDS);
-	sz = zbx_mem_required_size(sz, 4, "history cache", "HistoryCacheSize");
+	sz += ids_size * sizeof(ZBX_DC_ID);
+	sz += sizeof(ZBX_DC_JOURNAL);
+	sz = zbx_mem_required_size(sz, 5 + 2 * CONFIG_HISTORY_CACHE_SHARDS, "history cache", "HistoryCacheSize");
 
 	zbx_mem_create(&history_mem, history_shm_key, ZBX_NO_MUTEX, sz, "history cache", "HistoryCacheSize");
 
 	cache = (ZBX_DC_CACHE *)__history_mem_malloc_func(NULL, sizeof(ZBX_DC_CACHE));
+	cache->shards = (ZBX_DC_SHARD *)__history_mem_malloc_func(NULL, CONFIG_HISTORY_CACHE_SHARDS * sizeof(ZBX_DC_SHARD));
 
-	cache->history = (ZBX_DC_HISTORY *)__history_mem_malloc_func(NULL, ZBX_HISTORY_SIZE * sizeof(ZBX_DC_HISTORY));
-	cache->history_first = 0;
-	cache->history_num = 0;
-	cache->itemids = (zbx_uint64_t *)__history_mem_malloc_func(NULL, ZBX_ITEMIDS_SIZE * sizeof(zbx_uint64_t));
-	cache->itemids_alloc = ZBX_ITEMIDS_SIZE;
-	cache->itemids_num = 0;
-	memset(&cache->stats, 0, sizeof(ZBX_DC_STATS));
+	for (s = 0; s < CONFIG_HISTORY_CACHE_SHARDS; s++)
+	{
+		shard = &cache->shards[s];
+
+		shard->num = s;
+		shard->history = (ZBX_DC_HISTORY *)__history_mem_malloc_func(NULL,
+				ZBX_HISTORY_SIZE * sizeof(ZBX_DC_HISTORY));
+		shard->history_first = 0;
+		shard->history_num = 0;
+		shard->itemids = (zbx_uint64_t *)__history_mem_malloc_func(NULL, ZBX_ITEMIDS_SIZE * sizeof(zbx_uint64_t));
+		shard->itemids_alloc = ZBX_ITEMIDS_SIZE;
+		shard->itemids_num = 0;
+		memset(&shard->stats, 0, sizeof(ZBX_DC_STATS));
+	}
 
 	ids = (ZBX_DC_IDS *)__history_mem_malloc_func(NULL, sizeof(ZBX_DC_IDS));
-	memset(ids, 0, sizeof(ZBX_DC_IDS));
+	ids->id = (ZBX_DC_ID *)__history_mem_malloc_func(NULL, ids_size * sizeof(ZBX_DC_ID));
+	ids->size = ids_size;
+	memset(ids->id, 0, ids_size * sizeof(ZBX_DC_ID));
+
+	if (NULL != CONFIG_HISTORY_JOURNAL_DIR)
+	{
+		journal = (ZBX_DC_JOURNAL *)__history_mem_malloc_func(NULL, sizeof(ZBX_DC_JOURNAL));
+		DCjournal_load();
+	}
 
 	/* history text cache */
 
-	sz = zbx_mem_required_size(CONFIG_TEXT_CACHE_SIZE, 1, "history text cache", "HistoryTextCacheSize");
+	sz = zbx_mem_required_size(CONFIG_HISTORY_CACHE_SHARDS * ZBX_TEXTBUFFER_SIZE, CONFIG_HISTORY_CACHE_SHARDS,
+			"history text cache", "HistoryTextCacheSize");
 
 	zbx_mem_create(&history_text_mem, history_text_shm_key, ZBX_NO_MUTEX, sz, "history text cache", "HistoryTextCacheSize");
 
-	cache->text = (char *)__history_text_mem_malloc_func(NULL, CONFIG_TEXT_CACHE_SIZE);
-	cache->last_text = cache->text;
+	for (s = 0; s < CONFIG_HISTORY_CACHE_SHARDS; s++)
+	{
+		shard = &cache->shards[s];
+
+		shard->text = (char *)__history_text_mem_malloc_func(NULL, ZBX_TEXTBUFFER_SIZE);
+		shard->last_text = shard->text;
+		shard->text_in_sync = 0;
+		shard->text_vacuum = 0;
+	}
 
 	/* trend cache */
 
@@ -2744,12 +5093,101 @@ void	init_database_cache(unsigned char p)
 
 #define	INIT_HASHSET_SIZE	1000 /* should be calculated dynamically based on trends size? */
 
-	zbx_hashset_create_ext(&cache->trends, INIT_HASHSET_SIZE,
-			ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC,
-			__trend_mem_malloc_func, __trend_mem_realloc_func, __trend_mem_free_func);
+	/* trends are only referenced while the trend cache is locked, so they can be stored inline */
+	zbx_hashset_create_inline(&cache->trends, INIT_HASHSET_SIZE, sizeof(ZBX_DC_TREND),
+			ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC, NULL,
+			__trend_mem_try_malloc_func, __trend_mem_realloc_func, __trend_mem_free_func);
+
+	cache->trends_pending_num = 0;
+	cache->buckets = NULL;
+	cache->buckets_num = 0;
+	cache->buckets_alloc = 0;
+	cache->trends_flushing = 0;
 
 #undef	INIT_HASHSET_SIZE
 
+	/* last value cache */
+
+	if (0 != (zbx_process & ZBX_PROCESS_SERVER))
+	{
+		key_t	lastvalue_shm_key;
+
+		if (-1 == (lastvalue_shm_key = zbx_ftok(CONFIG_FILE, ZBX_IPC_LASTVALUE_ID)))
+		{
+			zabbix_log(LOG_LEVEL_CRIT, "Cannot create IPC key for last value cache");
+			exit(FAIL);
+		}
+
+		if (ZBX_MUTEX_ERROR == zbx_mutex_create_force(&lastvalues_lock, ZBX_MUTEX_LASTVALUES))
+		{
+			zbx_error("Unable to create mutex for last value cache");
+			exit(FAIL);
+		}
+
+		sz = zbx_mem_required_size(CONFIG_LASTVALUE_CACHE_SIZE, 1, "last value cache", "LastValueCacheSize");
+
+		zbx_mem_create(&lastvalue_mem, lastvalue_shm_key, ZBX_NO_MUTEX, sz, "last value cache", "LastValueCacheSize");
+
+		lastvalues = (ZBX_DC_LASTVALUES *)__lastvalue_mem_malloc_func(NULL, sizeof(ZBX_DC_LASTVALUES));
+
+		/* slots are allocated once, the hashset is never allowed to grow (see DCput_lastvalue()) */
+		zbx_hashset_create_ext(&lastvalues->items, CONFIG_LASTVALUE_CACHE_SIZE / 128,
+				ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC,
+				__lastvalue_mem_malloc_func, __lastvalue_mem_realloc_func, __lastvalue_mem_free_func);
+
+		lastvalues->last_flush = time(NULL);
+		lastvalues->flushing = 0;
+	}
+
+	/* DB writer queue */
+
+	if (0 != CONFIG_DBWRITER_FORKS)
+	{
+		key_t	write_queue_shm_key;
+		int	i;
+
+		if (-1 == (write_queue_shm_key = zbx_ftok(CONFIG_FILE, ZBX_IPC_WRITE_QUEUE_ID)))
+		{
+			zabbix_log(LOG_LEVEL_CRIT, "Cannot create IPC key for DB writer queue");
+			exit(FAIL);
+		}
+
+		if (ZBX_MUTEX_ERROR == zbx_mutex_create_force(&write_queue_lock, ZBX_MUTEX_WRITE_QUEUE))
+		{
+			zbx_error("Unable to create mutex for DB writer queue");
+			exit(FAIL);
+		}
+
+		/* every syncer can have one batch being written and one waiting */
+		s = 2 * CONFIG_HISTSYNCER_FORKS;
+
+		sz = sizeof(ZBX_DC_WRITE_QUEUE);
+		sz += s * sizeof(ZBX_DC_WRITE_SLOT);
+		sz += s * ZBX_SYNC_MAX * sizeof(ZBX_DC_WRITE_ROW);
+		sz = zbx_mem_required_size(sz, 2 + s, "DB writer queue", "StartDBWriters");
+
+		zbx_mem_create(&write_queue_mem, write_queue_shm_key, ZBX_NO_MUTEX, sz, "DB writer queue",
+				"StartDBWriters");
+
+		write_queue = (ZBX_DC_WRITE_QUEUE *)__write_queue_mem_malloc_func(NULL, sizeof(ZBX_DC_WRITE_QUEUE));
+		write_queue->slots = (ZBX_DC_WRITE_SLOT *)__write_queue_mem_malloc_func(NULL,
+				s * sizeof(ZBX_DC_WRITE_SLOT));
+		write_queue->slots_num = s;
+		write_queue->seq = 1;
+		write_queue->stopped = 1;	/* until the first DB writer starts, see DCstart_write_queue() */
+
+		for (i = 0; i < s; i++)
+		{
+			write_queue->slots[i].rows = (ZBX_DC_WRITE_ROW *)__write_queue_mem_malloc_func(NULL,
+					ZBX_SYNC_MAX * sizeof(ZBX_DC_WRITE_ROW));
+			write_queue->slots[i].rows_num = 0;
+			write_queue->slots[i].seq = 0;
+			write_queue->slots[i].writer = 0;
+			write_queue->slots[i].state = ZBX_WRITE_SLOT_FREE;
+			write_queue->slots[i].orphaned = 0;
+		}
+	}
+
 	if (NULL == sql)
 		sql = zbx_malloc(sql, sql_allocated);
 
@@ -2775,7 +5213,9 @@ static void	DCsync_all()
 {
 	zabbix_log(LOG_LEVEL_DEBUG, "In DCsync_all()");
 
+	DCflush_write_queue();
 	DCsync_history(ZBX_SYNC_FULL);
+	DCflush_lastvalues(ZBX_SYNC_FULL);
 	DCsync_trends();
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of DCsync_all()");
@@ -2799,31 +5239,116 @@ static void	DCsync_all()
 void	free_database_cache()
 {
 	const char	*__function_name = "free_database_cache";
+	int		s;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
 	DCsync_all();
 
-	LOCK_CACHE;
+	for (s = 0; s < CONFIG_HISTORY_CACHE_SHARDS; s++)
+		zbx_mutex_lock(&shard_locks[s]);
 	LOCK_TRENDS;
 	LOCK_CACHE_IDS;
 
+	if (NULL != journal)
+	{
+		LOCK_JOURNAL;
+
+		DCjournal_unmap(&journal_read);
+
+		if (NULL != journal_write.addr)
+			msync(journal_write.addr, journal_write.size, MS_SYNC);
+		DCjournal_unmap(&journal_write);
+
+		journal = NULL;
+
+		UNLOCK_JOURNAL;
+	}
+
 	cache = NULL;
 	zbx_mem_destroy(history_mem);
 	zbx_mem_destroy(history_text_mem);
 	zbx_mem_destroy(trend_mem);
 
+	if (NULL != lastvalues)
+	{
+		LOCK_LASTVALUES;
+		lastvalues = NULL;
+		zbx_mem_destroy(lastvalue_mem);
+		UNLOCK_LASTVALUES;
+		zbx_mutex_destroy(&lastvalues_lock);
+	}
+
+	if (NULL != write_queue)
+	{
+		LOCK_WRITE_QUEUE;
+		write_queue = NULL;
+		zbx_mem_destroy(write_queue_mem);
+		UNLOCK_WRITE_QUEUE;
+		zbx_mutex_destroy(&write_queue_lock);
+	}
+
 	UNLOCK_CACHE_IDS;
 	UNLOCK_TRENDS;
-	UNLOCK_CACHE;
+	for (s = 0; s < CONFIG_HISTORY_CACHE_SHARDS; s++)
+		zbx_mutex_unlock(&shard_locks[s]);
 
-	zbx_mutex_destroy(&cache_lock);
+	for (s = 0; s < CONFIG_HISTORY_CACHE_SHARDS; s++)
+		zbx_mutex_destroy(&shard_locks[s]);
 	zbx_mutex_destroy(&trends_lock);
 	zbx_mutex_destroy(&cache_ids_lock);
+	zbx_mutex_destroy(&journal_lock);
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: DCget_id                                                         *
+ *                                                                            *
+ * Purpose: find the id cache entry of a table, adding it if necessary        *
+ *                                                                            *
+ * Parameters: table_name - [IN] the table name                               *
+ *             created    - [OUT] 1 if the entry has been added, 0 otherwise  *
+ *                                                                            *
+ * Return value: the id cache entry                                           *
+ *                                                                            *
+ * Comments: must be called with the id cache locked                          *
+ *                                                                            *
+ ******************************************************************************/
+static ZBX_DC_ID	*DCget_id(const char *table_name, int *created)
+{
+	ZBX_DC_ID	*id;
+	int		i, n;
+
+	*created = 0;
+
+	for (n = 0, i = ZBX_DEFAULT_STRING_HASH_FUNC(table_name) % ids->size; n < ids->size;
+			n++, i = (i + 1) % ids->size)
+	{
+		id = &ids->id[i];
+
+		if ('\0' == *id->table_name)
+		{
+			zbx_strlcpy(id->table_name, table_name, sizeof(id->table_name));
+			id->lastid = 0;
+			id->reserved = 0;
+			id->reserve = ZBX_RESERVE_MIN;
+			id->reserve_time = 0;
+
+			*created = 1;
+
+			return id;
+		}
+
+		if (0 == strcmp(id->table_name, table_name))
+			return id;
+	}
+
+	zabbix_log(LOG_LEVEL_ERR, "Insufficient shared memory for ids");
+	exit(-1);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: DCget_nextid                                                     *
@@ -2842,7 +5367,7 @@ void	free_database_cache()
 zbx_uint64_t	DCget_nextid(const char *table_name, int num)
 {
 	const char	*__function_name = "DCget_nextid";
-	int		i, nodeid;
+	int		nodeid, created;
 	DB_RESULT	result;
 	DB_ROW		row;
 	const ZBX_TABLE	*table;
@@ -2854,34 +5379,21 @@ zbx_uint64_t	DCget_nextid(const char *table_name, int num)
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() table:'%s' num:%d",
 			__function_name, table_name, num);
 
-	for (i = 0; i < ZBX_IDS_SIZE; i++)
-	{
-		id = &ids->id[i];
-		if ('\0' == *id->table_name)
-			break;
-
-		if (0 == strcmp(id->table_name, table_name))
-		{
-			nextid = id->lastid + 1;
-			id->lastid += num;
+	id = DCget_id(table_name, &created);
 
-			zabbix_log(LOG_LEVEL_DEBUG, "End of %s() table:'%s' [" ZBX_FS_UI64 ":" ZBX_FS_UI64 "]",
-					__function_name, table_name, nextid, id->lastid);
+	if (0 == created)
+	{
+		nextid = id->lastid + 1;
+		id->lastid += num;
 
-			UNLOCK_CACHE_IDS;
+		zabbix_log(LOG_LEVEL_DEBUG, "End of %s() table:'%s' [" ZBX_FS_UI64 ":" ZBX_FS_UI64 "]",
+				__function_name, table_name, nextid, id->lastid);
 
-			return nextid;
-		}
-	}
+		UNLOCK_CACHE_IDS;
 
-	if (i == ZBX_IDS_SIZE)
-	{
-		zabbix_log(LOG_LEVEL_ERR, "Insufficient shared memory for ids");
-		exit(-1);
+		return nextid;
 	}
 
-	zbx_strlcpy(id->table_name, table_name, sizeof(id->table_name));
-
 	table = DBget_table(table_name);
 	nodeid = CONFIG_NODEID >= 0 ? CONFIG_NODEID : 0;
 
@@ -2932,14 +5444,14 @@ zbx_uint64_t	DCget_nextid(const char *table_name, int num)
  *                                                                            *
  * Author: Alexander Vladishev                                                *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: the number of ids reserved in the ids table at once follows the  *
+ *           consumption rate, between ZBX_RESERVE_MIN and ZBX_RESERVE_MAX    *
  *                                                                            *
  ******************************************************************************/
 zbx_uint64_t	DCget_nextid_shared(const char *table_name)
 {
-#define ZBX_RESERVE	256
 	const char	*__function_name = "DCget_nextid_shared";
-	int		i;
+	int		created, reserve, now;
 	ZBX_DC_ID	*id;
 	zbx_uint64_t	nextid;
 
@@ -2948,28 +5460,7 @@ zbx_uint64_t	DCget_nextid_shared(const char *table_name)
 
 	LOCK_CACHE_IDS;
 
-	for (i = 0; i < ZBX_IDS_SIZE; i++)
-	{
-		id = &ids->id[i];
-
-		if ('\0' == *id->table_name)
-		{
-			zbx_strlcpy(id->table_name, table_name, sizeof(id->table_name));
-			id->lastid = 0;
-			id->reserved = 0;
-
-			break;
-		}
-
-		if (0 == strcmp(id->table_name, table_name))
-			break;
-	}
-
-	if (i == ZBX_IDS_SIZE)
-	{
-		zabbix_log(LOG_LEVEL_ERR, "Insufficient shared memory for ids");
-		exit(-1);
-	}
+	id = DCget_id(table_name, &created);
 
 	if (id->reserved > 0)
 	{
@@ -2986,10 +5477,12 @@ zbx_uint64_t	DCget_nextid_shared(const char *table_name)
 		return nextid;
 	}
 
+	reserve = id->reserve;
+
 	UNLOCK_CACHE_IDS;
 
 retry:
-	nextid = DBget_nextid(table_name, ZBX_RESERVE) - 1;
+	nextid = DBget_nextid(table_name, reserve) - 1;
 
 	LOCK_CACHE_IDS;
 
@@ -3002,16 +5495,26 @@ retry:
 	if (0 == id->reserved)
 	{
 		id->lastid = nextid;
-		id->reserved = ZBX_RESERVE;
+		id->reserved = reserve;
+
+		/* size the next reservation after how long the previous one lasted */
+		now = (int)time(NULL);
+
+		if (now - id->reserve_time < ZBX_RESERVE_FAST && ZBX_RESERVE_MAX > id->reserve)
+			id->reserve *= 2;
+		else if (now - id->reserve_time > ZBX_RESERVE_SLOW && ZBX_RESERVE_MIN < id->reserve)
+			id->reserve /= 2;
+
+		id->reserve_time = now;
 	}
 	else if (id->lastid + id->reserved == nextid)
 	{
-		id->reserved += ZBX_RESERVE;
+		id->reserved += reserve;
 	}
-	else if (id->reserved < ZBX_RESERVE && nextid > id->lastid)
+	else if (id->reserved < reserve && nextid > id->lastid)
 	{
 		id->lastid = nextid;
-		id->reserved = ZBX_RESERVE;
+		id->reserved = reserve;
 	}
 
 	id->lastid++;
@@ -3044,19 +5547,22 @@ retry:
  ******************************************************************************/
 int	DCget_item_lastclock(zbx_uint64_t itemid)
 {
-	int	i, index, clock = FAIL;
+	ZBX_DC_SHARD	*shard;
+	int		i, index, clock = FAIL;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In DCget_item_lastclock(): itemid [" ZBX_FS_UI64 "]", itemid);
 
-	LOCK_CACHE;
+	shard = DCget_shard(itemid);
+
+	LOCK_SHARD(shard);
 
-	index = (cache->history_first + cache->history_num - 1) % ZBX_HISTORY_SIZE;
+	index = (shard->history_first + shard->history_num - 1) % ZBX_HISTORY_SIZE;
 
-	for (i = cache->history_num - 1; i >= 0; i--)
+	for (i = shard->history_num - 1; i >= 0; i--)
 	{
-		if (cache->history[index].itemid == itemid)
+		if (shard->history[index].itemid == itemid)
 		{
-			clock = cache->history[index].clock;
+			clock = shard->history[index].clock;
 			break;
 		}
 
@@ -3064,9 +5570,109 @@ int	DCget_item_lastclock(zbx_uint64_t itemid)
 			index = ZBX_HISTORY_SIZE - 1;
 	}
 
-	UNLOCK_CACHE;
+	UNLOCK_SHARD(shard);
+
+	/* the last clock may not be flushed to the database yet */
+	if (FAIL == clock && NULL != lastvalues)
+	{
+		ZBX_DC_LASTVALUE	*lv;
+
+		LOCK_LASTVALUES;
+
+		if (NULL != (lv = zbx_hashset_search(&lastvalues->items, &itemid)) && 0 != (lv->flags & ZBX_LASTVALUE_DIRTY))
+			clock = lv->lastclock;
+
+		UNLOCK_LASTVALUES;
+	}
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of DCget_item_lastclock(): %d", clock);
 
 	return clock;
 }
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCis_item_in_sync                                                *
+ *                                                                            *
+ * Purpose: check whether values of an item are being written to the         *
+ *          database by another history syncer                                *
+ *                                                                            *
+ * Parameters: itemid - [IN] item identifier                                  *
+ *                                                                            *
+ * Return value: SUCCEED - the values may not be committed yet,               *
+ *               FAIL - otherwise                                             *
+ *                                                                            *
+ * Comments: the batch of the calling process is not reported, its own        *
+ *           uncommitted values are visible to it                             *
+ *                                                                            *
+ ******************************************************************************/
+int	DCis_item_in_sync(zbx_uint64_t itemid)
+{
+	ZBX_DC_SHARD	*shard;
+	int		ret;
+
+	if (NULL != sync_itemids &&
+			SUCCEED == uint64_array_exists(sync_itemids->values, sync_itemids->values_num, itemid))
+	{
+		return FAIL;
+	}
+
+	shard = DCget_shard(itemid);
+
+	LOCK_SHARD(shard);
+
+	ret = uint64_array_exists(shard->itemids, shard->itemids_num, itemid);
+
+	UNLOCK_SHARD(shard);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCget_item_lastvalues                                            *
+ *                                                                            *
+ * Purpose: overwrite last values of an item read from the database with the  *
+ *          values kept in the last value cache                               *
+ *                                                                            *
+ * Parameters: item - [IN/OUT] item with itemid and value_type set            *
+ *                                                                            *
+ * Return value: SUCCEED - the item is cached and its last values were set,   *
+ *               FAIL - the item is not cached, values are left untouched     *
+ *                                                                            *
+ * Comments: only numeric items are kept in the cache                         *
+ *                                                                            *
+ ******************************************************************************/
+int	DCget_item_lastvalues(DB_ITEM *item)
+{
+	ZBX_DC_LASTVALUE	lv;
+
+	if (NULL == lastvalues)
+		return FAIL;
+
+	if (ITEM_VALUE_TYPE_FLOAT != item->value_type && ITEM_VALUE_TYPE_UINT64 != item->value_type)
+		return FAIL;
+
+	if (SUCCEED != DCget_lastvalue(&lv, item->itemid, item->value_type))
+		return FAIL;
+
+	item->lastclock = lv.lastclock;
+	item->lastvalue_null = (0 != (lv.flags & ZBX_LASTVALUE_NULL) ? 1 : 0);
+	item->prevvalue_null = (0 != (lv.flags & ZBX_PREVVALUE_NULL) ? 1 : 0);
+	item->prevorgvalue_null = (0 != (lv.flags & ZBX_PREVORGVALUE_NULL) ? 1 : 0);
+
+	if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
+	{
+		item->lastvalue_dbl = lv.lastvalue.value_float;
+		item->prevvalue_dbl = lv.prevvalue.value_float;
+		item->prevorgvalue_dbl = lv.prevorgvalue.value_float;
+	}
+	else
+	{
+		item->lastvalue_uint64 = lv.lastvalue.value_uint64;
+		item->prevvalue_uint64 = lv.prevvalue.value_uint64;
+		item->prevorgvalue_uint64 = lv.prevorgvalue.value_uint64;
+	}
+
+	return SUCCEED;
+}
@@ -30,8 +30,12 @@
 
 #include "zbxalgo.h"
 
-#define	LOCK_CACHE	zbx_mutex_lock(&config_lock)
-#define	UNLOCK_CACHE	zbx_mutex_unlock(&config_lock)
+#include <sys/mman.h>
+
+#define	LOCK_CACHE	zbx_rwlock_wrlock(&config_lock)
+#define	UNLOCK_CACHE	zbx_rwlock_wrunlock(&config_lock)
+#define	RDLOCK_CACHE	zbx_rwlock_rdlock(&config_lock)
+#define	RDUNLOCK_CACHE	zbx_rwlock_rdunlock(&config_lock)
 
 #define	ZBX_DC_ITEM		struct zbx_dc_item
 #define	ZBX_DC_ITEM_HK		struct zbx_dc_item_hk
@@ -49,8 +53,22 @@
 #define	ZBX_DC_HOST_PH		struct zbx_dc_host_ph
 #define	ZBX_DC_IPMIHOST		struct zbx_dc_ipmihost
 
+#define	ZBX_DC_TRIGGER		struct zbx_dc_trigger
+#define	ZBX_DC_FUNCTION		struct zbx_dc_function
+#define	ZBX_DC_ITEM_TR		struct zbx_dc_item_tr
+#define	ZBX_DC_TRIGGER_DEPLIST	struct zbx_dc_trigger_deplist
+
 #define	ZBX_DC_CONFIG		struct zbx_dc_config
 
+#define	ZBX_DC_ROW		struct zbx_dc_row
+#define	ZBX_DC_ITEM_SCHED	struct zbx_dc_item_sched
+#define	ZBX_DC_STAGE		struct zbx_dc_stage
+
+#define ZBX_TRIGGER_DEPENDENCY_LEVELS_MAX	32
+
+#define ZBX_DEPLIST_UNVISITED	-1
+#define ZBX_DEPLIST_VISITING	-2
+
 #define ZBX_LOC_NOWHERE	0
 #define ZBX_LOC_QUEUE	1
 #define ZBX_LOC_POLLER	2
@@ -59,15 +77,12 @@ ZBX_DC_ITEM
 {
 	zbx_uint64_t	itemid;
 	zbx_uint64_t	hostid;
+	zbx_uint64_t	digest;			/* of the database row the item was last synchronised from		*/
 	const char	*key;			/* interned; key[ITEM_KEY_LEN_MAX];					*/
-	int		delay;
-	int		nextcheck;
+	int		slot;			/* of the scheduling fields in ZBX_DC_ITEM_SCHED			*/
 	unsigned char	type;
 	unsigned char	data_type;
 	unsigned char	value_type;
-	unsigned char	poller_type;
-	unsigned char	status;
-	unsigned char	location;
 };
 
 ZBX_DC_ITEM_HK
@@ -149,6 +164,7 @@ ZBX_DC_HOST
 {
 	zbx_uint64_t	hostid;
 	zbx_uint64_t	proxy_hostid;
+	zbx_uint64_t	digest;			/* of the configuration columns the host was last synchronised from	*/
 	const char	*host;			/* interned; host[HOST_HOST_LEN_MAX];					*/
 	const char	*ip;			/* interned; ip[HOST_IP_LEN_MAX];					*/
 	const char	*dns;			/* interned; dns[HOST_DNS_LEN_MAX];					*/
@@ -168,6 +184,7 @@ ZBX_DC_HOST
 	unsigned char	ipmi_available;
 	unsigned char	status;
 	unsigned char	location;
+	int		queue_id;		/* in the passive proxy queue, if queued */
 };
 
 ZBX_DC_HOST_PH
@@ -190,6 +207,51 @@ ZBX_DC_IPMIHOST
 	unsigned char	ipmi_privilege;
 };
 
+ZBX_DC_TRIGGER
+{
+	zbx_uint64_t	triggerid;
+	const char	*expression;		/* interned; expression[TRIGGER_EXPRESSION_LEN_MAX];			*/
+	unsigned char	type;
+};
+
+/* only the ids are kept, they are needed to maintain items_tr as functions change */
+ZBX_DC_FUNCTION
+{
+	zbx_uint64_t	functionid;
+	zbx_uint64_t	triggerid;
+	zbx_uint64_t	itemid;
+};
+
+ZBX_DC_ITEM_TR
+{
+	zbx_uint64_t		itemid;
+	zbx_vector_uint64_t	triggerids;	/* one entry per function of the item, may repeat */
+};
+
+ZBX_DC_TRIGGER_DEPLIST
+{
+	zbx_uint64_t		triggerid;
+	zbx_vector_uint64_t	dependencies;	/* triggers this trigger depends on (triggerid_up) */
+	unsigned int		sync_num;
+	int			lastchange;	/* time of the last value update outside of configuration sync */
+	int			level;		/* triggers without dependencies are at level 0 */
+	unsigned char		value;
+};
+
+/* fields of the items used by the poller queues, one array per field indexed by ZBX_DC_ITEM slot */
+ZBX_DC_ITEM_SCHED
+{
+	ZBX_DC_ITEM	**items;
+	int		*nextcheck;
+	int		*delay;
+	int		*queue_id;	/* in the queue of the poller type, if queued */
+	unsigned char	*poller_type;
+	unsigned char	*status;
+	unsigned char	*location;
+	int		num;
+	int		alloc;
+};
+
 ZBX_DC_CONFIG
 {
 	zbx_hashset_t		items;
@@ -206,16 +268,70 @@ ZBX_DC_CONFIG
 	zbx_hashset_t		hosts;
 	zbx_hashset_t		hosts_ph;	/* proxy_hostid, host */
 	zbx_hashset_t		ipmihosts;
-	zbx_binary_heap_t	queues[ZBX_POLLER_TYPE_COUNT];
-	zbx_binary_heap_t	pqueue;
+	zbx_hashset_t		triggers;
+	zbx_hashset_t		functions;
+	zbx_hashset_t		items_tr;	/* itemid -> triggerids */
+	zbx_hashset_t		deplists;	/* trigger dependency graph */
+	ZBX_DC_ITEM_SCHED	items_sched;
+	zbx_timer_wheel_t	queues[ZBX_POLLER_TYPE_COUNT];	/* keys are item slots */
+	zbx_timer_wheel_t	pqueue;				/* keys are proxy hostids */
+	unsigned int		triggers_revision;		/* changes when triggers are removed */
+};
+
+#define ZBX_DC_STAGE_VALUES_MAX	32
+
+ZBX_DC_ROW
+{
+	zbx_uint64_t	id;
+	zbx_uint64_t	digest;
+	const char	**values;		/* string columns are interned, the rest are local copies */
+};
+
+ZBX_DC_STAGE
+{
+	ZBX_DC_ROW		*rows;		/* new and changed records */
+	int			rows_num;
+	int			rows_alloc;
+	int			values_num;
+	unsigned char		interned[ZBX_DC_STAGE_VALUES_MAX];
+	zbx_vector_uint64_t	removed;	/* cached records that were not selected */
 };
 
 static ZBX_DC_CONFIG	*config = NULL;
-static ZBX_MUTEX	config_lock;
+static ZBX_RWLOCK	config_lock;
 static zbx_mem_info_t	*config_mem;
+static unsigned char	zbx_process;
+
+ZBX_MEM_FUNC_DECL(__config);
 
 static unsigned int	sync_num = 0;
 
+/* trigger values changed by this process in the current transaction, they reach the dependency graph */
+/* only when the transaction is committed                                                             */
+static zbx_vector_uint64_t	trigger_value_ids;
+static zbx_hashmap_t		trigger_values;
+
+#define DC_ITEM_NEXTCHECK(item)		config->items_sched.nextcheck[(item)->slot]
+#define DC_ITEM_DELAY(item)		config->items_sched.delay[(item)->slot]
+#define DC_ITEM_QUEUE_ID(item)		config->items_sched.queue_id[(item)->slot]
+#define DC_ITEM_POLLER_TYPE(item)	config->items_sched.poller_type[(item)->slot]
+#define DC_ITEM_STATUS(item)		config->items_sched.status[(item)->slot]
+#define DC_ITEM_LOCATION(item)		config->items_sched.location[(item)->slot]
+
+#define ZBX_CONFIG_FULL_SYNC	10	/* every so many synchronisations reload all items, hosts and triggers */
+
+/* columns of the item, host, trigger and function selects in DCsync_configuration() and the string ones */
+/* among them */
+#define ZBX_DC_ITEM_VALUES_NUM		26
+#define ZBX_DC_HOST_VALUES_NUM		27
+#define ZBX_DC_TRIGGER_VALUES_NUM	3
+#define ZBX_DC_FUNCTION_VALUES_NUM	3
+
+static const int	item_strings[] = {6, 7, 8, 10, 12, 13, 14, 16, 17, 18, 19, 22, 23, 24, 25, -1};
+static const int	host_strings[] = {2, 4, 5, 8, 12, 13, -1};
+static const int	trigger_strings[] = {2, -1};
+static const int	function_strings[] = {-1};
+
 static const char	*INTERNED_SERVER_STATUS_KEY;
 static const char	*INTERNED_SERVER_ZABBIXLOG_KEY;
 
@@ -282,7 +398,7 @@ static int	DCget_reachable_nextcheck(const ZBX_DC_ITEM *item, int now)
 {
 	int	nextcheck;
 
-	if (ITEM_STATUS_NOTSUPPORTED == item->status)
+	if (ITEM_STATUS_NOTSUPPORTED == DC_ITEM_STATUS(item))
 		nextcheck = calculate_item_nextcheck(item->itemid, item->type,
 				CONFIG_REFRESH_UNSUPPORTED, NULL, now, NULL);
 	else
@@ -291,7 +407,7 @@ static int	DCget_reachable_nextcheck(const ZBX_DC_ITEM *item, int now)
 
 		flexitem = zbx_hashset_search(&config->flexitems, &item->itemid);
 		nextcheck = calculate_item_nextcheck(item->itemid, item->type,
-				item->delay, flexitem ? flexitem->delay_flex : NULL, now, NULL);
+				DC_ITEM_DELAY(item), flexitem ? flexitem->delay_flex : NULL, now, NULL);
 	}
 
 	return nextcheck;
@@ -415,54 +531,266 @@ static ZBX_DC_HOST	*DCfind_host(zbx_uint64_t proxy_hostid, const char *hostname)
 		return host_ph->host_ptr;
 }
 
-static void	DCstrpool_replace(int found, const char **curr, const char *new)
+/******************************************************************************
+ *                                                                            *
+ * Function: DCstrpool_assign                                                 *
+ *                                                                            *
+ * Purpose: replace a cached string with one interned while staging           *
+ *                                                                            *
+ * Comments: interned strings are unique, so comparing pointers is enough     *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCstrpool_assign(int found, const char **curr, const char *interned)
 {
-	if (!found)
+	if (found)
 	{
-		*curr = zbx_strpool_intern(new);
+		if (*curr == interned)
+			return;
+
+		zbx_strpool_release(*curr);
 	}
-	else if (0 != strcmp(*curr, new))
+
+	*curr = zbx_strpool_acquire(interned);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCrow_digest                                                     *
+ *                                                                            *
+ * Purpose: fold database row columns from..to into a 64-bit digest           *
+ *                                                                            *
+ * Parameters: digest - [IN] digest of the preceding columns or 0             *
+ *             row    - [IN] database row                                     *
+ *             from   - [IN] first column                                     *
+ *             to     - [IN] last column                                      *
+ *                                                                            *
+ * Return value: the updated digest                                           *
+ *                                                                            *
+ * Comments: the two halves come from different hash functions. Terminating   *
+ *           zeroes are hashed too, so that "ab","c" and "a","bc" differ.     *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_uint64_t	DCrow_digest(zbx_uint64_t digest, DB_ROW row, int from, int to)
+{
+	zbx_hash_t	lo, hi;
+	const char	*value;
+	size_t		len;
+	int		i;
+
+	lo = (zbx_hash_t)(digest & 0xffffffff);
+	hi = (zbx_hash_t)(digest >> 32);
+
+	for (i = from; i <= to; i++)
 	{
-		zbx_strpool_release(*curr);
-		*curr = zbx_strpool_intern(new);
+		value = (NULL != row[i] ? row[i] : "");
+		len = strlen(value) + 1;
+
+		lo = zbx_hash_modfnv(value, len, lo);
+		hi = zbx_hash_murmur2(value, len, hi);
 	}
+
+	return ((zbx_uint64_t)hi << 32) | lo;
 }
 
-static void	DCupdate_item_queue(ZBX_DC_ITEM *item, unsigned char old_poller_type, int old_nextcheck)
+static void	DCstage_init(ZBX_DC_STAGE *stage, int values_num, const int *strings)
 {
-	zbx_binary_heap_elem_t	elem;
+	memset(stage, 0, sizeof(ZBX_DC_STAGE));
 
-	if (ZBX_LOC_POLLER == item->location)
-		return;
+	stage->values_num = values_num;
+
+	for (; -1 != *strings; strings++)
+		stage->interned[*strings] = 1;
+
+	zbx_vector_uint64_create(&stage->removed);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCstage_row                                                      *
+ *                                                                            *
+ * Purpose: keep a new or changed database row for DCsync_items(),            *
+ *          DCsync_hosts(), DCsync_triggers() or DCsync_functions()           *
+ *                                                                            *
+ * Comments: string columns are interned here, outside of the configuration   *
+ *           cache lock. The string pool has its own lock.                    *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCstage_row(ZBX_DC_STAGE *stage, zbx_uint64_t id, zbx_uint64_t digest, DB_ROW row)
+{
+	ZBX_DC_ROW	*dc_row;
+	const char	*value;
+	int		i;
+
+	if (stage->rows_num == stage->rows_alloc)
+	{
+		stage->rows_alloc = (0 == stage->rows_alloc ? 64 : stage->rows_alloc * 3 / 2);
+		stage->rows = zbx_realloc(stage->rows, stage->rows_alloc * sizeof(ZBX_DC_ROW));
+	}
+
+	dc_row = &stage->rows[stage->rows_num++];
+	dc_row->id = id;
+	dc_row->digest = digest;
+	dc_row->values = zbx_malloc(NULL, stage->values_num * sizeof(const char *));
+
+	for (i = 0; i < stage->values_num; i++)
+	{
+		value = (NULL != row[i] ? row[i] : "");
+
+		if (0 != stage->interned[i])
+			dc_row->values[i] = zbx_strpool_intern(value);
+		else
+			dc_row->values[i] = zbx_strdup(NULL, value);
+	}
+}
+
+static void	DCstage_free(ZBX_DC_STAGE *stage)
+{
+	int	i, j;
+
+	for (i = 0; i < stage->rows_num; i++)
+	{
+		for (j = 0; j < stage->values_num; j++)
+		{
+			if (0 != stage->interned[j])
+				zbx_strpool_release(stage->rows[i].values[j]);
+			else
+				free((void *)stage->rows[i].values[j]);
+		}
+
+		zbx_free(stage->rows[i].values);
+	}
+
+	zbx_free(stage->rows);
+	zbx_vector_uint64_destroy(&stage->removed);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCstage_new_rows                                                 *
+ *                                                                            *
+ * Purpose: count staged rows that are not in the cache yet                   *
+ *                                                                            *
+ * Parameters: stage   - [IN] staged rows                                     *
+ *             records - [IN] cached records, keyed by row id                 *
+ *                                                                            *
+ * Return value: number of new rows                                           *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCstage_new_rows(const ZBX_DC_STAGE *stage, zbx_hashset_t *records)
+{
+	int	i, new_num = 0;
+
+	for (i = 0; i < stage->rows_num; i++)
+	{
+		if (NULL == zbx_hashset_search(records, &stage->rows[i].id))
+			new_num++;
+	}
+
+	return new_num;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCsched_add                                                      *
+ *                                                                            *
+ * Purpose: give a new item a slot at the end of the scheduling arrays        *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCsched_add(ZBX_DC_ITEM *item)
+{
+	ZBX_DC_ITEM_SCHED	*sched = &config->items_sched;
+
+	if (sched->num == sched->alloc)
+	{
+		sched->alloc = (0 == sched->alloc ? 1024 : sched->alloc * 3 / 2);
+
+		sched->items = __config_mem_realloc_func(sched->items, sched->alloc * sizeof(ZBX_DC_ITEM *));
+		sched->nextcheck = __config_mem_realloc_func(sched->nextcheck, sched->alloc * sizeof(int));
+		sched->delay = __config_mem_realloc_func(sched->delay, sched->alloc * sizeof(int));
+		sched->queue_id = __config_mem_realloc_func(sched->queue_id, sched->alloc * sizeof(int));
+		sched->poller_type = __config_mem_realloc_func(sched->poller_type, sched->alloc);
+		sched->status = __config_mem_realloc_func(sched->status, sched->alloc);
+		sched->location = __config_mem_realloc_func(sched->location, sched->alloc);
+	}
+
+	item->slot = sched->num++;
+
+	sched->items[item->slot] = item;
+	sched->nextcheck[item->slot] = 0;
+	sched->delay[item->slot] = 0;
+	sched->queue_id[item->slot] = -1;
+	sched->poller_type[item->slot] = ZBX_NO_POLLER;
+	sched->status[item->slot] = ITEM_STATUS_ACTIVE;
+	sched->location[item->slot] = ZBX_LOC_NOWHERE;
+}
 
-	if (ZBX_LOC_QUEUE == item->location && old_poller_type != item->poller_type)
+/******************************************************************************
+ *                                                                            *
+ * Function: DCsched_remove                                                   *
+ *                                                                            *
+ * Purpose: release the slot of an item that is being removed                 *
+ *                                                                            *
+ * Comments: the item must not be in a queue. The last slot is moved into the *
+ *           released one to keep the arrays dense, its queue entry is        *
+ *           rekeyed accordingly.                                             *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCsched_remove(ZBX_DC_ITEM *item)
+{
+	ZBX_DC_ITEM_SCHED	*sched = &config->items_sched;
+	int			slot = item->slot, last = sched->num - 1;
+
+	if (slot != last)
 	{
-		item->location = ZBX_LOC_NOWHERE;
-		zbx_binary_heap_remove_direct(&config->queues[old_poller_type], item->itemid);
+		sched->items[slot] = sched->items[last];
+		sched->nextcheck[slot] = sched->nextcheck[last];
+		sched->delay[slot] = sched->delay[last];
+		sched->queue_id[slot] = sched->queue_id[last];
+		sched->poller_type[slot] = sched->poller_type[last];
+		sched->status[slot] = sched->status[last];
+		sched->location[slot] = sched->location[last];
+
+		sched->items[slot]->slot = slot;
+
+		if (ZBX_LOC_QUEUE == sched->location[slot])
+			zbx_timer_wheel_set_key(&config->queues[sched->poller_type[slot]], sched->queue_id[slot], slot);
 	}
 
-	if (item->poller_type >= ZBX_POLLER_TYPE_COUNT)
+	sched->num--;
+}
+
+static void	DCupdate_item_queue(ZBX_DC_ITEM *item, unsigned char old_poller_type, int old_nextcheck)
+{
+	if (ZBX_LOC_POLLER == DC_ITEM_LOCATION(item))
 		return;
 
-	if (ZBX_LOC_QUEUE == item->location && old_nextcheck == item->nextcheck)
+	if (ZBX_LOC_QUEUE == DC_ITEM_LOCATION(item) && old_poller_type != DC_ITEM_POLLER_TYPE(item))
+	{
+		DC_ITEM_LOCATION(item) = ZBX_LOC_NOWHERE;
+		zbx_timer_wheel_remove(&config->queues[old_poller_type], DC_ITEM_QUEUE_ID(item));
+	}
+
+	if (DC_ITEM_POLLER_TYPE(item) >= ZBX_POLLER_TYPE_COUNT)
 		return;
 
-	elem.key = item->itemid;
-	elem.data = (const void *)item;
+	if (ZBX_LOC_QUEUE == DC_ITEM_LOCATION(item) && old_nextcheck == DC_ITEM_NEXTCHECK(item))
+		return;
 
-	if (ZBX_LOC_QUEUE == item->location)
-		zbx_binary_heap_update_direct(&config->queues[item->poller_type], &elem);
+	if (ZBX_LOC_QUEUE == DC_ITEM_LOCATION(item))
+	{
+		zbx_timer_wheel_update(&config->queues[DC_ITEM_POLLER_TYPE(item)], DC_ITEM_QUEUE_ID(item),
+				DC_ITEM_NEXTCHECK(item));
+	}
 	else
 	{
-		item->location = ZBX_LOC_QUEUE;
-		zbx_binary_heap_insert(&config->queues[item->poller_type], &elem);
+		DC_ITEM_LOCATION(item) = ZBX_LOC_QUEUE;
+		DC_ITEM_QUEUE_ID(item) = zbx_timer_wheel_insert(&config->queues[DC_ITEM_POLLER_TYPE(item)],
+				item->slot, DC_ITEM_NEXTCHECK(item));
 	}
 }
 
 static void	DCupdate_proxy_queue(ZBX_DC_HOST *host)
 {
-	zbx_binary_heap_elem_t	elem;
-
 	if (ZBX_LOC_POLLER == host->location)
 		return;
 
@@ -471,29 +799,94 @@ static void	DCupdate_proxy_queue(ZBX_DC_HOST *host)
 		if (ZBX_LOC_QUEUE == host->location)
 		{
 			host->location = ZBX_LOC_NOWHERE;
-			zbx_binary_heap_remove_direct(&config->pqueue, host->hostid);
+			zbx_timer_wheel_remove(&config->pqueue, host->queue_id);
 		}
 
 		return;
 	}
 
-	elem.key = host->hostid;
-	elem.data = (const void *)host;
-
 	if (ZBX_LOC_QUEUE == host->location)
-		zbx_binary_heap_update_direct(&config->pqueue, &elem);
+		zbx_timer_wheel_update(&config->pqueue, host->queue_id, host->disable_until);
 	else
 	{
 		host->location = ZBX_LOC_QUEUE;
-		zbx_binary_heap_insert(&config->pqueue, &elem);
+		host->queue_id = zbx_timer_wheel_insert(&config->pqueue, host->hostid, host->disable_until);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCstage_items                                                    *
+ *                                                                            *
+ * Purpose: find items that DCsync_items() has to add, update or remove       *
+ *                                                                            *
+ * Parameters: result          - [IN] selected items                          *
+ *             changed_itemids - [IN] changed items after an incremental      *
+ *                               selection, NULL after a full one             *
+ *             changed_hostids - [IN] changed hosts after an incremental      *
+ *                               selection                                    *
+ *             stage           - [OUT] new and changed rows, removed items    *
+ *                                                                            *
+ * Comments: runs without the configuration cache lock. This is safe because  *
+ *           only the configuration syncer adds or removes items and writes   *
+ *           the fields used here.                                            *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCstage_items(DB_RESULT result, zbx_vector_uint64_t *changed_itemids,
+		zbx_vector_uint64_t *changed_hostids, ZBX_DC_STAGE *stage)
+{
+	DB_ROW			row;
+	ZBX_DC_ITEM		*item;
+	zbx_uint64_t		itemid, digest;
+	zbx_vector_uint64_t	ids;
+	zbx_hashset_iter_t	iter;
+
+	zbx_vector_uint64_create(&ids);
+	zbx_vector_uint64_reserve(&ids, config->items.num_data + 32);
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		ZBX_STR2UINT64(itemid, row[0]);
+
+		/* array of selected items */
+		zbx_vector_uint64_append(&ids, itemid);
+
+		digest = DCrow_digest(0, row, 0, stage->values_num - 1);
+
+		if (NULL == (item = zbx_hashset_search(&config->items, &itemid)) || digest != item->digest)
+			DCstage_row(stage, itemid, digest, row);
+	}
+
+	zbx_vector_uint64_sort(&ids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	zbx_hashset_iter_reset(&config->items, &iter);
+
+	while (NULL != (item = zbx_hashset_iter_next(&iter)))
+	{
+		if (FAIL != zbx_vector_uint64_bsearch(&ids, item->itemid, ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+			continue;
+
+		/* after an incremental synchronisation only the changed items can be gone */
+		if (NULL != changed_itemids &&
+				FAIL == zbx_vector_uint64_bsearch(changed_itemids, item->itemid,
+						ZBX_DEFAULT_UINT64_COMPARE_FUNC) &&
+				FAIL == zbx_vector_uint64_bsearch(changed_hostids, item->hostid,
+						ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+		{
+			continue;
+		}
+
+		zbx_vector_uint64_append(&stage->removed, item->itemid);
 	}
+
+	zbx_vector_uint64_destroy(&ids);
 }
 
-static void	DCsync_items(DB_RESULT result)
+static void	DCsync_items(ZBX_DC_STAGE *stage)
 {
 	const char		*__function_name = "DCsync_items";
 
-	DB_ROW			row;
+	const char		**row;
 
 	ZBX_DC_ITEM		*item;
 	ZBX_DC_SNMPITEM		*snmpitem;
@@ -510,30 +903,31 @@ static void	DCsync_items(DB_RESULT result)
 
 	time_t			now;
 	unsigned char		status, old_poller_type;
-	int			delay, found;
+	int			delay, found, i, new_num;
 	int			update_index, old_nextcheck;
 	zbx_uint64_t		itemid, hostid, proxy_hostid;
-	zbx_vector_uint64_t	ids;
-	zbx_hashset_iter_t	iter;
-
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
-	zbx_vector_uint64_create(&ids);
-	zbx_vector_uint64_reserve(&ids, config->items.num_data + 32);
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() staged:%d removed:%d", __function_name,
+			stage->rows_num, stage->removed.values_num);
 
 	now = time(NULL);
 
-	while (NULL != (row = DBfetch(result)))
+	/* items_hk records of new items are allocated in one go, records of item types as they come */
+
+	new_num = DCstage_new_rows(stage, &config->items);
+	zbx_mem_slab_reserve(config_mem, sizeof(ZBX_HASHSET_ENTRY_T), new_num);
+	zbx_mem_slab_reserve(config_mem, sizeof(ZBX_DC_ITEM_HK), new_num);
+
+	for (i = 0; i < stage->rows_num; i++)
 	{
-		ZBX_STR2UINT64(itemid, row[0]);
+		row = stage->rows[i].values;
+
+		itemid = stage->rows[i].id;
 		ZBX_STR2UINT64(hostid, row[1]);
 		ZBX_STR2UINT64(proxy_hostid, row[2]);
 		delay = atoi(row[15]);
 		status = (unsigned char)atoi(row[20]);
 
-		/* array of selected items */
-		zbx_vector_uint64_append(&ids, itemid);
-
 		item = DCfind_id(&config->items, itemid, sizeof(ZBX_DC_ITEM), &found);
 
 		/* see whether we should and can update items_hk index at this point */
@@ -572,10 +966,11 @@ static void	DCsync_items(DB_RESULT result)
 
 		item->itemid = itemid;
 		item->hostid = hostid;
+		item->digest = stage->rows[i].digest;
 		item->type = (unsigned char)atoi(row[3]);
 		item->data_type = (unsigned char)atoi(row[4]);
 		item->value_type = (unsigned char)atoi(row[5]);
-		DCstrpool_replace(found, &item->key, row[6]);
+		DCstrpool_assign(found, &item->key, row[6]);
 
 		/* update items_hk index using new data, if not done already */
 
@@ -590,37 +985,36 @@ static void	DCsync_items(DB_RESULT result)
 
 		if (!found)
 		{
-			item->location = ZBX_LOC_NOWHERE;
-			item->poller_type = ZBX_NO_POLLER;
+			DCsched_add(item);
 			old_nextcheck = 0;
 
 			if (ITEM_STATUS_NOTSUPPORTED == status)
-				item->nextcheck = calculate_item_nextcheck(itemid, item->type,
+				DC_ITEM_NEXTCHECK(item) = calculate_item_nextcheck(itemid, item->type,
 						CONFIG_REFRESH_UNSUPPORTED, NULL, now, NULL);
 			else
-				item->nextcheck = calculate_item_nextcheck(itemid, item->type,
+				DC_ITEM_NEXTCHECK(item) = calculate_item_nextcheck(itemid, item->type,
 						delay, row[16], now, NULL);
 		}
 		else
 		{
-			old_nextcheck = item->nextcheck;
+			old_nextcheck = DC_ITEM_NEXTCHECK(item);
 
-			if (ITEM_STATUS_ACTIVE == status && (status != item->status || delay != item->delay))
-				item->nextcheck = calculate_item_nextcheck(itemid, item->type,
+			if (ITEM_STATUS_ACTIVE == status && (status != DC_ITEM_STATUS(item) || delay != DC_ITEM_DELAY(item)))
+				DC_ITEM_NEXTCHECK(item) = calculate_item_nextcheck(itemid, item->type,
 						delay, row[16], now, NULL);
-			else if (ITEM_STATUS_NOTSUPPORTED == status && status != item->status)
-				item->nextcheck = calculate_item_nextcheck(itemid, item->type,
+			else if (ITEM_STATUS_NOTSUPPORTED == status && status != DC_ITEM_STATUS(item))
+				DC_ITEM_NEXTCHECK(item) = calculate_item_nextcheck(itemid, item->type,
 						CONFIG_REFRESH_UNSUPPORTED, NULL, now, NULL);
 		}
 
-		item->status = status;
-		item->delay = delay;
+		DC_ITEM_STATUS(item) = status;
+		DC_ITEM_DELAY(item) = delay;
 
-		old_poller_type = item->poller_type;
-		poller_by_item(itemid, proxy_hostid, item->type, item->key, &item->poller_type);
+		old_poller_type = DC_ITEM_POLLER_TYPE(item);
+		poller_by_item(itemid, proxy_hostid, item->type, item->key, &DC_ITEM_POLLER_TYPE(item));
 		if (ZBX_POLLER_TYPE_UNREACHABLE == old_poller_type &&
-				(ZBX_POLLER_TYPE_NORMAL == item->poller_type || ZBX_POLLER_TYPE_IPMI == item->poller_type))
-			item->poller_type = ZBX_POLLER_TYPE_UNREACHABLE;
+				(ZBX_POLLER_TYPE_NORMAL == DC_ITEM_POLLER_TYPE(item) || ZBX_POLLER_TYPE_IPMI == DC_ITEM_POLLER_TYPE(item)))
+			DC_ITEM_POLLER_TYPE(item) = ZBX_POLLER_TYPE_UNREACHABLE;
 
 		DCupdate_item_queue(item, old_poller_type, old_nextcheck);
 
@@ -631,13 +1025,13 @@ static void	DCsync_items(DB_RESULT result)
 			snmpitem = DCfind_id(&config->snmpitems, itemid, sizeof(ZBX_DC_SNMPITEM), &found);
 
 			snmpitem->itemid = itemid;
-			DCstrpool_replace(found, &snmpitem->snmp_community, row[7]);
-			DCstrpool_replace(found, &snmpitem->snmp_oid, row[8]);
+			DCstrpool_assign(found, &snmpitem->snmp_community, row[7]);
+			DCstrpool_assign(found, &snmpitem->snmp_oid, row[8]);
 			snmpitem->snmp_port = (unsigned short)atoi(row[9]);
-			DCstrpool_replace(found, &snmpitem->snmpv3_securityname, row[10]);
+			DCstrpool_assign(found, &snmpitem->snmpv3_securityname, row[10]);
 			snmpitem->snmpv3_securitylevel = (unsigned char)atoi(row[11]);
-			DCstrpool_replace(found, &snmpitem->snmpv3_authpassphrase, row[12]);
-			DCstrpool_replace(found, &snmpitem->snmpv3_privpassphrase, row[13]);
+			DCstrpool_assign(found, &snmpitem->snmpv3_authpassphrase, row[12]);
+			DCstrpool_assign(found, &snmpitem->snmpv3_privpassphrase, row[13]);
 		}
 		else if (NULL != (snmpitem = zbx_hashset_search(&config->snmpitems, &itemid)))
 		{
@@ -659,7 +1053,7 @@ static void	DCsync_items(DB_RESULT result)
 			ipmiitem = DCfind_id(&config->ipmiitems, itemid, sizeof(ZBX_DC_IPMIITEM), &found);
 
 			ipmiitem->itemid = itemid;
-			DCstrpool_replace(found, &ipmiitem->ipmi_sensor, row[14]);
+			DCstrpool_assign(found, &ipmiitem->ipmi_sensor, row[14]);
 		}
 		else if (NULL != (ipmiitem = zbx_hashset_search(&config->ipmiitems, &itemid)))
 		{
@@ -675,7 +1069,7 @@ static void	DCsync_items(DB_RESULT result)
 			flexitem = DCfind_id(&config->flexitems, itemid, sizeof(ZBX_DC_FLEXITEM), &found);
 
 			flexitem->itemid = itemid;
-			DCstrpool_replace(found, &flexitem->delay_flex, row[16]);
+			DCstrpool_assign(found, &flexitem->delay_flex, row[16]);
 		}
 		else if (NULL != (flexitem = zbx_hashset_search(&config->flexitems, &itemid)))
 		{
@@ -691,7 +1085,7 @@ static void	DCsync_items(DB_RESULT result)
 			trapitem = DCfind_id(&config->trapitems, itemid, sizeof(ZBX_DC_TRAPITEM), &found);
 
 			trapitem->itemid = itemid;
-			DCstrpool_replace(found, &trapitem->trapper_hosts, row[17]);
+			DCstrpool_assign(found, &trapitem->trapper_hosts, row[17]);
 		}
 		else if (NULL != (trapitem = zbx_hashset_search(&config->trapitems, &itemid)))
 		{
@@ -707,7 +1101,7 @@ static void	DCsync_items(DB_RESULT result)
 			logitem = DCfind_id(&config->logitems, itemid, sizeof(ZBX_DC_LOGITEM), &found);
 
 			logitem->itemid = itemid;
-			DCstrpool_replace(found, &logitem->logtimefmt, row[18]);
+			DCstrpool_assign(found, &logitem->logtimefmt, row[18]);
 		}
 		else if (NULL != (logitem = zbx_hashset_search(&config->logitems, &itemid)))
 		{
@@ -723,7 +1117,7 @@ static void	DCsync_items(DB_RESULT result)
 			dbitem = DCfind_id(&config->dbitems, itemid, sizeof(ZBX_DC_DBITEM), &found);
 
 			dbitem->itemid = itemid;
-			DCstrpool_replace(found, &dbitem->params, row[19]);
+			DCstrpool_assign(found, &dbitem->params, row[19]);
 		}
 		else if (NULL != (dbitem = zbx_hashset_search(&config->dbitems, &itemid)))
 		{
@@ -740,11 +1134,11 @@ static void	DCsync_items(DB_RESULT result)
 
 			sshitem->itemid = itemid;
 			sshitem->authtype = (unsigned short)atoi(row[21]);
-			DCstrpool_replace(found, &sshitem->username, row[22]);
-			DCstrpool_replace(found, &sshitem->password, row[23]);
-			DCstrpool_replace(found, &sshitem->publickey, row[24]);
-			DCstrpool_replace(found, &sshitem->privatekey, row[25]);
-			DCstrpool_replace(found, &sshitem->params, row[19]);
+			DCstrpool_assign(found, &sshitem->username, row[22]);
+			DCstrpool_assign(found, &sshitem->password, row[23]);
+			DCstrpool_assign(found, &sshitem->publickey, row[24]);
+			DCstrpool_assign(found, &sshitem->privatekey, row[25]);
+			DCstrpool_assign(found, &sshitem->params, row[19]);
 		}
 		else if (NULL != (sshitem = zbx_hashset_search(&config->sshitems, &itemid)))
 		{
@@ -766,9 +1160,9 @@ static void	DCsync_items(DB_RESULT result)
 			telnetitem = DCfind_id(&config->telnetitems, itemid, sizeof(ZBX_DC_TELNETITEM), &found);
 
 			telnetitem->itemid = itemid;
-			DCstrpool_replace(found, &telnetitem->username, row[22]);
-			DCstrpool_replace(found, &telnetitem->password, row[23]);
-			DCstrpool_replace(found, &telnetitem->params, row[19]);
+			DCstrpool_assign(found, &telnetitem->username, row[22]);
+			DCstrpool_assign(found, &telnetitem->password, row[23]);
+			DCstrpool_assign(found, &telnetitem->params, row[19]);
 		}
 		else if (NULL != (telnetitem = zbx_hashset_search(&config->telnetitems, &itemid)))
 		{
@@ -788,7 +1182,7 @@ static void	DCsync_items(DB_RESULT result)
 			calcitem = DCfind_id(&config->calcitems, itemid, sizeof(ZBX_DC_CALCITEM), &found);
 
 			calcitem->itemid = itemid;
-			DCstrpool_replace(found, &calcitem->params, row[19]);
+			DCstrpool_assign(found, &calcitem->params, row[19]);
 		}
 		else if (NULL != (calcitem = zbx_hashset_search(&config->calcitems, &itemid)))
 		{
@@ -800,16 +1194,10 @@ static void	DCsync_items(DB_RESULT result)
 
 	/* remove deleted or disabled items from buffer */
 
-	zbx_vector_uint64_sort(&ids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
-
-	zbx_hashset_iter_reset(&config->items, &iter);
-
-	while (NULL != (item = zbx_hashset_iter_next(&iter)))
+	for (i = 0; i < stage->removed.values_num; i++)
 	{
-		itemid = item->itemid;
-
-		if (FAIL != zbx_vector_uint64_bsearch(&ids, itemid, ZBX_DEFAULT_UINT64_COMPARE_FUNC))
-			continue;
+		itemid = stage->removed.values[i];
+		item = zbx_hashset_search(&config->items, &itemid);
 
 		/* SNMP items */
 
@@ -921,63 +1309,127 @@ static void	DCsync_items(DB_RESULT result)
 			zbx_hashset_remove(&config->items_hk, &item_hk_local);
 		}
 
-		if (ZBX_LOC_QUEUE == item->location)
-			zbx_binary_heap_remove_direct(&config->queues[item->poller_type], item->itemid);
+		if (ZBX_LOC_QUEUE == DC_ITEM_LOCATION(item))
+			zbx_timer_wheel_remove(&config->queues[DC_ITEM_POLLER_TYPE(item)], DC_ITEM_QUEUE_ID(item));
+
+		DCsched_remove(item);
 
 		zbx_strpool_release(item->key);
-		zbx_hashset_iter_remove(&iter);
+		zbx_hashset_remove(&config->items, &itemid);
 	}
 
-	zbx_vector_uint64_destroy(&ids);
-
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
-static void	DCsync_hosts(DB_RESULT result)
+/******************************************************************************
+ *                                                                            *
+ * Function: DCstage_hosts                                                    *
+ *                                                                            *
+ * Purpose: find hosts that DCsync_hosts() has to add, update or remove       *
+ *                                                                            *
+ * Parameters: result          - [IN] selected hosts                          *
+ *             changed_hostids - [IN] changed hosts after an incremental      *
+ *                               selection, NULL after a full one             *
+ *             stage           - [OUT] new and changed rows, removed hosts    *
+ *                                                                            *
+ * Comments: runs without the configuration cache lock, see DCstage_items().  *
+ *           Availability columns are left out of the digest. Pollers keep    *
+ *           them up to date in the cache, and they are only read for new     *
+ *           hosts.                                                           *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCstage_hosts(DB_RESULT result, zbx_vector_uint64_t *changed_hostids, ZBX_DC_STAGE *stage)
 {
-	const char		*__function_name = "DCsync_hosts";
-
 	DB_ROW			row;
-
 	ZBX_DC_HOST		*host;
-	ZBX_DC_IPMIHOST		*ipmihost;
-
-	ZBX_DC_HOST_PH		*host_ph, host_ph_local;
-
-	int			found;
-	int			update_index, update_queue;
-	zbx_uint64_t		hostid, proxy_hostid;
+	zbx_uint64_t		hostid, digest;
 	zbx_vector_uint64_t	ids;
 	zbx_hashset_iter_t	iter;
-	unsigned char		status;
-	time_t			now;
-
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
 	zbx_vector_uint64_create(&ids);
 	zbx_vector_uint64_reserve(&ids, config->hosts.num_data + 32);
 
-	now = time(NULL);
-
 	while (NULL != (row = DBfetch(result)))
 	{
 		ZBX_STR2UINT64(hostid, row[0]);
-		ZBX_STR2UINT64(proxy_hostid, row[1]);
-		status = (unsigned char)atoi(row[26]);
 
 		/* array of selected hosts */
 		zbx_vector_uint64_append(&ids, hostid);
 
-		host = DCfind_id(&config->hosts, hostid, sizeof(ZBX_DC_HOST), &found);
+		digest = DCrow_digest(0, row, 0, 16);
+		digest = DCrow_digest(digest, row, 26, 26);
 
-		/* see whether we should and can update hosts_ph index at this point */
+		if (NULL == (host = zbx_hashset_search(&config->hosts, &hostid)) || digest != host->digest)
+			DCstage_row(stage, hostid, digest, row);
+	}
 
-		update_index = 0;
+	zbx_vector_uint64_sort(&ids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
 
-		if (!(found && host->proxy_hostid == proxy_hostid &&
-					host->status == status && 0 == strcmp(host->host, row[2])))
+	zbx_hashset_iter_reset(&config->hosts, &iter);
+
+	while (NULL != (host = zbx_hashset_iter_next(&iter)))
+	{
+		if (FAIL != zbx_vector_uint64_bsearch(&ids, host->hostid, ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+			continue;
+
+		/* after an incremental synchronisation only the changed hosts can be gone */
+		if (NULL != changed_hostids &&
+				FAIL == zbx_vector_uint64_bsearch(changed_hostids, host->hostid,
+						ZBX_DEFAULT_UINT64_COMPARE_FUNC))
 		{
-			if (found)
+			continue;
+		}
+
+		zbx_vector_uint64_append(&stage->removed, host->hostid);
+	}
+
+	zbx_vector_uint64_destroy(&ids);
+}
+
+static void	DCsync_hosts(ZBX_DC_STAGE *stage)
+{
+	const char		*__function_name = "DCsync_hosts";
+
+	const char		**row;
+
+	ZBX_DC_HOST		*host;
+	ZBX_DC_IPMIHOST		*ipmihost;
+
+	ZBX_DC_HOST_PH		*host_ph, host_ph_local;
+
+	int			found, i, new_num;
+	int			update_index, update_queue;
+	zbx_uint64_t		hostid, proxy_hostid;
+	unsigned char		status;
+	time_t			now;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() staged:%d removed:%d", __function_name,
+			stage->rows_num, stage->removed.values_num);
+
+	now = time(NULL);
+
+	new_num = DCstage_new_rows(stage, &config->hosts);
+	zbx_mem_slab_reserve(config_mem, sizeof(ZBX_HASHSET_ENTRY_T), new_num);
+	zbx_mem_slab_reserve(config_mem, sizeof(ZBX_DC_HOST_PH), new_num);
+
+	for (i = 0; i < stage->rows_num; i++)
+	{
+		row = stage->rows[i].values;
+
+		hostid = stage->rows[i].id;
+		ZBX_STR2UINT64(proxy_hostid, row[1]);
+		status = (unsigned char)atoi(row[26]);
+
+		host = DCfind_id(&config->hosts, hostid, sizeof(ZBX_DC_HOST), &found);
+
+		/* see whether we should and can update hosts_ph index at this point */
+
+		update_index = 0;
+
+		if (!(found && host->proxy_hostid == proxy_hostid &&
+					host->status == status && 0 == strcmp(host->host, row[2])))
+		{
+			if (found)
 			{
 				host_ph_local.proxy_hostid = host->proxy_hostid;
 				host_ph_local.status = host->status;
@@ -1012,10 +1464,11 @@ static void	DCsync_hosts(DB_RESULT result)
 
 		host->hostid = hostid;
 		host->proxy_hostid = proxy_hostid;
-		DCstrpool_replace(found, &host->host, row[2]);
+		host->digest = stage->rows[i].digest;
+		DCstrpool_assign(found, &host->host, row[2]);
 		host->useip = (unsigned char)atoi(row[3]);
-		DCstrpool_replace(found, &host->ip, row[4]);
-		DCstrpool_replace(found, &host->dns, row[5]);
+		DCstrpool_assign(found, &host->ip, row[4]);
+		DCstrpool_assign(found, &host->dns, row[5]);
 		host->port = (unsigned short)atoi(row[6]);
 		host->maintenance_status = (unsigned char)atoi(row[14]);
 		host->maintenance_type = (unsigned char)atoi(row[15]);
@@ -1071,12 +1524,12 @@ static void	DCsync_hosts(DB_RESULT result)
 			ipmihost = DCfind_id(&config->ipmihosts, hostid, sizeof(ZBX_DC_IPMIHOST), &found);
 
 			ipmihost->hostid = hostid;
-			DCstrpool_replace(found, &ipmihost->ipmi_ip, row[8]);
+			DCstrpool_assign(found, &ipmihost->ipmi_ip, row[8]);
 			ipmihost->ipmi_port = (unsigned short)atoi(row[9]);
 			ipmihost->ipmi_authtype = (signed char)atoi(row[10]);
 			ipmihost->ipmi_privilege = (unsigned char)atoi(row[11]);
-			DCstrpool_replace(found, &ipmihost->ipmi_username, row[12]);
-			DCstrpool_replace(found, &ipmihost->ipmi_password, row[13]);
+			DCstrpool_assign(found, &ipmihost->ipmi_username, row[12]);
+			DCstrpool_assign(found, &ipmihost->ipmi_password, row[13]);
 		}
 		else if (NULL != (ipmihost = zbx_hashset_search(&config->ipmihosts, &hostid)))
 		{
@@ -1092,16 +1545,10 @@ static void	DCsync_hosts(DB_RESULT result)
 
 	/* remove deleted or disabled hosts from buffer */
 
-	zbx_vector_uint64_sort(&ids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
-
-	zbx_hashset_iter_reset(&config->hosts, &iter);
-
-	while (NULL != (host = zbx_hashset_iter_next(&iter)))
+	for (i = 0; i < stage->removed.values_num; i++)
 	{
-		hostid = host->hostid;
-
-		if (FAIL != zbx_vector_uint64_bsearch(&ids, hostid, ZBX_DEFAULT_UINT64_COMPARE_FUNC))
-			continue;
+		hostid = stage->removed.values[i];
+		host = zbx_hashset_search(&config->hosts, &hostid);
 
 		/* IPMI hosts */
 
@@ -1119,7 +1566,7 @@ static void	DCsync_hosts(DB_RESULT result)
 		if (ZBX_LOC_QUEUE == host->location)
 		{
 			host->location = ZBX_LOC_NOWHERE;
-			zbx_binary_heap_remove_direct(&config->pqueue, host->hostid);
+			zbx_timer_wheel_remove(&config->pqueue, host->queue_id);
 		}
 
 		/* hosts */
@@ -1139,106 +1586,842 @@ static void	DCsync_hosts(DB_RESULT result)
 		zbx_strpool_release(host->ip);
 		zbx_strpool_release(host->dns);
 
-		zbx_hashset_iter_remove(&iter);
+		zbx_hashset_remove(&config->hosts, &hostid);
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+static void	DCstage_triggers(DB_RESULT result, zbx_vector_uint64_t *changed_triggerids, ZBX_DC_STAGE *stage)
+{
+	DB_ROW			row;
+	ZBX_DC_TRIGGER		*trigger;
+	zbx_uint64_t		triggerid;
+	int			i;
+	zbx_vector_uint64_t	ids;
+	zbx_hashset_iter_t	iter;
+
+	zbx_vector_uint64_create(&ids);
+	zbx_vector_uint64_reserve(&ids, NULL == changed_triggerids ? config->triggers.num_data + 32 :
+			changed_triggerids->values_num);
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		ZBX_STR2UINT64(triggerid, row[0]);
+
+		/* array of selected triggers */
+		zbx_vector_uint64_append(&ids, triggerid);
+
+		if (NULL == (trigger = zbx_hashset_search(&config->triggers, &triggerid)) ||
+				trigger->type != (unsigned char)atoi(row[1]) || 0 != strcmp(trigger->expression, row[2]))
+		{
+			DCstage_row(stage, triggerid, 0, row);
+		}
+	}
+
+	zbx_vector_uint64_sort(&ids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	if (NULL != changed_triggerids)
+	{
+		/* after an incremental synchronisation only the changed triggers can be gone */
+		for (i = 0; i < changed_triggerids->values_num; i++)
+		{
+			triggerid = changed_triggerids->values[i];
+
+			if (NULL != zbx_hashset_search(&config->triggers, &triggerid) &&
+					FAIL == zbx_vector_uint64_bsearch(&ids, triggerid, ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+			{
+				zbx_vector_uint64_append(&stage->removed, triggerid);
+			}
+		}
+	}
+	else
+	{
+		zbx_hashset_iter_reset(&config->triggers, &iter);
+
+		while (NULL != (trigger = zbx_hashset_iter_next(&iter)))
+		{
+			if (FAIL == zbx_vector_uint64_bsearch(&ids, trigger->triggerid, ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+				zbx_vector_uint64_append(&stage->removed, trigger->triggerid);
+		}
+	}
+
+	zbx_vector_uint64_destroy(&ids);
+}
+
+static void	DCsync_triggers(ZBX_DC_STAGE *stage)
+{
+	const char		*__function_name = "DCsync_triggers";
+
+	const char		**row;
+
+	ZBX_DC_TRIGGER		*trigger;
+
+	int			found, i;
+	zbx_uint64_t		triggerid;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() staged:%d removed:%d", __function_name,
+			stage->rows_num, stage->removed.values_num);
+
+	zbx_mem_slab_reserve(config_mem, sizeof(ZBX_HASHSET_ENTRY_T), DCstage_new_rows(stage, &config->triggers));
+
+	for (i = 0; i < stage->rows_num; i++)
+	{
+		row = stage->rows[i].values;
+
+		triggerid = stage->rows[i].id;
+		trigger = DCfind_id(&config->triggers, triggerid, sizeof(ZBX_DC_TRIGGER), &found);
+
+		trigger->triggerid = triggerid;
+		trigger->type = (unsigned char)atoi(row[1]);
+		DCstrpool_assign(found, &trigger->expression, row[2]);
+	}
+
+	/* remove deleted or disabled triggers from buffer */
+
+	for (i = 0; i < stage->removed.values_num; i++)
+	{
+		triggerid = stage->removed.values[i];
+		trigger = zbx_hashset_search(&config->triggers, &triggerid);
+
+		zbx_strpool_release(trigger->expression);
+
+		zbx_hashset_remove(&config->triggers, &triggerid);
+	}
+
+	if (0 != stage->removed.values_num)
+		config->triggers_revision++;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+static void	DCitem_tr_add(zbx_uint64_t itemid, zbx_uint64_t triggerid)
+{
+	ZBX_DC_ITEM_TR	*item_tr;
+	int		found;
+
+	item_tr = DCfind_id(&config->items_tr, itemid, sizeof(ZBX_DC_ITEM_TR), &found);
+
+	if (!found)
+	{
+		zbx_vector_uint64_create_ext(&item_tr->triggerids,
+				__config_mem_malloc_func,
+				__config_mem_realloc_func,
+				__config_mem_free_func);
+	}
+
+	zbx_vector_uint64_append(&item_tr->triggerids, triggerid);
+}
+
+static void	DCitem_tr_remove(zbx_uint64_t itemid, zbx_uint64_t triggerid)
+{
+	ZBX_DC_ITEM_TR	*item_tr;
+	int		i;
+
+	if (NULL == (item_tr = zbx_hashset_search(&config->items_tr, &itemid)))
+		return;
+
+	for (i = 0; i < item_tr->triggerids.values_num; i++)
+	{
+		if (item_tr->triggerids.values[i] == triggerid)
+		{
+			zbx_vector_uint64_remove_noorder(&item_tr->triggerids, i);
+			break;
+		}
+	}
+
+	if (0 == item_tr->triggerids.values_num)
+	{
+		zbx_vector_uint64_destroy(&item_tr->triggerids);
+		zbx_hashset_remove(&config->items_tr, &itemid);
+	}
+}
+
+static void	DCstage_functions(DB_RESULT result, zbx_vector_uint64_t *changed_triggerids, ZBX_DC_STAGE *stage)
+{
+	DB_ROW			row;
+	ZBX_DC_FUNCTION		*function;
+	zbx_uint64_t		functionid, triggerid, itemid;
+	zbx_vector_uint64_t	ids;
+	zbx_hashset_iter_t	iter;
+
+	zbx_vector_uint64_create(&ids);
+	zbx_vector_uint64_reserve(&ids, NULL == changed_triggerids ? config->functions.num_data + 32 : 32);
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		ZBX_STR2UINT64(functionid, row[0]);
+		ZBX_STR2UINT64(triggerid, row[1]);
+		ZBX_STR2UINT64(itemid, row[2]);
+
+		/* array of selected functions */
+		zbx_vector_uint64_append(&ids, functionid);
+
+		if (NULL == (function = zbx_hashset_search(&config->functions, &functionid)) ||
+				function->triggerid != triggerid || function->itemid != itemid)
+		{
+			DCstage_row(stage, functionid, 0, row);
+		}
+	}
+
+	zbx_vector_uint64_sort(&ids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	zbx_hashset_iter_reset(&config->functions, &iter);
+
+	while (NULL != (function = zbx_hashset_iter_next(&iter)))
+	{
+		if (FAIL != zbx_vector_uint64_bsearch(&ids, function->functionid, ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+			continue;
+
+		/* after an incremental synchronisation only the functions of the changed triggers can be gone */
+		if (NULL != changed_triggerids &&
+				FAIL == zbx_vector_uint64_bsearch(changed_triggerids, function->triggerid,
+						ZBX_DEFAULT_UINT64_COMPARE_FUNC))
+		{
+			continue;
+		}
+
+		zbx_vector_uint64_append(&stage->removed, function->functionid);
 	}
 
 	zbx_vector_uint64_destroy(&ids);
+}
+
+static void	DCsync_functions(ZBX_DC_STAGE *stage)
+{
+	const char		*__function_name = "DCsync_functions";
+
+	const char		**row;
+
+	ZBX_DC_FUNCTION		*function;
+
+	int			found, i;
+	zbx_uint64_t		functionid, triggerid, itemid;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() staged:%d removed:%d", __function_name,
+			stage->rows_num, stage->removed.values_num);
+
+	zbx_mem_slab_reserve(config_mem, sizeof(ZBX_HASHSET_ENTRY_T), DCstage_new_rows(stage, &config->functions));
+
+	for (i = 0; i < stage->rows_num; i++)
+	{
+		row = stage->rows[i].values;
+
+		functionid = stage->rows[i].id;
+		ZBX_STR2UINT64(triggerid, row[1]);
+		ZBX_STR2UINT64(itemid, row[2]);
+
+		function = DCfind_id(&config->functions, functionid, sizeof(ZBX_DC_FUNCTION), &found);
+
+		/* update items_tr index */
+
+		if (found)
+			DCitem_tr_remove(function->itemid, function->triggerid);
+
+		DCitem_tr_add(itemid, triggerid);
+
+		function->functionid = functionid;
+		function->triggerid = triggerid;
+		function->itemid = itemid;
+	}
+
+	/* remove deleted functions from buffer */
+
+	for (i = 0; i < stage->removed.values_num; i++)
+	{
+		functionid = stage->removed.values[i];
+		function = zbx_hashset_search(&config->functions, &functionid);
+
+		DCitem_tr_remove(function->itemid, function->triggerid);
+
+		zbx_hashset_remove(&config->functions, &functionid);
+	}
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
+static ZBX_DC_TRIGGER_DEPLIST	*DCfind_deplist(zbx_uint64_t triggerid)
+{
+	ZBX_DC_TRIGGER_DEPLIST	*deplist;
+	int			found;
+
+	deplist = DCfind_id(&config->deplists, triggerid, sizeof(ZBX_DC_TRIGGER_DEPLIST), &found);
+
+	if (!found)
+	{
+		zbx_vector_uint64_create_ext(&deplist->dependencies,
+				__config_mem_malloc_func,
+				__config_mem_realloc_func,
+				__config_mem_free_func);
+
+		deplist->lastchange = 0;
+		deplist->value = TRIGGER_VALUE_UNKNOWN;
+	}
+	else if (sync_num != deplist->sync_num)
+		deplist->dependencies.values_num = 0;
+
+	deplist->sync_num = sync_num;
+
+	return deplist;
+}
+
 /******************************************************************************
  *                                                                            *
- * Function: DCsync_configuration                                             *
- *                                                                            *
- * Purpose: Synchronize configuration data from database                      *
+ * Function: DCset_deplist_level                                              *
  *                                                                            *
- * Parameters:                                                                *
+ * Purpose: calculate the level of a trigger in the dependency graph and      *
+ *          drop dependencies that would make the graph cyclic                *
  *                                                                            *
- * Return value:                                                              *
+ * Parameters: deplist - [IN] trigger                                         *
+ *             depth - [IN] number of triggers visited before this one        *
  *                                                                            *
- * Author: Alexander Vladishev, Aleksandrs Saveljevs                          *
+ * Return value: level of the trigger or ZBX_DEPLIST_VISITING if the trigger  *
+ *               is already being visited, i.e., a cycle was found            *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: recursive function; dependency chains are limited to            *
+ *           ZBX_TRIGGER_DEPENDENCY_LEVELS_MAX triggers, as before            *
  *                                                                            *
  ******************************************************************************/
-void	DCsync_configuration()
+static int	DCset_deplist_level(ZBX_DC_TRIGGER_DEPLIST *deplist, int depth)
 {
-	const char		*__function_name = "DCsync_configuration";
+	ZBX_DC_TRIGGER_DEPLIST	*deplist_up;
+	int			i, level;
 
-	DB_RESULT		item_result;
-	DB_RESULT		host_result;
+	if (ZBX_DEPLIST_UNVISITED != deplist->level)
+		return deplist->level;
 
-	int			i;
-	double			sec, isec, hsec, ssec;
-	const zbx_strpool_t	*strpool;
+	deplist->level = ZBX_DEPLIST_VISITING;
+
+	level = 0;
+
+	for (i = 0; i < deplist->dependencies.values_num; i++)
+	{
+		deplist_up = zbx_hashset_search(&config->deplists, &deplist->dependencies.values[i]);
+
+		if (ZBX_TRIGGER_DEPENDENCY_LEVELS_MAX <= depth ||
+				ZBX_DEPLIST_VISITING == DCset_deplist_level(deplist_up, depth + 1) ||
+				ZBX_TRIGGER_DEPENDENCY_LEVELS_MAX <= deplist_up->level)
+		{
+			zabbix_log(LOG_LEVEL_CRIT, "Recursive trigger dependency detected! Please fix. Triggerid:"
+					ZBX_FS_UI64, deplist->triggerid);
+
+			zbx_vector_uint64_remove_noorder(&deplist->dependencies, i--);
+			continue;
+		}
+
+		if (level <= deplist_up->level)
+			level = deplist_up->level + 1;
+	}
+
+	deplist->level = level;
+
+	return level;
+}
+
+static void	DCsync_trigger_deps(DB_RESULT result, int sync_start)
+{
+	const char		*__function_name = "DCsync_trigger_deps";
+
+	DB_ROW			row;
+
+	ZBX_DC_TRIGGER_DEPLIST	*deplist, *deplist_up;
+
+	zbx_uint64_t		triggerid_down, triggerid_up;
+	zbx_hashset_iter_t	iter;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
-	sync_num++;
+	while (NULL != (row = DBfetch(result)))
+	{
+		ZBX_STR2UINT64(triggerid_down, row[0]);
+		ZBX_STR2UINT64(triggerid_up, row[1]);
 
-	sec = zbx_time();
-	item_result = DBselect(
-			"select i.itemid,i.hostid,h.proxy_hostid,i.type,i.data_type,i.value_type,i.key_,"
-				"i.snmp_community,i.snmp_oid,i.snmp_port,i.snmpv3_securityname,"
-				"i.snmpv3_securitylevel,i.snmpv3_authpassphrase,i.snmpv3_privpassphrase,"
-				"i.ipmi_sensor,i.delay,i.delay_flex,i.trapper_hosts,i.logtimefmt,i.params,"
-				"i.status,i.authtype,i.username,i.password,i.publickey,i.privatekey"
-			" from items i,hosts h"
-			" where i.hostid=h.hostid"
-				" and h.status in (%d)"
-				" and i.status in (%d,%d)"
-				DB_NODE,
-			HOST_STATUS_MONITORED,
-			ITEM_STATUS_ACTIVE, ITEM_STATUS_NOTSUPPORTED,
-			DBnode_local("i.itemid"));
-	isec = zbx_time() - sec;
+		deplist_up = DCfind_deplist(triggerid_up);
 
-	sec = zbx_time();
-	host_result = DBselect(
-			"select hostid,proxy_hostid,host,useip,ip,dns,port,"
-				"useipmi,ipmi_ip,ipmi_port,ipmi_authtype,ipmi_privilege,ipmi_username,"
-				"ipmi_password,maintenance_status,maintenance_type,maintenance_from,"
-				"errors_from,available,disable_until,snmp_errors_from,snmp_available,"
-				"snmp_disable_until,ipmi_errors_from,ipmi_available,ipmi_disable_until,"
-				"status"
-			" from hosts"
-			" where status in (%d,%d,%d)"
-				DB_NODE,
-			HOST_STATUS_MONITORED, HOST_STATUS_PROXY_ACTIVE, HOST_STATUS_PROXY_PASSIVE,
-			DBnode_local("hostid"));
-	hsec = zbx_time() - sec;
+		/* keep values set by history syncers while the dependencies were being selected */
+		if (deplist_up->lastchange < sync_start)
+			deplist_up->value = (unsigned char)atoi(row[2]);
 
-	LOCK_CACHE;
+		deplist = DCfind_deplist(triggerid_down);
 
-	sec = zbx_time();
-	DCsync_items(item_result);
-	DCsync_hosts(host_result);
-	ssec = zbx_time() - sec;
+		zbx_vector_uint64_append(&deplist->dependencies, triggerid_up);
+	}
 
-	strpool = zbx_strpool_info();
+	/* remove triggers that are not in the dependency graph anymore */
 
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() sync_num   : %u", __function_name, sync_num);
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() item sql   : " ZBX_FS_DBL " sec.", __function_name,
-			isec);
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() host sql   : " ZBX_FS_DBL " sec.", __function_name,
-			hsec);
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() sync lock  : " ZBX_FS_DBL " sec.", __function_name,
-			ssec);
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() total time : " ZBX_FS_DBL " sec.", __function_name,
-			isec + hsec + ssec);
+	zbx_hashset_iter_reset(&config->deplists, &iter);
 
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() items      : %d (%d slots)", __function_name,
-			config->items.num_data, config->items.num_slots);
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() items_hk   : %d (%d slots)", __function_name,
-			config->items_hk.num_data, config->items_hk.num_slots);
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() snmpitems  : %d (%d slots)", __function_name,
-			config->snmpitems.num_data, config->snmpitems.num_slots);
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() ipmiitems  : %d (%d slots)", __function_name,
-			config->ipmiitems.num_data, config->ipmiitems.num_slots);
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() flexitems  : %d (%d slots)", __function_name,
-			config->flexitems.num_data, config->flexitems.num_slots);
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() trapitems  : %d (%d slots)", __function_name,
+	while (NULL != (deplist = zbx_hashset_iter_next(&iter)))
+	{
+		if (sync_num == deplist->sync_num)
+		{
+			deplist->level = ZBX_DEPLIST_UNVISITED;
+			continue;
+		}
+
+		zbx_vector_uint64_destroy(&deplist->dependencies);
+
+		zbx_hashset_iter_remove(&iter);
+	}
+
+	/* detect cycles and order triggers so that dependencies come first */
+
+	zbx_hashset_iter_reset(&config->deplists, &iter);
+
+	while (NULL != (deplist = zbx_hashset_iter_next(&iter)))
+		DCset_deplist_level(deplist, 0);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCget_config_changes                                             *
+ *                                                                            *
+ * Purpose: take items, hosts and triggers changed since the last             *
+ *          synchronisation out of the change log                             *
+ *                                                                            *
+ * Parameters: itemids    - [OUT] sorted ids of the changed items             *
+ *             hostids    - [OUT] sorted ids of the changed hosts             *
+ *             triggerids - [OUT] sorted ids of the changed triggers          *
+ *                                                                            *
+ * Comments: config_changes is filled by database triggers on items, hosts,   *
+ *           triggers and functions, a change of a function is recorded as a  *
+ *           change of its trigger. The rows are deleted before the changed   *
+ *           records are selected, so a change committed in the meantime is   *
+ *           either seen by this synchronisation or left for the next one.    *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCget_config_changes(zbx_vector_uint64_t *itemids, zbx_vector_uint64_t *hostids,
+		zbx_vector_uint64_t *triggerids)
+{
+	DB_RESULT	result;
+	DB_ROW		row;
+	zbx_uint64_t	recordid;
+	char		*sql = NULL;
+	int		sql_alloc = ZBX_KIBIBYTE, sql_offset;
+
+	result = DBselect("select distinct table_name,recordid from config_changes");
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		ZBX_STR2UINT64(recordid, row[1]);
+
+		if (0 == strcmp(row[0], "items"))
+			zbx_vector_uint64_append(itemids, recordid);
+		else if (0 == strcmp(row[0], "hosts"))
+			zbx_vector_uint64_append(hostids, recordid);
+		else if (0 == strcmp(row[0], "triggers"))
+			zbx_vector_uint64_append(triggerids, recordid);
+	}
+	DBfree_result(result);
+
+	zbx_vector_uint64_sort(itemids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	zbx_vector_uint64_sort(hostids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	zbx_vector_uint64_sort(triggerids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	sql = zbx_malloc(sql, sql_alloc);
+
+	if (0 != itemids->values_num)
+	{
+		sql_offset = 0;
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 64,
+				"delete from config_changes where table_name='items' and");
+		DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "recordid", itemids->values, itemids->values_num);
+		DBexecute("%s", sql);
+	}
+
+	if (0 != hostids->values_num)
+	{
+		sql_offset = 0;
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 64,
+				"delete from config_changes where table_name='hosts' and");
+		DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "recordid", hostids->values, hostids->values_num);
+		DBexecute("%s", sql);
+	}
+
+	if (0 != triggerids->values_num)
+	{
+		sql_offset = 0;
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 64,
+				"delete from config_changes where table_name='triggers' and");
+		DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "recordid", triggerids->values,
+				triggerids->values_num);
+		DBexecute("%s", sql);
+	}
+
+	zbx_free(sql);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCget_item_triggers                                              *
+ *                                                                            *
+ * Purpose: add the triggers with functions on the changed items and on the   *
+ *          items of the changed hosts to the changed triggers                *
+ *                                                                            *
+ * Parameters: itemids    - [IN] sorted ids of the changed items              *
+ *             hostids    - [IN] sorted ids of the changed hosts              *
+ *             triggerids - [IN/OUT] sorted ids of the changed triggers       *
+ *                                                                            *
+ * Comments: only the functions on cached items are indexed, so enabling or   *
+ *           disabling an item or a host changes the triggers without a       *
+ *           change of the triggers themselves                                *
+ *                                                                            *
+ ******************************************************************************/
+static void	DCget_item_triggers(zbx_vector_uint64_t *itemids, zbx_vector_uint64_t *hostids,
+		zbx_vector_uint64_t *triggerids)
+{
+	DB_RESULT	result;
+	DB_ROW		row;
+	ZBX_DC_ITEM_TR	*item_tr;
+	zbx_uint64_t	triggerid;
+	char		*sql = NULL;
+	int		sql_alloc = ZBX_KIBIBYTE, sql_offset = 0, i, j;
+
+	if (0 == itemids->values_num && 0 == hostids->values_num)
+		return;
+
+	sql = zbx_malloc(sql, sql_alloc);
+
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 128,
+			"select distinct f.triggerid"
+			" from functions f,items i"
+			" where f.itemid=i.itemid"
+				" and (");
+	DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "f.itemid", itemids->values, itemids->values_num);
+	if (0 != itemids->values_num && 0 != hostids->values_num)
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 8, " or");
+	DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "i.hostid", hostids->values, hostids->values_num);
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 8, ")");
+
+	result = DBselect("%s", sql);
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		ZBX_STR2UINT64(triggerid, row[0]);
+		zbx_vector_uint64_append(triggerids, triggerid);
+	}
+	DBfree_result(result);
+
+	zbx_free(sql);
+
+	/* the functions of deleted items are gone from the database, but not from the cache */
+	for (i = 0; i < itemids->values_num; i++)
+	{
+		if (NULL == (item_tr = zbx_hashset_search(&config->items_tr, &itemids->values[i])))
+			continue;
+
+		for (j = 0; j < item_tr->triggerids.values_num; j++)
+			zbx_vector_uint64_append(triggerids, item_tr->triggerids.values[j]);
+	}
+
+	zbx_vector_uint64_sort(triggerids, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	for (i = 1, j = 0; i < triggerids->values_num; i++)
+	{
+		if (triggerids->values[i] != triggerids->values[j])
+			triggerids->values[++j] = triggerids->values[i];
+	}
+
+	if (0 != triggerids->values_num)
+		triggerids->values_num = j + 1;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCsync_configuration                                             *
+ *                                                                            *
+ * Purpose: Synchronize configuration data from database                      *
+ *                                                                            *
+ * Parameters:                                                                *
+ *                                                                            *
+ * Return value:                                                              *
+ *                                                                            *
+ * Author: Alexander Vladishev, Aleksandrs Saveljevs                          *
+ *                                                                            *
+ * Comments:                                                                  *
+ *                                                                            *
+ ******************************************************************************/
+void	DCsync_configuration()
+{
+	const char		*__function_name = "DCsync_configuration";
+
+	/* string columns of the item and host selects below, -1 terminated */
+	DB_RESULT		item_result = NULL;
+	DB_RESULT		host_result = NULL;
+	DB_RESULT		trigger_result = NULL;
+	DB_RESULT		function_result = NULL;
+	DB_RESULT		dep_result = NULL;
+
+	int			i, full;
+	double			sec, csec, isec, hsec, tsec = 0, fsec = 0, dsec = 0, stsec, ssec;
+	int			sync_start = 0;
+	const zbx_strpool_t	*strpool;
+	zbx_vector_uint64_t	itemids, hostids, triggerids;
+	ZBX_DC_STAGE		item_stage, host_stage, trigger_stage, function_stage;
+	char			*sql = NULL;
+	int			sql_alloc = 4 * ZBX_KIBIBYTE, sql_offset = 0;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	sync_num++;
+
+	/* the change log is a shortcut, everything is reloaded now and then in case it missed something */
+	full = (1 == sync_num || 0 == sync_num % ZBX_CONFIG_FULL_SYNC);
+
+	zbx_vector_uint64_create(&itemids);
+	zbx_vector_uint64_create(&hostids);
+	zbx_vector_uint64_create(&triggerids);
+
+	sec = zbx_time();
+	if (0 != full)
+		DBexecute("delete from config_changes");
+	else
+		DCget_config_changes(&itemids, &hostids, &triggerids);
+	csec = zbx_time() - sec;
+
+	sql = zbx_malloc(sql, sql_alloc);
+
+	sec = zbx_time();
+	if (0 != full || 0 != itemids.values_num || 0 != hostids.values_num)
+	{
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 1024,
+				"select i.itemid,i.hostid,h.proxy_hostid,i.type,i.data_type,i.value_type,i.key_,"
+					"i.snmp_community,i.snmp_oid,i.snmp_port,i.snmpv3_securityname,"
+					"i.snmpv3_securitylevel,i.snmpv3_authpassphrase,i.snmpv3_privpassphrase,"
+					"i.ipmi_sensor,i.delay,i.delay_flex,i.trapper_hosts,i.logtimefmt,i.params,"
+					"i.status,i.authtype,i.username,i.password,i.publickey,i.privatekey"
+				" from items i,hosts h"
+				" where i.hostid=h.hostid"
+					" and h.status in (%d)"
+					" and i.status in (%d,%d)",
+				HOST_STATUS_MONITORED,
+				ITEM_STATUS_ACTIVE, ITEM_STATUS_NOTSUPPORTED);
+
+		/* items of the changed hosts are reloaded, as they may have been enabled or disabled with the host */
+		if (0 == full)
+		{
+			zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 8, " and (");
+			DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "i.itemid", itemids.values,
+					itemids.values_num);
+			if (0 != itemids.values_num && 0 != hostids.values_num)
+				zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 8, " or");
+			DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "i.hostid", hostids.values,
+					hostids.values_num);
+			zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 8, ")");
+		}
+
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 128, DB_NODE, DBnode_local("i.itemid"));
+
+		item_result = DBselect("%s", sql);
+	}
+	isec = zbx_time() - sec;
+
+	sec = zbx_time();
+	if (0 != full || 0 != hostids.values_num)
+	{
+		sql_offset = 0;
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 1024,
+				"select hostid,proxy_hostid,host,useip,ip,dns,port,"
+					"useipmi,ipmi_ip,ipmi_port,ipmi_authtype,ipmi_privilege,ipmi_username,"
+					"ipmi_password,maintenance_status,maintenance_type,maintenance_from,"
+					"errors_from,available,disable_until,snmp_errors_from,snmp_available,"
+					"snmp_disable_until,ipmi_errors_from,ipmi_available,ipmi_disable_until,"
+					"status"
+				" from hosts"
+				" where status in (%d,%d,%d)",
+				HOST_STATUS_MONITORED, HOST_STATUS_PROXY_ACTIVE, HOST_STATUS_PROXY_PASSIVE);
+
+		if (0 == full)
+		{
+			zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 8, " and");
+			DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "hostid", hostids.values,
+					hostids.values_num);
+		}
+
+		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 128, DB_NODE, DBnode_local("hostid"));
+
+		host_result = DBselect("%s", sql);
+	}
+	hsec = zbx_time() - sec;
+
+	/* only the functions on items in the buffer are indexed, so triggers are selected the same way */
+
+	if (0 != (zbx_process & ZBX_PROCESS_SERVER))
+	{
+		sec = zbx_time();
+		if (0 == full)
+			DCget_item_triggers(&itemids, &hostids, &triggerids);
+
+		if (0 != full || 0 != triggerids.values_num)
+		{
+			sql_offset = 0;
+			zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 512,
+					"select distinct t.triggerid,t.type,t.expression"
+					" from hosts h,items i,functions f,triggers t"
+					" where h.hostid=i.hostid"
+						" and i.itemid=f.itemid"
+						" and f.triggerid=t.triggerid"
+						" and h.status in (%d)"
+						" and i.status in (%d,%d)"
+						" and t.status in (%d)",
+					HOST_STATUS_MONITORED,
+					ITEM_STATUS_ACTIVE, ITEM_STATUS_NOTSUPPORTED,
+					TRIGGER_STATUS_ENABLED);
+
+			if (0 == full)
+			{
+				zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 8, " and");
+				DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "t.triggerid", triggerids.values,
+						triggerids.values_num);
+			}
+
+			zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 128, DB_NODE, DBnode_local("t.triggerid"));
+
+			trigger_result = DBselect("%s", sql);
+		}
+		tsec = zbx_time() - sec;
+
+		sec = zbx_time();
+		if (0 != full || 0 != triggerids.values_num)
+		{
+			sql_offset = 0;
+			zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 512,
+					"select f.functionid,f.triggerid,f.itemid"
+					" from hosts h,items i,functions f,triggers t"
+					" where h.hostid=i.hostid"
+						" and i.itemid=f.itemid"
+						" and f.triggerid=t.triggerid"
+						" and h.status in (%d)"
+						" and i.status in (%d,%d)"
+						" and t.status in (%d)",
+					HOST_STATUS_MONITORED,
+					ITEM_STATUS_ACTIVE, ITEM_STATUS_NOTSUPPORTED,
+					TRIGGER_STATUS_ENABLED);
+
+			if (0 == full)
+			{
+				zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 8, " and");
+				DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "f.triggerid", triggerids.values,
+						triggerids.values_num);
+			}
+
+			zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 128, DB_NODE, DBnode_local("f.functionid"));
+
+			function_result = DBselect("%s", sql);
+		}
+		fsec = zbx_time() - sec;
+
+		sync_start = (int)time(NULL);
+
+		sec = zbx_time();
+		dep_result = DBselect(
+				"select d.triggerid_down,d.triggerid_up,t.value"
+				" from trigger_depends d,triggers t"
+				" where d.triggerid_up=t.triggerid"
+					DB_NODE,
+				DBnode_local("d.triggerid_down"));
+		dsec = zbx_time() - sec;
+	}
+
+	zbx_free(sql);
+
+	/* everything that does not need the lock is done while pollers and trappers keep using the cache */
+
+	sec = zbx_time();
+
+	DCstage_init(&item_stage, ZBX_DC_ITEM_VALUES_NUM, item_strings);
+	DCstage_init(&host_stage, ZBX_DC_HOST_VALUES_NUM, host_strings);
+	DCstage_init(&trigger_stage, ZBX_DC_TRIGGER_VALUES_NUM, trigger_strings);
+	DCstage_init(&function_stage, ZBX_DC_FUNCTION_VALUES_NUM, function_strings);
+
+	if (0 != full)
+	{
+		DCstage_items(item_result, NULL, NULL, &item_stage);
+		DCstage_hosts(host_result, NULL, &host_stage);
+	}
+	else
+	{
+		if (0 != itemids.values_num || 0 != hostids.values_num)
+			DCstage_items(item_result, &itemids, &hostids, &item_stage);
+
+		if (0 != hostids.values_num)
+			DCstage_hosts(host_result, &hostids, &host_stage);
+	}
+
+	if (NULL != trigger_result)
+	{
+		DCstage_triggers(trigger_result, 0 != full ? NULL : &triggerids, &trigger_stage);
+		DCstage_functions(function_result, 0 != full ? NULL : &triggerids, &function_stage);
+	}
+
+	DBfree_result(item_result);
+	DBfree_result(host_result);
+	DBfree_result(trigger_result);
+	DBfree_result(function_result);
+
+	stsec = zbx_time() - sec;
+
+	LOCK_CACHE;
+
+	sec = zbx_time();
+
+	DCsync_items(&item_stage);
+	DCsync_hosts(&host_stage);
+
+	if (0 != (zbx_process & ZBX_PROCESS_SERVER))
+	{
+		DCsync_triggers(&trigger_stage);
+		DCsync_functions(&function_stage);
+		DCsync_trigger_deps(dep_result, sync_start);
+	}
+	ssec = zbx_time() - sec;
+
+	strpool = zbx_strpool_info();
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() sync_num   : %u (%s)", __function_name, sync_num,
+			0 != full ? "full" : "incremental");
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() changes    : %d items, %d hosts, %d triggers", __function_name,
+			itemids.values_num, hostids.values_num, triggerids.values_num);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() change sql : " ZBX_FS_DBL " sec.", __function_name,
+			csec);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() item sql   : " ZBX_FS_DBL " sec.", __function_name,
+			isec);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() host sql   : " ZBX_FS_DBL " sec.", __function_name,
+			hsec);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() trigger sql: " ZBX_FS_DBL " sec.", __function_name,
+			tsec);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() func sql   : " ZBX_FS_DBL " sec.", __function_name,
+			fsec);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() dep sql    : " ZBX_FS_DBL " sec.", __function_name,
+			dsec);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() staging    : " ZBX_FS_DBL " sec.", __function_name,
+			stsec);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() sync lock  : " ZBX_FS_DBL " sec.", __function_name,
+			ssec);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() total time : " ZBX_FS_DBL " sec.", __function_name,
+			csec + isec + hsec + tsec + fsec + dsec + stsec + ssec);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() staged     : %d items (%d removed), %d hosts (%d removed)",
+			__function_name, item_stage.rows_num, item_stage.removed.values_num,
+			host_stage.rows_num, host_stage.removed.values_num);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() staged     : %d triggers (%d removed), %d functions (%d removed)",
+			__function_name, trigger_stage.rows_num, trigger_stage.removed.values_num,
+			function_stage.rows_num, function_stage.removed.values_num);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() items      : %d (%d slots)", __function_name,
+			config->items.num_data, config->items.num_slots);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() itemsched  : %d (%d allocated)", __function_name,
+			config->items_sched.num, config->items_sched.alloc);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() items_hk   : %d (%d slots)", __function_name,
+			config->items_hk.num_data, config->items_hk.num_slots);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() snmpitems  : %d (%d slots)", __function_name,
+			config->snmpitems.num_data, config->snmpitems.num_slots);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() ipmiitems  : %d (%d slots)", __function_name,
+			config->ipmiitems.num_data, config->ipmiitems.num_slots);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() flexitems  : %d (%d slots)", __function_name,
+			config->flexitems.num_data, config->flexitems.num_slots);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() trapitems  : %d (%d slots)", __function_name,
 			config->trapitems.num_data, config->trapitems.num_slots);
 	zabbix_log(LOG_LEVEL_DEBUG, "%s() logitems   : %d (%d slots)", __function_name,
 			config->logitems.num_data, config->logitems.num_slots);
@@ -1256,31 +2439,499 @@ void	DCsync_configuration()
 			config->hosts_ph.num_data, config->hosts_ph.num_slots);
 	zabbix_log(LOG_LEVEL_DEBUG, "%s() ipmihosts  : %d (%d slots)", __function_name,
 			config->ipmihosts.num_data, config->ipmihosts.num_slots);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() triggers   : %d (%d slots)", __function_name,
+			config->triggers.num_data, config->triggers.num_slots);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() functions  : %d (%d slots)", __function_name,
+			config->functions.num_data, config->functions.num_slots);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() items_tr   : %d (%d slots)", __function_name,
+			config->items_tr.num_data, config->items_tr.num_slots);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() deplists   : %d (%d slots)", __function_name,
+			config->deplists.num_data, config->deplists.num_slots);
+
+	for (i = 0; i < ZBX_POLLER_TYPE_COUNT; i++)
+		zabbix_log(LOG_LEVEL_DEBUG, "%s() queue[%d]   : %d (%d allocated)", __function_name,
+				i, config->queues[i].elems_num, config->queues[i].ids_alloc);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() pqueue     : %d (%d allocated)", __function_name,
+			config->pqueue.elems_num, config->pqueue.ids_alloc);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() configfree : " ZBX_FS_DBL "%%", __function_name,
+			100 * ((double)config_mem->free_size / config_mem->orig_size));
+
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() strings    : %d (%d slots)", __function_name,
+			strpool->hashset->num_data, strpool->hashset->num_slots);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() strpoolfree: " ZBX_FS_DBL "%%", __function_name,
+			100 * ((double)strpool->mem_info->free_size / strpool->mem_info->orig_size));
+
+	zbx_mem_dump_stats(config_mem);
+	zbx_mem_dump_stats(strpool->mem_info);
+
+	UNLOCK_CACHE;
+
+	DCstage_free(&item_stage);
+	DCstage_free(&host_stage);
+	DCstage_free(&trigger_stage);
+	DCstage_free(&function_stage);
+
+	DBfree_result(dep_result);
+
+	zbx_vector_uint64_destroy(&itemids);
+	zbx_vector_uint64_destroy(&hostids);
+	zbx_vector_uint64_destroy(&triggerids);
+
+	if (0 != full)
+		DCsave_configuration_snapshot();
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+/* configuration cache snapshot, item and host rows in the layout of the selects in DCsync_configuration() */
+
+#define ZBX_SNAPSHOT_MAGIC	0x4353425a	/* "ZBSC" */
+#define ZBX_SNAPSHOT_VERSION	1
+
+#define ZBX_DC_SNAPSHOT_HEADER	struct zbx_dc_snapshot_header_type
+#define ZBX_DC_SNAPSHOT_BUFFER	struct zbx_dc_snapshot_buffer_type
+
+/* followed by the item rows and then by the host rows, every row is the id, the digest and the values, */
+/* a value is its length, its characters and the terminating zero */
+ZBX_DC_SNAPSHOT_HEADER
+{
+	int		magic;
+	int		version;
+	int		items_num;
+	int		item_values_num;
+	int		hosts_num;
+	int		host_values_num;
+	zbx_uint64_t	size;		/* of the rows following the header */
+	zbx_hash_t	checksum;	/* of the rows following the header */
+};
+
+ZBX_DC_SNAPSHOT_BUFFER
+{
+	char	*data;
+	size_t	alloc;
+	size_t	offset;
+};
+
+static void	DCsnapshot_add(ZBX_DC_SNAPSHOT_BUFFER *buffer, const void *src, size_t size)
+{
+	if (buffer->offset + size > buffer->alloc)
+	{
+		while (buffer->offset + size > buffer->alloc)
+			buffer->alloc *= 2;
+
+		buffer->data = zbx_realloc(buffer->data, buffer->alloc);
+	}
+
+	memcpy(buffer->data + buffer->offset, src, size);
+	buffer->offset += size;
+}
+
+static void	DCsnapshot_add_str(ZBX_DC_SNAPSHOT_BUFFER *buffer, const char *value)
+{
+	uint32_t	len;
+
+	len = (uint32_t)strlen(value);
+
+	DCsnapshot_add(buffer, &len, sizeof(len));
+	DCsnapshot_add(buffer, value, len + 1);
+}
+
+static void	DCsnapshot_add_uint64(ZBX_DC_SNAPSHOT_BUFFER *buffer, zbx_uint64_t value)
+{
+	char	tmp[MAX_ID_LEN];
+
+	zbx_snprintf(tmp, sizeof(tmp), ZBX_FS_UI64, value);
+	DCsnapshot_add_str(buffer, tmp);
+}
+
+static void	DCsnapshot_add_int(ZBX_DC_SNAPSHOT_BUFFER *buffer, int value)
+{
+	char	tmp[MAX_ID_LEN];
+
+	zbx_snprintf(tmp, sizeof(tmp), "%d", value);
+	DCsnapshot_add_str(buffer, tmp);
+}
+
+static void	DCsnapshot_add_item(ZBX_DC_SNAPSHOT_BUFFER *buffer, const ZBX_DC_ITEM *item)
+{
+	const ZBX_DC_HOST	*host;
+	const ZBX_DC_SNMPITEM	*snmpitem;
+	const ZBX_DC_IPMIITEM	*ipmiitem;
+	const ZBX_DC_FLEXITEM	*flexitem;
+	const ZBX_DC_TRAPITEM	*trapitem;
+	const ZBX_DC_LOGITEM	*logitem;
+	const ZBX_DC_DBITEM	*dbitem;
+	const ZBX_DC_SSHITEM	*sshitem;
+	const ZBX_DC_TELNETITEM	*telnetitem;
+	const ZBX_DC_CALCITEM	*calcitem;
+	const char		*params = "", *username = "", *password = "";
+
+	host = zbx_hashset_search(&config->hosts, &item->hostid);
+	snmpitem = zbx_hashset_search(&config->snmpitems, &item->itemid);
+	ipmiitem = zbx_hashset_search(&config->ipmiitems, &item->itemid);
+	flexitem = zbx_hashset_search(&config->flexitems, &item->itemid);
+	trapitem = zbx_hashset_search(&config->trapitems, &item->itemid);
+	logitem = zbx_hashset_search(&config->logitems, &item->itemid);
+
+	if (NULL != (dbitem = zbx_hashset_search(&config->dbitems, &item->itemid)))
+		params = dbitem->params;
+
+	if (NULL != (sshitem = zbx_hashset_search(&config->sshitems, &item->itemid)))
+	{
+		params = sshitem->params;
+		username = sshitem->username;
+		password = sshitem->password;
+	}
+
+	if (NULL != (telnetitem = zbx_hashset_search(&config->telnetitems, &item->itemid)))
+	{
+		params = telnetitem->params;
+		username = telnetitem->username;
+		password = telnetitem->password;
+	}
+
+	if (NULL != (calcitem = zbx_hashset_search(&config->calcitems, &item->itemid)))
+		params = calcitem->params;
+
+	DCsnapshot_add(buffer, &item->itemid, sizeof(zbx_uint64_t));
+	DCsnapshot_add(buffer, &item->digest, sizeof(zbx_uint64_t));
+
+	DCsnapshot_add_uint64(buffer, item->itemid);
+	DCsnapshot_add_uint64(buffer, item->hostid);
+	DCsnapshot_add_uint64(buffer, NULL != host ? host->proxy_hostid : 0);
+	DCsnapshot_add_int(buffer, item->type);
+	DCsnapshot_add_int(buffer, item->data_type);
+	DCsnapshot_add_int(buffer, item->value_type);
+	DCsnapshot_add_str(buffer, item->key);
+	DCsnapshot_add_str(buffer, NULL != snmpitem ? snmpitem->snmp_community : "");
+	DCsnapshot_add_str(buffer, NULL != snmpitem ? snmpitem->snmp_oid : "");
+	DCsnapshot_add_int(buffer, NULL != snmpitem ? snmpitem->snmp_port : 0);
+	DCsnapshot_add_str(buffer, NULL != snmpitem ? snmpitem->snmpv3_securityname : "");
+	DCsnapshot_add_int(buffer, NULL != snmpitem ? snmpitem->snmpv3_securitylevel : 0);
+	DCsnapshot_add_str(buffer, NULL != snmpitem ? snmpitem->snmpv3_authpassphrase : "");
+	DCsnapshot_add_str(buffer, NULL != snmpitem ? snmpitem->snmpv3_privpassphrase : "");
+	DCsnapshot_add_str(buffer, NULL != ipmiitem ? ipmiitem->ipmi_sensor : "");
+	DCsnapshot_add_int(buffer, DC_ITEM_DELAY(item));
+	DCsnapshot_add_str(buffer, NULL != flexitem ? flexitem->delay_flex : "");
+	DCsnapshot_add_str(buffer, NULL != trapitem ? trapitem->trapper_hosts : "");
+	DCsnapshot_add_str(buffer, NULL != logitem ? logitem->logtimefmt : "");
+	DCsnapshot_add_str(buffer, params);
+	DCsnapshot_add_int(buffer, DC_ITEM_STATUS(item));
+	DCsnapshot_add_int(buffer, NULL != sshitem ? sshitem->authtype : 0);
+	DCsnapshot_add_str(buffer, username);
+	DCsnapshot_add_str(buffer, password);
+	DCsnapshot_add_str(buffer, NULL != sshitem ? sshitem->publickey : "");
+	DCsnapshot_add_str(buffer, NULL != sshitem ? sshitem->privatekey : "");
+}
+
+static void	DCsnapshot_add_host(ZBX_DC_SNAPSHOT_BUFFER *buffer, const ZBX_DC_HOST *host)
+{
+	const ZBX_DC_IPMIHOST	*ipmihost;
+
+	ipmihost = zbx_hashset_search(&config->ipmihosts, &host->hostid);
+
+	DCsnapshot_add(buffer, &host->hostid, sizeof(zbx_uint64_t));
+	DCsnapshot_add(buffer, &host->digest, sizeof(zbx_uint64_t));
+
+	DCsnapshot_add_uint64(buffer, host->hostid);
+	DCsnapshot_add_uint64(buffer, host->proxy_hostid);
+	DCsnapshot_add_str(buffer, host->host);
+	DCsnapshot_add_int(buffer, host->useip);
+	DCsnapshot_add_str(buffer, host->ip);
+	DCsnapshot_add_str(buffer, host->dns);
+	DCsnapshot_add_int(buffer, host->port);
+	DCsnapshot_add_int(buffer, NULL != ipmihost ? 1 : 0);
+	DCsnapshot_add_str(buffer, NULL != ipmihost ? ipmihost->ipmi_ip : "");
+	DCsnapshot_add_int(buffer, NULL != ipmihost ? ipmihost->ipmi_port : 0);
+	DCsnapshot_add_int(buffer, NULL != ipmihost ? ipmihost->ipmi_authtype : 0);
+	DCsnapshot_add_int(buffer, NULL != ipmihost ? ipmihost->ipmi_privilege : 0);
+	DCsnapshot_add_str(buffer, NULL != ipmihost ? ipmihost->ipmi_username : "");
+	DCsnapshot_add_str(buffer, NULL != ipmihost ? ipmihost->ipmi_password : "");
+	DCsnapshot_add_int(buffer, host->maintenance_status);
+	DCsnapshot_add_int(buffer, host->maintenance_type);
+	DCsnapshot_add_int(buffer, host->maintenance_from);
+	DCsnapshot_add_int(buffer, host->errors_from);
+	DCsnapshot_add_int(buffer, host->available);
+	DCsnapshot_add_int(buffer, host->disable_until);
+	DCsnapshot_add_int(buffer, host->snmp_errors_from);
+	DCsnapshot_add_int(buffer, host->snmp_available);
+	DCsnapshot_add_int(buffer, host->snmp_disable_until);
+	DCsnapshot_add_int(buffer, host->ipmi_errors_from);
+	DCsnapshot_add_int(buffer, host->ipmi_available);
+	DCsnapshot_add_int(buffer, host->ipmi_disable_until);
+	DCsnapshot_add_int(buffer, host->status);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCsave_configuration_snapshot                                    *
+ *                                                                            *
+ * Purpose: write items and hosts of the configuration cache to the file set  *
+ *          by CacheSnapshotFile                                              *
+ *                                                                            *
+ * Comments: the rows are collected under the read lock and written to a      *
+ *           temporary file after it is released, the file is renamed over    *
+ *           the previous snapshot only when it is complete                   *
+ *                                                                            *
+ ******************************************************************************/
+void	DCsave_configuration_snapshot()
+{
+	const char		*__function_name = "DCsave_configuration_snapshot";
+
+	ZBX_DC_SNAPSHOT_HEADER	header;
+	ZBX_DC_SNAPSHOT_BUFFER	buffer;
+	const ZBX_DC_ITEM	*item;
+	const ZBX_DC_HOST	*host;
+	zbx_hashset_iter_t	iter;
+	char			*path = NULL;
+	int			fd;
+
+	if (NULL == CONFIG_CONF_CACHE_SNAPSHOT_FILE || NULL == config)
+		return;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = ZBX_SNAPSHOT_MAGIC;
+	header.version = ZBX_SNAPSHOT_VERSION;
+	header.item_values_num = ZBX_DC_ITEM_VALUES_NUM;
+	header.host_values_num = ZBX_DC_HOST_VALUES_NUM;
+
+	buffer.alloc = 64 * ZBX_KIBIBYTE;
+	buffer.offset = 0;
+	buffer.data = zbx_malloc(NULL, buffer.alloc);
+
+	RDLOCK_CACHE;
+
+	zbx_hashset_iter_reset(&config->items, &iter);
+
+	while (NULL != (item = zbx_hashset_iter_next(&iter)))
+	{
+		DCsnapshot_add_item(&buffer, item);
+		header.items_num++;
+	}
+
+	zbx_hashset_iter_reset(&config->hosts, &iter);
+
+	while (NULL != (host = zbx_hashset_iter_next(&iter)))
+	{
+		DCsnapshot_add_host(&buffer, host);
+		header.hosts_num++;
+	}
+
+	RDUNLOCK_CACHE;
+
+	header.size = buffer.offset;
+	header.checksum = zbx_hash_modfnv(buffer.data, buffer.offset, ZBX_DEFAULT_HASH_SEED);
+
+	path = zbx_dsprintf(path, "%s.tmp", CONFIG_CONF_CACHE_SNAPSHOT_FILE);
+
+	if (-1 == (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "Cannot open configuration cache snapshot [%s]: %s", path, strerror(errno));
+		goto out;
+	}
+
+	if (sizeof(header) != write(fd, &header, sizeof(header)) ||
+			(ssize_t)buffer.offset != write(fd, buffer.data, buffer.offset) || 0 != fsync(fd))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "Cannot write configuration cache snapshot [%s]: %s", path, strerror(errno));
+		close(fd);
+		unlink(path);
+		goto out;
+	}
+
+	close(fd);
+
+	if (0 != rename(path, CONFIG_CONF_CACHE_SNAPSHOT_FILE))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "Cannot rename configuration cache snapshot [%s] to [%s]: %s",
+				path, CONFIG_CONF_CACHE_SNAPSHOT_FILE, strerror(errno));
+		unlink(path);
+	}
+out:
+	zbx_free(path);
+	zbx_free(buffer.data);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() items:%d hosts:%d size:" ZBX_FS_UI64, __function_name,
+			header.items_num, header.hosts_num, header.size);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCsnapshot_stage_rows                                            *
+ *                                                                            *
+ * Purpose: stage snapshot rows the same way as selected database rows        *
+ *                                                                            *
+ * Parameters: data     - [IN/OUT] the first row, the data after the last row *
+ *                        on return                                           *
+ *             end      - [IN] the end of the snapshot data                   *
+ *             rows_num - [IN] number of rows                                 *
+ *             stage    - [OUT] the staged rows                               *
+ *                                                                            *
+ * Return value: SUCCEED - the rows were staged                               *
+ *               FAIL    - the rows do not fit into the data                  *
+ *                                                                            *
+ ******************************************************************************/
+static int	DCsnapshot_stage_rows(const char **data, const char *end, int rows_num, ZBX_DC_STAGE *stage)
+{
+	const char	*ptr = *data;
+	char		*values[ZBX_DC_STAGE_VALUES_MAX];
+	zbx_uint64_t	id, digest;
+	uint32_t	len;
+	int		i, j;
+
+	for (i = 0; i < rows_num; i++)
+	{
+		if ((size_t)(end - ptr) < 2 * sizeof(zbx_uint64_t))
+			return FAIL;
+
+		memcpy(&id, ptr, sizeof(zbx_uint64_t));
+		memcpy(&digest, ptr + sizeof(zbx_uint64_t), sizeof(zbx_uint64_t));
+		ptr += 2 * sizeof(zbx_uint64_t);
+
+		for (j = 0; j < stage->values_num; j++)
+		{
+			if ((size_t)(end - ptr) < sizeof(len))
+				return FAIL;
+
+			memcpy(&len, ptr, sizeof(len));
+			ptr += sizeof(len);
+
+			if ((size_t)(end - ptr) <= len || '\0' != ptr[len])
+				return FAIL;
+
+			values[j] = (char *)ptr;
+			ptr += len + 1;
+		}
+
+		DCstage_row(stage, id, digest, values);
+	}
+
+	*data = ptr;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCload_configuration_snapshot                                    *
+ *                                                                            *
+ * Purpose: fill the empty configuration cache with items and hosts from the  *
+ *          file set by CacheSnapshotFile                                     *
+ *                                                                            *
+ * Return value: SUCCEED - the snapshot was loaded                            *
+ *               FAIL    - there is no usable snapshot                        *
+ *                                                                            *
+ * Comments: called by the main process before the configuration syncer is    *
+ *           started. Loaded records keep the digests of their database rows, *
+ *           so the first synchronisation only applies what has changed since *
+ *           the snapshot was written.                                        *
+ *                                                                            *
+ ******************************************************************************/
+int	DCload_configuration_snapshot()
+{
+	const char		*__function_name = "DCload_configuration_snapshot";
+
+	const ZBX_DC_SNAPSHOT_HEADER	*header;
+	ZBX_DC_STAGE		item_stage, host_stage;
+	struct stat		st;
+	const char		*data, *end;
+	void			*addr;
+	int			fd, ret = FAIL;
+
+	if (NULL == CONFIG_CONF_CACHE_SNAPSHOT_FILE)
+		return FAIL;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	if (-1 == (fd = open(CONFIG_CONF_CACHE_SNAPSHOT_FILE, O_RDONLY)))
+	{
+		if (ENOENT != errno)
+		{
+			zabbix_log(LOG_LEVEL_ERR, "Cannot open configuration cache snapshot [%s]: %s",
+					CONFIG_CONF_CACHE_SNAPSHOT_FILE, strerror(errno));
+		}
+
+		goto out;
+	}
+
+	if (0 != fstat(fd, &st))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "Cannot stat configuration cache snapshot [%s]: %s",
+				CONFIG_CONF_CACHE_SNAPSHOT_FILE, strerror(errno));
+		close(fd);
+		goto out;
+	}
+
+	if ((size_t)st.st_size < sizeof(ZBX_DC_SNAPSHOT_HEADER))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "Configuration cache snapshot [%s] is truncated",
+				CONFIG_CONF_CACHE_SNAPSHOT_FILE);
+		close(fd);
+		goto out;
+	}
+
+	addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (MAP_FAILED == addr)
+	{
+		zabbix_log(LOG_LEVEL_ERR, "Cannot map configuration cache snapshot [%s]: %s",
+				CONFIG_CONF_CACHE_SNAPSHOT_FILE, strerror(errno));
+		goto out;
+	}
 
-	for (i = 0; i < ZBX_POLLER_TYPE_COUNT; i++)
-		zabbix_log(LOG_LEVEL_DEBUG, "%s() queue[%d]   : %d (%d allocated)", __function_name,
-				i, config->queues[i].elems_num, config->queues[i].elems_alloc);
+	header = (const ZBX_DC_SNAPSHOT_HEADER *)addr;
+	data = (const char *)addr + sizeof(ZBX_DC_SNAPSHOT_HEADER);
+	end = (const char *)addr + st.st_size;
 
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() pqueue     : %d (%d allocated)", __function_name,
-			config->pqueue.elems_num, config->pqueue.elems_alloc);
+	if (ZBX_SNAPSHOT_MAGIC != header->magic || ZBX_SNAPSHOT_VERSION != header->version ||
+			ZBX_DC_ITEM_VALUES_NUM != header->item_values_num ||
+			ZBX_DC_HOST_VALUES_NUM != header->host_values_num ||
+			(zbx_uint64_t)(end - data) != header->size ||
+			header->checksum != zbx_hash_modfnv(data, end - data, ZBX_DEFAULT_HASH_SEED))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "Configuration cache snapshot [%s] is corrupted",
+				CONFIG_CONF_CACHE_SNAPSHOT_FILE);
+		munmap(addr, (size_t)st.st_size);
+		goto out;
+	}
 
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() configfree : " ZBX_FS_DBL "%%", __function_name,
-			100 * ((double)config_mem->free_size / config_mem->orig_size));
+	DCstage_init(&item_stage, ZBX_DC_ITEM_VALUES_NUM, item_strings);
+	DCstage_init(&host_stage, ZBX_DC_HOST_VALUES_NUM, host_strings);
 
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() strings    : %d (%d slots)", __function_name,
-			strpool->hashset->num_data, strpool->hashset->num_slots);
-	zabbix_log(LOG_LEVEL_DEBUG, "%s() strpoolfree: " ZBX_FS_DBL "%%", __function_name,
-			100 * ((double)strpool->mem_info->free_size / strpool->mem_info->orig_size));
+	if (SUCCEED == DCsnapshot_stage_rows(&data, end, header->items_num, &item_stage) &&
+			SUCCEED == DCsnapshot_stage_rows(&data, end, header->hosts_num, &host_stage))
+	{
+		LOCK_CACHE;
 
-	zbx_mem_dump_stats(config_mem);
-	zbx_mem_dump_stats(strpool->mem_info);
+		DCsync_items(&item_stage);
+		DCsync_hosts(&host_stage);
 
-	UNLOCK_CACHE;
+		UNLOCK_CACHE;
 
-	DBfree_result(item_result);
-	DBfree_result(host_result);
+		zabbix_log(LOG_LEVEL_WARNING, "Loaded configuration cache snapshot [%s]: %d items, %d hosts",
+				CONFIG_CONF_CACHE_SNAPSHOT_FILE, item_stage.rows_num, host_stage.rows_num);
 
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+		ret = SUCCEED;
+	}
+	else
+	{
+		zabbix_log(LOG_LEVEL_ERR, "Configuration cache snapshot [%s] is corrupted",
+				CONFIG_CONF_CACHE_SNAPSHOT_FILE);
+	}
+
+	DCstage_free(&item_stage);
+	DCstage_free(&host_stage);
+
+	munmap(addr, (size_t)st.st_size);
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
+
+	return ret;
 }
 
 /******************************************************************************
@@ -1350,43 +3001,48 @@ static int	__config_host_ph_compare(const void *d1, const void *d2)
 	return (host_ph_1->host == host_ph_2->host ? 0 : strcmp(host_ph_1->host, host_ph_2->host));
 }
 
-static int	__config_nextcheck_compare(const void *d1, const void *d2)
+/* items and hosts are stored inline, pointers to them are updated when their hashsets grow */
+
+static void	__config_item_moved(const void *old_data, void *new_data)
 {
-	const zbx_binary_heap_elem_t	*e1 = (const zbx_binary_heap_elem_t *)d1;
-	const zbx_binary_heap_elem_t	*e2 = (const zbx_binary_heap_elem_t *)d2;
+	ZBX_DC_ITEM	*item = (ZBX_DC_ITEM *)new_data;
+	ZBX_DC_ITEM_HK	*item_hk, item_hk_local;
 
-	const ZBX_DC_ITEM		*i1 = (const ZBX_DC_ITEM *)e1->data;
-	const ZBX_DC_ITEM		*i2 = (const ZBX_DC_ITEM *)e2->data;
+	config->items_sched.items[item->slot] = item;
 
-	if (i1->nextcheck < i2->nextcheck) return -1;
-	if (i1->nextcheck > i2->nextcheck) return +1;
-	return 0;
+	item_hk_local.hostid = item->hostid;
+	item_hk_local.key = item->key;
+
+	if (NULL != (item_hk = zbx_hashset_search(&config->items_hk, &item_hk_local)) && old_data == item_hk->item_ptr)
+		item_hk->item_ptr = item;
 }
 
-static int	__config_proxy_compare(const void *d1, const void *d2)
+static void	__config_host_moved(const void *old_data, void *new_data)
 {
-	const zbx_binary_heap_elem_t	*e1 = (const zbx_binary_heap_elem_t *)d1;
-	const zbx_binary_heap_elem_t	*e2 = (const zbx_binary_heap_elem_t *)d2;
+	ZBX_DC_HOST	*host = (ZBX_DC_HOST *)new_data;
+	ZBX_DC_HOST_PH	*host_ph, host_ph_local;
 
-	const ZBX_DC_HOST		*h1 = (const ZBX_DC_HOST *)e1->data;
-	const ZBX_DC_HOST		*h2 = (const ZBX_DC_HOST *)e2->data;
+	host_ph_local.proxy_hostid = host->proxy_hostid;
+	host_ph_local.status = host->status;
+	host_ph_local.host = host->host;
 
-	if (h1->disable_until < h2->disable_until) return -1;
-	if (h1->disable_until > h2->disable_until) return +1;
-	return 0;
+	if (NULL != (host_ph = zbx_hashset_search(&config->hosts_ph, &host_ph_local)) && old_data == host_ph->host_ptr)
+		host_ph->host_ptr = host;
 }
 
-void	init_configuration_cache()
+void	init_configuration_cache(unsigned char p)
 {
 	const char	*__function_name = "init_configuration_cache";
 
-	int		i;
+	int		i, now;
 	key_t		shm_key;
 	size_t		config_size;
 	size_t		strpool_size;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() size:%d", __function_name, CONFIG_CONF_CACHE_SIZE);
 
+	zbx_process = p;
+
 	strpool_size = (size_t)(CONFIG_CONF_CACHE_SIZE * 0.15);
 	config_size = CONFIG_CONF_CACHE_SIZE - strpool_size;
 
@@ -1396,13 +3052,14 @@ void	init_configuration_cache()
 		exit(FAIL);
 	}
 
-	if (ZBX_MUTEX_ERROR == zbx_mutex_create_force(&config_lock, ZBX_MUTEX_CONFIG))
+	if (ZBX_MUTEX_ERROR == zbx_rwlock_create(&config_lock, ZBX_MUTEX_CONFIG, ZBX_MUTEX_CONFIG_WRITERS))
 	{
 		zbx_error("Unable to create mutex for configuration cache");
 		exit(FAIL);
 	}
 
 	zbx_mem_create(&config_mem, shm_key, ZBX_NO_MUTEX, config_size, "configuration cache", "CacheSize");
+	zbx_mem_enable_slabs(config_mem);
 
 	config = __config_mem_malloc_func(NULL, sizeof(ZBX_DC_CONFIG));
 
@@ -1415,7 +3072,14 @@ void	init_configuration_cache()
 								__config_mem_realloc_func,	\
 								__config_mem_free_func);
 
-	CREATE_HASHSET(config->items);
+	zbx_hashset_create_inline(&config->items, INIT_HASHSET_SIZE, sizeof(ZBX_DC_ITEM),
+					ZBX_DEFAULT_UINT64_HASH_FUNC,
+					ZBX_DEFAULT_UINT64_COMPARE_FUNC,
+					__config_item_moved,
+					__config_mem_malloc_func,
+					__config_mem_realloc_func,
+					__config_mem_free_func);
+	memset(&config->items_sched, 0, sizeof(ZBX_DC_ITEM_SCHED));
 	CREATE_HASHSET(config->snmpitems);
 	CREATE_HASHSET(config->ipmiitems);
 	CREATE_HASHSET(config->flexitems);
@@ -1426,9 +3090,21 @@ void	init_configuration_cache()
 	CREATE_HASHSET(config->telnetitems);
 	CREATE_HASHSET(config->calcitems);
 
-	CREATE_HASHSET(config->hosts);
+	zbx_hashset_create_inline(&config->hosts, INIT_HASHSET_SIZE, sizeof(ZBX_DC_HOST),
+					ZBX_DEFAULT_UINT64_HASH_FUNC,
+					ZBX_DEFAULT_UINT64_COMPARE_FUNC,
+					__config_host_moved,
+					__config_mem_malloc_func,
+					__config_mem_realloc_func,
+					__config_mem_free_func);
 	CREATE_HASHSET(config->ipmihosts);
 
+	CREATE_HASHSET(config->triggers);
+	CREATE_HASHSET(config->functions);
+	CREATE_HASHSET(config->items_tr);
+	CREATE_HASHSET(config->deplists);
+	config->triggers_revision = 0;
+
 	zbx_hashset_create_ext(&config->items_hk, INIT_HASHSET_SIZE,
 					__config_item_hk_hash,
 					__config_item_hk_compare,
@@ -1443,19 +3119,17 @@ void	init_configuration_cache()
 					__config_mem_realloc_func,
 					__config_mem_free_func);
 
+	now = time(NULL);
+
 	for (i = 0; i < ZBX_POLLER_TYPE_COUNT; i++)
 	{
-		zbx_binary_heap_create_ext(&config->queues[i],
-						__config_nextcheck_compare,
-						ZBX_BINARY_HEAP_OPTION_DIRECT,
+		zbx_timer_wheel_create_ext(&config->queues[i], now,
 						__config_mem_malloc_func,
 						__config_mem_realloc_func,
 						__config_mem_free_func);
 	}
 
-	zbx_binary_heap_create_ext(&config->pqueue,
-					__config_proxy_compare,
-					ZBX_BINARY_HEAP_OPTION_DIRECT,
+	zbx_timer_wheel_create_ext(&config->pqueue, now,
 					__config_mem_malloc_func,
 					__config_mem_realloc_func,
 					__config_mem_free_func);
@@ -1502,7 +3176,7 @@ void	free_configuration_cache()
 
 	UNLOCK_CACHE;
 
-	zbx_mutex_destroy(&config_lock);
+	zbx_rwlock_destroy(&config_lock);
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
@@ -1564,7 +3238,7 @@ int	DCget_host_by_hostid(DC_HOST *host, zbx_uint64_t hostid)
 	int			res = FAIL;
 	const ZBX_DC_HOST	*dc_host;
 
-	LOCK_CACHE;
+	RDLOCK_CACHE;
 
 	if (NULL != (dc_host = zbx_hashset_search(&config->hosts, &hostid)))
 	{
@@ -1572,7 +3246,7 @@ int	DCget_host_by_hostid(DC_HOST *host, zbx_uint64_t hostid)
 		res = SUCCEED;
 	}
 
-	UNLOCK_CACHE;
+	RDUNLOCK_CACHE;
 
 	return res;
 }
@@ -1595,9 +3269,9 @@ static void	DCget_item(DC_ITEM *dst_item, const ZBX_DC_ITEM *src_item)
 	dst_item->value_type = src_item->value_type;
 	strscpy(dst_item->key_orig, src_item->key);
 	dst_item->key = NULL;
-	dst_item->delay = src_item->delay;
-	dst_item->nextcheck = src_item->nextcheck;
-	dst_item->status = src_item->status;
+	dst_item->delay = DC_ITEM_DELAY(src_item);
+	dst_item->nextcheck = DC_ITEM_NEXTCHECK(src_item);
+	dst_item->status = DC_ITEM_STATUS(src_item);
 	*dst_item->trapper_hosts = '\0';
 	*dst_item->logtimefmt = '\0';
 	*dst_item->delay_flex = '\0';
@@ -1704,7 +3378,7 @@ int	DCconfig_get_item_by_key(DC_ITEM *item, zbx_uint64_t proxy_hostid, const cha
 	const ZBX_DC_ITEM	*dc_item;
 	const ZBX_DC_HOST	*dc_host;
 
-	LOCK_CACHE;
+	RDLOCK_CACHE;
 
 	if (NULL == (dc_host = DCfind_host(proxy_hostid, hostname)))
 		goto unlock;
@@ -1717,11 +3391,90 @@ int	DCconfig_get_item_by_key(DC_ITEM *item, zbx_uint64_t proxy_hostid, const cha
 
 	res = SUCCEED;
 unlock:
-	UNLOCK_CACHE;
+	RDUNLOCK_CACHE;
 
 	return res;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: DCconfig_get_items_by_keys                                       *
+ *                                                                            *
+ * Purpose: locate a batch of items by host name and key                      *
+ *                                                                            *
+ * Parameters: items        - [OUT] the located items                         *
+ *             proxy_hostid - [IN] proxy the values came from, 0 if none      *
+ *             hostnames    - [IN] host names                                 *
+ *             keys         - [IN] item keys                                  *
+ *             errcodes     - [OUT] SUCCEED if the item was located and FAIL  *
+ *                            otherwise                                       *
+ *             num          - [IN] number of elements in the arrays           *
+ *                                                                            *
+ * Comments: The whole batch is resolved under one read lock. Only the        *
+ *           fields needed to accept a value are copied. Consecutive values   *
+ *           usually come from the same host, so its lookup is reused.        *
+ *                                                                            *
+ ******************************************************************************/
+void	DCconfig_get_items_by_keys(DC_VALUE_ITEM *items, zbx_uint64_t proxy_hostid, const char **hostnames,
+		const char **keys, int *errcodes, int num)
+{
+	const char		*__function_name = "DCconfig_get_items_by_keys";
+
+	const ZBX_DC_ITEM	*dc_item;
+	const ZBX_DC_HOST	*dc_host = NULL;
+	const ZBX_DC_TRAPITEM	*trapitem;
+	const ZBX_DC_LOGITEM	*logitem;
+	const char		*hostname = NULL;
+	int			i, found = 0;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() num:%d", __function_name, num);
+
+	RDLOCK_CACHE;
+
+	for (i = 0; i < num; i++)
+	{
+		errcodes[i] = FAIL;
+
+		if (NULL == hostname || 0 != strcmp(hostname, hostnames[i]))
+		{
+			hostname = hostnames[i];
+			dc_host = DCfind_host(proxy_hostid, hostname);
+		}
+
+		if (NULL == dc_host || NULL == (dc_item = DCfind_item(dc_host->hostid, keys[i])))
+			continue;
+
+		items[i].itemid = dc_item->itemid;
+		items[i].type = dc_item->type;
+		items[i].data_type = dc_item->data_type;
+		items[i].value_type = dc_item->value_type;
+		items[i].maintenance_status = dc_host->maintenance_status;
+		items[i].maintenance_type = dc_host->maintenance_type;
+		items[i].maintenance_from = dc_host->maintenance_from;
+		*items[i].trapper_hosts = '\0';
+		*items[i].logtimefmt = '\0';
+
+		if (ITEM_TYPE_TRAPPER == dc_item->type &&
+				NULL != (trapitem = zbx_hashset_search(&config->trapitems, &dc_item->itemid)))
+		{
+			strscpy(items[i].trapper_hosts, trapitem->trapper_hosts);
+		}
+
+		if (ITEM_VALUE_TYPE_LOG == dc_item->value_type &&
+				NULL != (logitem = zbx_hashset_search(&config->logitems, &dc_item->itemid)))
+		{
+			strscpy(items[i].logtimefmt, logitem->logtimefmt);
+		}
+
+		errcodes[i] = SUCCEED;
+		found++;
+	}
+
+	RDUNLOCK_CACHE;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() found:%d", __function_name, found);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: DCconfig_get_item_by_itemid                                      *
@@ -1744,7 +3497,7 @@ int	DCconfig_get_item_by_itemid(DC_ITEM *item, zbx_uint64_t itemid)
 	const ZBX_DC_ITEM	*dc_item;
 	const ZBX_DC_HOST	*dc_host;
 
-	LOCK_CACHE;
+	RDLOCK_CACHE;
 
 	if (NULL == (dc_item = zbx_hashset_search(&config->items, &itemid)))
 		goto unlock;
@@ -1757,7 +3510,7 @@ int	DCconfig_get_item_by_itemid(DC_ITEM *item, zbx_uint64_t itemid)
 
 	res = SUCCEED;
 unlock:
-	UNLOCK_CACHE;
+	RDUNLOCK_CACHE;
 
 	return res;
 }
@@ -1774,35 +3527,23 @@ unlock:
  *                                                                            *
  * Author: Alexander Vladishev, Aleksandrs Saveljevs                          *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: for items due more than 255 seconds later the returned time may  *
+ *           be earlier than their actual nextcheck                           *
  *                                                                            *
  ******************************************************************************/
 int	DCconfig_get_poller_nextcheck(unsigned char poller_type)
 {
-	const char			*__function_name = "DCconfig_get_poller_nextcheck";
+	const char	*__function_name = "DCconfig_get_poller_nextcheck";
 
-	int				nextcheck;
-	zbx_binary_heap_t		*queue;
-	const zbx_binary_heap_elem_t	*min;
-	const ZBX_DC_ITEM		*dc_item;
+	int		nextcheck;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() poller_type:%d", __function_name, (int)poller_type);
 
-	queue = &config->queues[poller_type];
-
-	LOCK_CACHE;
-
-	if (FAIL == zbx_binary_heap_empty(queue))
-	{
-		min = zbx_binary_heap_find_min(queue);
-		dc_item = (const ZBX_DC_ITEM *)min->data;
+	RDLOCK_CACHE;
 
-		nextcheck = dc_item->nextcheck;
-	}
-	else
-		nextcheck = FAIL;
+	nextcheck = zbx_timer_wheel_nextcheck(&config->queues[poller_type]);
 
-	UNLOCK_CACHE;
+	RDUNLOCK_CACHE;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __function_name, nextcheck);
 
@@ -1833,7 +3574,8 @@ int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items, int max
 	const char		*__function_name = "DCconfig_get_poller_items";
 
 	int			now, num = 0;
-	zbx_binary_heap_t	*queue;
+	zbx_uint64_t		slot;
+	zbx_timer_wheel_t	*queue;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() poller_type:%d", __function_name, (int)poller_type);
 
@@ -1843,24 +3585,17 @@ int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items, int max
 
 	LOCK_CACHE;
 
-	while (num < max_items && FAIL == zbx_binary_heap_empty(queue))
+	while (num < max_items && SUCCEED == zbx_timer_wheel_pop(queue, now, &slot))
 	{
-		int				disable_until, old_nextcheck;
-		unsigned char			old_poller_type;
-		const zbx_binary_heap_elem_t	*min;
-		ZBX_DC_ITEM			*dc_item;
-		ZBX_DC_HOST			*dc_host;
-
-		min = zbx_binary_heap_find_min(queue);
-		dc_item = (ZBX_DC_ITEM *)min->data;
+		int		disable_until, old_nextcheck;
+		unsigned char	old_poller_type;
+		ZBX_DC_ITEM	*dc_item;
+		ZBX_DC_HOST	*dc_host;
 
-		if (dc_item->nextcheck > now)
-			break;
-
-		zbx_binary_heap_remove_min(queue);
-		dc_item->location = ZBX_LOC_NOWHERE;
+		dc_item = config->items_sched.items[slot];
+		DC_ITEM_LOCATION(dc_item) = ZBX_LOC_NOWHERE;
 
-		if (CONFIG_REFRESH_UNSUPPORTED == 0 && ITEM_STATUS_NOTSUPPORTED == dc_item->status)
+		if (CONFIG_REFRESH_UNSUPPORTED == 0 && ITEM_STATUS_NOTSUPPORTED == DC_ITEM_STATUS(dc_item))
 			continue;
 
 		if (NULL == (dc_host = zbx_hashset_search(&config->hosts, &dc_item->hostid)))
@@ -1869,10 +3604,10 @@ int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items, int max
 		if (HOST_MAINTENANCE_STATUS_ON == dc_host->maintenance_status &&
 				MAINTENANCE_TYPE_NODATA == dc_host->maintenance_type)
 		{
-			old_nextcheck = dc_item->nextcheck;
-			dc_item->nextcheck = DCget_reachable_nextcheck(dc_item, now);
+			old_nextcheck = DC_ITEM_NEXTCHECK(dc_item);
+			DC_ITEM_NEXTCHECK(dc_item) = DCget_reachable_nextcheck(dc_item, now);
 
-			DCupdate_item_queue(dc_item, dc_item->poller_type, old_nextcheck);
+			DCupdate_item_queue(dc_item, DC_ITEM_POLLER_TYPE(dc_item), old_nextcheck);
 			continue;
 		}
 
@@ -1880,12 +3615,12 @@ int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items, int max
 		{
 			if (ZBX_POLLER_TYPE_UNREACHABLE == poller_type)
 			{
-				old_poller_type = dc_item->poller_type;
+				old_poller_type = DC_ITEM_POLLER_TYPE(dc_item);
 				poller_by_item(dc_item->itemid, dc_host->proxy_hostid, dc_item->type, dc_item->key,
-						&dc_item->poller_type);
+						&DC_ITEM_POLLER_TYPE(dc_item));
 
-				old_nextcheck = dc_item->nextcheck;
-				dc_item->nextcheck = DCget_reachable_nextcheck(dc_item, now);
+				old_nextcheck = DC_ITEM_NEXTCHECK(dc_item);
+				DC_ITEM_NEXTCHECK(dc_item) = DCget_reachable_nextcheck(dc_item, now);
 
 				DCupdate_item_queue(dc_item, old_poller_type, old_nextcheck);
 				continue;
@@ -1895,29 +3630,29 @@ int	DCconfig_get_poller_items(unsigned char poller_type, DC_ITEM *items, int max
 		{
 			if (ZBX_POLLER_TYPE_NORMAL == poller_type || ZBX_POLLER_TYPE_IPMI == poller_type)
 			{
-				old_poller_type = dc_item->poller_type;
-				dc_item->poller_type = ZBX_POLLER_TYPE_UNREACHABLE;
+				old_poller_type = DC_ITEM_POLLER_TYPE(dc_item);
+				DC_ITEM_POLLER_TYPE(dc_item) = ZBX_POLLER_TYPE_UNREACHABLE;
 
-				old_nextcheck = dc_item->nextcheck;
+				old_nextcheck = DC_ITEM_NEXTCHECK(dc_item);
 				if (disable_until > now)
-					dc_item->nextcheck = DCget_unreachable_nextcheck(dc_item, dc_host);
+					DC_ITEM_NEXTCHECK(dc_item) = DCget_unreachable_nextcheck(dc_item, dc_host);
 
 				DCupdate_item_queue(dc_item, old_poller_type, old_nextcheck);
 				continue;
 			}
 			else if (disable_until > now)
 			{
-				old_nextcheck = dc_item->nextcheck;
-				dc_item->nextcheck = DCget_unreachable_nextcheck(dc_item, dc_host);
+				old_nextcheck = DC_ITEM_NEXTCHECK(dc_item);
+				DC_ITEM_NEXTCHECK(dc_item) = DCget_unreachable_nextcheck(dc_item, dc_host);
 
-				DCupdate_item_queue(dc_item, dc_item->poller_type, old_nextcheck);
+				DCupdate_item_queue(dc_item, DC_ITEM_POLLER_TYPE(dc_item), old_nextcheck);
 				continue;
 			}
 
 			DCincrease_disable_until(dc_item, dc_host, now);
 		}
 
-		dc_item->location = ZBX_LOC_POLLER;
+		DC_ITEM_LOCATION(dc_item) = ZBX_LOC_POLLER;
 		DCget_host(&items[num].host, dc_host);
 		DCget_item(&items[num], dc_item);
 		num++;
@@ -1961,7 +3696,7 @@ int	DCconfig_get_items(zbx_uint64_t hostid, const char *key, DC_ITEM **items)
 
 	*items = zbx_malloc(*items, items_alloc * sizeof(DC_ITEM));
 
-	LOCK_CACHE;
+	RDLOCK_CACHE;
 
 	if (0 == hostid)
 		zbx_hashset_iter_reset(&config->hosts, &dc_iter);
@@ -1990,7 +3725,7 @@ int	DCconfig_get_items(zbx_uint64_t hostid, const char *key, DC_ITEM **items)
 			continue;
 
 		if (CONFIG_REFRESH_UNSUPPORTED == 0 &&
-				ITEM_STATUS_NOTSUPPORTED == dc_item->status)
+				ITEM_STATUS_NOTSUPPORTED == DC_ITEM_STATUS(dc_item))
 			continue;
 
 		if (items_num == items_alloc)
@@ -2004,7 +3739,7 @@ int	DCconfig_get_items(zbx_uint64_t hostid, const char *key, DC_ITEM **items)
 		items_num++;
 	}
 
-	UNLOCK_CACHE;
+	RDUNLOCK_CACHE;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __function_name, items_num);
 
@@ -2022,19 +3757,19 @@ void	DCrequeue_reachable_item(zbx_uint64_t itemid, unsigned char status, int now
 
 	if (NULL != (dc_item = zbx_hashset_search(&config->items, &itemid)))
 	{
-		dc_item->status = status;
+		DC_ITEM_STATUS(dc_item) = status;
 
-		old_poller_type = dc_item->poller_type;
-		if (ZBX_POLLER_TYPE_UNREACHABLE == dc_item->poller_type)
+		old_poller_type = DC_ITEM_POLLER_TYPE(dc_item);
+		if (ZBX_POLLER_TYPE_UNREACHABLE == DC_ITEM_POLLER_TYPE(dc_item))
 			if (NULL != (dc_host = zbx_hashset_search(&config->hosts, &dc_item->hostid)))
 				poller_by_item(dc_item->itemid, dc_host->proxy_hostid, dc_item->type, dc_item->key,
-						&dc_item->poller_type);
+						&DC_ITEM_POLLER_TYPE(dc_item));
 
-		old_nextcheck = dc_item->nextcheck;
-		dc_item->nextcheck = DCget_reachable_nextcheck(dc_item, now);
+		old_nextcheck = DC_ITEM_NEXTCHECK(dc_item);
+		DC_ITEM_NEXTCHECK(dc_item) = DCget_reachable_nextcheck(dc_item, now);
 
-		if (ZBX_LOC_POLLER == dc_item->location)
-			dc_item->location = ZBX_LOC_NOWHERE;
+		if (ZBX_LOC_POLLER == DC_ITEM_LOCATION(dc_item))
+			DC_ITEM_LOCATION(dc_item) = ZBX_LOC_NOWHERE;
 
 		DCupdate_item_queue(dc_item, old_poller_type, old_nextcheck);
 	}
@@ -2054,15 +3789,15 @@ void	DCrequeue_unreachable_item(zbx_uint64_t itemid)
 	if (NULL != (dc_item = zbx_hashset_search(&config->items, &itemid)) &&
 			NULL != (dc_host = zbx_hashset_search(&config->hosts, &dc_item->hostid)))
 	{
-		old_poller_type = dc_item->poller_type;
-		if (ZBX_POLLER_TYPE_NORMAL == dc_item->poller_type || ZBX_POLLER_TYPE_IPMI == dc_item->poller_type)
-			dc_item->poller_type = ZBX_POLLER_TYPE_UNREACHABLE;
+		old_poller_type = DC_ITEM_POLLER_TYPE(dc_item);
+		if (ZBX_POLLER_TYPE_NORMAL == DC_ITEM_POLLER_TYPE(dc_item) || ZBX_POLLER_TYPE_IPMI == DC_ITEM_POLLER_TYPE(dc_item))
+			DC_ITEM_POLLER_TYPE(dc_item) = ZBX_POLLER_TYPE_UNREACHABLE;
 
-		old_nextcheck = dc_item->nextcheck;
-		dc_item->nextcheck = DCget_unreachable_nextcheck(dc_item, dc_host);
+		old_nextcheck = DC_ITEM_NEXTCHECK(dc_item);
+		DC_ITEM_NEXTCHECK(dc_item) = DCget_unreachable_nextcheck(dc_item, dc_host);
 
-		if (ZBX_LOC_POLLER == dc_item->location)
-			dc_item->location = ZBX_LOC_NOWHERE;
+		if (ZBX_LOC_POLLER == DC_ITEM_LOCATION(dc_item))
+			DC_ITEM_LOCATION(dc_item) = ZBX_LOC_NOWHERE;
 
 		DCupdate_item_queue(dc_item, old_poller_type, old_nextcheck);
 	}
@@ -2292,7 +4027,8 @@ int	DCconfig_get_proxypoller_hosts(DC_HOST *hosts, int max_hosts)
 {
 	const char		*__function_name = "DCconfig_get_proxypoller_hosts";
 	int			now, num = 0;
-	zbx_binary_heap_t	*queue;
+	zbx_uint64_t		hostid;
+	zbx_timer_wheel_t	*queue;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -2302,18 +4038,11 @@ int	DCconfig_get_proxypoller_hosts(DC_HOST *hosts, int max_hosts)
 
 	LOCK_CACHE;
 
-	while (num < max_hosts && FAIL == zbx_binary_heap_empty(queue))
+	while (num < max_hosts && SUCCEED == zbx_timer_wheel_pop(queue, now, &hostid))
 	{
-		const zbx_binary_heap_elem_t	*min;
-		ZBX_DC_HOST			*dc_host;
+		ZBX_DC_HOST	*dc_host;
 
-		min = zbx_binary_heap_find_min(queue);
-		dc_host = (ZBX_DC_HOST *)min->data;
-
-		if (dc_host->disable_until > now)
-			break;
-
-		zbx_binary_heap_remove_min(queue);
+		dc_host = zbx_hashset_search(&config->hosts, &hostid);
 		dc_host->location = ZBX_LOC_POLLER;
 
 		DCget_host(&hosts[num], dc_host);
@@ -2340,35 +4069,23 @@ int	DCconfig_get_proxypoller_hosts(DC_HOST *hosts, int max_hosts)
  *                                                                            *
  * Author: Alexander Vladishev                                                *
  *                                                                            *
- * Comments:                                                                  *
+ * Comments: for proxies due more than 255 seconds later the returned time    *
+ *           may be earlier than their actual nextcheck                       *
  *                                                                            *
  ******************************************************************************/
 int	DCconfig_get_proxypoller_nextcheck()
 {
-	const char			*__function_name = "DCconfig_get_proxypoller_nextcheck";
+	const char	*__function_name = "DCconfig_get_proxypoller_nextcheck";
 
-	int				nextcheck;
-	zbx_binary_heap_t		*queue;
-	const zbx_binary_heap_elem_t	*min;
-	const ZBX_DC_HOST		*dc_host;
+	int		nextcheck;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
-	queue = &config->pqueue;
-
-	LOCK_CACHE;
-
-	if (FAIL == zbx_binary_heap_empty(queue))
-	{
-		min = zbx_binary_heap_find_min(queue);
-		dc_host = (const ZBX_DC_HOST *)min->data;
+	RDLOCK_CACHE;
 
-		nextcheck = dc_host->disable_until;
-	}
-	else
-		nextcheck = FAIL;
+	nextcheck = zbx_timer_wheel_nextcheck(&config->pqueue);
 
-	UNLOCK_CACHE;
+	RDUNLOCK_CACHE;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __function_name, nextcheck);
 
@@ -2412,3 +4129,288 @@ void	DCrequeue_proxy(zbx_uint64_t hostid, unsigned char update_nextcheck)
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCconfig_get_triggers_by_itemids                                 *
+ *                                                                            *
+ * Purpose: get enabled triggers that have functions on the specified items   *
+ *                                                                            *
+ * Parameters: triggers - [OUT] pointer to array of DC_TRIGGER structures     *
+ *             itemids - [IN] array of item IDs                               *
+ *             clocks - [IN] clocks of the item values                        *
+ *             itemids_num - [IN] number of items                             *
+ *                                                                            *
+ * Return value: number of triggers                                           *
+ *                                                                            *
+ * Comments: triggers are sorted by triggerid, trigger clock is the latest    *
+ *           clock of its items and level is its level in the dependency      *
+ *           graph; expressions must be freed by the caller                   *
+ *                                                                            *
+ ******************************************************************************/
+int	DCconfig_get_triggers_by_itemids(DC_TRIGGER **triggers, const zbx_uint64_t *itemids, const int *clocks,
+		int itemids_num)
+{
+	const char	*__function_name = "DCconfig_get_triggers_by_itemids";
+
+	int		triggers_num = 0, triggers_alloc = 0, i, j, index;
+	zbx_hashmap_t	trigger_index;
+	ZBX_DC_ITEM_TR	*item_tr;
+	ZBX_DC_TRIGGER	*dc_trigger;
+	ZBX_DC_TRIGGER_DEPLIST	*deplist;
+	DC_TRIGGER	*trigger;
+	zbx_uint64_t	triggerid;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() items:%d", __function_name, itemids_num);
+
+	*triggers = NULL;
+
+	zbx_hashmap_create(&trigger_index, itemids_num);
+
+	RDLOCK_CACHE;
+
+	for (i = 0; i < itemids_num; i++)
+	{
+		if (NULL == (item_tr = zbx_hashset_search(&config->items_tr, &itemids[i])))
+			continue;
+
+		for (j = 0; j < item_tr->triggerids.values_num; j++)
+		{
+			triggerid = item_tr->triggerids.values[j];
+
+			if (FAIL != (index = zbx_hashmap_get(&trigger_index, triggerid)))
+			{
+				trigger = &(*triggers)[index];
+
+				if (trigger->clock < clocks[i])
+					trigger->clock = clocks[i];
+
+				continue;
+			}
+
+			if (NULL == (dc_trigger = zbx_hashset_search(&config->triggers, &triggerid)))
+				continue;
+
+			if (triggers_num == triggers_alloc)
+			{
+				triggers_alloc += 64;
+				*triggers = zbx_realloc(*triggers, triggers_alloc * sizeof(DC_TRIGGER));
+			}
+
+			trigger = &(*triggers)[triggers_num];
+			trigger->triggerid = triggerid;
+			trigger->expression = zbx_strdup(NULL, dc_trigger->expression);
+			trigger->type = dc_trigger->type;
+			trigger->clock = clocks[i];
+
+			if (NULL != (deplist = zbx_hashset_search(&config->deplists, &triggerid)))
+				trigger->level = deplist->level;
+			else
+				trigger->level = 0;
+
+			zbx_hashmap_set(&trigger_index, triggerid, triggers_num++);
+		}
+	}
+
+	RDUNLOCK_CACHE;
+
+	zbx_hashmap_destroy(&trigger_index);
+
+	if (1 < triggers_num)
+		qsort(*triggers, triggers_num, sizeof(DC_TRIGGER), ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%d", __function_name, triggers_num);
+
+	return triggers_num;
+}
+
+static int	DCcheck_deplist(const ZBX_DC_TRIGGER_DEPLIST *deplist)
+{
+	const ZBX_DC_TRIGGER_DEPLIST	*deplist_up;
+	int				i, value;
+
+	for (i = 0; i < deplist->dependencies.values_num; i++)
+	{
+		deplist_up = zbx_hashset_search(&config->deplists, &deplist->dependencies.values[i]);
+
+		/* a value changed earlier in the same transaction is not in the graph yet */
+		if (0 == trigger_values.num_data ||
+				FAIL == (value = zbx_hashmap_get(&trigger_values, deplist_up->triggerid)))
+		{
+			value = deplist_up->value;
+		}
+
+		if (TRIGGER_VALUE_TRUE == value || SUCCEED == DCcheck_deplist(deplist_up))
+		{
+			zabbix_log(LOG_LEVEL_DEBUG, "This trigger depends on " ZBX_FS_UI64 ". Will not apply actions",
+					deplist_up->triggerid);
+			return SUCCEED;
+		}
+	}
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCconfig_get_triggers_revision                                   *
+ *                                                                            *
+ * Purpose: get the number that changes whenever triggers are removed from    *
+ *          the cache                                                         *
+ *                                                                            *
+ ******************************************************************************/
+unsigned int	DCconfig_get_triggers_revision()
+{
+	unsigned int	revision;
+
+	RDLOCK_CACHE;
+
+	revision = config->triggers_revision;
+
+	RDUNLOCK_CACHE;
+
+	return revision;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCconfig_get_removed_triggerids                                  *
+ *                                                                            *
+ * Purpose: find out which of the triggers are not in the cache any more      *
+ *                                                                            *
+ * Parameters: triggerids - [IN/OUT] trigger IDs, only the IDs of triggers    *
+ *                          which are not cached are left                     *
+ *                                                                            *
+ ******************************************************************************/
+void	DCconfig_get_removed_triggerids(zbx_vector_uint64_t *triggerids)
+{
+	int	i, j;
+
+	RDLOCK_CACHE;
+
+	for (i = 0, j = 0; i < triggerids->values_num; i++)
+	{
+		if (NULL == zbx_hashset_search(&config->triggers, &triggerids->values[i]))
+			triggerids->values[j++] = triggerids->values[i];
+	}
+
+	RDUNLOCK_CACHE;
+
+	triggerids->values_num = j;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCconfig_check_trigger_dependencies                              *
+ *                                                                            *
+ * Purpose: check if trigger depends on triggers having value TRUE            *
+ *                                                                            *
+ * Parameters: triggerid - [IN] trigger ID                                    *
+ *                                                                            *
+ * Return value: SUCCEED - it does depend, FAIL - otherwise                   *
+ *                                                                            *
+ * Comments: the dependency graph has no cycles after configuration sync      *
+ *                                                                            *
+ ******************************************************************************/
+int	DCconfig_check_trigger_dependencies(zbx_uint64_t triggerid)
+{
+	const char		*__function_name = "DCconfig_check_trigger_dependencies";
+
+	ZBX_DC_TRIGGER_DEPLIST	*deplist;
+	int			ret = FAIL;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() triggerid:" ZBX_FS_UI64, __function_name, triggerid);
+
+	RDLOCK_CACHE;
+
+	if (NULL != (deplist = zbx_hashset_search(&config->deplists, &triggerid)))
+		ret = DCcheck_deplist(deplist);
+
+	RDUNLOCK_CACHE;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCconfig_set_trigger_value                                       *
+ *                                                                            *
+ * Purpose: remember the new value of a trigger for the dependency graph      *
+ *                                                                            *
+ * Parameters: triggerid - [IN] trigger ID                                    *
+ *             value - [IN] new trigger value                                 *
+ *                                                                            *
+ * Comments: must be called whenever trigger value is changed in database.    *
+ *           The value is seen by the dependency checks of this process at    *
+ *           once and by the other processes after DBcommit().                *
+ *                                                                            *
+ ******************************************************************************/
+void	DCconfig_set_trigger_value(zbx_uint64_t triggerid, unsigned char value)
+{
+	if (NULL == trigger_values.slots)
+	{
+		zbx_vector_uint64_create(&trigger_value_ids);
+		zbx_hashmap_create(&trigger_values, 64);
+	}
+
+	if (FAIL == zbx_hashmap_get(&trigger_values, triggerid))
+		zbx_vector_uint64_append(&trigger_value_ids, triggerid);
+
+	zbx_hashmap_set(&trigger_values, triggerid, value);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCconfig_commit_trigger_values                                   *
+ *                                                                            *
+ * Purpose: copy trigger values changed in a committed transaction into the   *
+ *          dependency graph                                                  *
+ *                                                                            *
+ ******************************************************************************/
+void	DCconfig_commit_trigger_values()
+{
+	ZBX_DC_TRIGGER_DEPLIST	*deplist;
+	zbx_uint64_t		triggerid;
+	int			i, now;
+
+	if (NULL == trigger_values.slots || 0 == trigger_value_ids.values_num)
+		return;
+
+	now = (int)time(NULL);
+
+	LOCK_CACHE;
+
+	for (i = 0; i < trigger_value_ids.values_num; i++)
+	{
+		triggerid = trigger_value_ids.values[i];
+
+		if (NULL != (deplist = zbx_hashset_search(&config->deplists, &triggerid)))
+		{
+			deplist->value = (unsigned char)zbx_hashmap_get(&trigger_values, triggerid);
+			deplist->lastchange = now;
+		}
+	}
+
+	UNLOCK_CACHE;
+
+	DCconfig_rollback_trigger_values();
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DCconfig_rollback_trigger_values                                 *
+ *                                                                            *
+ * Purpose: forget trigger values changed in a transaction that was rolled    *
+ *          back or lost                                                      *
+ *                                                                            *
+ ******************************************************************************/
+void	DCconfig_rollback_trigger_values()
+{
+	if (NULL == trigger_values.slots || 0 == trigger_value_ids.values_num)
+		return;
+
+	zbx_hashmap_clear(&trigger_values);
+	zbx_vector_uint64_clear(&trigger_value_ids);
+}
@@ -284,6 +284,8 @@ void	DCflush_nextchecks()
 							triggerid);
 			zbx_free(error_msg_esc);
 
+			DCconfig_set_trigger_value(triggerid, TRIGGER_VALUE_UNKNOWN);
+
 			if (events_num == events_allocated)
 			{
 				events_allocated += 32;
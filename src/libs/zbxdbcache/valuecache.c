@@ -0,0 +1,1323 @@
+/*
+** ZABBIX
+** Copyright (C) 2000-2011 SIA Zabbix
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**/
+
+#include "common.h"
+#include "log.h"
+
+#include "db.h"
+#include "dbcache.h"
+#include "ipc.h"
+#include "mutexs.h"
+
+#include "memalloc.h"
+#include "zbxalgo.h"
+#include "valuecache.h"
+
+/*
+ * The value cache keeps recent values of numeric items for trigger functions.
+ *
+ * An item is added when a function asks for its values for the first time. The requested window is read from
+ * the database and from then on history syncers add new values of the item as they write them. The cache
+ * holds all values of an item since cached_from, so any later window is served from memory.
+ *
+ * Every item keeps enough values for the longest time window and the largest number of values requested for
+ * it. When the cache is full, the items which were not requested for the longest time are dropped.
+ *
+ * For functions over a time window an item can also keep running aggregates (sum and number of values, minimum
+ * and maximum candidates, number of matching values). An aggregate covers values with clock in (from, to] and is
+ * moved forward when it is requested: the values which entered the window are added and the ones which left it
+ * are subtracted, so every value is processed twice regardless of the window size. A value which arrives into
+ * the already aggregated part of the window invalidates the aggregate and it is built again on the next request.
+ */
+
+static zbx_mem_info_t	*vc_mem = NULL;
+
+#define	LOCK_VALUECACHE		zbx_mutex_lock(&vc_lock)
+#define	UNLOCK_VALUECACHE	zbx_mutex_unlock(&vc_lock)
+
+static ZBX_MUTEX	vc_lock;
+
+ZBX_MEM_FUNC_IMPL(__vc, vc_mem);
+
+#define ZBX_VC_ITEM_READY	0
+#define ZBX_VC_ITEM_LOADING	1	/* the values are being read from the database by a process */
+#define ZBX_VC_ITEM_DROPPED	2	/* a value did not fit while loading, the item must not be cached */
+
+/* free memory which is never handed out to item values, it is left for hashset entries and fragmentation */
+#define ZBX_VC_MEM_RESERVE	(vc_mem->orig_size / 16)
+
+/* the number of aggregates an item can keep, the least recently requested one is replaced */
+#define ZBX_VC_ITEM_AGGS_MAX	8
+
+/* running aggregate of the item values with clock in (from, to] */
+typedef struct
+{
+	history_value_t	pattern;	/* the value compared with by function count */
+	history_value_t	sum;
+	zbx_vc_value_t	*deque;		/* minimum or maximum candidates, a ring buffer sorted by clock */
+	int		deque_alloc;
+	int		deque_first;
+	int		deque_num;
+	int		seconds;
+	int		from;
+	int		to;
+	int		num;		/* number of the values in the window */
+	int		matched;	/* number of the values counted by function count */
+	int		lastaccess;
+	unsigned char	func;
+	unsigned char	op;
+	unsigned char	valid;
+}
+zbx_vc_agg_t;
+
+typedef struct zbx_vc_item_s
+{
+	zbx_uint64_t		itemid;
+	zbx_vc_value_t		*values;	/* sorted by clock, oldest first */
+	int			values_num;
+	int			values_alloc;
+	zbx_vc_agg_t		*aggs;		/* ZBX_VC_ITEM_AGGS_MAX slots, allocated on the first request */
+	int			aggs_num;
+	int			cached_from;	/* all values with clock >= cached_from are cached */
+	int			range;		/* the longest time window requested, in seconds back from now */
+	int			count;		/* the largest number of values requested */
+	unsigned char		value_type;
+	unsigned char		state;
+	struct zbx_vc_item_s	*prev;		/* least recently used list, the last requested item first */
+	struct zbx_vc_item_s	*next;
+}
+zbx_vc_item_t;
+
+typedef struct
+{
+	zbx_hashset_t	items;
+	zbx_vc_item_t	*head;
+	zbx_vc_item_t	*tail;
+	zbx_uint64_t	hits;
+	zbx_uint64_t	misses;
+}
+zbx_vc_cache_t;
+
+static zbx_vc_cache_t	*vc_cache = NULL;
+
+extern int		CONFIG_VALUE_CACHE_SIZE;
+
+static void	vc_lru_unlink(zbx_vc_item_t *item)
+{
+	if (NULL != item->prev)
+		item->prev->next = item->next;
+	else
+		vc_cache->head = item->next;
+
+	if (NULL != item->next)
+		item->next->prev = item->prev;
+	else
+		vc_cache->tail = item->prev;
+
+	item->prev = NULL;
+	item->next = NULL;
+}
+
+static void	vc_lru_push(zbx_vc_item_t *item)
+{
+	item->prev = NULL;
+	item->next = vc_cache->head;
+
+	if (NULL != vc_cache->head)
+		vc_cache->head->prev = item;
+	else
+		vc_cache->tail = item;
+
+	vc_cache->head = item;
+}
+
+static void	vc_agg_clear(zbx_vc_agg_t *agg)
+{
+	if (NULL != agg->deque)
+		__vc_mem_free_func(agg->deque);
+
+	memset(agg, 0, sizeof(zbx_vc_agg_t));
+}
+
+static void	vc_item_remove(zbx_vc_item_t *item)
+{
+	int	i;
+
+	vc_lru_unlink(item);
+
+	if (NULL != item->values)
+		__vc_mem_free_func(item->values);
+
+	if (NULL != item->aggs)
+	{
+		for (i = 0; i < item->aggs_num; i++)
+			vc_agg_clear(&item->aggs[i]);
+
+		__vc_mem_free_func(item->aggs);
+	}
+
+	zbx_hashset_remove(&vc_cache->items, &item->itemid);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_evict_item                                                    *
+ *                                                                            *
+ * Purpose: drop the least recently requested item from the cache             *
+ *                                                                            *
+ * Parameters: keep - [IN] item which must not be dropped, can be NULL        *
+ *                                                                            *
+ * Return value: SUCCEED - an item was dropped, FAIL - nothing to drop        *
+ *                                                                            *
+ * Comments: items being loaded are owned by the loading process              *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_evict_item(const zbx_vc_item_t *keep)
+{
+	zbx_vc_item_t	*item;
+
+	for (item = vc_cache->tail; NULL != item; item = item->prev)
+	{
+		if (item != keep && ZBX_VC_ITEM_READY == item->state)
+		{
+			zabbix_log(LOG_LEVEL_DEBUG, "value cache is full, dropping item " ZBX_FS_UI64, item->itemid);
+			vc_item_remove(item);
+			return SUCCEED;
+		}
+	}
+
+	return FAIL;
+}
+
+static int	vc_reserve_memory(size_t size, const zbx_vc_item_t *keep)
+{
+	while (vc_mem->free_size < size + ZBX_VC_MEM_RESERVE)
+	{
+		if (FAIL == vc_evict_item(keep))
+			return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_item_create                                                   *
+ *                                                                            *
+ * Purpose: add an item to the cache in the loading state                     *
+ *                                                                            *
+ * Parameters: itemid     - [IN] item identifier                              *
+ *             value_type - [IN] type of the item values                      *
+ *                                                                            *
+ * Return value: the new item or NULL if it does not fit into the cache       *
+ *                                                                            *
+ * Comments: the hashset slots are allocated once, instead of growing the     *
+ *           hashset the least recently requested items are dropped           *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_vc_item_t	*vc_item_create(zbx_uint64_t itemid, unsigned char value_type)
+{
+	zbx_vc_item_t	item_local;
+
+	while (vc_cache->items.num_data + 1 >= vc_cache->items.num_slots * 4 / 5)
+	{
+		if (FAIL == vc_evict_item(NULL))
+			return NULL;
+	}
+
+	if (FAIL == vc_reserve_memory(sizeof(zbx_vc_item_t) + sizeof(ZBX_HASHSET_ENTRY_T), NULL))
+		return NULL;
+
+	memset(&item_local, 0, sizeof(zbx_vc_item_t));
+	item_local.itemid = itemid;
+	item_local.value_type = value_type;
+	item_local.state = ZBX_VC_ITEM_LOADING;
+
+	return zbx_hashset_insert(&vc_cache->items, &item_local, sizeof(zbx_vc_item_t));
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_item_reserve                                                  *
+ *                                                                            *
+ * Purpose: make room for the specified number of values of an item           *
+ *                                                                            *
+ * Parameters: item         - [IN] the item                                   *
+ *             values_alloc - [IN] the number of values                       *
+ *                                                                            *
+ * Return value: SUCCEED - the values fit, FAIL - otherwise                   *
+ *                                                                            *
+ * Comments: the values are moved to a new chunk instead of being reallocated *
+ *           in place, so that they are not lost when memory runs out         *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_item_reserve(zbx_vc_item_t *item, int values_alloc)
+{
+	zbx_vc_value_t	*values;
+	size_t		size;
+
+	if (values_alloc <= item->values_alloc)
+		return SUCCEED;
+
+	size = values_alloc * sizeof(zbx_vc_value_t);
+
+	/* a single item must not push all the other items out of the cache */
+	if (size > vc_mem->orig_size / 4)
+		return FAIL;
+
+	if (FAIL == vc_reserve_memory(size, item) || NULL == (values = zbx_mem_try_malloc(vc_mem, size)))
+		return FAIL;
+
+	if (NULL != item->values)
+	{
+		memcpy(values, item->values, item->values_num * sizeof(zbx_vc_value_t));
+		__vc_mem_free_func(item->values);
+	}
+
+	item->values = values;
+	item->values_alloc = values_alloc;
+
+	return SUCCEED;
+}
+
+static int	vc_item_add_value(zbx_vc_item_t *item, int clock, const history_value_t *value)
+{
+	int	i, j;
+
+	if (item->values_num == item->values_alloc &&
+			FAIL == vc_item_reserve(item, MAX(item->values_alloc * 3 / 2, item->values_num + 16)))
+	{
+		return FAIL;
+	}
+
+	/* values mostly come in order, so the place is searched from the end */
+	for (i = item->values_num; 0 < i && item->values[i - 1].clock > clock; i--)
+		;
+
+	/* the value belongs to the part of the window which has already been aggregated */
+	for (j = 0; j < item->aggs_num; j++)
+	{
+		if (clock <= item->aggs[j].to)
+			item->aggs[j].valid = 0;
+	}
+
+	if (i != item->values_num)
+		memmove(&item->values[i + 1], &item->values[i], (item->values_num - i) * sizeof(zbx_vc_value_t));
+
+	item->values[i].clock = clock;
+	item->values[i].value = *value;
+	item->values_num++;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_item_trim                                                     *
+ *                                                                            *
+ * Purpose: drop values which are not needed by any requested window          *
+ *                                                                            *
+ * Parameters: item - [IN] the item                                           *
+ *             now  - [IN] current time                                       *
+ *                                                                            *
+ * Comments: when only a part of the values with the same clock is dropped,   *
+ *           the rest is kept, but the clock is no longer fully cached        *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_item_trim(zbx_vc_item_t *item, int now)
+{
+	int	i;
+
+	for (i = 0; i < item->values_num - item->count && item->values[i].clock <= now - item->range; i++)
+		;
+
+	if (0 == i)
+		return;
+
+	item->cached_from = MAX(item->cached_from, item->values[i - 1].clock + 1);
+	item->values_num -= i;
+	memmove(item->values, &item->values[i], item->values_num * sizeof(zbx_vc_value_t));
+}
+
+static void	vc_values_append(zbx_vc_value_t **values, int *values_alloc, int *values_num, const zbx_vc_value_t *value)
+{
+	if (*values_num == *values_alloc)
+	{
+		*values_alloc = MAX(*values_alloc * 3 / 2, 16);
+		*values = zbx_realloc(*values, *values_alloc * sizeof(zbx_vc_value_t));
+	}
+
+	(*values)[(*values_num)++] = *value;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_get_window                                                    *
+ *                                                                            *
+ * Purpose: copy values of the requested window, the newest first             *
+ *                                                                            *
+ * Parameters: src, src_num     - [IN] values sorted by clock, oldest first   *
+ *             cached_from      - [IN] all values with clock >= cached_from   *
+ *                                     are present in src                     *
+ *             seconds, count   - [IN] the window, see zbx_vc_get_value_range *
+ *             timestamp        - [IN] end of the window                      *
+ *             values, ...      - [OUT] values of the window                  *
+ *                                                                            *
+ * Return value: SUCCEED - the window is complete, FAIL - it starts before    *
+ *               cached_from                                                  *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_get_window(const zbx_vc_value_t *src, int src_num, int cached_from, int seconds, int count,
+		int timestamp, zbx_vc_value_t **values, int *values_alloc, int *values_num)
+{
+	int	i;
+
+	*values_num = 0;
+
+	if (0 != seconds)
+	{
+		if (cached_from > timestamp - seconds + 1)
+			return FAIL;
+
+		for (i = src_num - 1; 0 <= i && src[i].clock > timestamp - seconds; i--)
+		{
+			if (src[i].clock <= timestamp)
+				vc_values_append(values, values_alloc, values_num, &src[i]);
+		}
+
+		return SUCCEED;
+	}
+
+	for (i = src_num - 1; 0 <= i && *values_num < count; i--)
+	{
+		if (src[i].clock <= timestamp)
+			vc_values_append(values, values_alloc, values_num, &src[i]);
+	}
+
+	/* fewer values than requested are fine only if the whole history is cached */
+	return (*values_num == count || 0 == cached_from ? SUCCEED : FAIL);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_db_read_values                                                *
+ *                                                                            *
+ * Purpose: read values of the requested window from the database            *
+ *                                                                            *
+ * Parameters: itemid, value_type       - [IN] the item                       *
+ *             seconds, count           - [IN] the window                     *
+ *             timestamp                - [IN] end of the window              *
+ *             to_present               - [IN] 1 - read values newer than the *
+ *                                             window as well                 *
+ *             values, ...              - [OUT] values sorted by clock,       *
+ *                                              oldest first                  *
+ *             cached_from              - [OUT] all values with clock >=      *
+ *                                              cached_from were read         *
+ *                                                                            *
+ ******************************************************************************/
+static void	vc_db_read_values(zbx_uint64_t itemid, int value_type, int seconds, int count, int timestamp,
+		int to_present, zbx_vc_value_t **values, int *values_alloc, int *values_num, int *cached_from)
+{
+	DB_RESULT	result;
+	DB_ROW		row;
+	zbx_vc_value_t	value;
+	char		sql[MAX_STRING_LEN];
+	const char	*table;
+	int		i, offset;
+
+	table = (ITEM_VALUE_TYPE_FLOAT == value_type ? "history" : "history_uint");
+
+	*values_num = 0;
+
+	if (0 != seconds)
+	{
+		offset = zbx_snprintf(sql, sizeof(sql),
+				"select clock,value"
+				" from %s"
+				" where itemid=" ZBX_FS_UI64
+					" and clock>%d",
+				table, itemid, timestamp - seconds);
+
+		if (0 == to_present)
+			offset += zbx_snprintf(sql + offset, sizeof(sql) - offset, " and clock<=%d", timestamp);
+
+		zbx_snprintf(sql + offset, sizeof(sql) - offset, " order by clock");
+
+		result = DBselect("%s", sql);
+		*cached_from = timestamp - seconds + 1;
+	}
+	else
+	{
+		zbx_snprintf(sql, sizeof(sql),
+				"select clock,value"
+				" from %s"
+				" where itemid=" ZBX_FS_UI64
+					" and clock<=%d"
+				" order by clock desc",
+				table, itemid, timestamp);
+
+		result = DBselectN(sql, count);
+	}
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		value.clock = atoi(row[0]);
+
+		if (ITEM_VALUE_TYPE_FLOAT == value_type)
+			value.value.value_float = atof(row[1]);
+		else
+			ZBX_STR2UINT64(value.value.value_uint64, row[1]);
+
+		vc_values_append(values, values_alloc, values_num, &value);
+	}
+	DBfree_result(result);
+
+	if (0 != seconds)
+		return;
+
+	/* the newest values were read first */
+	for (i = 0; i < *values_num / 2; i++)
+	{
+		value = (*values)[i];
+		(*values)[i] = (*values)[*values_num - 1 - i];
+		(*values)[*values_num - 1 - i] = value;
+	}
+
+	if (*values_num < count)
+		*cached_from = 0;
+	else
+		*cached_from = (*values)[0].clock + 1;
+
+	if (0 == to_present)
+		return;
+
+	zbx_snprintf(sql, sizeof(sql),
+			"select clock,value"
+			" from %s"
+			" where itemid=" ZBX_FS_UI64
+				" and clock>%d"
+			" order by clock",
+			table, itemid, timestamp);
+
+	result = DBselect("%s", sql);
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		value.clock = atoi(row[0]);
+
+		if (ITEM_VALUE_TYPE_FLOAT == value_type)
+			value.value.value_float = atof(row[1]);
+		else
+			ZBX_STR2UINT64(value.value.value_uint64, row[1]);
+
+		vc_values_append(values, values_alloc, values_num, &value);
+	}
+	DBfree_result(result);
+}
+
+static int	vc_value_equal(const zbx_vc_value_t *v1, const zbx_vc_value_t *v2, int value_type)
+{
+	if (v1->clock != v2->clock)
+		return FAIL;
+
+	if (ITEM_VALUE_TYPE_FLOAT == value_type)
+		return (v1->value.value_float == v2->value.value_float ? SUCCEED : FAIL);
+
+	return (v1->value.value_uint64 == v2->value.value_uint64 ? SUCCEED : FAIL);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_item_load                                                     *
+ *                                                                            *
+ * Purpose: store values read from the database in an item being loaded       *
+ *                                                                            *
+ * Parameters: item        - [IN] the item in the loading state               *
+ *             values, ... - [IN] values read from the database               *
+ *             cached_from - [IN] all values with clock >= cached_from were   *
+ *                                read                                        *
+ *                                                                            *
+ * Return value: SUCCEED - the item is ready, FAIL - it does not fit          *
+ *                                                                            *
+ * Comments: values added by history syncers while the database was read are *
+ *           merged in, the ones which were read as well are skipped          *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_item_load(zbx_vc_item_t *item, const zbx_vc_value_t *values, int values_num, int cached_from)
+{
+	zbx_vc_value_t	*added;
+	int		added_num, i = 0, j = 0, k;
+
+	if (ZBX_VC_ITEM_DROPPED == item->state)
+		return FAIL;
+
+	/* the values added while loading are moved aside and merged back in clock order */
+	added = item->values;
+	added_num = item->values_num;
+
+	item->values = NULL;
+	item->values_num = 0;
+	item->values_alloc = 0;
+
+	if (FAIL == vc_item_reserve(item, values_num + added_num))
+	{
+		if (NULL != added)
+			__vc_mem_free_func(added);
+		return FAIL;
+	}
+
+	while (i < values_num || j < added_num)
+	{
+		if (j < added_num && added[j].clock < cached_from)
+		{
+			j++;
+			continue;
+		}
+
+		if (j == added_num || (i < values_num && values[i].clock <= added[j].clock))
+		{
+			/* skip the added values which were already committed when the database was read */
+			for (k = j; k < added_num && added[k].clock == values[i].clock; k++)
+			{
+				if (SUCCEED == vc_value_equal(&values[i], &added[k], item->value_type))
+				{
+					memmove(&added[k], &added[k + 1], (added_num - k - 1) * sizeof(zbx_vc_value_t));
+					added_num--;
+					break;
+				}
+			}
+
+			item->values[item->values_num++] = values[i++];
+		}
+		else
+			item->values[item->values_num++] = added[j++];
+	}
+
+	if (NULL != added)
+		__vc_mem_free_func(added);
+
+	item->cached_from = cached_from;
+	item->state = ZBX_VC_ITEM_READY;
+
+	return SUCCEED;
+}
+
+static void	vc_item_update_window(zbx_vc_item_t *item, int seconds, int count, int timestamp, int now)
+{
+	if (0 != seconds)
+		item->range = MAX(item->range, now - timestamp + seconds);
+	else
+		item->count = MAX(item->count, count);
+}
+
+static int	vc_value_compare(int value_type, const history_value_t *v1, const history_value_t *v2)
+{
+	if (ITEM_VALUE_TYPE_FLOAT == value_type)
+	{
+		if (v1->value_float < v2->value_float)
+			return -1;
+
+		return (v1->value_float > v2->value_float ? 1 : 0);
+	}
+
+	if (v1->value_uint64 < v2->value_uint64)
+		return -1;
+
+	return (v1->value_uint64 > v2->value_uint64 ? 1 : 0);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_item_search                                                   *
+ *                                                                            *
+ * Purpose: find the first value of an item newer than the specified clock    *
+ *                                                                            *
+ * Return value: index of the value, values_num if there is no such value     *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_item_search(const zbx_vc_item_t *item, int clock)
+{
+	int	lo = 0, hi = item->values_num, mid;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+
+		if (item->values[mid].clock <= clock)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_agg_deque_push                                                *
+ *                                                                            *
+ * Purpose: add a value to the minimum or maximum candidates of an aggregate  *
+ *                                                                            *
+ * Return value: SUCCEED - the value was added, FAIL - out of memory          *
+ *                                                                            *
+ * Comments: the candidates which can no longer become the minimum (maximum)  *
+ *           of the window are dropped, so the first candidate is the result  *
+ *           and the deque stays monotonic                                    *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_agg_deque_push(zbx_vc_item_t *item, zbx_vc_agg_t *agg, const zbx_vc_value_t *value)
+{
+	zbx_vc_value_t	*deque;
+	int		i, last, cmp, deque_alloc;
+	size_t		size;
+
+	while (0 < agg->deque_num)
+	{
+		last = (agg->deque_first + agg->deque_num - 1) % agg->deque_alloc;
+		cmp = vc_value_compare(item->value_type, &agg->deque[last].value, &value->value);
+
+		if ((ZBX_VC_AGG_MIN == agg->func && 0 > cmp) || (ZBX_VC_AGG_MAX == agg->func && 0 < cmp))
+			break;
+
+		agg->deque_num--;
+	}
+
+	if (agg->deque_num == agg->deque_alloc)
+	{
+		deque_alloc = MAX(agg->deque_alloc * 2, 16);
+		size = deque_alloc * sizeof(zbx_vc_value_t);
+
+		if (FAIL == vc_reserve_memory(size, item) || NULL == (deque = zbx_mem_try_malloc(vc_mem, size)))
+			return FAIL;
+
+		for (i = 0; i < agg->deque_num; i++)
+			deque[i] = agg->deque[(agg->deque_first + i) % agg->deque_alloc];
+
+		if (NULL != agg->deque)
+			__vc_mem_free_func(agg->deque);
+
+		agg->deque = deque;
+		agg->deque_alloc = deque_alloc;
+		agg->deque_first = 0;
+	}
+
+	agg->deque[(agg->deque_first + agg->deque_num++) % agg->deque_alloc] = *value;
+
+	return SUCCEED;
+}
+
+static int	vc_agg_add(zbx_vc_item_t *item, zbx_vc_agg_t *agg, const zbx_vc_value_t *value, zbx_vc_match_func_t match)
+{
+	switch (agg->func)
+	{
+		case ZBX_VC_AGG_SUM:
+			if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
+				agg->sum.value_float += value->value.value_float;
+			else
+				agg->sum.value_uint64 += value->value.value_uint64;
+			break;
+		case ZBX_VC_AGG_MIN:
+		case ZBX_VC_AGG_MAX:
+			if (FAIL == vc_agg_deque_push(item, agg, value))
+				return FAIL;
+			break;
+		case ZBX_VC_AGG_COUNT:
+			if (SUCCEED == match(agg->op, item->value_type, &value->value, &agg->pattern))
+				agg->matched++;
+			break;
+	}
+
+	agg->num++;
+
+	return SUCCEED;
+}
+
+static void	vc_agg_remove(zbx_vc_item_t *item, zbx_vc_agg_t *agg, const zbx_vc_value_t *value,
+		zbx_vc_match_func_t match)
+{
+	switch (agg->func)
+	{
+		case ZBX_VC_AGG_SUM:
+			if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
+				agg->sum.value_float -= value->value.value_float;
+			else
+				agg->sum.value_uint64 -= value->value.value_uint64;
+			break;
+		case ZBX_VC_AGG_COUNT:
+			if (SUCCEED == match(agg->op, item->value_type, &value->value, &agg->pattern))
+				agg->matched--;
+			break;
+	}
+
+	/* start over from an exact zero, so that the float rounding errors do not pile up */
+	if (0 == --agg->num)
+		memset(&agg->sum, 0, sizeof(history_value_t));
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_agg_update                                                    *
+ *                                                                            *
+ * Purpose: move an aggregate to the window (timestamp - seconds, timestamp]  *
+ *                                                                            *
+ * Parameters: item      - [IN] the item                                      *
+ *             agg       - [IN] aggregate of the item                         *
+ *             timestamp - [IN] end of the window                             *
+ *             match     - [IN] function checking values for function count  *
+ *                                                                            *
+ * Return value: SUCCEED - the aggregate covers the window, FAIL - the window *
+ *               is not cached or it ends before the aggregated part          *
+ *                                                                            *
+ ******************************************************************************/
+static int	vc_agg_update(zbx_vc_item_t *item, zbx_vc_agg_t *agg, int timestamp, zbx_vc_match_func_t match)
+{
+	int	i, from;
+
+	from = timestamp - agg->seconds;
+
+	if (0 != agg->valid && timestamp < agg->to)
+		return FAIL;
+
+	/* the values leaving the window must still be in the cache to be subtracted */
+	if (0 != agg->valid && (from >= agg->to || item->cached_from > agg->from + 1))
+		agg->valid = 0;
+
+	if (0 == agg->valid)
+	{
+		if (item->cached_from > from + 1)
+			return FAIL;
+
+		memset(&agg->sum, 0, sizeof(history_value_t));
+		agg->deque_first = 0;
+		agg->deque_num = 0;
+		agg->num = 0;
+		agg->matched = 0;
+		agg->from = from;
+		agg->to = from;
+		agg->valid = 1;
+	}
+
+	for (i = vc_item_search(item, agg->to); i < item->values_num && item->values[i].clock <= timestamp; i++)
+	{
+		if (FAIL == vc_agg_add(item, agg, &item->values[i], match))
+		{
+			agg->valid = 0;
+			return FAIL;
+		}
+	}
+
+	agg->to = timestamp;
+
+	if (from <= agg->from)
+		return SUCCEED;
+
+	for (i = vc_item_search(item, agg->from); i < item->values_num && item->values[i].clock <= from; i++)
+		vc_agg_remove(item, agg, &item->values[i], match);
+
+	agg->from = from;
+
+	while (0 < agg->deque_num && agg->deque[agg->deque_first].clock <= from)
+	{
+		agg->deque_first = (agg->deque_first + 1) % agg->deque_alloc;
+		agg->deque_num--;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: vc_item_get_agg                                                  *
+ *                                                                            *
+ * Purpose: find an aggregate of an item or add a new one                     *
+ *                                                                            *
+ * Return value: the aggregate or NULL if it does not fit into the cache      *
+ *                                                                            *
+ ******************************************************************************/
+static zbx_vc_agg_t	*vc_item_get_agg(zbx_vc_item_t *item, int func, int seconds, int op,
+		const history_value_t *pattern, int now)
+{
+	zbx_vc_agg_t	*agg = NULL;
+	size_t		size;
+	int		i;
+
+	for (i = 0; i < item->aggs_num; i++)
+	{
+		agg = &item->aggs[i];
+
+		if (func != agg->func || seconds != agg->seconds)
+			continue;
+
+		if (ZBX_VC_AGG_COUNT == func && (op != agg->op ||
+				0 != vc_value_compare(item->value_type, pattern, &agg->pattern)))
+		{
+			continue;
+		}
+
+		agg->lastaccess = now;
+
+		return agg;
+	}
+
+	if (NULL == item->aggs)
+	{
+		size = ZBX_VC_ITEM_AGGS_MAX * sizeof(zbx_vc_agg_t);
+
+		if (FAIL == vc_reserve_memory(size, item) || NULL == (item->aggs = zbx_mem_try_malloc(vc_mem, size)))
+			return NULL;
+	}
+
+	if (ZBX_VC_ITEM_AGGS_MAX == item->aggs_num)
+	{
+		/* functions of the triggers which were changed or disabled are not requested anymore */
+		for (agg = &item->aggs[0], i = 1; i < item->aggs_num; i++)
+		{
+			if (item->aggs[i].lastaccess < agg->lastaccess)
+				agg = &item->aggs[i];
+		}
+
+		vc_agg_clear(agg);
+	}
+	else
+	{
+		agg = &item->aggs[item->aggs_num++];
+		memset(agg, 0, sizeof(zbx_vc_agg_t));
+	}
+
+	agg->func = (unsigned char)func;
+	agg->seconds = seconds;
+	agg->lastaccess = now;
+
+	if (ZBX_VC_AGG_COUNT == func)
+	{
+		agg->op = (unsigned char)op;
+		agg->pattern = *pattern;
+	}
+
+	return agg;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_init                                                      *
+ *                                                                            *
+ * Purpose: create the value cache in shared memory                           *
+ *                                                                            *
+ * Comments: the cache is disabled when ValueCacheSize is 0                   *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_init()
+{
+	const char	*__function_name = "zbx_vc_init";
+	key_t		shm_key;
+	size_t		sz;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
+
+	if (0 == CONFIG_VALUE_CACHE_SIZE)
+		goto out;
+
+	if (128 * ZBX_KIBIBYTE > CONFIG_VALUE_CACHE_SIZE)
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "ValueCacheSize must be either 0 or at least 128K");
+		exit(FAIL);
+	}
+
+	if (-1 == (shm_key = zbx_ftok(CONFIG_FILE, ZBX_IPC_VALUECACHE_ID)))
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "Cannot create IPC key for value cache");
+		exit(FAIL);
+	}
+
+	if (ZBX_MUTEX_ERROR == zbx_mutex_create_force(&vc_lock, ZBX_MUTEX_VALUECACHE))
+	{
+		zbx_error("Unable to create mutex for value cache");
+		exit(FAIL);
+	}
+
+	sz = zbx_mem_required_size(CONFIG_VALUE_CACHE_SIZE, 1, "value cache", "ValueCacheSize");
+
+	zbx_mem_create(&vc_mem, shm_key, ZBX_NO_MUTEX, sz, "value cache", "ValueCacheSize");
+
+	vc_cache = (zbx_vc_cache_t *)__vc_mem_malloc_func(NULL, sizeof(zbx_vc_cache_t));
+
+	zbx_hashset_create_ext(&vc_cache->items, CONFIG_VALUE_CACHE_SIZE / 256,
+			ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC,
+			__vc_mem_malloc_func, __vc_mem_realloc_func, __vc_mem_free_func);
+
+	vc_cache->head = NULL;
+	vc_cache->tail = NULL;
+	vc_cache->hits = 0;
+	vc_cache->misses = 0;
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_destroy                                                   *
+ *                                                                            *
+ * Purpose: free the shared memory of the value cache                         *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_destroy()
+{
+	if (NULL == vc_cache)
+		return;
+
+	LOCK_VALUECACHE;
+
+	vc_cache = NULL;
+	zbx_mem_destroy(vc_mem);
+
+	UNLOCK_VALUECACHE;
+
+	zbx_mutex_destroy(&vc_lock);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_get_value_range                                           *
+ *                                                                            *
+ * Purpose: get values of an item for a trigger function                      *
+ *                                                                            *
+ * Parameters: itemid       - [IN] item identifier                            *
+ *             value_type   - [IN] type of the item values                    *
+ *             values       - [IN/OUT] buffer for the values, the newest      *
+ *                                     first; reallocated as needed           *
+ *             values_alloc - [IN/OUT] size of the buffer                     *
+ *             values_num   - [OUT] number of the values                      *
+ *             seconds      - [IN] values with clock in                       *
+ *                                 (timestamp - seconds, timestamp], or 0     *
+ *             count        - [IN] the last count values with                 *
+ *                                 clock <= timestamp, used if seconds is 0   *
+ *             timestamp    - [IN] end of the window                          *
+ *                                                                            *
+ * Return value: SUCCEED - the values were retrieved,                         *
+ *               FAIL - the cache is disabled or does not keep such items,    *
+ *                      the caller must query the database itself             *
+ *                                                                            *
+ * Comments: on a cache miss the window is read from the database and the     *
+ *           item is cached for the following requests                        *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_vc_get_value_range(zbx_uint64_t itemid, int value_type, zbx_vc_value_t **values, int *values_alloc,
+		int *values_num, int seconds, int count, int timestamp)
+{
+	const char	*__function_name = "zbx_vc_get_value_range";
+	static zbx_vc_value_t	*db_values = NULL;
+	static int	db_values_alloc = 0;
+	zbx_vc_item_t	*item;
+	int		db_values_num, cached_from, now, ret = FAIL;
+
+	if (NULL == vc_cache)
+		return FAIL;
+
+	if (ITEM_VALUE_TYPE_FLOAT != value_type && ITEM_VALUE_TYPE_UINT64 != value_type)
+		return FAIL;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() itemid:" ZBX_FS_UI64 " seconds:%d count:%d timestamp:%d",
+			__function_name, itemid, seconds, count, timestamp);
+
+	now = (int)time(NULL);
+
+	LOCK_VALUECACHE;
+
+	if (NULL != (item = zbx_hashset_search(&vc_cache->items, &itemid)) && ZBX_VC_ITEM_READY == item->state)
+	{
+		if (value_type == item->value_type && SUCCEED == vc_get_window(item->values, item->values_num,
+				item->cached_from, seconds, count, timestamp, values, values_alloc, values_num))
+		{
+			vc_item_update_window(item, seconds, count, timestamp, now);
+			vc_lru_unlink(item);
+			vc_lru_push(item);
+			vc_cache->hits++;
+			ret = SUCCEED;
+		}
+		else
+		{
+			/* the item is read again from the database with the wider window */
+			vc_item_remove(item);
+			item = NULL;
+		}
+	}
+
+	if (SUCCEED != ret)
+	{
+		vc_cache->misses++;
+
+		/* the item is loaded by this process unless another one is already loading it */
+		if (NULL == item)
+		{
+			if (NULL != (item = vc_item_create(itemid, (unsigned char)value_type)))
+				vc_lru_push(item);
+		}
+		else
+			item = NULL;
+	}
+
+	UNLOCK_VALUECACHE;
+
+	if (SUCCEED == ret)
+		goto out;
+
+	/* values of an item written by another history syncer may not be committed yet */
+	if (NULL != item && SUCCEED == DCis_item_in_sync(itemid))
+	{
+		LOCK_VALUECACHE;
+		vc_item_remove(item);
+		UNLOCK_VALUECACHE;
+
+		item = NULL;
+	}
+
+	/* the last values of the item may still be queued for a DB writer */
+	DCwait_queued_history(&itemid, 1);
+
+	vc_db_read_values(itemid, value_type, seconds, count, timestamp, NULL != item, &db_values, &db_values_alloc,
+			&db_values_num, &cached_from);
+
+	vc_get_window(db_values, db_values_num, cached_from, seconds, count, timestamp, values, values_alloc,
+			values_num);
+
+	if (NULL != item)
+	{
+		LOCK_VALUECACHE;
+
+		if (SUCCEED == vc_item_load(item, db_values, db_values_num, cached_from))
+		{
+			vc_item_update_window(item, seconds, count, timestamp, now);
+			vc_item_trim(item, now);
+		}
+		else
+			vc_item_remove(item);
+
+		UNLOCK_VALUECACHE;
+	}
+
+	ret = SUCCEED;
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s values:%d", __function_name, zbx_result_string(ret), *values_num);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_get_aggregate                                             *
+ *                                                                            *
+ * Purpose: get a running aggregate of item values for a trigger function     *
+ *                                                                            *
+ * Parameters: itemid     - [IN] item identifier                              *
+ *             value_type - [IN] type of the item values                      *
+ *             func       - [IN] one of ZBX_VC_AGG_* values                   *
+ *             seconds    - [IN] values with clock in                         *
+ *                               (timestamp - seconds, timestamp]             *
+ *             timestamp  - [IN] end of the window                            *
+ *             op         - [IN] operator of function count                   *
+ *             pattern    - [IN] value compared with by function count        *
+ *             match      - [IN] function checking values for function count *
+ *             result     - [OUT] sum, minimum or maximum of the values       *
+ *             num        - [OUT] number of the values, for function count    *
+ *                                the number of the matching values           *
+ *                                                                            *
+ * Return value: SUCCEED - the aggregate was retrieved,                       *
+ *               FAIL - the item or its window is not in the cache, the       *
+ *                      caller must get the values with                       *
+ *                      zbx_vc_get_value_range()                              *
+ *                                                                            *
+ * Comments: op, pattern and match are used only for ZBX_VC_AGG_COUNT         *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_vc_get_aggregate(zbx_uint64_t itemid, int value_type, int func, int seconds, int timestamp, int op,
+		const history_value_t *pattern, zbx_vc_match_func_t match, history_value_t *result, int *num)
+{
+	const char	*__function_name = "zbx_vc_get_aggregate";
+	zbx_vc_item_t	*item;
+	zbx_vc_agg_t	*agg;
+	int		now, ret = FAIL;
+
+	if (NULL == vc_cache)
+		return FAIL;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() itemid:" ZBX_FS_UI64 " func:%d seconds:%d timestamp:%d",
+			__function_name, itemid, func, seconds, timestamp);
+
+	now = (int)time(NULL);
+
+	LOCK_VALUECACHE;
+
+	if (NULL == (item = zbx_hashset_search(&vc_cache->items, &itemid)) || ZBX_VC_ITEM_READY != item->state ||
+			value_type != item->value_type)
+	{
+		goto unlock;
+	}
+
+	if (NULL == (agg = vc_item_get_agg(item, func, seconds, op, pattern, now)))
+		goto unlock;
+
+	if (FAIL == vc_agg_update(item, agg, timestamp, match))
+		goto unlock;
+
+	switch (func)
+	{
+		case ZBX_VC_AGG_SUM:
+			*result = agg->sum;
+			*num = agg->num;
+			break;
+		case ZBX_VC_AGG_MIN:
+		case ZBX_VC_AGG_MAX:
+			if (0 != agg->deque_num)
+				*result = agg->deque[agg->deque_first].value;
+			*num = agg->num;
+			break;
+		case ZBX_VC_AGG_COUNT:
+			*num = agg->matched;
+			break;
+	}
+
+	vc_item_update_window(item, seconds, 0, timestamp, now);
+	vc_lru_unlink(item);
+	vc_lru_push(item);
+	vc_cache->hits++;
+
+	ret = SUCCEED;
+unlock:
+	UNLOCK_VALUECACHE;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(ret));
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_add_values                                                *
+ *                                                                            *
+ * Purpose: add new values of items to the value cache                        *
+ *                                                                            *
+ * Parameters: values     - [IN] values written to the database               *
+ *             values_num - [IN] number of the values                         *
+ *                                                                            *
+ * Comments: called by history syncers before their triggers are evaluated;  *
+ *           only values of the items already in the cache are kept           *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_vc_add_values(zbx_vc_item_value_t *values, int values_num)
+{
+	zbx_vc_item_t	*item;
+	int		i, now;
+
+	if (NULL == vc_cache || 0 == values_num)
+		return;
+
+	now = (int)time(NULL);
+
+	LOCK_VALUECACHE;
+
+	for (i = 0; i < values_num; i++)
+	{
+		if (NULL == (item = zbx_hashset_search(&vc_cache->items, &values[i].itemid)))
+			continue;
+
+		if (ZBX_VC_ITEM_DROPPED == item->state)
+			continue;
+
+		if (ZBX_VC_ITEM_READY == item->state)
+		{
+			/* the value type of the item has been changed */
+			if (values[i].value_type != item->value_type)
+			{
+				vc_item_remove(item);
+				continue;
+			}
+
+			if (values[i].clock < item->cached_from)
+				continue;
+		}
+
+		if (SUCCEED == vc_item_add_value(item, values[i].clock, &values[i].value))
+		{
+			if (ZBX_VC_ITEM_READY == item->state)
+				vc_item_trim(item, now);
+		}
+		else if (ZBX_VC_ITEM_READY == item->state)
+			vc_item_remove(item);
+		else
+			item->state = ZBX_VC_ITEM_DROPPED;
+	}
+
+	UNLOCK_VALUECACHE;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_vc_get_stats                                                 *
+ *                                                                            *
+ * Purpose: get value cache statistics for internal items                     *
+ *                                                                            *
+ * Parameters: request - [IN] one of ZBX_VC_STATS_* values                    *
+ *                                                                            *
+ * Return value: pointer to a static zbx_uint64_t or double value, NULL if    *
+ *               the cache is disabled                                        *
+ *                                                                            *
+ ******************************************************************************/
+void	*zbx_vc_get_stats(int request)
+{
+	static zbx_uint64_t	value_uint;
+	static double		value_double;
+	void			*ret = &value_uint;
+
+	if (NULL == vc_cache)
+		return NULL;
+
+	LOCK_VALUECACHE;
+
+	switch (request)
+	{
+		case ZBX_VC_STATS_HITS:
+			value_uint = vc_cache->hits;
+			break;
+		case ZBX_VC_STATS_MISSES:
+			value_uint = vc_cache->misses;
+			break;
+		case ZBX_VC_STATS_ITEMS:
+			value_uint = vc_cache->items.num_data;
+			break;
+		case ZBX_VC_STATS_TOTAL:
+			value_uint = vc_mem->orig_size;
+			break;
+		case ZBX_VC_STATS_USED:
+			value_uint = vc_mem->orig_size - vc_mem->free_size;
+			break;
+		case ZBX_VC_STATS_FREE:
+			value_uint = vc_mem->free_size;
+			break;
+		case ZBX_VC_STATS_PFREE:
+			value_double = 100.0 * ((double)vc_mem->free_size / vc_mem->orig_size);
+			ret = &value_double;
+			break;
+		default:
+			ret = NULL;
+	}
+
+	UNLOCK_VALUECACHE;
+
+	return ret;
+}
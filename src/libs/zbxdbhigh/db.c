@@ -173,19 +173,32 @@ void	DBbegin()
  *                                                                            *
  * Parameters: -                                                              *
  *                                                                            *
- * Return value: -                                                            *
+ * Return value: SUCCEED - the transaction is committed                       *
+ *               FAIL - the connection was lost and the transaction with it   *
  *                                                                            *
  * Author: Eugene Grigorjev                                                   *
  *                                                                            *
  * Comments: Do nothing if DB does not support transactions                   *
  *                                                                            *
  ******************************************************************************/
-void	DBcommit()
+int	DBcommit()
 {
-	int	rc;
+	int	rc, ret;
 
 	rc = zbx_db_commit();
 
+	/* the transaction is lost if the connection has to be re-established */
+	if (ZBX_DB_OK <= rc)
+	{
+		DCconfig_commit_trigger_values();
+		ret = SUCCEED;
+	}
+	else
+	{
+		DCconfig_rollback_trigger_values();
+		ret = FAIL;
+	}
+
 	while (rc == ZBX_DB_DOWN)
 	{
 		DBclose();
@@ -198,6 +211,8 @@ void	DBcommit()
 			sleep(10);
 		}
 	}
+
+	return ret;
 }
 
 /******************************************************************************
@@ -219,6 +234,8 @@ void	DBrollback()
 {
 	int	rc;
 
+	DCconfig_rollback_trigger_values();
+
 	rc = zbx_db_rollback();
 
 	while (rc == ZBX_DB_DOWN)
@@ -268,6 +285,206 @@ int	__zbx_DBexecute(const char *fmt, ...)
 	return rc;
 }
 
+#ifndef HAVE_PREPARED_STATEMENTS
+/******************************************************************************
+ *                                                                            *
+ * Function: DBformat_prepared                                                *
+ *                                                                            *
+ * Purpose: substitute parameter values for '?' placeholders                  *
+ *                                                                            *
+ * Parameters: sql        - [IN] SQL text with '?' placeholders               *
+ *             types      - [IN] parameter types (ZBX_DB_TYPE_*)              *
+ *             params     - [IN] parameter values                             *
+ *             params_num - [IN] number of parameters                         *
+ *                                                                            *
+ * Return value: dynamically allocated SQL text                               *
+ *                                                                            *
+ * Comments: used by databases without prepared statement support             *
+ *                                                                            *
+ ******************************************************************************/
+static char	*DBformat_prepared(const char *sql, const unsigned char *types, const zbx_db_value_t *params,
+		int params_num)
+{
+	char		*text = NULL, *str_esc;
+	int		text_allocated, text_offset = 0, i = 0;
+	const char	*p;
+
+	text_allocated = strlen(sql) + 256;
+	text = zbx_malloc(text, text_allocated);
+
+	for (p = sql; '\0' != *p; p++)
+	{
+		if ('?' != *p || i == params_num)
+		{
+			zbx_chrcpy_alloc(&text, &text_allocated, &text_offset, *p);
+			continue;
+		}
+
+		switch (types[i])
+		{
+			case ZBX_DB_TYPE_INT:
+				zbx_snprintf_alloc(&text, &text_allocated, &text_offset, 16, "%d", params[i].i);
+				break;
+			case ZBX_DB_TYPE_UINT64:
+				zbx_snprintf_alloc(&text, &text_allocated, &text_offset, 32, ZBX_FS_UI64, params[i].ui64);
+				break;
+			case ZBX_DB_TYPE_FLOAT:
+				zbx_snprintf_alloc(&text, &text_allocated, &text_offset, 512, ZBX_FS_DBL, params[i].dbl);
+				break;
+			case ZBX_DB_TYPE_STR:
+				str_esc = DBdyn_escape_string(params[i].str);
+				zbx_snprintf_alloc(&text, &text_allocated, &text_offset, strlen(str_esc) + 3, "'%s'", str_esc);
+				zbx_free(str_esc);
+				break;
+		}
+
+		i++;
+	}
+
+	text[text_offset] = '\0';
+
+	return text;
+}
+#endif	/* not HAVE_PREPARED_STATEMENTS */
+
+/******************************************************************************
+ *                                                                            *
+ * Function: DBexecute_prepared                                               *
+ *                                                                            *
+ * Purpose: execute a non-select statement with '?' placeholders without      *
+ *          formatting and escaping the values into SQL text                  *
+ *                                                                            *
+ * Parameters: sql   - [IN] SQL text with '?' placeholders                    *
+ *             types - [IN] one character per parameter: 'i' - int,           *
+ *                          'u' - zbx_uint64_t, 'd' - double,                 *
+ *                          's' - string (not escaped)                        *
+ *             ...   - [IN] parameter values                                  *
+ *                                                                            *
+ * Return value: number of affected rows or ZBX_DB_FAIL                       *
+ *                                                                            *
+ * Comments: retries until the database is available, same as DBexecute().   *
+ *           The statement is prepared once per connection; databases        *
+ *           without prepared statement support get the values formatted     *
+ *           into the SQL text.                                               *
+ *                                                                            *
+ ******************************************************************************/
+int	DBexecute_prepared(const char *sql, const char *types, ...)
+{
+	va_list		args;
+	zbx_db_value_t	params[ZBX_DB_PARAMS_MAX];
+	unsigned char	param_types[ZBX_DB_PARAMS_MAX];
+	int		params_num, rc;
+#ifndef HAVE_PREPARED_STATEMENTS
+	char		*text;
+#endif
+
+	va_start(args, types);
+
+	for (params_num = 0; '\0' != types[params_num]; params_num++)
+	{
+		if (ZBX_DB_PARAMS_MAX == params_num)
+		{
+			THIS_SHOULD_NEVER_HAPPEN;
+			exit(FAIL);
+		}
+
+		switch (types[params_num])
+		{
+			case 'i':
+				param_types[params_num] = ZBX_DB_TYPE_INT;
+				params[params_num].i = va_arg(args, int);
+				break;
+			case 'u':
+				param_types[params_num] = ZBX_DB_TYPE_UINT64;
+				params[params_num].ui64 = va_arg(args, zbx_uint64_t);
+				break;
+			case 'd':
+				param_types[params_num] = ZBX_DB_TYPE_FLOAT;
+				params[params_num].dbl = va_arg(args, double);
+				break;
+			case 's':
+				param_types[params_num] = ZBX_DB_TYPE_STR;
+				params[params_num].str = va_arg(args, const char *);
+				break;
+			default:
+				THIS_SHOULD_NEVER_HAPPEN;
+				exit(FAIL);
+		}
+	}
+
+	va_end(args);
+
+#ifdef HAVE_PREPARED_STATEMENTS
+	rc = zbx_db_execute_prepared(sql, param_types, params, params_num);
+
+	while (rc == ZBX_DB_DOWN)
+	{
+		DBclose();
+		DBconnect(ZBX_DB_CONNECT_NORMAL);
+
+		rc = zbx_db_execute_prepared(sql, param_types, params, params_num);
+
+		if (rc == ZBX_DB_DOWN)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "Database is down."
+					" Retrying in 10 seconds");
+			sleep(10);
+		}
+	}
+#else
+	text = DBformat_prepared(sql, param_types, params, params_num);
+	rc = DBexecute("%s", text);
+	zbx_free(text);
+#endif
+
+	return rc;
+}
+
+#ifdef HAVE_BULK_INSERT
+/******************************************************************************
+ *                                                                            *
+ * Function: DBbulk_insert                                                    *
+ *                                                                            *
+ * Purpose: insert rows of numeric values using the bulk path of the database *
+ *                                                                            *
+ * Parameters: table      - [IN] table name                                   *
+ *             fields     - [IN] column names                                 *
+ *             types      - [IN] column value types (ZBX_DB_TYPE_*)           *
+ *             fields_num - [IN] number of columns                            *
+ *             values     - [IN] row values, fields_num values per row        *
+ *             rows_num   - [IN] number of rows                               *
+ *                                                                            *
+ * Return value: number of inserted rows or ZBX_DB_FAIL                       *
+ *                                                                            *
+ * Comments: retries until the database is available, same as DBexecute()    *
+ *                                                                            *
+ ******************************************************************************/
+int	DBbulk_insert(const char *table, const char **fields, const unsigned char *types, int fields_num,
+		const zbx_db_value_t *values, int rows_num)
+{
+	int	rc;
+
+	rc = zbx_db_bulk_insert(table, fields, types, fields_num, values, rows_num);
+
+	while (rc == ZBX_DB_DOWN)
+	{
+		DBclose();
+		DBconnect(ZBX_DB_CONNECT_NORMAL);
+
+		rc = zbx_db_bulk_insert(table, fields, types, fields_num, values, rows_num);
+
+		if (rc == ZBX_DB_DOWN)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "Database is down."
+					" Retrying in 10 seconds");
+			sleep(10);
+		}
+	}
+
+	return rc;
+}
+#endif	/* HAVE_BULK_INSERT */
+
 int	DBis_null(const char *field)
 {
 	return zbx_db_is_null(field);
@@ -378,8 +595,8 @@ int	DBadd_service_alarm(zbx_uint64_t serviceid, int status, int clock)
 
 	if (SUCCEED != latest_service_alarm(serviceid, status))
 	{
-		DBexecute("insert into service_alarms (servicealarmid,serviceid,clock,value)"
-			" values(" ZBX_FS_UI64 "," ZBX_FS_UI64 ",%d,%d)",
+		DBexecute_prepared("insert into service_alarms (servicealarmid,serviceid,clock,value)"
+			" values (?,?,?,?)", "uuii",
 			DBget_maxid("service_alarms"), serviceid, clock, status);
 	}
 
@@ -388,96 +605,6 @@ int	DBadd_service_alarm(zbx_uint64_t serviceid, int status, int clock)
 	return SUCCEED;
 }
 
-/******************************************************************************
- *                                                                            *
- * Function: trigger_dependent_rec                                            *
- *                                                                            *
- * Purpose: check if status depends on triggers having status TRUE            *
- *                                                                            *
- * Parameters: triggerid - trigger ID                                         *
- *                                                                            *
- * Return value: SUCCEED - it does depend, FAIL - otherwise                   *
- *                                                                            *
- * Author: Alexei Vladishev                                                   *
- *                                                                            *
- * Comments: Recursive function!                                              *
- *                                                                            *
- ******************************************************************************/
-static int	trigger_dependent_rec(zbx_uint64_t triggerid, int *level)
-{
-	int		ret = FAIL;
-	DB_RESULT	result;
-	DB_ROW		row;
-
-	zbx_uint64_t	triggerid_tmp;
-	int		value_tmp;
-
-	zabbix_log( LOG_LEVEL_DEBUG, "In trigger_dependent_rec(triggerid:" ZBX_FS_UI64 ",level:%d)",
-		triggerid,
-		*level);
-
-	(*level)++;
-
-	if(*level > 32)
-	{
-		zabbix_log( LOG_LEVEL_CRIT, "Recursive trigger dependency detected! Please fix. Triggerid:" ZBX_FS_UI64,
-			triggerid);
-		return ret;
-	}
-
-	result = DBselect("select t.triggerid, t.value from trigger_depends d,triggers t where d.triggerid_down=" ZBX_FS_UI64 " and d.triggerid_up=t.triggerid",
-		triggerid);
-	while((row=DBfetch(result)))
-	{
-		ZBX_STR2UINT64(triggerid_tmp, row[0]);
-		value_tmp = atoi(row[1]);
-		if(TRIGGER_VALUE_TRUE == value_tmp || trigger_dependent_rec(triggerid_tmp, level) == SUCCEED)
-		{
-			zabbix_log( LOG_LEVEL_DEBUG, "This trigger depends on " ZBX_FS_UI64 ". Will not apply actions",
-				triggerid_tmp);
-			ret = SUCCEED;
-			break;
-		}
-	}
-	DBfree_result(result);
-
-	zabbix_log(LOG_LEVEL_DEBUG, "End of trigger_dependent_rec():%s",
-			zbx_result_string(ret));
-
-	return ret;
-}
-
-/******************************************************************************
- *                                                                            *
- * Function: trigger_dependent                                                *
- *                                                                            *
- * Purpose: check if status depends on triggers having status TRUE            *
- *                                                                            *
- * Parameters: triggerid - trigger ID                                         *
- *                                                                            *
- * Return value: SUCCEED - it does depend, FAIL - not such triggers           *
- *                                                                            *
- * Author: Alexei Vladishev                                                   *
- *                                                                            *
- * Comments:                                                                  *
- *                                                                            *
- ******************************************************************************/
-static int	trigger_dependent(zbx_uint64_t triggerid)
-{
-	int	ret;
-	int	level = 0;
-
-	zabbix_log( LOG_LEVEL_DEBUG, "In trigger_dependent(triggerid:" ZBX_FS_UI64 ")",
-		triggerid);
-
-	ret = trigger_dependent_rec(triggerid, &level);
-
-	zabbix_log(LOG_LEVEL_DEBUG, "End of trigger_dependent():%s",
-			zbx_result_string(ret));
-
-	return ret;
-}
-
 int	DBupdate_trigger_value(zbx_uint64_t triggerid, int trigger_type, int trigger_value,
 		const char *trigger_error, int new_value, int now, const char *reason)
 {
@@ -485,7 +612,7 @@ int	DBupdate_trigger_value(zbx_uint64_t triggerid, int trigger_type, int trigger
 	int		ret = SUCCEED;
 	DB_EVENT	event;
 	int		update_status;
-	char		*reason_esc;
+	char		error[TRIGGER_ERROR_LEN_MAX];
 
 	if (reason == NULL)
 		zabbix_log(LOG_LEVEL_DEBUG, "In %s() triggerid:" ZBX_FS_UI64 " old:%d new:%d now:%d",
@@ -498,11 +625,11 @@ int	DBupdate_trigger_value(zbx_uint64_t triggerid, int trigger_type, int trigger
 	{
 		case TRIGGER_TYPE_MULTIPLE_TRUE:
 			update_status = (trigger_value != new_value || new_value == TRIGGER_VALUE_TRUE);
-			update_status = update_status && trigger_dependent(triggerid) == FAIL;
+			update_status = update_status && FAIL == DCconfig_check_trigger_dependencies(triggerid);
 			break;
 		case TRIGGER_TYPE_NORMAL:
 		default:
-			update_status = (trigger_value != new_value && trigger_dependent(triggerid) == FAIL);
+			update_status = (trigger_value != new_value && FAIL == DCconfig_check_trigger_dependencies(triggerid));
 			break;
 	}
 
@@ -514,26 +641,16 @@ int	DBupdate_trigger_value(zbx_uint64_t triggerid, int trigger_type, int trigger
 		if (trigger_value != new_value ||
 				(trigger_type == TRIGGER_TYPE_MULTIPLE_TRUE && new_value == TRIGGER_VALUE_TRUE))
 		{
-			if (reason == NULL)
-			{
-				DBexecute("update triggers"
-						" set value=%d,"
-							"lastchange=%d,"
-							"error=''"
-						" where triggerid=" ZBX_FS_UI64,
-					new_value, now, triggerid);
-			}
-			else
-			{
-				reason_esc = DBdyn_escape_string_len(reason, TRIGGER_ERROR_LEN);
-				DBexecute("update triggers"
-						" set value=%d,"
-							"lastchange=%d,"
-							"error='%s'"
-						" where triggerid=" ZBX_FS_UI64,
-					new_value, now, reason_esc, triggerid);
-				zbx_free(reason_esc);
-			}
+			strscpy(error, NULL == reason ? "" : reason);
+
+			DBexecute_prepared("update triggers"
+					" set value=?,"
+						"lastchange=?,"
+						"error=?"
+					" where triggerid=?", "iisu",
+				new_value, now, error, triggerid);
+
+			DCconfig_set_trigger_value(triggerid, (unsigned char)new_value);
 
 			/* Preparing event for processing */
 			memset(&event, 0, sizeof(DB_EVENT));
@@ -555,13 +672,13 @@ int	DBupdate_trigger_value(zbx_uint64_t triggerid, int trigger_type, int trigger
 	}
 	else if (new_value == TRIGGER_VALUE_UNKNOWN && 0 != strcmp(trigger_error, reason))
 	{
-		reason_esc = DBdyn_escape_string_len(reason, TRIGGER_ERROR_LEN);
-		DBexecute("update triggers"
-				" set error='%s'"
-				" where triggerid=" ZBX_FS_UI64,
-				reason_esc,
+		strscpy(error, reason);
+
+		DBexecute_prepared("update triggers"
+				" set error=?"
+				" where triggerid=?", "su",
+				error,
 				triggerid);
-		zbx_free(reason_esc);
 	}
 	else
 		ret = FAIL;
@@ -979,11 +1096,11 @@ int	DBstart_escalation(zbx_uint64_t actionid, zbx_uint64_t triggerid, zbx_uint64
 	zbx_uint64_t	escalationid;
 
 	/* remove older active escalations... */
-	DBexecute("delete from escalations"
-			" where actionid=" ZBX_FS_UI64
-				" and triggerid=" ZBX_FS_UI64
-				" and status not in (%d,%d,%d)"
-				" and (esc_step<>0 or status<>%d)",
+	DBexecute_prepared("delete from escalations"
+			" where actionid=?"
+				" and triggerid=?"
+				" and status not in (?,?,?)"
+				" and (esc_step<>0 or status<>?)", "uuiiii",
 			actionid,
 			triggerid,
 			ESCALATION_STATUS_RECOVERY,
@@ -992,12 +1109,12 @@ int	DBstart_escalation(zbx_uint64_t actionid, zbx_uint64_t triggerid, zbx_uint64
 			ESCALATION_STATUS_ACTIVE);
 
 	/* ...except we should execute an escalation at least once before it is removed */
-	DBexecute("update escalations"
-			" set status=%d"
-			" where actionid=" ZBX_FS_UI64
-				" and triggerid=" ZBX_FS_UI64
+	DBexecute_prepared("update escalations"
+			" set status=?"
+			" where actionid=?"
+				" and triggerid=?"
 				" and esc_step=0"
-				" and status=%d",
+				" and status=?", "iuui",
 			ESCALATION_STATUS_SUPERSEDED_ACTIVE,
 			actionid,
 			triggerid,
@@ -1005,8 +1122,8 @@ int	DBstart_escalation(zbx_uint64_t actionid, zbx_uint64_t triggerid, zbx_uint64
 
 	escalationid = DBget_maxid("escalations");
 
-	DBexecute("insert into escalations (escalationid,actionid,triggerid,eventid,status)"
-			" values (" ZBX_FS_UI64 "," ZBX_FS_UI64 "," ZBX_FS_UI64 "," ZBX_FS_UI64 ",%d)",
+	DBexecute_prepared("insert into escalations (escalationid,actionid,triggerid,eventid,status)"
+			" values (?,?,?,?,?)", "uuuui",
 			escalationid,
 			actionid,
 			triggerid,
@@ -1054,11 +1171,11 @@ int	DBstop_escalation(zbx_uint64_t actionid, zbx_uint64_t triggerid, zbx_uint64_
 		else
 			new_status = ESCALATION_STATUS_RECOVERY;
 
-		DBexecute("update escalations"
-				" set r_eventid=" ZBX_FS_UI64 ","
-					"status=%d,"
+		DBexecute_prepared("update escalations"
+				" set r_eventid=?,"
+					"status=?,"
 					"nextcheck=0"
-				" where escalationid=" ZBX_FS_UI64,
+				" where escalationid=?", "uiu",
 				eventid,
 				new_status,
 				escalationid);
@@ -1070,7 +1187,7 @@ int	DBstop_escalation(zbx_uint64_t actionid, zbx_uint64_t triggerid, zbx_uint64_
 
 int	DBremove_escalation(zbx_uint64_t escalationid)
 {
-	DBexecute("delete from escalations where escalationid=" ZBX_FS_UI64,
+	DBexecute_prepared("delete from escalations where escalationid=?", "u",
 			escalationid);
 
 	return SUCCEED;
@@ -1491,6 +1608,9 @@ void	DBget_item_from_db(DB_ITEM *item, DB_ROW row)
 	item->data_type			= atoi(row[25]);
 	item->mtime			= atoi(row[26]);
 
+	/* numeric last values may not be flushed to the database yet */
+	DCget_item_lastvalues(item);
+
 	key = zbx_dsprintf(key, "%s", item->key_orig);
 	substitute_simple_macros(NULL, item, NULL, NULL, NULL, &key, MACRO_TYPE_ITEM_KEY, NULL, 0);
 	item->key = key;
@@ -1628,7 +1748,8 @@ zbx_uint64_t	DBget_nextid(const char *tablename, int num)
 				continue;
 			}
 
-			DBexecute("update ids set nextid=nextid+%d where nodeid=%d and table_name='%s' and field_name='%s'",
+			DBexecute_prepared("update ids set nextid=nextid+? where nodeid=? and table_name=? and field_name=?",
+					"iiss",
 					num,
 					nodeid,
 					table->table,
@@ -102,6 +102,20 @@ ZBX_TABLE	tables[]={
 		{0}
 		}
 	},
+	{"write_queue",	"slotid",	0,
+		{
+		{"slotid",	ZBX_TYPE_INT,	ZBX_NOTNULL,	NULL},
+		{"seq",	ZBX_TYPE_UINT,	ZBX_NOTNULL,	NULL},
+		{0}
+		}
+	},
+	{"config_changes",	"",	0,
+		{
+		{"table_name",	ZBX_TYPE_CHAR,	ZBX_NOTNULL,	NULL},
+		{"recordid",	ZBX_TYPE_ID,	ZBX_NOTNULL,	NULL},
+		{0}
+		}
+	},
 	{"httptest",	"httptestid",	ZBX_SYNC,
 		{
 		{"httptestid",	ZBX_TYPE_ID,	ZBX_NOTNULL,	NULL},
@@ -1270,31 +1270,47 @@ void	process_mass_data(zbx_sock_t *sock, zbx_uint64_t proxy_hostid,
 {
 	const char	*__function_name = "process_mass_data";
 	AGENT_RESULT	agent;
-	DC_ITEM		item;
-	int		i;
+	DC_VALUE_ITEM	*items, *item;
+	const char	**hostnames, **keys;
+	int		i, *errcodes;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
+	items = zbx_malloc(NULL, value_num * sizeof(DC_VALUE_ITEM));
+	hostnames = zbx_malloc(NULL, value_num * sizeof(const char *));
+	keys = zbx_malloc(NULL, value_num * sizeof(const char *));
+	errcodes = zbx_malloc(NULL, value_num * sizeof(int));
+
+	for (i = 0; i < value_num; i++)
+	{
+		hostnames[i] = values[i].host_name;
+		keys[i] = values[i].key;
+	}
+
+	DCconfig_get_items_by_keys(items, proxy_hostid, hostnames, keys, errcodes, value_num);
+
 	DCinit_nextchecks();
 
 	for (i = 0; i < value_num; i++)
 	{
-		if (SUCCEED != DCconfig_get_item_by_key(&item, proxy_hostid, values[i].host_name, values[i].key))
+		if (SUCCEED != errcodes[i])
 			continue;
 
-		if (item.host.maintenance_status == HOST_MAINTENANCE_STATUS_ON &&
-				item.host.maintenance_type == MAINTENANCE_TYPE_NODATA &&
-				item.host.maintenance_from <= values[i].clock)
+		item = &items[i];
+
+		if (item->maintenance_status == HOST_MAINTENANCE_STATUS_ON &&
+				item->maintenance_type == MAINTENANCE_TYPE_NODATA &&
+				item->maintenance_from <= values[i].clock)
 			continue;
 
-		if (item.type == ITEM_TYPE_INTERNAL || item.type == ITEM_TYPE_AGGREGATE || item.type == ITEM_TYPE_CALCULATED)
+		if (item->type == ITEM_TYPE_INTERNAL || item->type == ITEM_TYPE_AGGREGATE || item->type == ITEM_TYPE_CALCULATED)
 			continue;
 
-		if (0 == proxy_hostid && item.type != ITEM_TYPE_TRAPPER && item.type != ITEM_TYPE_ZABBIX_ACTIVE)
+		if (0 == proxy_hostid && item->type != ITEM_TYPE_TRAPPER && item->type != ITEM_TYPE_ZABBIX_ACTIVE)
 			continue;
 			
-		if (item.type == ITEM_TYPE_TRAPPER && 0 == proxy_hostid &&
-				FAIL == zbx_tcp_check_security(sock, item.trapper_hosts, 1))
+		if (item->type == ITEM_TYPE_TRAPPER && 0 == proxy_hostid &&
+				FAIL == zbx_tcp_check_security(sock, item->trapper_hosts, 1))
 		{
 			zabbix_log(LOG_LEVEL_WARNING, "Process data failed: %s", zbx_tcp_strerror());
 			continue;
@@ -1302,7 +1318,7 @@ void	process_mass_data(zbx_sock_t *sock, zbx_uint64_t proxy_hostid,
 
 		if (0 == strcmp(values[i].value, "ZBX_NOTSUPPORTED"))
 		{
-			DCadd_nextcheck(item.itemid, (time_t)values[i].clock, values[i].value);
+			DCadd_nextcheck(item->itemid, (time_t)values[i].clock, values[i].value);
 
 			if (NULL != processed)
 				(*processed)++;
@@ -1311,15 +1327,15 @@ void	process_mass_data(zbx_sock_t *sock, zbx_uint64_t proxy_hostid,
 		{
 			init_result(&agent);
 
-			if (SUCCEED == set_result_type(&agent, item.value_type,
-						proxy_hostid ? ITEM_DATA_TYPE_DECIMAL : item.data_type, values[i].value))
+			if (SUCCEED == set_result_type(&agent, item->value_type,
+						proxy_hostid ? ITEM_DATA_TYPE_DECIMAL : item->data_type, values[i].value))
 			{
-				if (ITEM_VALUE_TYPE_LOG == item.value_type)
-					calc_timestamp(values[i].value, &values[i].timestamp, item.logtimefmt);
+				if (ITEM_VALUE_TYPE_LOG == item->value_type)
+					calc_timestamp(values[i].value, &values[i].timestamp, item->logtimefmt);
 
 				if (NULL != values[i].source)
 					zbx_replace_invalid_utf8(values[i].source);
-				dc_add_history(item.itemid, item.value_type, &agent, values[i].clock,
+				dc_add_history(item->itemid, item->value_type, &agent, values[i].clock,
 						values[i].timestamp, values[i].source, values[i].severity,
 						values[i].logeventid, values[i].lastlogsize, values[i].mtime);
 
@@ -1329,8 +1345,8 @@ void	process_mass_data(zbx_sock_t *sock, zbx_uint64_t proxy_hostid,
 			else if (ISSET_MSG(&agent))
 			{
 				zabbix_log(LOG_LEVEL_DEBUG, "Item [%s:%s] error: %s",
-						item.host.host, item.key_orig, agent.msg);
-				DCadd_nextcheck(item.itemid, (time_t)values[i].clock, agent.msg);
+						values[i].host_name, values[i].key, agent.msg);
+				DCadd_nextcheck(item->itemid, (time_t)values[i].clock, agent.msg);
 			}
 			else
 				THIS_SHOULD_NEVER_HAPPEN; /* set_result_type() always sets MSG result if not SUCCEED */
@@ -1341,6 +1357,11 @@ void	process_mass_data(zbx_sock_t *sock, zbx_uint64_t proxy_hostid,
 
 	DCflush_nextchecks();
 
+	zbx_free(errcodes);
+	zbx_free(keys);
+	zbx_free(hostnames);
+	zbx_free(items);
+
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
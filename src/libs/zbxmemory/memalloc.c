@@ -115,6 +115,7 @@ static void	mem_link_chunk(zbx_mem_info_t *info, void *chunk);
 static void	mem_unlink_chunk(zbx_mem_info_t *info, void *chunk);
 
 static void	*__mem_malloc(zbx_mem_info_t *info, uint32_t size);
+static void	*__mem_malloc_aligned(zbx_mem_info_t *info, uint32_t size, uint32_t align);
 static void	*__mem_realloc(zbx_mem_info_t *info, void *old, uint32_t size);
 static void	__mem_free(zbx_mem_info_t *info, void *ptr);
 
@@ -131,8 +132,83 @@ static void	__mem_free(zbx_mem_info_t *info, void *ptr);
 #define MEM_MIN_ALLOC	24	/* should be a multiple of 8 and at least (2 * ZBX_PTR_SIZE) */
 
 #define	MEM_MIN_BUCKET_SIZE	MEM_MIN_ALLOC
-#define	MEM_MAX_BUCKET_SIZE	256 /* starting from this size all free chunks are put into the same bucket */
-#define	MEM_BUCKET_COUNT	((MEM_MAX_BUCKET_SIZE - MEM_MIN_BUCKET_SIZE) / 8 + 1)
+#define	MEM_MAX_BUCKET_SIZE	256 /* starting from this size free chunks are put into buckets of size ranges */
+#define	MEM_MAX_BUCKET_LOG	8   /* log2(MEM_MAX_BUCKET_SIZE) */
+#define	MEM_RANGE_SPLIT_BITS	2   /* each power of two is split into 2^MEM_RANGE_SPLIT_BITS ranges */
+#define	MEM_SMALL_BUCKET_COUNT	((MEM_MAX_BUCKET_SIZE - MEM_MIN_BUCKET_SIZE) / 8)
+#define	MEM_RANGE_BUCKET_COUNT	((31 - MEM_MAX_BUCKET_LOG) << MEM_RANGE_SPLIT_BITS)
+#define	MEM_BUCKET_COUNT	(MEM_SMALL_BUCKET_COUNT + MEM_RANGE_BUCKET_COUNT)
+#define	MEM_BITMAP_WORDS	((MEM_BUCKET_COUNT + 31) / 32)
+
+/******************************************************************************
+ *                                                                            *
+ * (*) buckets: free chunks smaller than MEM_MAX_BUCKET_SIZE are kept in      *
+ *     buckets of exactly one size, larger free chunks are kept in buckets    *
+ *     of size ranges [2^n + k * 2^(n-2), 2^n + (k+1) * 2^(n-2))              *
+ *                                                                            *
+ *     a bitmap with a bit per bucket tells which buckets are not empty, so   *
+ *     that the first bucket where every chunk is big enough can be found     *
+ *     without walking free chunks                                            *
+ *                                                                            *
+ ******************************************************************************/
+
+/******************************************************************************
+ *                                                                            *
+ * (*) slabs: if enabled, allocations of up to MEM_SLAB_MAX_SIZE bytes are    *
+ *     served from page-aligned pages that hold objects of one size class     *
+ *     (multiples of 8 bytes) without per-object size fields                  *
+ *                                                                            *
+ *     each page is a used chunk of MEM_SLAB_PAGE_SIZE bytes, starting with   *
+ *     a header that has a bitmap of free objects, followed by the objects    *
+ *                                                                            *
+ *     a page map with a bit per MEM_SLAB_PAGE_SIZE bytes of shared memory    *
+ *     tells whether a pointer being freed belongs to a slab page             *
+ *                                                                            *
+ ******************************************************************************/
+
+#define	MEM_SLAB_PAGE_SIZE	4096
+#define	MEM_SLAB_MAX_SIZE	MEM_MAX_BUCKET_SIZE
+#define	MEM_SLAB_CLASS_COUNT	(MEM_SLAB_MAX_SIZE / 8)
+#define	MEM_SLAB_BITMAP_WORDS	(MEM_SLAB_PAGE_SIZE / 8 / 32)
+
+typedef struct mem_slab_page_s
+{
+	struct mem_slab_page_s	*prev;
+	struct mem_slab_page_s	*next;
+	uint32_t		class_index;
+	uint32_t		free_num;
+	uint32_t		bitmap[MEM_SLAB_BITMAP_WORDS];	/* a set bit marks a free object */
+}
+mem_slab_page_t;
+
+typedef struct
+{
+	mem_slab_page_t	*partial;	/* pages with free objects */
+	mem_slab_page_t	*full;
+	uint32_t	object_size;
+	uint32_t	objects_per_page;
+	int		pages_num;
+	int		used_num;
+}
+mem_slab_class_t;
+
+#define	MEM_SLAB_HEADER_SIZE	((sizeof(mem_slab_page_t) + 7) & ~(size_t)7)
+#define	MEM_SLAB_OBJECTS(page)	((void *)(page) + MEM_SLAB_HEADER_SIZE)
+
+static int	mem_slab_class_by_size(uint32_t size);
+
+static void	mem_slab_mark_page(zbx_mem_info_t *info, mem_slab_page_t *page, int is_slab);
+static mem_slab_page_t	*mem_slab_page_by_ptr(zbx_mem_info_t *info, void *ptr);
+
+static void	mem_slab_link_page(mem_slab_page_t **list, mem_slab_page_t *page);
+static void	mem_slab_unlink_page(mem_slab_page_t **list, mem_slab_page_t *page);
+
+static int	mem_slab_add_page(zbx_mem_info_t *info, mem_slab_class_t *slab_class);
+static void	*mem_slab_alloc(zbx_mem_info_t *info, uint32_t size);
+static void	mem_slab_free(zbx_mem_info_t *info, mem_slab_page_t *page, void *ptr);
+static void	mem_slabs_init(zbx_mem_info_t *info);
+
+static void	*mem_malloc_ptr(zbx_mem_info_t *info, uint32_t size);
 
 /* helper functions */
 
@@ -165,11 +241,58 @@ static uint32_t	mem_proper_alloc_size(uint32_t size)
 
 static int	mem_bucket_by_size(uint32_t size)
 {
+	int	log;
+
 	if (size < MEM_MIN_BUCKET_SIZE)
 		return 0;
 	if (size < MEM_MAX_BUCKET_SIZE)
 		return (size - MEM_MIN_BUCKET_SIZE) >> 3;
-	return MEM_BUCKET_COUNT - 1;
+
+	for (log = MEM_MAX_BUCKET_LOG; 0 != (size >> (log + 1)); log++)
+		;
+
+	return MEM_SMALL_BUCKET_COUNT + ((log - MEM_MAX_BUCKET_LOG) << MEM_RANGE_SPLIT_BITS) +
+			(int)((size >> (log - MEM_RANGE_SPLIT_BITS)) & ((1 << MEM_RANGE_SPLIT_BITS) - 1));
+}
+
+static uint32_t	mem_bucket_min_size(int index)
+{
+	int	log;
+
+	if (index < MEM_SMALL_BUCKET_COUNT)
+		return MEM_MIN_BUCKET_SIZE + 8 * index;
+
+	index -= MEM_SMALL_BUCKET_COUNT;
+	log = MEM_MAX_BUCKET_LOG + (index >> MEM_RANGE_SPLIT_BITS);
+
+	return ((uint32_t)1 << log) +
+			((uint32_t)(index & ((1 << MEM_RANGE_SPLIT_BITS) - 1)) << (log - MEM_RANGE_SPLIT_BITS));
+}
+
+/* returns the first non-empty bucket starting with index "from" or FAIL if there is none */
+static int	mem_find_bucket(zbx_mem_info_t *info, int from)
+{
+	int		word;
+	uint32_t	bits;
+
+	if (MEM_BUCKET_COUNT <= from)
+		return FAIL;
+
+	word = from >> 5;
+	bits = info->buckets_bitmap[word] & ~(((uint32_t)1 << (from & 31)) - 1);
+
+	while (0 == bits)
+	{
+		if (MEM_BITMAP_WORDS == ++word)
+			return FAIL;
+
+		bits = info->buckets_bitmap[word];
+	}
+
+	for (from = word << 5; 0 == (bits & 1); bits >>= 1)
+		from++;
+
+	return from;
 }
 
 static void	mem_set_chunk_size(void *chunk, uint32_t size)
@@ -227,6 +350,7 @@ static void	mem_link_chunk(zbx_mem_info_t *info, void *chunk)
 	mem_set_next_chunk(chunk, info->buckets[index]);
 
 	info->buckets[index] = chunk;
+	info->buckets_bitmap[index >> 5] |= (uint32_t)1 << (index & 31);
 }
 
 static void	mem_unlink_chunk(zbx_mem_info_t *info, void *chunk)
@@ -246,52 +370,59 @@ static void	mem_unlink_chunk(zbx_mem_info_t *info, void *chunk)
 	*next_in_prev_chunk = next_chunk;
 	if (NULL != prev_in_next_chunk)
 		*prev_in_next_chunk = prev_chunk;
+
+	if (NULL == info->buckets[index])
+		info->buckets_bitmap[index >> 5] &= ~((uint32_t)1 << (index & 31));
 }
 
 /* private memory functions */
 
 static void	*__mem_malloc(zbx_mem_info_t *info, uint32_t size)
 {
-	int		index;
+	int		index, found;
 	void		*chunk;
 	uint32_t	chunk_size;
 
 	size = mem_proper_alloc_size(size);
 
-	/* try to find an appropriate chunk in special buckets */
+	/* chunks in a small bucket are all of the bucket size, but chunks in a range bucket can be smaller */
+	/* than requested, so for a range bucket the search starts with the next one unless its first chunk fits */
 
 	index = mem_bucket_by_size(size);
-	
-	while (index < MEM_BUCKET_COUNT - 1 && NULL == info->buckets[index])
-		index++;
-
 	chunk = info->buckets[index];
 
-	if (index == MEM_BUCKET_COUNT - 1)
+	if (index < MEM_SMALL_BUCKET_COUNT || NULL == chunk || CHUNK_SIZE(chunk) < size)
 	{
-		/* otherwise, find a chunk big enough according to first-fit strategy */
-
-		int		counter = 0;
-		uint32_t	skip_min = 0xffffffff, skip_max = 0;
-
-		while (NULL != chunk && CHUNK_SIZE(chunk) < size)
+		if (FAIL != (found = mem_find_bucket(info, index < MEM_SMALL_BUCKET_COUNT ? index : index + 1)))
+			chunk = info->buckets[found];
+		else if (index < MEM_SMALL_BUCKET_COUNT)
+			chunk = NULL;
+		else
 		{
-			counter++;
-			skip_min = MIN(skip_min, CHUNK_SIZE(chunk));
-			skip_max = MAX(skip_max, CHUNK_SIZE(chunk));
-			chunk = mem_get_next_chunk(chunk);
+			/* otherwise, find a chunk big enough in the range bucket according to first-fit strategy */
+
+			int		counter = 0;
+			uint32_t	skip_min = 0xffffffff, skip_max = 0;
+
+			while (NULL != chunk && CHUNK_SIZE(chunk) < size)
+			{
+				counter++;
+				skip_min = MIN(skip_min, CHUNK_SIZE(chunk));
+				skip_max = MAX(skip_max, CHUNK_SIZE(chunk));
+				chunk = mem_get_next_chunk(chunk);
+			}
+
+			if (NULL != chunk && counter >= 100)
+				zabbix_log(LOG_LEVEL_DEBUG, "__mem_malloc: skipped %d asked %u skip_min %u skip_max %u size %u",
+						counter, size, skip_min, skip_max, CHUNK_SIZE(chunk));
 		}
-
-		if (NULL == chunk)
-			zabbix_log(LOG_LEVEL_CRIT, "__mem_malloc: skipped %d asked %u skip_min %u skip_max %u",
-					counter, size, skip_min, skip_max);
-		else if (counter >= 100)
-			zabbix_log(LOG_LEVEL_DEBUG, "__mem_malloc: skipped %d asked %u skip_min %u skip_max %u size %u",
-					counter, size, skip_min, skip_max, CHUNK_SIZE(chunk));
 	}
 
 	if (NULL == chunk)
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "__mem_malloc: no free chunk of %u bytes, %u bytes free", size, info->free_size);
 		return NULL;
+	}
 
 	chunk_size = CHUNK_SIZE(chunk);
 	mem_unlink_chunk(info, chunk);
@@ -325,6 +456,58 @@ static void	*__mem_malloc(zbx_mem_info_t *info, uint32_t size)
 	return chunk;
 }
 
+/* same as __mem_malloc(), but the allocatable memory of the returned chunk starts at a multiple of align */
+static void	*__mem_malloc_aligned(zbx_mem_info_t *info, uint32_t size, uint32_t align)
+{
+	void		*chunk, *ptr;
+	uint32_t	chunk_size, gap, min_gap = 2 * MEM_SIZE_FIELD + MEM_MIN_ALLOC;
+
+	size = mem_proper_alloc_size(size);
+
+	if (NULL == (chunk = __mem_malloc(info, size + align + min_gap)))
+		return NULL;
+
+	chunk_size = CHUNK_SIZE(chunk);
+
+	/* the memory before the aligned address must be large enough to become a free chunk */
+
+	ptr = (void *)(((uintptr_t)(chunk + MEM_SIZE_FIELD) + align - 1) & ~(uintptr_t)(align - 1));
+	gap = (uint32_t)(ptr - (chunk + MEM_SIZE_FIELD));
+
+	if (0 != gap && gap < min_gap)
+	{
+		ptr += align;
+		gap += align;
+	}
+
+	if (0 != gap)
+	{
+		/* the two new size fields are taken from used memory, __mem_free() then accounts the rest */
+		info->used_size -= 2 * MEM_SIZE_FIELD;
+
+		mem_set_used_chunk_size(chunk, gap - 2 * MEM_SIZE_FIELD);
+		mem_set_used_chunk_size(ptr - MEM_SIZE_FIELD, chunk_size - gap);
+		__mem_free(info, chunk + MEM_SIZE_FIELD);
+
+		chunk = ptr - MEM_SIZE_FIELD;
+		chunk_size -= gap;
+	}
+
+	if (chunk_size >= size + 2 * MEM_SIZE_FIELD + MEM_MIN_ALLOC)
+	{
+		void	*new_chunk;
+
+		info->used_size -= 2 * MEM_SIZE_FIELD;
+
+		new_chunk = chunk + MEM_SIZE_FIELD + size + MEM_SIZE_FIELD;
+		mem_set_used_chunk_size(new_chunk, chunk_size - size - 2 * MEM_SIZE_FIELD);
+		mem_set_used_chunk_size(chunk, size);
+		__mem_free(info, new_chunk + MEM_SIZE_FIELD);
+	}
+
+	return chunk;
+}
+
 static void	*__mem_realloc(zbx_mem_info_t *info, void *old, uint32_t size)
 {
 	void		*chunk, *new_chunk, *next_chunk;
@@ -388,8 +571,9 @@ static void	*__mem_realloc(zbx_mem_info_t *info, void *old, uint32_t size)
 
 	if (next_free && chunk_size + 2 * MEM_SIZE_FIELD + CHUNK_SIZE(next_chunk) >= size)
 	{
+		/* the size fields between the chunks become free too, they are taken back below with the rest */
 		info->used_size -= chunk_size;
-		info->free_size += chunk_size;
+		info->free_size += chunk_size + 2 * MEM_SIZE_FIELD;
 
 		chunk_size += 2 * MEM_SIZE_FIELD + CHUNK_SIZE(next_chunk);
 
@@ -516,13 +700,221 @@ static void	__mem_free(zbx_mem_info_t *info, void *ptr)
 	}
 }
 
+/* private slab functions */
+
+static int	mem_slab_class_by_size(uint32_t size)
+{
+	return (int)((size - 1) >> 3);
+}
+
+static void	mem_slab_mark_page(zbx_mem_info_t *info, mem_slab_page_t *page, int is_slab)
+{
+	size_t	index;
+
+	index = ((void *)page - info->slab_base) / MEM_SLAB_PAGE_SIZE;
+
+	if (0 != is_slab)
+		info->slab_pages[index >> 3] |= (unsigned char)(1 << (index & 7));
+	else
+		info->slab_pages[index >> 3] &= (unsigned char)~(1 << (index & 7));
+}
+
+static mem_slab_page_t	*mem_slab_page_by_ptr(zbx_mem_info_t *info, void *ptr)
+{
+	size_t	index;
+
+	if (NULL == info->slabs || ptr < info->lo_bound || ptr >= info->hi_bound)
+		return NULL;
+
+	index = (ptr - info->slab_base) / MEM_SLAB_PAGE_SIZE;
+
+	if (0 == (info->slab_pages[index >> 3] & (1 << (index & 7))))
+		return NULL;
+
+	return (mem_slab_page_t *)(info->slab_base + index * MEM_SLAB_PAGE_SIZE);
+}
+
+static void	mem_slab_link_page(mem_slab_page_t **list, mem_slab_page_t *page)
+{
+	page->prev = NULL;
+	page->next = *list;
+
+	if (NULL != *list)
+		(*list)->prev = page;
+
+	*list = page;
+}
+
+static void	mem_slab_unlink_page(mem_slab_page_t **list, mem_slab_page_t *page)
+{
+	if (NULL != page->prev)
+		page->prev->next = page->next;
+	else
+		*list = page->next;
+
+	if (NULL != page->next)
+		page->next->prev = page->prev;
+}
+
+static int	mem_slab_add_page(zbx_mem_info_t *info, mem_slab_class_t *slab_class)
+{
+	void		*chunk;
+	mem_slab_page_t	*page;
+	uint32_t	i;
+
+	if (NULL == (chunk = __mem_malloc_aligned(info, MEM_SLAB_PAGE_SIZE, MEM_SLAB_PAGE_SIZE)))
+		return FAIL;
+
+	page = (mem_slab_page_t *)(chunk + MEM_SIZE_FIELD);
+
+	page->class_index = (uint32_t)(slab_class - (mem_slab_class_t *)info->slabs);
+	page->free_num = slab_class->objects_per_page;
+
+	memset(page->bitmap, 0, sizeof(page->bitmap));
+
+	for (i = 0; i < slab_class->objects_per_page; i++)
+		page->bitmap[i >> 5] |= (uint32_t)1 << (i & 31);
+
+	mem_slab_link_page(&slab_class->partial, page);
+	mem_slab_mark_page(info, page, 1);
+
+	slab_class->pages_num++;
+
+	return SUCCEED;
+}
+
+static void	*mem_slab_alloc(zbx_mem_info_t *info, uint32_t size)
+{
+	mem_slab_class_t	*slab_class;
+	mem_slab_page_t		*page;
+	uint32_t		word, bit;
+
+	slab_class = (mem_slab_class_t *)info->slabs + mem_slab_class_by_size(size);
+
+	if (NULL == slab_class->partial && SUCCEED != mem_slab_add_page(info, slab_class))
+		return NULL;
+
+	page = slab_class->partial;
+
+	for (word = 0; 0 == page->bitmap[word]; word++)
+		;
+
+	for (bit = 0; 0 == (page->bitmap[word] & ((uint32_t)1 << bit)); bit++)
+		;
+
+	page->bitmap[word] &= ~((uint32_t)1 << bit);
+
+	if (0 == --page->free_num)
+	{
+		mem_slab_unlink_page(&slab_class->partial, page);
+		mem_slab_link_page(&slab_class->full, page);
+	}
+
+	slab_class->used_num++;
+
+	return MEM_SLAB_OBJECTS(page) + (word * 32 + bit) * slab_class->object_size;
+}
+
+static void	mem_slab_free(zbx_mem_info_t *info, mem_slab_page_t *page, void *ptr)
+{
+	mem_slab_class_t	*slab_class;
+	uint32_t		index;
+
+	slab_class = (mem_slab_class_t *)info->slabs + page->class_index;
+	index = (uint32_t)(ptr - MEM_SLAB_OBJECTS(page)) / slab_class->object_size;
+
+	page->bitmap[index >> 5] |= (uint32_t)1 << (index & 31);
+
+	if (0 == page->free_num++)
+	{
+		mem_slab_unlink_page(&slab_class->full, page);
+		mem_slab_link_page(&slab_class->partial, page);
+	}
+
+	slab_class->used_num--;
+
+	/* return empty pages to the shared memory, but keep the last partial one to avoid thrashing */
+
+	if (page->free_num == slab_class->objects_per_page && (NULL != page->prev || NULL != page->next))
+	{
+		mem_slab_unlink_page(&slab_class->partial, page);
+		mem_slab_mark_page(info, page, 0);
+		__mem_free(info, page);
+
+		slab_class->pages_num--;
+	}
+}
+
+static void	mem_slabs_init(zbx_mem_info_t *info)
+{
+	mem_slab_class_t	*slab_class;
+	void			*classes_chunk, *pages_chunk;
+	size_t			pages_num;
+	int			i;
+
+	info->slab_base = (void *)((uintptr_t)info->lo_bound & ~(uintptr_t)(MEM_SLAB_PAGE_SIZE - 1));
+	pages_num = (info->hi_bound - info->slab_base) / MEM_SLAB_PAGE_SIZE + 1;
+
+	classes_chunk = __mem_malloc(info, MEM_SLAB_CLASS_COUNT * sizeof(mem_slab_class_t));
+	pages_chunk = __mem_malloc(info, pages_num / 8 + 1);
+
+	if (NULL == classes_chunk || NULL == pages_chunk)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "not enough space in %s for slabs, they will not be used", info->mem_descr);
+
+		if (NULL != classes_chunk)
+			__mem_free(info, classes_chunk + MEM_SIZE_FIELD);
+		if (NULL != pages_chunk)
+			__mem_free(info, pages_chunk + MEM_SIZE_FIELD);
+
+		info->slabs = NULL;
+		info->slab_pages = NULL;
+
+		return;
+	}
+
+	info->slabs = classes_chunk + MEM_SIZE_FIELD;
+	info->slab_pages = pages_chunk + MEM_SIZE_FIELD;
+
+	memset(info->slab_pages, 0, pages_num / 8 + 1);
+
+	for (i = 0; i < MEM_SLAB_CLASS_COUNT; i++)
+	{
+		slab_class = (mem_slab_class_t *)info->slabs + i;
+
+		slab_class->partial = NULL;
+		slab_class->full = NULL;
+		slab_class->object_size = 8 * (i + 1);
+		slab_class->objects_per_page = (MEM_SLAB_PAGE_SIZE - MEM_SLAB_HEADER_SIZE) / slab_class->object_size;
+		slab_class->pages_num = 0;
+		slab_class->used_num = 0;
+
+		if (slab_class->objects_per_page > MEM_SLAB_BITMAP_WORDS * 32)
+			slab_class->objects_per_page = MEM_SLAB_BITMAP_WORDS * 32;
+	}
+}
+
+/* allocates memory from a slab or a chunk, whichever is appropriate, and returns a pointer to it or NULL */
+static void	*mem_malloc_ptr(zbx_mem_info_t *info, uint32_t size)
+{
+	void	*ptr, *chunk;
+
+	if (NULL != info->slabs && size <= MEM_SLAB_MAX_SIZE && NULL != (ptr = mem_slab_alloc(info, size)))
+		return ptr;
+
+	if (NULL != (chunk = __mem_malloc(info, size)))
+		return chunk + MEM_SIZE_FIELD;
+
+	return NULL;
+}
+
 /* public memory interface */
 
 void	zbx_mem_create(zbx_mem_info_t **info, key_t shm_key, int lock_name, size_t size, const char *descr, const char *param)
 {
 	const char	*__function_name = "zbx_mem_create";
 
-	int		shm_id, index;
+	int		shm_id;
 	void		*base, *chunk_lsize, *chunk_rsize;
 
 	descr = (NULL == descr ? "(null)" : descr);
@@ -574,6 +966,11 @@ void	zbx_mem_create(zbx_mem_info_t **info, key_t shm_key, int lock_name, size_t
 	size -= (void *)((*info)->buckets + MEM_BUCKET_COUNT) - base;
 	base = (void *)((*info)->buckets + MEM_BUCKET_COUNT);
 
+	(*info)->buckets_bitmap = ALIGN4(base);
+	memset((*info)->buckets_bitmap, 0, MEM_BITMAP_WORDS * sizeof(uint32_t));
+	size -= (void *)((*info)->buckets_bitmap + MEM_BITMAP_WORDS) - base;
+	base = (void *)((*info)->buckets_bitmap + MEM_BITMAP_WORDS);
+
 	strcpy(base, descr);
 	(*info)->mem_descr = base;
 	size -= strlen(descr) + 1;
@@ -600,6 +997,10 @@ void	zbx_mem_create(zbx_mem_info_t **info, key_t shm_key, int lock_name, size_t
 	else
 		(*info)->use_lock = 0;
 
+	(*info)->slabs = NULL;
+	(*info)->slab_pages = NULL;
+	(*info)->slab_base = NULL;
+
 	/* prepare shared memory for further allocation by creating one big chunk */
 
 	chunk_lsize = ALIGN8(base);
@@ -616,11 +1017,8 @@ void	zbx_mem_create(zbx_mem_info_t **info, key_t shm_key, int lock_name, size_t
 
 	(*info)->total_size = (uint32_t)(chunk_rsize - chunk_lsize - MEM_SIZE_FIELD);
 
-	index = mem_bucket_by_size((*info)->total_size);
-	(*info)->buckets[index] = (*info)->lo_bound;
-	mem_set_chunk_size((*info)->buckets[index], (*info)->total_size);
-	mem_set_prev_chunk((*info)->buckets[index], NULL);
-	mem_set_next_chunk((*info)->buckets[index], NULL);
+	mem_set_chunk_size((*info)->lo_bound, (*info)->total_size);
+	mem_link_chunk(*info, (*info)->lo_bound);
 
 	(*info)->used_size = 0;
 	(*info)->free_size = (*info)->total_size;
@@ -655,7 +1053,7 @@ void	*__zbx_mem_malloc(const char *file, int line, zbx_mem_info_t *info, const v
 {
 	const char	*__function_name = "zbx_mem_malloc";
 
-	void		*chunk;
+	void		*ptr;
 
 	if (NULL != old)
 	{
@@ -673,11 +1071,11 @@ void	*__zbx_mem_malloc(const char *file, int line, zbx_mem_info_t *info, const v
 
 	LOCK_INFO;
 
-	chunk = __mem_malloc(info, (uint32_t)size);
+	ptr = mem_malloc_ptr(info, (uint32_t)size);
 
 	UNLOCK_INFO;
 
-	if (NULL == chunk)
+	if (NULL == ptr)
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "[file:%s,line:%d] %s(): out of memory (requested %lu bytes)",
 				file, line, __function_name, size);
@@ -686,14 +1084,32 @@ void	*__zbx_mem_malloc(const char *file, int line, zbx_mem_info_t *info, const v
 		exit(FAIL);
 	}
 
-	return chunk + MEM_SIZE_FIELD;
+	return ptr;
+}
+
+/* same as zbx_mem_malloc(), but returns NULL instead of exiting when there is no free chunk large enough */
+void	*zbx_mem_try_malloc(zbx_mem_info_t *info, size_t size)
+{
+	void	*ptr;
+
+	if (0 == size || size > MEM_MAX_SIZE)
+		return NULL;
+
+	LOCK_INFO;
+
+	ptr = mem_malloc_ptr(info, (uint32_t)size);
+
+	UNLOCK_INFO;
+
+	return ptr;
 }
 
 void	*__zbx_mem_realloc(const char *file, int line, zbx_mem_info_t *info, void *old, size_t size)
 {
 	const char	*__function_name = "zbx_mem_realloc";
 
-	void		*chunk;
+	void		*ptr;
+	mem_slab_page_t	*page;
 
 	if (0 == size || size > MEM_MAX_SIZE)
 	{
@@ -705,13 +1121,25 @@ void	*__zbx_mem_realloc(const char *file, int line, zbx_mem_info_t *info, void *
 	LOCK_INFO;
 
 	if (NULL == old)
-		chunk = __mem_malloc(info, (uint32_t)size);
-	else
-		chunk = __mem_realloc(info, old, (uint32_t)size);
+		ptr = mem_malloc_ptr(info, (uint32_t)size);
+	else if (NULL != (page = mem_slab_page_by_ptr(info, old)))
+	{
+		uint32_t	object_size = ((mem_slab_class_t *)info->slabs + page->class_index)->object_size;
+
+		if (size <= MEM_SLAB_MAX_SIZE && (int)page->class_index == mem_slab_class_by_size((uint32_t)size))
+			ptr = old;
+		else if (NULL != (ptr = mem_malloc_ptr(info, (uint32_t)size)))
+		{
+			memcpy(ptr, old, MIN(object_size, size));
+			mem_slab_free(info, page, old);
+		}
+	}
+	else if (NULL != (ptr = __mem_realloc(info, old, (uint32_t)size)))
+		ptr += MEM_SIZE_FIELD;
 
 	UNLOCK_INFO;
 
-	if (NULL == chunk)
+	if (NULL == ptr)
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "[file:%s,line:%d] %s(): out of memory (requested %lu bytes)",
 				file, line, __function_name, size);
@@ -720,13 +1148,15 @@ void	*__zbx_mem_realloc(const char *file, int line, zbx_mem_info_t *info, void *
 		exit(FAIL);
 	}
 
-	return chunk + MEM_SIZE_FIELD;
+	return ptr;
 }
 
 void	__zbx_mem_free(const char *file, int line, zbx_mem_info_t *info, void *ptr)
 {
 	const char	*__function_name = "zbx_mem_free";
 
+	mem_slab_page_t	*page;
+
 	if (NULL == ptr)
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "[file:%s,line:%d] %s(): freeing a NULL pointer",
@@ -736,7 +1166,10 @@ void	__zbx_mem_free(const char *file, int line, zbx_mem_info_t *info, void *ptr)
 
 	LOCK_INFO;
 
-	__mem_free(info, ptr);
+	if (NULL != (page = mem_slab_page_by_ptr(info, ptr)))
+		mem_slab_free(info, page, ptr);
+	else
+		__mem_free(info, ptr);
 
 	UNLOCK_INFO;
 }
@@ -745,26 +1178,86 @@ void	zbx_mem_clear(zbx_mem_info_t *info)
 {
 	const char	*__function_name = "zbx_mem_clear";
 
-	int		index;
-
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
 	LOCK_INFO;
 
 	memset(info->buckets, 0, MEM_BUCKET_COUNT * ZBX_PTR_SIZE);
-	index = mem_bucket_by_size(info->total_size);
-	info->buckets[index] = info->lo_bound;
-	mem_set_chunk_size(info->buckets[index], info->total_size);
-	mem_set_prev_chunk(info->buckets[index], NULL);
-	mem_set_next_chunk(info->buckets[index], NULL);
+	memset(info->buckets_bitmap, 0, MEM_BITMAP_WORDS * sizeof(uint32_t));
+	mem_set_chunk_size(info->lo_bound, info->total_size);
+	mem_link_chunk(info, info->lo_bound);
 	info->used_size = 0;
 	info->free_size = info->total_size;
 
+	if (NULL != info->slabs)
+		mem_slabs_init(info);
+
+	UNLOCK_INFO;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_mem_enable_slabs                                             *
+ *                                                                            *
+ * Purpose: serve small allocations from size class slabs                     *
+ *                                                                            *
+ * Parameters: info - [IN] shared memory to enable slabs for                  *
+ *                                                                            *
+ * Comments: meant for memory holding many records of the same few sizes,     *
+ *           must be called before anything is allocated from it              *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_mem_enable_slabs(zbx_mem_info_t *info)
+{
+	const char	*__function_name = "zbx_mem_enable_slabs";
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() descr:'%s'", __function_name, info->mem_descr);
+
+	LOCK_INFO;
+
+	mem_slabs_init(info);
+
 	UNLOCK_INFO;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __function_name);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_mem_slab_reserve                                             *
+ *                                                                            *
+ * Purpose: make sure that a number of objects of the given size can be       *
+ *          allocated without adding slab pages one at a time                 *
+ *                                                                            *
+ * Parameters: info - [IN] shared memory with slabs enabled                   *
+ *             size - [IN] object size                                        *
+ *             num  - [IN] number of objects about to be allocated            *
+ *                                                                            *
+ * Comments: does nothing if slabs are not enabled or the size is not served  *
+ *           by them; stops quietly if there is not enough memory             *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_mem_slab_reserve(zbx_mem_info_t *info, size_t size, int num)
+{
+	mem_slab_class_t	*slab_class;
+	int			free_num;
+
+	if (NULL == info->slabs || 0 == size || MEM_SLAB_MAX_SIZE < size || 0 >= num)
+		return;
+
+	LOCK_INFO;
+
+	slab_class = (mem_slab_class_t *)info->slabs + mem_slab_class_by_size((uint32_t)size);
+	free_num = slab_class->pages_num * (int)slab_class->objects_per_page - slab_class->used_num;
+
+	while (free_num < num && SUCCEED == mem_slab_add_page(info, slab_class))
+		free_num += (int)slab_class->objects_per_page;
+
+	UNLOCK_INFO;
+}
+
 void	zbx_mem_dump_stats(zbx_mem_info_t *info)
 {
 	void		*chunk;
@@ -791,9 +1284,9 @@ void	zbx_mem_dump_stats(zbx_mem_info_t *info)
 		if (counter > 0)
 		{
 			total_free += counter;
-			zabbix_log(LOG_LEVEL_DEBUG, "free chunks of size %2s %3d bytes: %8d",
-					index == MEM_BUCKET_COUNT - 1 ? ">=" : "",
-					MEM_MIN_BUCKET_SIZE + 8 * index, counter);
+			zabbix_log(LOG_LEVEL_DEBUG, "free chunks of size %2s %10u bytes: %8d",
+					index < MEM_SMALL_BUCKET_COUNT ? "" : ">=",
+					mem_bucket_min_size(index), counter);
 		}
 	}
 
@@ -805,6 +1298,21 @@ void	zbx_mem_dump_stats(zbx_mem_info_t *info)
 	zabbix_log(LOG_LEVEL_DEBUG, "of those, %10u bytes are in %8d free chunks", info->free_size, total_free);
 	zabbix_log(LOG_LEVEL_DEBUG, "of those, %10u bytes are in %8d used chunks", info->used_size, total - total_free);
 
+	for (index = 0; NULL != info->slabs && index < MEM_SLAB_CLASS_COUNT; index++)
+	{
+		const mem_slab_class_t	*slab_class = (const mem_slab_class_t *)info->slabs + index;
+		int			objects_num;
+
+		if (0 == slab_class->pages_num)
+			continue;
+
+		objects_num = slab_class->pages_num * (int)slab_class->objects_per_page;
+
+		zabbix_log(LOG_LEVEL_DEBUG, "slab of %3u byte objects: %6d pages, %8d of %8d objects used ("
+				ZBX_FS_DBL "%%)", slab_class->object_size, slab_class->pages_num,
+				slab_class->used_num, objects_num, 100 * ((double)slab_class->used_num / objects_num));
+	}
+
 	zabbix_log(LOG_LEVEL_DEBUG, "================================");
 
 	UNLOCK_INFO;
@@ -825,6 +1333,8 @@ size_t	zbx_mem_required_size(size_t size, int chunks_num, const char *descr, con
 	size += sizeof(zbx_mem_info_t);
 	size += ZBX_PTR_SIZE - 1;			/* ensure we allocate enough to align bucket pointers */
 	size += ZBX_PTR_SIZE * MEM_BUCKET_COUNT;
+	size += 3;					/* ensure we allocate enough to align the bucket bitmap */
+	size += sizeof(uint32_t) * MEM_BITMAP_WORDS;
 	size += strlen(descr) + 1;
 	size += strlen(param) + 1;
 	size += (MEM_SIZE_FIELD - 1) + 8;		/* ensure we allocate enough to align the first chunk */
@@ -70,6 +70,7 @@ extern int	CONFIG_DATASENDER_FORKS;
 extern int	CONFIG_CONFSYNCER_FORKS;
 extern int	CONFIG_HEARTBEAT_FORKS;
 extern int	CONFIG_SELFMON_FORKS;
+extern int	CONFIG_DBWRITER_FORKS;
 
 /******************************************************************************
  *                                                                            *
@@ -128,6 +129,8 @@ int	get_process_type_forks(unsigned char process_type)
 			return CONFIG_HEARTBEAT_FORKS;
 		case ZBX_PROCESS_TYPE_SELFMON:
 			return CONFIG_SELFMON_FORKS;
+		case ZBX_PROCESS_TYPE_DBWRITER:
+			return CONFIG_DBWRITER_FORKS;
 	}
 
 	assert(0);
@@ -191,6 +194,8 @@ const char	*get_process_type_string(unsigned char process_type)
 			return "heartbeat sender";
 		case ZBX_PROCESS_TYPE_SELFMON:
 			return "self-monitoring";
+		case ZBX_PROCESS_TYPE_DBWRITER:
+			return "db writer";
 	}
 
 	assert(0);
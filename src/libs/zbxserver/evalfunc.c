@@ -22,9 +22,14 @@
 #include "log.h"
 #include "zlog.h"
 #include "zbxserver.h"
+#include "valuecache.h"
 
 #include "evalfunc.h"
 
+/* buffer for the values returned by the value cache, reused between calls */
+static zbx_vc_value_t	*vc_values = NULL;
+static int		vc_values_alloc = 0, vc_values_num = 0;
+
 const char	*get_table_by_value_type(int value_type)
 {
 	switch (value_type)
@@ -117,6 +122,38 @@ clean:
 	return res;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Function: get_cached_values                                                *
+ *                                                                            *
+ * Purpose: get values of a numeric item for the function period from the     *
+ *          value cache                                                       *
+ *                                                                            *
+ * Parameters: item - item (performance metric)                               *
+ *             arg1 - number of seconds/values                                *
+ *             flag - ZBX_FLAG_SEC or ZBX_FLAG_VALUES                         *
+ *             now  - end of the period                                       *
+ *                                                                            *
+ * Return value: SUCCEED - the values are stored in vc_values, the newest     *
+ *                         first                                              *
+ *               FAIL - the values must be read from the database, values of *
+ *                      the item queued for DB writers are inserted already   *
+ *                                                                            *
+ ******************************************************************************/
+static int	get_cached_values(DB_ITEM *item, int arg1, int flag, time_t now)
+{
+	if (0 < arg1 && SUCCEED == zbx_vc_get_value_range(item->itemid, item->value_type, &vc_values,
+			&vc_values_alloc, &vc_values_num, ZBX_FLAG_SEC == flag ? arg1 : 0,
+			ZBX_FLAG_VALUES == flag ? arg1 : 0, (int)now))
+	{
+		return SUCCEED;
+	}
+
+	DCwait_queued_history(&item->itemid, 1);
+
+	return FAIL;
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: evaluate_LOGEVENTID                                              *
@@ -317,6 +354,89 @@ clean:
 	return res;
 }
 
+#define OP_EQ 0
+#define OP_NE 1
+#define OP_GT 2
+#define OP_GE 3
+#define OP_LT 4
+#define OP_LE 5
+#define OP_LIKE 6
+#define OP_MAX 7
+
+/******************************************************************************
+ *                                                                            *
+ * Function: count_match                                                      *
+ *                                                                            *
+ * Purpose: check a numeric value against the operator of function count      *
+ *                                                                            *
+ * Return value: SUCCEED - the value matches, FAIL - otherwise                *
+ *                                                                            *
+ ******************************************************************************/
+static int	count_match(int op, int value_type, const history_value_t *value, const history_value_t *pattern)
+{
+	if (ITEM_VALUE_TYPE_UINT64 == value_type)
+	{
+		switch (op)
+		{
+			case OP_EQ:	return value->value_uint64 == pattern->value_uint64 ? SUCCEED : FAIL;
+			case OP_NE:	return value->value_uint64 != pattern->value_uint64 ? SUCCEED : FAIL;
+			case OP_GT:	return value->value_uint64 > pattern->value_uint64 ? SUCCEED : FAIL;
+			case OP_GE:	return value->value_uint64 >= pattern->value_uint64 ? SUCCEED : FAIL;
+			case OP_LT:	return value->value_uint64 < pattern->value_uint64 ? SUCCEED : FAIL;
+			case OP_LE:	return value->value_uint64 <= pattern->value_uint64 ? SUCCEED : FAIL;
+			default:	return FAIL;
+		}
+	}
+
+	switch (op)
+	{
+		case OP_EQ:
+			return value->value_float > pattern->value_float - 0.00001 &&
+					value->value_float < pattern->value_float + 0.00001 ? SUCCEED : FAIL;
+		case OP_NE:
+			return !(value->value_float > pattern->value_float - 0.00001 &&
+					value->value_float < pattern->value_float + 0.00001) ? SUCCEED : FAIL;
+		case OP_GT:	return value->value_float > pattern->value_float ? SUCCEED : FAIL;
+		case OP_GE:	return value->value_float >= pattern->value_float ? SUCCEED : FAIL;
+		case OP_LT:	return value->value_float < pattern->value_float ? SUCCEED : FAIL;
+		case OP_LE:	return value->value_float <= pattern->value_float ? SUCCEED : FAIL;
+		default:	return FAIL;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: get_cached_aggregate                                             *
+ *                                                                            *
+ * Purpose: get a running aggregate of a numeric item over a time period from *
+ *          the value cache                                                   *
+ *                                                                            *
+ * Parameters: item    - item (performance metric)                            *
+ *             func    - ZBX_VC_AGG_* value                                   *
+ *             arg1    - number of seconds/values                             *
+ *             flag    - ZBX_FLAG_SEC or ZBX_FLAG_VALUES                      *
+ *             now     - end of the period                                    *
+ *             op      - operator of function count                           *
+ *             pattern - value compared with by function count                *
+ *             agg     - sum, minimum or maximum of the values                *
+ *             num     - number of the (matching) values                      *
+ *                                                                            *
+ * Return value: SUCCEED - the aggregate is stored in agg and num             *
+ *               FAIL - the values must be processed one by one               *
+ *                                                                            *
+ * Comments: only time periods are aggregated                                 *
+ *                                                                            *
+ ******************************************************************************/
+static int	get_cached_aggregate(DB_ITEM *item, int func, int arg1, int flag, time_t now, int op,
+		const history_value_t *pattern, history_value_t *agg, int *num)
+{
+	if (ZBX_FLAG_SEC != flag || 0 >= arg1)
+		return FAIL;
+
+	return zbx_vc_get_aggregate(item->itemid, item->value_type, func, arg1, (int)now, op, pattern, count_match,
+			agg, num);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: evaluate_COUNT                                                   *
@@ -340,24 +460,14 @@ clean:
  ******************************************************************************/
 static int	evaluate_COUNT(char *value, DB_ITEM *item, const char *function, const char *parameters, time_t now)
 {
-#define OP_EQ 0
-#define OP_NE 1
-#define OP_GT 2
-#define OP_GE 3
-#define OP_LT 4
-#define OP_LE 5
-#define OP_LIKE 6
-#define OP_MAX 7
-
 	const char	*__function_name = "evaluate_COUNT";
 	DB_RESULT	result;
 	DB_ROW		row;
 
 	char		sql[MAX_STRING_LEN];
 
-	int		arg1, flag, op, offset, numeric_search, nparams, count, res = FAIL;
-	zbx_uint64_t	value_uint64 = 0, dbvalue_uint64;
-	double		value_double = 0, dbvalue_double;
+	int		arg1, flag, op, offset, numeric_search, nparams, count, i, res = FAIL;
+	history_value_t	pattern, dbvalue;
 	char		*operators[OP_MAX] = {"=", "<>", ">", ">=", "<", "<=", "like"};
 	char		*arg2 = NULL, *arg3 = NULL, *arg2_esc = NULL;
 
@@ -366,6 +476,8 @@ static int	evaluate_COUNT(char *value, DB_ITEM *item, const char *function, cons
 	numeric_search = (ITEM_VALUE_TYPE_UINT64 == item->value_type || ITEM_VALUE_TYPE_FLOAT == item->value_type);
 	op = (numeric_search ? OP_EQ : OP_LIKE);
 
+	memset(&pattern, 0, sizeof(pattern));
+
 	if (4 < (nparams = num_param(parameters)))
 		goto clean;
 
@@ -380,10 +492,10 @@ static int	evaluate_COUNT(char *value, DB_ITEM *item, const char *function, cons
 			switch (item->value_type)
 			{
 				case ITEM_VALUE_TYPE_UINT64:
-					ZBX_STR2UINT64(value_uint64, arg2);
+					ZBX_STR2UINT64(pattern.value_uint64, arg2);
 					break;
 				case ITEM_VALUE_TYPE_FLOAT:
-					value_double = atof(arg2);
+					pattern.value_float = atof(arg2);
 					break;
 				default:
 					;	/* nothing */
@@ -456,7 +568,27 @@ static int	evaluate_COUNT(char *value, DB_ITEM *item, const char *function, cons
 	if (NULL != arg2 && 0 == strcmp(arg2, "") && (numeric_search || OP_LIKE == op))
 		zbx_free(arg2);
 
-	if (ZBX_FLAG_SEC == flag)
+	if (numeric_search && SUCCEED == get_cached_aggregate(item, NULL == arg2 ? ZBX_VC_AGG_SUM : ZBX_VC_AGG_COUNT,
+			arg1, flag, now, op, &pattern, &dbvalue, &count))
+	{
+		zbx_snprintf(value, MAX_BUFFER_LEN, "%d", count);
+		res = SUCCEED;
+
+		zabbix_log(LOG_LEVEL_DEBUG, "%s() value:%s", __function_name, value);
+	}
+	else if (numeric_search && SUCCEED == get_cached_values(item, arg1, flag, now))
+	{
+		for (i = 0, count = 0; i < vc_values_num; i++)
+		{
+			if (NULL == arg2 || SUCCEED == count_match(op, item->value_type, &vc_values[i].value, &pattern))
+				count++;
+		}
+		zbx_snprintf(value, MAX_BUFFER_LEN, "%d", count);
+		res = SUCCEED;
+
+		zabbix_log(LOG_LEVEL_DEBUG, "%s() value:%s", __function_name, value);
+	}
+	else if (ZBX_FLAG_SEC == flag)
 	{
 		offset = zbx_snprintf(sql, sizeof(sql),
 				"select count(value)"
@@ -472,7 +604,7 @@ static int	evaluate_COUNT(char *value, DB_ITEM *item, const char *function, cons
 				offset += zbx_snprintf(sql + offset, sizeof(sql) - offset,
 						" and value%s" ZBX_FS_UI64,
 						operators[op],
-						value_uint64);
+						pattern.value_uint64);
 				break;
 			case ITEM_VALUE_TYPE_FLOAT:
 				switch (op) {
@@ -480,20 +612,20 @@ static int	evaluate_COUNT(char *value, DB_ITEM *item, const char *function, cons
 					offset += zbx_snprintf(sql + offset, sizeof(sql) - offset,
 							" and value>" ZBX_FS_DBL
 							" and value<" ZBX_FS_DBL,
-							value_double - 0.00001,
-							value_double + 0.00001);
+							pattern.value_float - 0.00001,
+							pattern.value_float + 0.00001);
 					break;
 				case OP_NE:
 					offset += zbx_snprintf(sql + offset, sizeof(sql) - offset,
 							" and not (value>" ZBX_FS_DBL " and value<" ZBX_FS_DBL ")",
-							value_double - 0.00001,
-							value_double + 0.00001);
+							pattern.value_float - 0.00001,
+							pattern.value_float + 0.00001);
 					break;
 				default:
 					offset += zbx_snprintf(sql + offset, sizeof(sql) - offset,
 							" and value%s" ZBX_FS_DBL,
 							operators[op],
-							value_double);
+							pattern.value_float);
 				}
 				break;
 			default:
@@ -529,6 +661,8 @@ static int	evaluate_COUNT(char *value, DB_ITEM *item, const char *function, cons
 			zbx_snprintf(value, MAX_BUFFER_LEN, "%s", row[0]);
 		res = SUCCEED;
 
+		DBfree_result(result);
+
 		zabbix_log(LOG_LEVEL_DEBUG, "%s() value:%s", __function_name, value);
 	}
 	else	/* ZBX_FLAG_VALUES */
@@ -563,64 +697,16 @@ static int	evaluate_COUNT(char *value, DB_ITEM *item, const char *function, cons
 
 			switch (item->value_type) {
 			case ITEM_VALUE_TYPE_UINT64:
-				ZBX_STR2UINT64(dbvalue_uint64, row[0]);
+				ZBX_STR2UINT64(dbvalue.value_uint64, row[0]);
 
-				switch (op) {
-				case OP_EQ:
-					if (dbvalue_uint64 == value_uint64)
-						goto count_inc;
-					break;
-				case OP_NE:
-					if (dbvalue_uint64 != value_uint64)
-						goto count_inc;
-					break;
-				case OP_GT:
-					if (dbvalue_uint64 > value_uint64)
-						goto count_inc;
-					break;
-				case OP_GE:
-					if (dbvalue_uint64 >= value_uint64)
-						goto count_inc;
-					break;
-				case OP_LT:
-					if (dbvalue_uint64 < value_uint64)
-						goto count_inc;
-					break;
-				case OP_LE:
-					if (dbvalue_uint64 <= value_uint64)
-						goto count_inc;
-					break;
-				}
+				if (SUCCEED == count_match(op, item->value_type, &dbvalue, &pattern))
+					goto count_inc;
 				break;
 			case ITEM_VALUE_TYPE_FLOAT:
-				dbvalue_double = atof(row[0]);
+				dbvalue.value_float = atof(row[0]);
 
-				switch (op) {
-				case OP_EQ:
-					if (dbvalue_double > value_double - 0.00001 && dbvalue_double < value_double + 0.00001)
-						goto count_inc;
-					break;
-				case OP_NE:
-					if (!(dbvalue_double > value_double - 0.00001 && dbvalue_double < value_double + 0.00001))
-						goto count_inc;
-					break;
-				case OP_GT:
-					if (dbvalue_double > value_double)
-						goto count_inc;
-					break;
-				case OP_GE:
-					if (dbvalue_double >= value_double)
-						goto count_inc;
-					break;
-				case OP_LT:
-					if (dbvalue_double < value_double)
-						goto count_inc;
-					break;
-				case OP_LE:
-					if (dbvalue_double <= value_double)
-						goto count_inc;
-					break;
-				}
+				if (SUCCEED == count_match(op, item->value_type, &dbvalue, &pattern))
+					goto count_inc;
 				break;
 			default:
 				switch (op) {
@@ -644,12 +730,13 @@ static int	evaluate_COUNT(char *value, DB_ITEM *item, const char *function, cons
 count_inc:
 			count++;
 		}
+		DBfree_result(result);
+
 		zbx_snprintf(value, MAX_BUFFER_LEN, "%d", count);
 		res = SUCCEED;
 
 		zabbix_log(LOG_LEVEL_DEBUG, "%s() value:%s", __function_name, value);
 	}
-	DBfree_result(result);
 	zbx_free(arg2);
 clean:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(res));
@@ -680,9 +767,10 @@ static int	evaluate_SUM(char *value, DB_ITEM *item, const char *function, const
 	DB_RESULT	result;
 	DB_ROW		row;
 	char		sql[MAX_STRING_LEN];
-	int		nparams, arg1, flag, rows = 0, res = FAIL;
+	int		nparams, arg1, flag, i, rows = 0, res = FAIL;
 	double		sum = 0;
 	zbx_uint64_t	l, sum_uint64 = 0;
+	history_value_t	agg;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -707,7 +795,25 @@ static int	evaluate_SUM(char *value, DB_ITEM *item, const char *function, const
 		now -= time_shift;
 	}
 
-	if (ZBX_FLAG_SEC == flag)
+	if (SUCCEED == get_cached_aggregate(item, ZBX_VC_AGG_SUM, arg1, flag, now, 0, NULL, &agg, &rows))
+	{
+		if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+			sum_uint64 = agg.value_uint64;
+		else
+			sum = agg.value_float;
+	}
+	else if (SUCCEED == get_cached_values(item, arg1, flag, now))
+	{
+		for (i = 0; i < vc_values_num; i++)
+		{
+			if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+				sum_uint64 += vc_values[i].value.value_uint64;
+			else
+				sum += vc_values[i].value.value_float;
+		}
+		rows = vc_values_num;
+	}
+	else if (ZBX_FLAG_SEC == flag)
 	{
 		result = DBselect(
 				"select sum(value)"
@@ -728,8 +834,10 @@ static int	evaluate_SUM(char *value, DB_ITEM *item, const char *function, const
 			res = SUCCEED;
 		}
 		DBfree_result(result);
+
+		goto clean;
 	}
-	else if (ZBX_FLAG_VALUES == flag)
+	else
 	{
 		zbx_snprintf(sql, sizeof(sql),
 				"select value"
@@ -761,17 +869,17 @@ static int	evaluate_SUM(char *value, DB_ITEM *item, const char *function, const
 			}
 		}
 		DBfree_result(result);
+	}
 
-		if (0 == rows)
-			zabbix_log(LOG_LEVEL_DEBUG, "Result for SUM is empty");
+	if (0 == rows)
+		zabbix_log(LOG_LEVEL_DEBUG, "Result for SUM is empty");
+	else
+	{
+		if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+			zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_UI64, sum_uint64);
 		else
-		{
-			if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
-				zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_UI64, sum_uint64);
-			else
-				zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, sum);
-			res = SUCCEED;
-		}
+			zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, sum);
+		res = SUCCEED;
 	}
 clean:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(res));
@@ -802,8 +910,9 @@ static int	evaluate_AVG(char *value, DB_ITEM *item, const char *function, const
 	DB_RESULT	result;
 	DB_ROW		row;
 	char		sql[MAX_STRING_LEN];
-	int		nparams, arg1, flag, rows = 0, res = FAIL;
+	int		nparams, arg1, flag, i, rows = 0, res = FAIL;
 	double		sum = 0;
+	history_value_t	agg;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -828,7 +937,25 @@ static int	evaluate_AVG(char *value, DB_ITEM *item, const char *function, const
 		now -= time_shift;
 	}
 
-	if (ZBX_FLAG_SEC == flag)
+	if (SUCCEED == get_cached_aggregate(item, ZBX_VC_AGG_SUM, arg1, flag, now, 0, NULL, &agg, &rows))
+	{
+		if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+			sum = (double)agg.value_uint64;
+		else
+			sum = agg.value_float;
+	}
+	else if (SUCCEED == get_cached_values(item, arg1, flag, now))
+	{
+		for (i = 0; i < vc_values_num; i++)
+		{
+			if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+				sum += (double)vc_values[i].value.value_uint64;
+			else
+				sum += vc_values[i].value.value_float;
+		}
+		rows = vc_values_num;
+	}
+	else if (ZBX_FLAG_SEC == flag)
 	{
 		result = DBselect(
 				"select avg(value)"
@@ -849,8 +976,10 @@ static int	evaluate_AVG(char *value, DB_ITEM *item, const char *function, const
 			res = SUCCEED;
 		}
 		DBfree_result(result);
+
+		goto clean;
 	}
-	else if (ZBX_FLAG_VALUES == flag)
+	else
 	{
 		zbx_snprintf(sql, sizeof(sql),
 				"select value"
@@ -870,14 +999,14 @@ static int	evaluate_AVG(char *value, DB_ITEM *item, const char *function, const
 			rows++;
 		}
 		DBfree_result(result);
+	}
 
-		if (0 == rows)
-			zabbix_log(LOG_LEVEL_DEBUG, "Result for AVG is empty");
-		else
-		{
-			zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, sum / (double)rows);
-			res = SUCCEED;
-		}
+	if (0 == rows)
+		zabbix_log(LOG_LEVEL_DEBUG, "Result for AVG is empty");
+	else
+	{
+		zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, sum / (double)rows);
+		res = SUCCEED;
 	}
 clean:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(res));
@@ -986,6 +1115,19 @@ static int	evaluate_LAST(char *value, DB_ITEM *item, const char *function, const
 	else
 	{
 history:
+		if (SUCCEED == get_cached_values(item, arg1, ZBX_FLAG_VALUES, now))
+		{
+			if (arg1 <= vc_values_num)
+			{
+				if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+					zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_UI64, vc_values[arg1 - 1].value.value_uint64);
+				else
+					zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, vc_values[arg1 - 1].value.value_float);
+				res = SUCCEED;
+			}
+			goto clean;
+		}
+
 		zbx_snprintf(sql, sizeof(sql),
 				"select value"
 				" from %s"
@@ -1042,6 +1184,7 @@ static int	evaluate_MIN(char *value, DB_ITEM *item, const char *function, const
 	int		nparams, arg1, flag, rows = 0, res = FAIL;
 	zbx_uint64_t	min_uint64 = 0, l;
 	double		min = 0, f;
+	history_value_t	agg;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -1066,7 +1209,32 @@ static int	evaluate_MIN(char *value, DB_ITEM *item, const char *function, const
 		now -= time_shift;
 	}
 
-	if (ZBX_FLAG_SEC == flag)
+	if (SUCCEED == get_cached_aggregate(item, ZBX_VC_AGG_MIN, arg1, flag, now, 0, NULL, &agg, &rows))
+	{
+		if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+			min_uint64 = agg.value_uint64;
+		else
+			min = agg.value_float;
+	}
+	else if (SUCCEED == get_cached_values(item, arg1, flag, now))
+	{
+		for (rows = 0; rows < vc_values_num; rows++)
+		{
+			if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+			{
+				l = vc_values[rows].value.value_uint64;
+				if (0 == rows || l < min_uint64)
+					min_uint64 = l;
+			}
+			else
+			{
+				f = vc_values[rows].value.value_float;
+				if (0 == rows || f < min)
+					min = f;
+			}
+		}
+	}
+	else if (ZBX_FLAG_SEC == flag)
 	{
 		result = DBselect(
 				"select min(value)"
@@ -1087,8 +1255,10 @@ static int	evaluate_MIN(char *value, DB_ITEM *item, const char *function, const
 			res = SUCCEED;
 		}
 		DBfree_result(result);
+
+		goto clean;
 	}
-	else if (ZBX_FLAG_VALUES == flag)
+	else
 	{
 		zbx_snprintf(sql, sizeof(sql),
 				"select value"
@@ -1123,17 +1293,17 @@ static int	evaluate_MIN(char *value, DB_ITEM *item, const char *function, const
 			}
 		}
 		DBfree_result(result);
+	}
 
-		if (0 == rows)
-			zabbix_log(LOG_LEVEL_DEBUG, "Result for MIN is empty");
+	if (0 == rows)
+		zabbix_log(LOG_LEVEL_DEBUG, "Result for MIN is empty");
+	else
+	{
+		if (item->value_type == ITEM_VALUE_TYPE_UINT64)
+			zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_UI64, min_uint64);
 		else
-		{
-			if (item->value_type == ITEM_VALUE_TYPE_UINT64)
-				zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_UI64, min_uint64);
-			else
-				zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, min);
-			res = SUCCEED;
-		}
+			zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, min);
+		res = SUCCEED;
 	}
 clean:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(res));
@@ -1167,6 +1337,7 @@ static int	evaluate_MAX(char *value, DB_ITEM *item, const char *function, const
 	int		nparams, arg1, flag, rows = 0, res = FAIL;
 	zbx_uint64_t	max_uint64 = 0, l;
 	double		max = 0, f;
+	history_value_t	agg;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -1191,7 +1362,32 @@ static int	evaluate_MAX(char *value, DB_ITEM *item, const char *function, const
 		now -= time_shift;
 	}
 
-	if (ZBX_FLAG_SEC == flag)
+	if (SUCCEED == get_cached_aggregate(item, ZBX_VC_AGG_MAX, arg1, flag, now, 0, NULL, &agg, &rows))
+	{
+		if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+			max_uint64 = agg.value_uint64;
+		else
+			max = agg.value_float;
+	}
+	else if (SUCCEED == get_cached_values(item, arg1, flag, now))
+	{
+		for (rows = 0; rows < vc_values_num; rows++)
+		{
+			if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+			{
+				l = vc_values[rows].value.value_uint64;
+				if (0 == rows || l > max_uint64)
+					max_uint64 = l;
+			}
+			else
+			{
+				f = vc_values[rows].value.value_float;
+				if (0 == rows || f > max)
+					max = f;
+			}
+		}
+	}
+	else if (ZBX_FLAG_SEC == flag)
 	{
 		result = DBselect(
 				"select max(value)"
@@ -1212,8 +1408,10 @@ static int	evaluate_MAX(char *value, DB_ITEM *item, const char *function, const
 			res = SUCCEED;
 		}
 		DBfree_result(result);
+
+		goto clean;
 	}
-	else if (ZBX_FLAG_VALUES == flag)
+	else
 	{
 		zbx_snprintf(sql, sizeof(sql),
 				"select value"
@@ -1248,17 +1446,17 @@ static int	evaluate_MAX(char *value, DB_ITEM *item, const char *function, const
 			}
 		}
 		DBfree_result(result);
+	}
 
-		if (0 == rows)
-			zabbix_log(LOG_LEVEL_DEBUG, "Result for MAX is empty");
+	if (0 == rows)
+		zabbix_log(LOG_LEVEL_DEBUG, "Result for MAX is empty");
+	else
+	{
+		if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+			zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_UI64, max_uint64);
 		else
-		{
-			if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
-				zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_UI64, max_uint64);
-			else
-				zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, max);
-			res = SUCCEED;
-		}
+			zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, max);
+		res = SUCCEED;
 	}
 clean:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(res));
@@ -1316,7 +1514,29 @@ static int	evaluate_DELTA(char *value, DB_ITEM *item, const char *function, cons
 		now -= time_shift;
 	}
 
-	if (ZBX_FLAG_SEC == flag)
+	if (SUCCEED == get_cached_values(item, arg1, flag, now))
+	{
+		for (rows = 0; rows < vc_values_num; rows++)
+		{
+			if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+			{
+				l = vc_values[rows].value.value_uint64;
+				if (0 == rows || l < min_uint64)
+					min_uint64 = l;
+				if (0 == rows || l > max_uint64)
+					max_uint64 = l;
+			}
+			else
+			{
+				f = vc_values[rows].value.value_float;
+				if (0 == rows || f < min)
+					min = f;
+				if (0 == rows || f > max)
+					max = f;
+			}
+		}
+	}
+	else if (ZBX_FLAG_SEC == flag)
 	{
 		result = DBselect(
 				"select max(value)-min(value)"
@@ -1337,8 +1557,10 @@ static int	evaluate_DELTA(char *value, DB_ITEM *item, const char *function, cons
 			res = SUCCEED;
 		}
 		DBfree_result(result);
+
+		goto clean;
 	}
-	else if (ZBX_FLAG_VALUES == flag)
+	else
 	{
 		zbx_snprintf(sql, sizeof(sql),
 				"select value"
@@ -1377,17 +1599,17 @@ static int	evaluate_DELTA(char *value, DB_ITEM *item, const char *function, cons
 			}
 		}
 		DBfree_result(result);
+	}
 
-		if (0 == rows)
-			zabbix_log(LOG_LEVEL_DEBUG, "Result for DELTA is empty");
+	if (0 == rows)
+		zabbix_log(LOG_LEVEL_DEBUG, "Result for DELTA is empty");
+	else
+	{
+		if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
+			zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_UI64, max_uint64 - min_uint64);
 		else
-		{
-			if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
-				zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_UI64, max_uint64 - min_uint64);
-			else
-				zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, max - min);
-			res = SUCCEED;
-		}
+			zbx_snprintf(value, MAX_BUFFER_LEN, ZBX_FS_DBL, max - min);
+		res = SUCCEED;
 	}
 clean:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __function_name, zbx_result_string(res));
@@ -1755,6 +1977,8 @@ static int	evaluate_STR(char *value, DB_ITEM *item, const char *function, const
 		DBfree_result(result);
 	}
 
+	DCwait_queued_history(&item->itemid, 1);
+
 	if (ZBX_FLAG_SEC == flag)
 	{
 		result = DBselect("select value"
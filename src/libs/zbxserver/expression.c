@@ -22,6 +22,8 @@
 #include "evalfunc.h"
 #include "db.h"
 #include "log.h"
+#include "dbcache.h"
+#include "zbxalgo.h"
 
 static DB_MACROS	*macros = NULL;
 
@@ -1015,9 +1017,10 @@ static int	DBget_item_lastvalue(DB_TRIGGER *trigger, char **lastvalue, int N_fun
 	DB_ROW		row;
 	DB_RESULT	h_result;
 	DB_ROW		h_row;
+	DB_ITEM		item;
 	zbx_uint64_t	valuemapid, functionid;
 	int		value_type, ret = FAIL;
-	char		tmp[MAX_STRING_LEN];
+	char		tmp[MAX_STRING_LEN], cached[MAX_STRING_LEN];
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __function_name);
 
@@ -1031,7 +1034,28 @@ static int	DBget_item_lastvalue(DB_TRIGGER *trigger, char **lastvalue, int N_fun
 				" and f.functionid=" ZBX_FS_UI64,
 			functionid);
 
-	if (NULL != (row = DBfetch(result)) && SUCCEED != DBis_null(row[4]))
+	if (NULL != (row = DBfetch(result)))
+	{
+		/* numeric last values may not be flushed to the database yet */
+		ZBX_STR2UINT64(item.itemid, row[0]);
+		item.value_type = atoi(row[1]);
+
+		if (SUCCEED == DCget_item_lastvalues(&item))
+		{
+			if (1 == item.lastvalue_null)
+				row[4] = NULL;
+			else
+			{
+				if (ITEM_VALUE_TYPE_FLOAT == item.value_type)
+					zbx_snprintf(cached, sizeof(cached), ZBX_FS_DBL, item.lastvalue_dbl);
+				else
+					zbx_snprintf(cached, sizeof(cached), ZBX_FS_UI64, item.lastvalue_uint64);
+				row[4] = cached;
+			}
+		}
+	}
+
+	if (NULL != row && SUCCEED != DBis_null(row[4]))
 	{
 		value_type = atoi(row[1]);
 		ZBX_STR2UINT64(valuemapid, row[2]);
@@ -2246,6 +2270,732 @@ error:
 	return FAIL;
 }
 
+/*
+ * Trigger expressions are compiled into postfix programs the first time they are evaluated by a process and are
+ * kept until the expression of the trigger changes. A program refers to the functions of the expression by slots,
+ * so the functions are fetched with a single query and evaluation does not format, substitute and parse values as
+ * text anymore. Anything the compiler does not understand is left to the text based evaluation.
+ */
+
+#define ZBX_EXP_CONST		0
+#define ZBX_EXP_FUNCTION	1	/* value of the function in slot 'index' */
+#define ZBX_EXP_TRIGGER_VALUE	2	/* {TRIGGER.VALUE} */
+#define ZBX_EXP_MACRO		3	/* user macro 'index' */
+#define ZBX_EXP_NEG		4
+#define ZBX_EXP_OPERATOR	5	/* binary operator 'op' */
+#define ZBX_EXP_LEFT		6	/* '(', used by the compiler only */
+#define ZBX_EXP_RIGHT		7	/* ')', used by the compiler only */
+
+typedef struct
+{
+	double		value;
+	int		index;		/* slot, user macro or, for '(', the matching ')' */
+	unsigned char	type;
+	unsigned char	neg;		/* the number of unary minuses, used by the compiler only */
+	char		op;
+}
+zbx_exp_op_t;
+
+typedef struct
+{
+	zbx_uint64_t	triggerid;
+	char		*source;	/* the expression the program was compiled from */
+	zbx_exp_op_t	*ops;
+	int		ops_num;
+	zbx_uint64_t	*functionids;
+	int		functionids_num;
+	char		**macros;
+	int		macros_num;
+}
+zbx_exp_program_t;
+
+/* the operators in the order evaluate_simple() splits expressions at them, '-' and '/' at the last occurrence */
+static const char	exp_operators[] = "|&=#><+-*/";
+
+static zbx_hashset_t	exp_programs;
+static int		exp_programs_init = 0;
+static unsigned int	exp_programs_revision = 0;	/* triggers revision of the configuration cache */
+static time_t		exp_programs_checked = 0;
+
+static void	exp_program_clean(zbx_exp_program_t *program)
+{
+	int	i;
+
+	for (i = 0; i < program->macros_num; i++)
+		zbx_free(program->macros[i]);
+
+	zbx_free(program->macros);
+	zbx_free(program->functionids);
+	zbx_free(program->ops);
+	zbx_free(program->source);
+}
+
+static void	exp_program_add_op(zbx_exp_program_t *program, int *ops_alloc, const zbx_exp_op_t *op)
+{
+	if (program->ops_num == *ops_alloc)
+	{
+		*ops_alloc = MAX(*ops_alloc * 2, 8);
+		program->ops = zbx_realloc(program->ops, *ops_alloc * sizeof(zbx_exp_op_t));
+	}
+
+	program->ops[program->ops_num++] = *op;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: exp_tokenize                                                     *
+ *                                                                            *
+ * Purpose: split an expression without spaces into operands, operators and  *
+ *          brackets                                                          *
+ *                                                                            *
+ * Parameters: exp     - [IN] the expression                                  *
+ *             program - [IN/OUT] functions and user macros of the expression *
+ *                                are registered in the program               *
+ *             tokens  - [OUT] the tokens, unary signs are folded into the    *
+ *                             following operand or '('                       *
+ *                                                                            *
+ * Return value: SUCCEED - the expression was split, FAIL - it contains       *
+ *               something the compiler does not support                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	exp_tokenize(const char *exp, zbx_exp_program_t *program, zbx_exp_op_t **tokens, int *tokens_num)
+{
+	zbx_exp_op_t	token;
+	const char	*p = exp, *end;
+	char		buffer[MAX_STRING_LEN];
+	int		tokens_alloc = 0, stack_alloc = 0, stack_num = 0, *stack = NULL, neg = 0, operand = 0, i,
+			ret = FAIL;
+	size_t		len;
+	zbx_uint64_t	functionid;
+
+	*tokens = NULL;
+	*tokens_num = 0;
+
+	while ('\0' != *p)
+	{
+		memset(&token, 0, sizeof(token));
+
+		if (0 == operand)
+		{
+			/* an operand or '(' is expected, signs before it are unary */
+			if ('-' == *p || '+' == *p)
+			{
+				if ('-' == *p)
+					neg++;
+				p++;
+				continue;
+			}
+
+			if ('(' == *p)
+			{
+				token.type = ZBX_EXP_LEFT;
+				p++;
+
+				if (stack_num == stack_alloc)
+				{
+					stack_alloc = MAX(stack_alloc * 2, 8);
+					stack = zbx_realloc(stack, stack_alloc * sizeof(int));
+				}
+				stack[stack_num++] = *tokens_num;
+			}
+			else if ('{' == *p)
+			{
+				if (NULL == (end = strchr(p, '}')) || (len = end - p + 1) >= sizeof(buffer))
+					goto out;
+
+				memcpy(buffer, p, len);
+				buffer[len] = '\0';
+				p = end + 1;
+
+				if (0 == strcmp(buffer, MVAR_TRIGGER_VALUE))
+					token.type = ZBX_EXP_TRIGGER_VALUE;
+				else if (0 == strncmp(buffer, "{$", 2))
+				{
+					for (i = 0; i < program->macros_num && 0 != strcmp(program->macros[i], buffer); i++)
+						;
+
+					if (i == program->macros_num)
+					{
+						program->macros = zbx_realloc(program->macros,
+								(program->macros_num + 1) * sizeof(char *));
+						program->macros[program->macros_num++] = zbx_strdup(NULL, buffer);
+					}
+
+					token.type = ZBX_EXP_MACRO;
+					token.index = i;
+				}
+				else
+				{
+					buffer[len - 1] = '\0';
+
+					if ('\0' == buffer[1] || MAX_ID_LEN <= strlen(buffer + 1) ||
+							SUCCEED != is_uint(buffer + 1))
+					{
+						goto out;
+					}
+
+					ZBX_STR2UINT64(functionid, buffer + 1);
+
+					for (i = 0; i < program->functionids_num && functionid != program->functionids[i]; i++)
+						;
+
+					if (i == program->functionids_num)
+					{
+						program->functionids = zbx_realloc(program->functionids,
+								(program->functionids_num + 1) * sizeof(zbx_uint64_t));
+						program->functionids[program->functionids_num++] = functionid;
+					}
+
+					token.type = ZBX_EXP_FUNCTION;
+					token.index = i;
+				}
+
+				operand = 1;
+			}
+			else
+			{
+				for (end = p; ('0' <= *end && '9' >= *end) || '.' == *end; end++)
+					;
+
+				if (end != p && '\0' != *end && NULL != strchr("KMGTsmhdw", *end))
+					end++;
+
+				if (end == p || (len = end - p) >= sizeof(buffer))
+					goto out;
+
+				memcpy(buffer, p, len);
+				buffer[len] = '\0';
+				p = end;
+
+				if (SUCCEED != is_double_prefix(buffer))
+					goto out;
+
+				token.type = ZBX_EXP_CONST;
+				token.value = str2double(buffer);
+				operand = 1;
+			}
+
+			token.neg = (unsigned char)(neg % 2);
+			neg = 0;
+		}
+		else
+		{
+			/* an operator or ')' is expected */
+			if (')' == *p)
+			{
+				if (0 == stack_num)
+					goto out;
+
+				(*tokens)[stack[--stack_num]].index = *tokens_num;
+				token.type = ZBX_EXP_RIGHT;
+			}
+			else if (NULL != strchr(exp_operators, *p))
+			{
+				token.type = ZBX_EXP_OPERATOR;
+				token.op = *p;
+				operand = 0;
+			}
+			else
+				goto out;
+
+			p++;
+		}
+
+		if (*tokens_num == tokens_alloc)
+		{
+			tokens_alloc = MAX(tokens_alloc * 2, 16);
+			*tokens = zbx_realloc(*tokens, tokens_alloc * sizeof(zbx_exp_op_t));
+		}
+
+		(*tokens)[(*tokens_num)++] = token;
+	}
+
+	if (0 == stack_num && 1 == operand)
+		ret = SUCCEED;
+out:
+	zbx_free(stack);
+
+	if (SUCCEED != ret)
+		zbx_free(*tokens);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: exp_compile                                                      *
+ *                                                                            *
+ * Purpose: compile tokens l..r into postfix operations                       *
+ *                                                                            *
+ * Return value: SUCCEED - compiled successfully, FAIL - otherwise            *
+ *                                                                            *
+ * Comments: the expression is split at the operators exactly the way         *
+ *           evaluate_simple() does it, so that the programs give the same    *
+ *           results as the text based evaluation. Recursive function.       *
+ *                                                                            *
+ ******************************************************************************/
+static int	exp_compile(const zbx_exp_op_t *tokens, int l, int r, zbx_exp_program_t *program, int *ops_alloc)
+{
+	zbx_exp_op_t	op;
+	const char	*o;
+	int		i, split = -1;
+
+	if (l > r)
+		return FAIL;
+
+	/* a bracketed subexpression is an operand */
+	if (ZBX_EXP_LEFT == tokens[l].type && tokens[l].index == r)
+	{
+		if (SUCCEED != exp_compile(tokens, l + 1, r - 1, program, ops_alloc))
+			return FAIL;
+
+		if (0 != tokens[l].neg)
+		{
+			memset(&op, 0, sizeof(op));
+			op.type = ZBX_EXP_NEG;
+			exp_program_add_op(program, ops_alloc, &op);
+		}
+
+		return SUCCEED;
+	}
+
+	if (l == r)
+	{
+		if (ZBX_EXP_OPERATOR == tokens[l].type || ZBX_EXP_LEFT == tokens[l].type ||
+				ZBX_EXP_RIGHT == tokens[l].type)
+		{
+			return FAIL;
+		}
+
+		op = tokens[l];
+		op.neg = 0;
+		exp_program_add_op(program, ops_alloc, &op);
+
+		if (0 != tokens[l].neg)
+		{
+			memset(&op, 0, sizeof(op));
+			op.type = ZBX_EXP_NEG;
+			exp_program_add_op(program, ops_alloc, &op);
+		}
+
+		return SUCCEED;
+	}
+
+	for (o = exp_operators; '\0' != *o && -1 == split; o++)
+	{
+		for (i = l; i <= r; i++)
+		{
+			if (ZBX_EXP_LEFT == tokens[i].type)
+				i = tokens[i].index;
+			else if (ZBX_EXP_OPERATOR == tokens[i].type && *o == tokens[i].op)
+			{
+				split = i;
+
+				if ('-' != *o && '/' != *o)
+					break;
+			}
+		}
+	}
+
+	if (-1 == split)
+		return FAIL;
+
+	if (SUCCEED != exp_compile(tokens, l, split - 1, program, ops_alloc) ||
+			SUCCEED != exp_compile(tokens, split + 1, r, program, ops_alloc))
+	{
+		return FAIL;
+	}
+
+	exp_program_add_op(program, ops_alloc, &tokens[split]);
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: exp_programs_prune                                               *
+ *                                                                            *
+ * Purpose: forget the programs of triggers removed from the configuration    *
+ *          cache                                                             *
+ *                                                                            *
+ * Comments: the cache is asked at most once a second, the programs are      *
+ *           looked through only after triggers have been removed from it     *
+ *                                                                            *
+ ******************************************************************************/
+static void	exp_programs_prune()
+{
+	const char		*__function_name = "exp_programs_prune";
+	zbx_exp_program_t	*program;
+	zbx_hashset_iter_t	iter;
+	zbx_vector_uint64_t	triggerids;
+	unsigned int		revision;
+	time_t			now;
+	int			i;
+
+	if (exp_programs_checked == (now = time(NULL)))
+		return;
+
+	exp_programs_checked = now;
+
+	if (exp_programs_revision == (revision = DCconfig_get_triggers_revision()))
+		return;
+
+	exp_programs_revision = revision;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() programs:%d", __function_name, exp_programs.num_data);
+
+	zbx_vector_uint64_create(&triggerids);
+	zbx_vector_uint64_reserve(&triggerids, exp_programs.num_data);
+
+	zbx_hashset_iter_reset(&exp_programs, &iter);
+
+	while (NULL != (program = zbx_hashset_iter_next(&iter)))
+		zbx_vector_uint64_append(&triggerids, program->triggerid);
+
+	DCconfig_get_removed_triggerids(&triggerids);
+
+	for (i = 0; i < triggerids.values_num; i++)
+	{
+		program = zbx_hashset_search(&exp_programs, &triggerids.values[i]);
+		exp_program_clean(program);
+		zbx_hashset_remove(&exp_programs, &triggerids.values[i]);
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() removed:%d", __function_name, triggerids.values_num);
+
+	zbx_vector_uint64_destroy(&triggerids);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: get_expression_program                                           *
+ *                                                                            *
+ * Purpose: get the compiled program of a trigger expression                  *
+ *                                                                            *
+ * Parameters: triggerid  - [IN] trigger identificator                        *
+ *             expression - [IN] short trigger expression                     *
+ *                                                                            *
+ * Return value: the program or NULL if the expression cannot be compiled    *
+ *                                                                            *
+ * Comments: a program is compiled again when the expression of the trigger   *
+ *           changes and is dropped when the trigger leaves the cache         *
+ *                                                                            *
+ ******************************************************************************/
+static const zbx_exp_program_t	*get_expression_program(zbx_uint64_t triggerid, const char *expression)
+{
+	const char		*__function_name = "get_expression_program";
+	zbx_exp_program_t	program_local, *program;
+	zbx_exp_op_t		*tokens;
+	char			*exp;
+	int			tokens_num, ops_alloc = 0, ret = FAIL;
+
+	if (0 == exp_programs_init)
+	{
+		zbx_hashset_create(&exp_programs, 1000, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+		exp_programs_init = 1;
+	}
+	else
+		exp_programs_prune();
+
+	if (NULL != (program = zbx_hashset_search(&exp_programs, &triggerid)))
+	{
+		if (0 == strcmp(program->source, expression))
+			return (NULL != program->ops ? program : NULL);
+
+		exp_program_clean(program);
+		zbx_hashset_remove(&exp_programs, &triggerid);
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() triggerid:" ZBX_FS_UI64 " expression:'%s'",
+			__function_name, triggerid, expression);
+
+	memset(&program_local, 0, sizeof(program_local));
+	program_local.triggerid = triggerid;
+	program_local.source = zbx_strdup(NULL, expression);
+
+	exp = zbx_strdup(NULL, expression);
+	zbx_remove_spaces(exp);
+
+	if (SUCCEED == exp_tokenize(exp, &program_local, &tokens, &tokens_num))
+	{
+		ret = exp_compile(tokens, 0, tokens_num - 1, &program_local, &ops_alloc);
+		zbx_free(tokens);
+	}
+
+	zbx_free(exp);
+
+	/* the expressions which cannot be compiled are remembered too, so that they are not compiled again */
+	if (SUCCEED != ret)
+	{
+		zbx_free(program_local.ops);
+		program_local.ops_num = 0;
+	}
+
+	program = zbx_hashset_insert(&exp_programs, &program_local, sizeof(program_local));
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s ops:%d functions:%d", __function_name, zbx_result_string(ret),
+			program->ops_num, program->functionids_num);
+
+	return (NULL != program->ops ? program : NULL);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: evaluate_program_functions                                       *
+ *                                                                            *
+ * Purpose: evaluate the functions of a compiled trigger expression           *
+ *                                                                            *
+ * Parameters: program   - [IN] the program                                   *
+ *             now       - [IN] time of the evaluation                        *
+ *             values    - [OUT] values of the function slots                 *
+ *             error     - [OUT] place error message if any                   *
+ *             maxerrlen - [IN] max length of error message                   *
+ *                                                                            *
+ * Return value: SUCCEED - all the functions were evaluated,                  *
+ *               FAIL - otherwise, error is empty if a value is not numeric   *
+ *                                                                            *
+ * Comments: the functions of the expression are fetched with one query, the  *
+ *           errors are checked in the order of the functions in the          *
+ *           expression, like substitute_functions() does                     *
+ *                                                                            *
+ ******************************************************************************/
+static int	evaluate_program_functions(const zbx_exp_program_t *program, time_t now, double *values,
+		char *error, int maxerrlen)
+{
+	DB_RESULT	result;
+	DB_ROW		row;
+	DB_ITEM		item;
+	char		*sql = NULL, value[MAX_BUFFER_LEN], function_error[MAX_STRING_LEN];
+	int		sql_alloc = 1024, sql_offset = 0, i, error_slot, *found;
+	zbx_uint64_t	functionid;
+
+	found = zbx_malloc(NULL, program->functionids_num * sizeof(int));
+	memset(found, 0, program->functionids_num * sizeof(int));
+	error_slot = program->functionids_num;
+
+	sql = zbx_malloc(sql, sql_alloc);
+
+	zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 1024,
+			"select distinct %s,f.function,f.parameter,h.status,f.functionid from %s,functions f"
+			" where i.hostid=h.hostid and i.itemid=f.itemid and",
+			ZBX_SQL_ITEM_FIELDS,
+			ZBX_SQL_ITEM_TABLES);
+
+	DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "f.functionid",
+			program->functionids, program->functionids_num);
+
+	result = DBselect("%s", sql);
+
+	while (NULL != (row = DBfetch(result)))
+	{
+		const char	*function, *parameter;
+		unsigned char	host_status;
+
+		ZBX_STR2UINT64(functionid, row[ZBX_SQL_ITEM_FIELDS_NUM + 3]);
+
+		for (i = 0; i < program->functionids_num && functionid != program->functionids[i]; i++)
+			;
+
+		if (i == program->functionids_num)
+			continue;
+
+		found[i] = 1;
+
+		DBget_item_from_db(&item, row);
+
+		function = row[ZBX_SQL_ITEM_FIELDS_NUM];
+		parameter = row[ZBX_SQL_ITEM_FIELDS_NUM + 1];
+		host_status = (unsigned char)atoi(row[ZBX_SQL_ITEM_FIELDS_NUM + 2]);
+
+		*function_error = '\0';
+
+		if (ITEM_STATUS_DISABLED == item.status)
+			zbx_snprintf(function_error, sizeof(function_error), "Item disabled for function: {%s:%s.%s(%s)}",
+					item.host_name, item.key, function, parameter);
+		else if (ITEM_STATUS_NOTSUPPORTED == item.status)
+			zbx_snprintf(function_error, sizeof(function_error), "Item not supported for function: {%s:%s.%s(%s)}",
+					item.host_name, item.key, function, parameter);
+
+		if ('\0' == *function_error && HOST_STATUS_NOT_MONITORED == host_status)
+			zbx_snprintf(function_error, sizeof(function_error), "Host disabled for function: {%s:%s.%s(%s)}",
+					item.host_name, item.key, function, parameter);
+
+		if ('\0' == *function_error && SUCCEED != evaluate_function(value, &item, function, parameter, now))
+			zbx_snprintf(function_error, sizeof(function_error), "Evaluation failed for function: {%s:%s.%s(%s)}",
+					item.host_name, item.key, function, parameter);
+
+		/* values which are not numbers are left to the text based evaluation */
+		if ('\0' == *function_error && ('\0' == *value || SUCCEED != is_double_prefix(value)))
+			*function_error = ' ';
+
+		if ('\0' == *function_error)
+			values[i] = str2double(value);
+		else if (i < error_slot)
+		{
+			error_slot = i;
+			zbx_strlcpy(error, ' ' == *function_error ? "" : function_error, maxerrlen);
+		}
+	}
+	DBfree_result(result);
+
+	zbx_free(sql);
+
+	for (i = 0; i < error_slot; i++)
+	{
+		if (0 == found[i])
+		{
+			error_slot = i;
+			zbx_snprintf(error, maxerrlen, "Could not obtain function and item for functionid: " ZBX_FS_UI64,
+					program->functionids[i]);
+			break;
+		}
+	}
+
+	zbx_free(found);
+
+	return (error_slot == program->functionids_num ? SUCCEED : FAIL);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: evaluate_program                                                 *
+ *                                                                            *
+ * Purpose: evaluate a compiled trigger expression                            *
+ *                                                                            *
+ * Parameters: program       - [IN] the program                               *
+ *             value         - [OUT] value of the expression                  *
+ *             now           - [IN] time of the evaluation                    *
+ *             trigger_value - [IN] current trigger value                     *
+ *             error         - [OUT] place error message if any               *
+ *             maxerrlen     - [IN] max length of error message               *
+ *                                                                            *
+ * Return value: SUCCEED - evaluated successfully,                            *
+ *               FAIL - otherwise, error is empty if the expression must be   *
+ *                      evaluated as text to get the exact error message      *
+ *                                                                            *
+ ******************************************************************************/
+static int	evaluate_program(const zbx_exp_program_t *program, double *value, time_t now, int trigger_value,
+		char *error, int maxerrlen)
+{
+	static double	*stack = NULL, *slots = NULL, *macro_values = NULL;
+	static int	stack_alloc = 0, slots_alloc = 0, macro_values_alloc = 0;
+	const zbx_exp_op_t	*op;
+	char		*replace_to = NULL;
+	double		v1, v2;
+	int		i, stack_num = 0;
+
+	*error = '\0';
+
+	if (stack_alloc < program->ops_num)
+	{
+		stack_alloc = program->ops_num;
+		stack = zbx_realloc(stack, stack_alloc * sizeof(double));
+	}
+
+	if (slots_alloc < program->functionids_num)
+	{
+		slots_alloc = program->functionids_num;
+		slots = zbx_realloc(slots, slots_alloc * sizeof(double));
+	}
+
+	if (macro_values_alloc < program->macros_num)
+	{
+		macro_values_alloc = program->macros_num;
+		macro_values = zbx_realloc(macro_values, macro_values_alloc * sizeof(double));
+	}
+
+	if (0 != program->macros_num && NULL == macros)
+		zbxmacros_init(&macros);
+
+	for (i = 0; i < program->macros_num; i++)
+	{
+		zbxmacros_get_value_by_triggerid(macros, program->triggerid, program->macros[i], &replace_to);
+
+		if (NULL == replace_to || '\0' == *replace_to || SUCCEED != is_double_prefix(replace_to))
+		{
+			zbx_free(replace_to);
+			return FAIL;
+		}
+
+		macro_values[i] = str2double(replace_to);
+		zbx_free(replace_to);
+	}
+
+	if (0 != program->functionids_num &&
+			SUCCEED != evaluate_program_functions(program, now, slots, error, maxerrlen))
+	{
+		return FAIL;
+	}
+
+	for (op = program->ops; op < program->ops + program->ops_num; op++)
+	{
+		switch (op->type)
+		{
+			case ZBX_EXP_CONST:
+				stack[stack_num++] = op->value;
+				continue;
+			case ZBX_EXP_FUNCTION:
+				stack[stack_num++] = slots[op->index];
+				continue;
+			case ZBX_EXP_TRIGGER_VALUE:
+				stack[stack_num++] = trigger_value;
+				continue;
+			case ZBX_EXP_MACRO:
+				stack[stack_num++] = macro_values[op->index];
+				continue;
+			case ZBX_EXP_NEG:
+				stack[stack_num - 1] = -stack[stack_num - 1];
+				continue;
+		}
+
+		v2 = stack[--stack_num];
+		v1 = stack[stack_num - 1];
+
+		switch (op->op)
+		{
+			case '|':
+				v1 = (0 != cmp_double(v1, 0) || 0 != cmp_double(v2, 0));
+				break;
+			case '&':
+				v1 = (0 != cmp_double(v1, 0) && 0 != cmp_double(v2, 0));
+				break;
+			case '=':
+				v1 = (0 == cmp_double(v1, v2));
+				break;
+			case '#':
+				v1 = (0 != cmp_double(v1, v2));
+				break;
+			case '>':
+				v1 = (v1 > v2);
+				break;
+			case '<':
+				v1 = (v1 < v2);
+				break;
+			case '+':
+				v1 += v2;
+				break;
+			case '-':
+				v1 -= v2;
+				break;
+			case '*':
+				v1 *= v2;
+				break;
+			case '/':
+				if (0 == cmp_double(v2, 0))
+					return FAIL;
+
+				v1 /= v2;
+				break;
+		}
+
+		stack[stack_num - 1] = v1;
+	}
+
+	*value = stack[0];
+
+	return SUCCEED;
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: evaluate_expression                                              *
@@ -2273,11 +3023,27 @@ int	evaluate_expression(int *result, char **expression, time_t now,
 	const char		*__function_name = "evaluate_expression";
 	/* Required for substitution of macros */
 	DB_EVENT		event;
+	const zbx_exp_program_t	*program;
 	int			ret = FAIL;
 	double			value;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() expression:'%s'", __function_name, *expression);
 
+	if (NULL != (program = get_expression_program(triggerid, *expression)))
+	{
+		if (SUCCEED == evaluate_program(program, &value, now, trigger_value, error, maxerrlen))
+		{
+			*result = (0 == cmp_double(value, 0) ? TRIGGER_VALUE_FALSE : TRIGGER_VALUE_TRUE);
+
+			zabbix_log(LOG_LEVEL_DEBUG, "%s() result:%d", __function_name, *result);
+			ret = SUCCEED;
+			goto out;
+		}
+
+		if ('\0' != *error)
+			goto out;
+	}
+
 	/* Substitute macros first */
 	memset(&event, 0, sizeof(DB_EVENT));
 	event.source = EVENT_SOURCE_TRIGGERS;
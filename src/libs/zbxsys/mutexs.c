@@ -96,7 +96,11 @@ int zbx_mutex_create_ext(ZBX_MUTEX *mutex, ZBX_MUTEX_NAME name, unsigned char fo
 	}
 
 lbl_create:
-	if (-1 != ZBX_SEM_LIST_ID || -1 != (ZBX_SEM_LIST_ID = semget(sem_key, ZBX_MUTEX_COUNT, IPC_CREAT | IPC_EXCL | 0600 /* 0022 */)) )
+	/* the set is initialized once, so that creating a mutex does not reset the ones in use */
+	if (-1 != ZBX_SEM_LIST_ID)
+		goto lbl_return;
+
+	if (-1 != (ZBX_SEM_LIST_ID = semget(sem_key, ZBX_MUTEX_COUNT, IPC_CREAT | IPC_EXCL | 0600 /* 0022 */)))
 	{
 		/* set default semaphore value */
 		semopts.val = 1;
@@ -316,6 +320,133 @@ int	zbx_mutex_destroy(ZBX_MUTEX *mutex)
 	return ZBX_MUTEX_OK;
 }
 
+#if !defined(_WINDOWS)
+
+static void	zbx_rwlock_semop(const char *filename, int line, struct sembuf *ops, int ops_num, const char *action)
+{
+	while (-1 == semop(ZBX_SEM_LIST_ID, ops, ops_num))
+	{
+		if (EINTR != errno)
+		{
+			zbx_error("[file:'%s',line:%d] %s failed [%s]", filename, line, action, strerror(errno));
+			exit(FAIL);
+		}
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_rwlock_create                                                *
+ *                                                                            *
+ * Purpose: create a lock that many readers or a single writer can hold       *
+ *                                                                            *
+ * Parameters: rwlock  - [OUT] the lock                                       *
+ *             readers - [IN] semaphore counting free reader places           *
+ *             writers - [IN] semaphore counting writers                      *
+ *                                                                            *
+ * Return value: ZBX_MUTEX_OK on success, ZBX_MUTEX_ERROR otherwise           *
+ *                                                                            *
+ * Comments: A reader waits for the writers semaphore to be zero and takes    *
+ *           one place in a single semop(). A writer first announces itself   *
+ *           in the writers semaphore. This stops new readers. It then takes  *
+ *           all the places, which waits until the readers inside have left.  *
+ *           So writers are not starved by a steady stream of readers. The    *
+ *           lock is not recursive.                                           *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_rwlock_create(ZBX_RWLOCK *rwlock, ZBX_MUTEX_NAME readers, ZBX_MUTEX_NAME writers)
+{
+	union semun	semopts;
+
+	if (ZBX_MUTEX_ERROR == zbx_mutex_create_force(&rwlock->readers, readers))
+		return ZBX_MUTEX_ERROR;
+
+	if (ZBX_MUTEX_ERROR == zbx_mutex_create_force(&rwlock->writers, writers))
+		return ZBX_MUTEX_ERROR;
+
+	semopts.val = ZBX_RWLOCK_READERS_MAX;
+
+	if (-1 == semctl(ZBX_SEM_LIST_ID, readers, SETVAL, semopts))
+	{
+		zbx_error("Semaphore [%i] error in semctl(SETVAL) [%s]", readers, strerror(errno));
+		return ZBX_MUTEX_ERROR;
+	}
+
+	semopts.val = 0;
+
+	if (-1 == semctl(ZBX_SEM_LIST_ID, writers, SETVAL, semopts))
+	{
+		zbx_error("Semaphore [%i] error in semctl(SETVAL) [%s]", writers, strerror(errno));
+		return ZBX_MUTEX_ERROR;
+	}
+
+	return ZBX_MUTEX_OK;
+}
+
+void	__zbx_rwlock_rdlock(const char *filename, int line, ZBX_RWLOCK *rwlock)
+{
+	struct sembuf	ops[2] = {{0, 0, 0}, {0, -1, SEM_UNDO}};
+
+	if (!rwlock->readers)
+		return;
+
+	ops[0].sem_num = rwlock->writers;
+	ops[1].sem_num = rwlock->readers;
+
+	zbx_rwlock_semop(filename, line, ops, 2, "Read lock");
+}
+
+void	__zbx_rwlock_rdunlock(const char *filename, int line, ZBX_RWLOCK *rwlock)
+{
+	struct sembuf	ops[1] = {{0, 1, SEM_UNDO}};
+
+	if (!rwlock->readers)
+		return;
+
+	ops[0].sem_num = rwlock->readers;
+
+	zbx_rwlock_semop(filename, line, ops, 1, "Read unlock");
+}
+
+void	__zbx_rwlock_wrlock(const char *filename, int line, ZBX_RWLOCK *rwlock)
+{
+	struct sembuf	ops[1] = {{0, 1, SEM_UNDO}};
+
+	if (!rwlock->readers)
+		return;
+
+	ops[0].sem_num = rwlock->writers;
+
+	zbx_rwlock_semop(filename, line, ops, 1, "Write lock");
+
+	ops[0].sem_num = rwlock->readers;
+	ops[0].sem_op = -ZBX_RWLOCK_READERS_MAX;
+
+	zbx_rwlock_semop(filename, line, ops, 1, "Write lock");
+}
+
+void	__zbx_rwlock_wrunlock(const char *filename, int line, ZBX_RWLOCK *rwlock)
+{
+	struct sembuf	ops[2] = {{0, ZBX_RWLOCK_READERS_MAX, SEM_UNDO}, {0, -1, SEM_UNDO}};
+
+	if (!rwlock->readers)
+		return;
+
+	ops[0].sem_num = rwlock->readers;
+	ops[1].sem_num = rwlock->writers;
+
+	zbx_rwlock_semop(filename, line, ops, 2, "Write unlock");
+}
+
+int	zbx_rwlock_destroy(ZBX_RWLOCK *rwlock)
+{
+	zbx_mutex_destroy(&rwlock->writers);
+
+	return zbx_mutex_destroy(&rwlock->readers);
+}
+
+#endif	/* not _WINDOWS */
+
 #if defined(HAVE_SQLITE3)
 
 /*
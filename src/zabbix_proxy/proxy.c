@@ -113,6 +113,7 @@ int	CONFIG_TIMER_FORKS		= 0;
 int	CONFIG_NODEWATCHER_FORKS	= 0;
 int	CONFIG_WATCHDOG_FORKS		= 0;
 int	CONFIG_HEARTBEAT_FORKS		= 1;
+int	CONFIG_DBWRITER_FORKS		= 0;
 
 int	CONFIG_LISTEN_PORT		= 10051;
 char	*CONFIG_LISTEN_IP		= NULL;
@@ -131,12 +132,21 @@ int	CONFIG_PROXYDATA_FREQUENCY	= 1;
 int	CONFIG_SENDER_FREQUENCY		= 30;
 int	CONFIG_HISTSYNCER_FORKS		= 4;
 int	CONFIG_HISTSYNCER_FREQUENCY	= 5;
+int	CONFIG_HISTSYNCER_BATCH_SIZE	= 1000;
 int	CONFIG_CONFSYNCER_FORKS		= 1;
 int	CONFIG_CONFSYNCER_FREQUENCY	= 60;
 int	CONFIG_CONF_CACHE_SIZE		= 8388608;	/* 8MB */
 int	CONFIG_HISTORY_CACHE_SIZE	= 8388608;	/* 8MB */
 int	CONFIG_TRENDS_CACHE_SIZE	= 4194304;	/* 4MB */
 int	CONFIG_TEXT_CACHE_SIZE		= 16777216;	/* 16MB */
+int	CONFIG_LASTVALUE_CACHE_SIZE	= 8388608;	/* 8MB */
+int	CONFIG_LASTVALUE_FLUSH_FREQUENCY	= 30;
+int	CONFIG_VALUE_CACHE_SIZE		= 8388608;	/* 8MB */
+int	CONFIG_HISTORY_CACHE_SHARDS	= 1;
+char	*CONFIG_HISTORY_JOURNAL_DIR	= NULL;
+int	CONFIG_HISTORY_JOURNAL_HIGH_WATER	= 80;		/* % of HistoryCacheSize and HistoryTextCacheSize */
+int	CONFIG_HISTORY_JOURNAL_SEGMENT_SIZE	= 16777216;	/* 16MB */
+char	*CONFIG_CONF_CACHE_SNAPSHOT_FILE	= NULL;
 int	CONFIG_UNREACHABLE_PERIOD	= 45;
 int	CONFIG_UNREACHABLE_DELAY	= 15;
 int	CONFIG_UNAVAILABLE_DELAY	= 60;
@@ -215,6 +225,8 @@ static void	init_config()
 			TYPE_STRING,	PARM_OPT,	0,			0},
 		{"StartDBSyncers",		&CONFIG_HISTSYNCER_FORKS,		NULL,
 			TYPE_INT,	PARM_OPT,	1,			100},
+		{"HistorySyncBatchSize",	&CONFIG_HISTSYNCER_BATCH_SIZE,		NULL,
+			TYPE_INT,	PARM_OPT,	100,			100000},
 		{"StartDiscoverers",		&CONFIG_DISCOVERER_FORKS,		NULL,
 			TYPE_INT,	PARM_OPT,	0,			250},
 		{"StartHTTPPollers",		&CONFIG_HTTPPOLLER_FORKS,		NULL,
@@ -237,6 +249,14 @@ static void	init_config()
 			TYPE_INT,	PARM_OPT,	128 * ZBX_KIBIBYTE,	ZBX_GIBIBYTE},
 		{"HistoryTextCacheSize",	&CONFIG_TEXT_CACHE_SIZE,		NULL,
 			TYPE_INT,	PARM_OPT,	128 * ZBX_KIBIBYTE,	ZBX_GIBIBYTE},
+		{"HistoryCacheShards",		&CONFIG_HISTORY_CACHE_SHARDS,		NULL,
+			TYPE_INT,	PARM_OPT,	1,			ZBX_HISTORY_SHARDS_MAX},
+		{"HistoryJournalDir",		&CONFIG_HISTORY_JOURNAL_DIR,		NULL,
+			TYPE_STRING,	PARM_OPT,	0,			0},
+		{"HistoryJournalHighWater",	&CONFIG_HISTORY_JOURNAL_HIGH_WATER,	NULL,
+			TYPE_INT,	PARM_OPT,	1,			100},
+		{"HistoryJournalSegmentSize",	&CONFIG_HISTORY_JOURNAL_SEGMENT_SIZE,	NULL,
+			TYPE_INT,	PARM_OPT,	ZBX_MEBIBYTE,		ZBX_GIBIBYTE},
 		{"CacheUpdateFrequency",	&CONFIG_CONFSYNCER_FREQUENCY,		NULL,
 			TYPE_INT,	PARM_OPT,	1,			SEC_PER_HOUR},
 		{"HousekeepingFrequency",	&CONFIG_HOUSEKEEPING_FREQUENCY,		NULL,
@@ -508,11 +528,15 @@ int	MAIN_ZABBIX_ENTRY()
 	DBinit();
 
 	init_database_cache(zbx_process);
-	init_configuration_cache();
+	init_configuration_cache(zbx_process);
 	init_selfmon_collector();
 
 	DBconnect(ZBX_DB_CONNECT_EXIT);
 	DCsync_configuration();
+
+	/* values spilled to the journal before the last shutdown go first */
+	DCsync_history_journal();
+
 	DBclose();
 
 	threads_num = 1 + CONFIG_CONFSYNCER_FORKS + CONFIG_DATASENDER_FORKS + CONFIG_POLLER_FORKS
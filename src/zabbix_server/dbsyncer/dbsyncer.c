@@ -32,6 +32,8 @@ extern int		ZBX_SYNC_MAX;
 extern unsigned char	process_type;
 extern int		process_num;
 
+#define ZBX_DBWRITER_IDLE_SLEEP	20000	/* microseconds */
+
 /******************************************************************************
  *                                                                            *
  * Function: main_dbsyncer_loop                                               *
@@ -118,3 +120,49 @@ void	main_dbsyncer_loop()
 		zbx_sleep_loop(sleeptime);
 	}
 }
+
+/******************************************************************************
+ *                                                                            *
+ * Function: main_dbwriter_loop                                               *
+ *                                                                            *
+ * Purpose: inserts history values queued by history syncers                  *
+ *                                                                            *
+ * Comments: never returns                                                    *
+ *                                                                            *
+ ******************************************************************************/
+void	main_dbwriter_loop()
+{
+	int	num;
+	double	sec;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In main_dbwriter_loop() process_num:%d", process_num);
+
+	set_child_signal_handler();
+
+	zbx_setproctitle("%s [connecting to the database]", get_process_type_string(process_type));
+
+	DBconnect(ZBX_DB_CONNECT_NORMAL);
+
+	DCstart_write_queue();
+
+	for (;;)
+	{
+		zbx_setproctitle("%s [writing history]", get_process_type_string(process_type));
+
+		sec = zbx_time();
+		num = DCwrite_history();
+		sec = zbx_time() - sec;
+
+		zabbix_log(LOG_LEVEL_DEBUG, "%s #%d spent " ZBX_FS_DBL " seconds while writing %d values",
+				get_process_type_string(process_type), process_num, sec, num);
+
+		if (0 != num)
+			continue;
+
+		/* a short nap, syncers hand over batches much more often than they sleep */
+		update_selfmon_counter(ZBX_PROCESS_STATE_IDLE);
+		zbx_setproctitle("%s [idle]", get_process_type_string(process_type));
+		usleep(ZBX_DBWRITER_IDLE_SLEEP);
+		update_selfmon_counter(ZBX_PROCESS_STATE_BUSY);
+	}
+}
@@ -299,8 +299,8 @@ int	process_event(DB_EVENT *event, int force_actions)
 	if (0 == event->eventid)
 		event->eventid = DBget_maxid("events");
 
-	DBexecute("insert into events (eventid,source,object,objectid,clock,value)"
-			" values (" ZBX_FS_UI64 ",%d,%d," ZBX_FS_UI64 ",%d,%d)",
+	DBexecute_prepared("insert into events (eventid,source,object,objectid,clock,value)"
+			" values (?,?,?,?,?,?)", "uiiuii",
 			event->eventid,
 			event->source,
 			event->object,
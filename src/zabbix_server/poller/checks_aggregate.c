@@ -145,9 +145,11 @@ static int	evaluate_aggregate(AGENT_RESULT *res, char *grpfunc,
 	DB_RESULT	result;
 	DB_ROW		row;
 
+	DB_ITEM		item;
 	unsigned char	valuetype;
 	double		d = 0;
 	const char	*value;
+	char		cached[MAX_STRING_LEN];
 	int		num = 0;
 	int		now;
 	int		ret = FAIL;
@@ -174,8 +176,7 @@ static int	evaluate_aggregate(AGENT_RESULT *res, char *grpfunc,
 		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 256,
 				"select itemid,value_type,lastvalue"
 				" from items"
-				" where lastvalue is not null"
-					" and value_type in (%d,%d)"
+				" where value_type in (%d,%d)"
 					" and",
 				ITEM_VALUE_TYPE_FLOAT, ITEM_VALUE_TYPE_UINT64);
 		DBadd_condition_alloc(&sql, &sql_alloc, &sql_offset, "itemid", ids, ids_num);
@@ -187,6 +188,29 @@ static int	evaluate_aggregate(AGENT_RESULT *res, char *grpfunc,
 			valuetype = (unsigned char)atoi(row[1]);
 			value = row[2];
 
+			/* numeric last values may not be flushed to the database yet */
+			ZBX_STR2UINT64(item.itemid, row[0]);
+			item.value_type = valuetype;
+
+			if (SUCCEED == DCget_item_lastvalues(&item))
+			{
+				if (1 == item.lastvalue_null)
+					value = NULL;
+				else
+				{
+					if (ITEM_VALUE_TYPE_FLOAT == item.value_type)
+						zbx_snprintf(cached, sizeof(cached), ZBX_FS_DBL, item.lastvalue_dbl);
+					else
+						zbx_snprintf(cached, sizeof(cached), ZBX_FS_UI64, item.lastvalue_uint64);
+					value = cached;
+				}
+			}
+			else if (SUCCEED == DBis_null(value))
+				value = NULL;
+
+			if (NULL == value)
+				continue;
+
 			if (FAIL == evaluate_one(&d, &num, grpfunc, value, valuetype))
 			{
 				SET_MSG_RESULT(res, strdup("Unsupported group function"));
@@ -200,6 +224,9 @@ static int	evaluate_aggregate(AGENT_RESULT *res, char *grpfunc,
 			0 == strcmp(itemfunc, "max") || 0 == strcmp(itemfunc, "min") ||
 			0 == strcmp(itemfunc, "sum"))
 	{
+		/* the last values of the items may still be queued for DB writers */
+		DCwait_queued_history(ids, ids_num);
+
 		sql_offset = 0;
 		zbx_snprintf_alloc(&sql, &sql_alloc, &sql_offset, 256,
 				"select i.itemid,i.value_type,%s(h.value)"
@@ -21,6 +21,7 @@
 #include "checks_internal.h"
 #include "log.h"
 #include "dbcache.h"
+#include "valuecache.h"
 #include "zbxself.h"
 
 /******************************************************************************
@@ -381,6 +382,58 @@ int	get_value_internal(DC_ITEM *item, AGENT_RESULT *result)
 		else
 			goto not_supported;
 	}
+	else if (0 == strcmp(tmp, "vcache"))
+	{
+		int	request;
+		void	*stats;
+
+		if (nparams > 3)
+			goto not_supported;
+
+		if (get_param(params, 2, tmp, sizeof(tmp)) != 0)
+			goto not_supported;
+
+		if (get_param(params, 3, tmp1, sizeof(tmp1)) != 0)
+			*tmp1 = '\0';
+
+		if (0 == strcmp(tmp, "buffer"))
+		{
+			if ('\0' == *tmp1 || 0 == strcmp(tmp1, "pfree"))
+				request = ZBX_VC_STATS_PFREE;
+			else if (0 == strcmp(tmp1, "total"))
+				request = ZBX_VC_STATS_TOTAL;
+			else if (0 == strcmp(tmp1, "used"))
+				request = ZBX_VC_STATS_USED;
+			else if (0 == strcmp(tmp1, "free"))
+				request = ZBX_VC_STATS_FREE;
+			else
+				goto not_supported;
+		}
+		else if (0 == strcmp(tmp, "cache"))
+		{
+			if ('\0' == *tmp1 || 0 == strcmp(tmp1, "hits"))
+				request = ZBX_VC_STATS_HITS;
+			else if (0 == strcmp(tmp1, "misses"))
+				request = ZBX_VC_STATS_MISSES;
+			else if (0 == strcmp(tmp1, "items"))
+				request = ZBX_VC_STATS_ITEMS;
+			else
+				goto not_supported;
+		}
+		else
+			goto not_supported;
+
+		if (NULL == (stats = zbx_vc_get_stats(request)))
+		{
+			error = zbx_strdup(error, "Value cache is disabled");
+			goto not_supported;
+		}
+
+		if (ZBX_VC_STATS_PFREE == request)
+			SET_DBL_RESULT(result, *(double *)stats);
+		else
+			SET_UI64_RESULT(result, *(zbx_uint64_t *)stats);
+	}
 	else
 		goto not_supported;
 
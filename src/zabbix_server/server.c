@@ -23,6 +23,7 @@
 #include "pid.h"
 #include "db.h"
 #include "dbcache.h"
+#include "valuecache.h"
 #include "log.h"
 #include "zbxgetopt.h"
 #include "mutexs.h"
@@ -116,6 +117,7 @@ int	CONFIG_SELFMON_FORKS		= 1;
 int	CONFIG_WATCHDOG_FORKS		= 1;
 int	CONFIG_DATASENDER_FORKS		= 0;
 int	CONFIG_HEARTBEAT_FORKS		= 0;
+int	CONFIG_DBWRITER_FORKS		= 0;
 
 int	CONFIG_LISTEN_PORT		= 10051;
 char	*CONFIG_LISTEN_IP		= NULL;
@@ -127,12 +129,21 @@ int	CONFIG_MAX_HOUSEKEEPER_DELETE	= 500;		/* applies for every separate field va
 int	CONFIG_SENDER_FREQUENCY		= 30;
 int	CONFIG_HISTSYNCER_FORKS		= 4;
 int	CONFIG_HISTSYNCER_FREQUENCY	= 5;
+int	CONFIG_HISTSYNCER_BATCH_SIZE	= 1000;
 int	CONFIG_CONFSYNCER_FORKS		= 1;
 int	CONFIG_CONFSYNCER_FREQUENCY	= 60;
 int	CONFIG_CONF_CACHE_SIZE		= 8388608;	/* 8MB */
 int	CONFIG_HISTORY_CACHE_SIZE	= 8388608;	/* 8MB */
 int	CONFIG_TRENDS_CACHE_SIZE	= 4194304;	/* 4MB */
 int	CONFIG_TEXT_CACHE_SIZE		= 16777216;	/* 16MB */
+int	CONFIG_LASTVALUE_CACHE_SIZE	= 8388608;	/* 8MB */
+int	CONFIG_LASTVALUE_FLUSH_FREQUENCY	= 30;
+int	CONFIG_VALUE_CACHE_SIZE		= 8388608;	/* 8MB */
+int	CONFIG_HISTORY_CACHE_SHARDS	= 1;
+char	*CONFIG_HISTORY_JOURNAL_DIR	= NULL;
+int	CONFIG_HISTORY_JOURNAL_HIGH_WATER	= 80;		/* % of HistoryCacheSize and HistoryTextCacheSize */
+int	CONFIG_HISTORY_JOURNAL_SEGMENT_SIZE	= 16777216;	/* 16MB */
+char	*CONFIG_CONF_CACHE_SNAPSHOT_FILE	= NULL;
 int	CONFIG_DISABLE_HOUSEKEEPING	= 0;
 int	CONFIG_UNREACHABLE_PERIOD	= 45;
 int	CONFIG_UNREACHABLE_DELAY	= 15;
@@ -206,6 +217,10 @@ static void	init_config()
 			TYPE,		MANDATORY,	MIN,			MAX */
 		{"StartDBSyncers",		&CONFIG_HISTSYNCER_FORKS,		NULL,
 			TYPE_INT,	PARM_OPT,	1,			100},
+		{"StartDBWriters",		&CONFIG_DBWRITER_FORKS,			NULL,
+			TYPE_INT,	PARM_OPT,	0,			100},
+		{"HistorySyncBatchSize",	&CONFIG_HISTSYNCER_BATCH_SIZE,		NULL,
+			TYPE_INT,	PARM_OPT,	100,			100000},
 		{"StartDiscoverers",		&CONFIG_DISCOVERER_FORKS,		NULL,
 			TYPE_INT,	PARM_OPT,	0,			250},
 		{"StartHTTPPollers",		&CONFIG_HTTPPOLLER_FORKS,		NULL,
@@ -228,8 +243,24 @@ static void	init_config()
 			TYPE_INT,	PARM_OPT,	128 * ZBX_KIBIBYTE,	ZBX_GIBIBYTE},
 		{"HistoryTextCacheSize",	&CONFIG_TEXT_CACHE_SIZE,		NULL,
 			TYPE_INT,	PARM_OPT,	128 * ZBX_KIBIBYTE,	ZBX_GIBIBYTE},
+		{"LastValueCacheSize",		&CONFIG_LASTVALUE_CACHE_SIZE,		NULL,
+			TYPE_INT,	PARM_OPT,	128 * ZBX_KIBIBYTE,	ZBX_GIBIBYTE},
+		{"LastValueFlushFrequency",	&CONFIG_LASTVALUE_FLUSH_FREQUENCY,	NULL,
+			TYPE_INT,	PARM_OPT,	1,			SEC_PER_HOUR},
+		{"ValueCacheSize",		&CONFIG_VALUE_CACHE_SIZE,		NULL,
+			TYPE_INT,	PARM_OPT,	0,			ZBX_GIBIBYTE},
+		{"HistoryCacheShards",		&CONFIG_HISTORY_CACHE_SHARDS,		NULL,
+			TYPE_INT,	PARM_OPT,	1,			ZBX_HISTORY_SHARDS_MAX},
+		{"HistoryJournalDir",		&CONFIG_HISTORY_JOURNAL_DIR,		NULL,
+			TYPE_STRING,	PARM_OPT,	0,			0},
+		{"HistoryJournalHighWater",	&CONFIG_HISTORY_JOURNAL_HIGH_WATER,	NULL,
+			TYPE_INT,	PARM_OPT,	1,			100},
+		{"HistoryJournalSegmentSize",	&CONFIG_HISTORY_JOURNAL_SEGMENT_SIZE,	NULL,
+			TYPE_INT,	PARM_OPT,	ZBX_MEBIBYTE,		ZBX_GIBIBYTE},
 		{"CacheUpdateFrequency",	&CONFIG_CONFSYNCER_FREQUENCY,		NULL,
 			TYPE_INT,	PARM_OPT,	1,			SEC_PER_HOUR},
+		{"CacheSnapshotFile",		&CONFIG_CONF_CACHE_SNAPSHOT_FILE,	NULL,
+			TYPE_STRING,	PARM_OPT,	0,			0},
 		{"HousekeepingFrequency",	&CONFIG_HOUSEKEEPING_FREQUENCY,		NULL,
 			TYPE_INT,	PARM_OPT,	1,			24},
 		{"MaxHousekeeperDelete",	&CONFIG_MAX_HOUSEKEEPER_DELETE,		NULL,
@@ -359,6 +390,18 @@ static void	init_config()
 
 	if (1 == CONFIG_DISABLE_HOUSEKEEPING)
 		CONFIG_HOUSEKEEPER_FORKS = 0;
+
+#if !defined(HAVE_POSTGRESQL) || !defined(HAVE_BULK_INSERT)
+	/* a syncer waiting for queued values must see them once they are committed, which needs */
+	/* the read committed isolation of PostgreSQL, SQLite serializes writers anyway          */
+	CONFIG_DBWRITER_FORKS = 0;
+#endif
+	/* without the value cache trigger functions would read history which is not written yet */
+	if (0 != CONFIG_DBWRITER_FORKS && 0 == CONFIG_VALUE_CACHE_SIZE)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "StartDBWriters is ignored when ValueCacheSize is 0");
+		CONFIG_DBWRITER_FORKS = 0;
+	}
 }
 
 /******************************************************************************
@@ -534,9 +577,16 @@ int	MAIN_ZABBIX_ENTRY()
 	}
 
 	init_database_cache(ZBX_PROCESS_SERVER);
-	init_configuration_cache();
+	init_configuration_cache(ZBX_PROCESS_SERVER);
+	DCload_configuration_snapshot();
+	zbx_vc_init();
 	init_selfmon_collector();
 
+	/* values spilled to the journal before the last shutdown go first */
+	DCsync_history_journal();
+
+	DCprepare_write_queue();
+
 	/* Need to set trigger status to UNKNOWN since last run */
 	DBupdate_triggers_status_after_restart();
 	DBclose();
@@ -552,7 +602,7 @@ int	MAIN_ZABBIX_ENTRY()
 			+ CONFIG_HOUSEKEEPER_FORKS + CONFIG_TIMER_FORKS + CONFIG_NODEWATCHER_FORKS
 			+ CONFIG_HTTPPOLLER_FORKS + CONFIG_DISCOVERER_FORKS + CONFIG_HISTSYNCER_FORKS
 			+ CONFIG_ESCALATOR_FORKS + CONFIG_IPMIPOLLER_FORKS + CONFIG_PROXYPOLLER_FORKS
-			+ CONFIG_SELFMON_FORKS;
+			+ CONFIG_SELFMON_FORKS + CONFIG_DBWRITER_FORKS;
 	threads = calloc(threads_num, sizeof(pid_t));
 
 	if (CONFIG_TRAPPER_FORKS > 0)
@@ -569,7 +619,7 @@ int	MAIN_ZABBIX_ENTRY()
 			+ CONFIG_HOUSEKEEPER_FORKS + CONFIG_TIMER_FORKS + CONFIG_NODEWATCHER_FORKS
 			+ CONFIG_HTTPPOLLER_FORKS + CONFIG_DISCOVERER_FORKS + CONFIG_HISTSYNCER_FORKS
 			+ CONFIG_ESCALATOR_FORKS + CONFIG_IPMIPOLLER_FORKS + CONFIG_PROXYPOLLER_FORKS
-			+ CONFIG_SELFMON_FORKS; i++)
+			+ CONFIG_SELFMON_FORKS + CONFIG_DBWRITER_FORKS; i++)
 	{
 		if (0 == (pid = zbx_fork()))
 		{
@@ -870,6 +920,31 @@ int	MAIN_ZABBIX_ENTRY()
 
 		main_selfmon_loop();
 	}
+	else if (server_num <= CONFIG_CONFSYNCER_FORKS + CONFIG_POLLER_FORKS
+			+ CONFIG_UNREACHABLE_POLLER_FORKS + CONFIG_TRAPPER_FORKS
+			+ CONFIG_PINGER_FORKS + CONFIG_ALERTER_FORKS
+			+ CONFIG_HOUSEKEEPER_FORKS + CONFIG_TIMER_FORKS
+			+ CONFIG_NODEWATCHER_FORKS + CONFIG_HTTPPOLLER_FORKS
+			+ CONFIG_DISCOVERER_FORKS + CONFIG_HISTSYNCER_FORKS
+			+ CONFIG_ESCALATOR_FORKS + CONFIG_IPMIPOLLER_FORKS
+			+ CONFIG_PROXYPOLLER_FORKS + CONFIG_SELFMON_FORKS
+			+ CONFIG_DBWRITER_FORKS)
+	{
+		process_type = ZBX_PROCESS_TYPE_DBWRITER;
+		process_num = server_num - CONFIG_CONFSYNCER_FORKS - CONFIG_POLLER_FORKS
+				- CONFIG_UNREACHABLE_POLLER_FORKS - CONFIG_TRAPPER_FORKS
+				- CONFIG_PINGER_FORKS - CONFIG_ALERTER_FORKS
+				- CONFIG_HOUSEKEEPER_FORKS - CONFIG_TIMER_FORKS
+				- CONFIG_NODEWATCHER_FORKS - CONFIG_HTTPPOLLER_FORKS
+				- CONFIG_DISCOVERER_FORKS - CONFIG_HISTSYNCER_FORKS
+				- CONFIG_ESCALATOR_FORKS - CONFIG_IPMIPOLLER_FORKS
+				- CONFIG_PROXYPOLLER_FORKS - CONFIG_SELFMON_FORKS;
+
+		zabbix_log(LOG_LEVEL_WARNING, "server #%d started [%s]",
+				server_num, get_process_type_string(process_type));
+
+		main_dbwriter_loop();
+	}
 
 	return SUCCEED;
 }
@@ -889,7 +964,8 @@ void	zbx_on_exit()
 				+ CONFIG_NODEWATCHER_FORKS + CONFIG_HTTPPOLLER_FORKS
 				+ CONFIG_DISCOVERER_FORKS + CONFIG_HISTSYNCER_FORKS
 				+ CONFIG_ESCALATOR_FORKS + CONFIG_IPMIPOLLER_FORKS
-				+ CONFIG_PROXYPOLLER_FORKS + CONFIG_SELFMON_FORKS; i++)
+				+ CONFIG_PROXYPOLLER_FORKS + CONFIG_SELFMON_FORKS
+				+ CONFIG_DBWRITER_FORKS; i++)
 		{
 			if (threads[i])
 			{
@@ -913,7 +989,9 @@ void	zbx_on_exit()
 
 	DBconnect(ZBX_DB_CONNECT_EXIT);
 	free_database_cache();
+	DCsave_configuration_snapshot();
 	free_configuration_cache();
+	zbx_vc_destroy();
 	DBclose();
 
 	zbx_mutex_destroy(&node_sync_access);
@@ -0,0 +1,296 @@
+/*
+** ZABBIX
+** Copyright (C) 2000-2010 SIA Zabbix
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**/
+
+#include "common.h"
+#include "zbxalgo.h"
+
+#include "zbxtest.h"
+
+/* checks the chained and the inline hashset against a plain array indexed by key */
+
+#define KEYS_NUM	20000
+
+typedef struct
+{
+	zbx_uint64_t	id;
+	zbx_uint64_t	value;
+	char		pad[16];
+}
+test_record_t;
+
+static test_record_t	*records[KEYS_NUM];	/* where the hashset keeps every record, NULL if absent */
+static zbx_uint64_t	values[KEYS_NUM];
+static int		moves, fail_alloc;
+
+static void	record_move(const void *old_data, void *new_data)
+{
+	const test_record_t	*record = (const test_record_t *)new_data;
+
+	ZBX_TEST_CHECK(records[record->id] == old_data);
+	records[record->id] = new_data;
+	moves++;
+}
+
+static void	*failing_malloc(void *old, size_t size)
+{
+	return 0 != fail_alloc ? NULL : zbx_malloc(old, size);
+}
+
+static void	hashset_check_contents(zbx_hashset_t *hs, int inline_records)
+{
+	zbx_hashset_iter_t	iter;
+	test_record_t		*record;
+	zbx_uint64_t		id;
+	int			num = 0, visited[KEYS_NUM];
+
+	memset(visited, 0, sizeof(visited));
+
+	for (id = 0; id < KEYS_NUM; id++)
+	{
+		record = zbx_hashset_search(hs, &id);
+
+		if (NULL == records[id])
+		{
+			ZBX_TEST_CHECK(NULL == record);
+			continue;
+		}
+
+		ZBX_TEST_CHECK(NULL != record);
+		ZBX_TEST_CHECK(id == record->id && values[id] == record->value);
+
+		if (0 != inline_records)
+			ZBX_TEST_CHECK(records[id] == record);
+
+		num++;
+	}
+
+	ZBX_TEST_CHECK(num == hs->num_data);
+
+	zbx_hashset_iter_reset(hs, &iter);
+
+	while (NULL != (record = zbx_hashset_iter_next(&iter)))
+	{
+		ZBX_TEST_CHECK(record->id < KEYS_NUM && NULL != records[record->id]);
+		ZBX_TEST_CHECK(0 == visited[record->id]);
+		visited[record->id] = 1;
+		num--;
+	}
+
+	ZBX_TEST_CHECK(0 == num);
+}
+
+static void	hashset_test_random(zbx_hashset_t *hs, int inline_records)
+{
+	test_record_t		local, *record;
+	zbx_hashset_iter_t	iter;
+	int			i, removed = 0;
+
+	memset(records, 0, sizeof(records));
+	memset(&local, 0, sizeof(local));
+
+	for (i = 0; i < 20 * KEYS_NUM; i++)
+	{
+		local.id = zbx_test_rand() % KEYS_NUM;
+
+		/* mostly inserts, so that the table grows, rehashes and purges deleted slots */
+		if (0 != zbx_test_rand() % 3)
+		{
+			local.value = zbx_test_rand();
+
+			ZBX_TEST_CHECK(NULL != (record = zbx_hashset_insert(hs, &local, sizeof(local))));
+
+			if (NULL == records[local.id])
+			{
+				records[local.id] = record;
+				values[local.id] = local.value;
+			}
+			else
+				ZBX_TEST_CHECK(values[local.id] == record->value);	/* insert keeps the old record */
+		}
+		else
+		{
+			zbx_hashset_remove(hs, &local);
+			records[local.id] = NULL;
+		}
+
+		if (0 == i % KEYS_NUM)
+			hashset_check_contents(hs, inline_records);
+	}
+
+	hashset_check_contents(hs, inline_records);
+
+	/* remove every other record while iterating */
+	zbx_hashset_iter_reset(hs, &iter);
+
+	while (NULL != (record = zbx_hashset_iter_next(&iter)))
+	{
+		if (0 != record->id % 2)
+			continue;
+
+		records[record->id] = NULL;
+		zbx_hashset_iter_remove(&iter);
+		removed++;
+	}
+
+	ZBX_TEST_CHECK(0 < removed);
+	hashset_check_contents(hs, inline_records);
+
+	zbx_hashset_clear(hs);
+	memset(records, 0, sizeof(records));
+	hashset_check_contents(hs, inline_records);
+}
+
+static void	hashset_test_grow_fail()
+{
+	zbx_hashset_t	hs;
+	test_record_t	local;
+	int		i, stored;
+
+	memset(records, 0, sizeof(records));
+	memset(&local, 0, sizeof(local));
+	fail_alloc = 0;
+
+	zbx_hashset_create_inline(&hs, 10, sizeof(test_record_t), ZBX_DEFAULT_UINT64_HASH_FUNC,
+			ZBX_DEFAULT_UINT64_COMPARE_FUNC, record_move, failing_malloc, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+			ZBX_DEFAULT_MEM_FREE_FUNC);
+
+	for (i = 0; i < 1000; i++)
+	{
+		if (500 == i)
+			fail_alloc = 1;
+
+		local.id = i;
+		local.value = i * 7;
+
+		if (NULL != (records[i] = zbx_hashset_insert(&hs, &local, sizeof(local))))
+			values[i] = local.value;
+		else
+			ZBX_TEST_CHECK(0 != fail_alloc);
+	}
+
+	/* a failed growth leaves the hashset as it was */
+	stored = hs.num_data;
+	ZBX_TEST_CHECK(500 <= stored && 1000 > stored);
+	hashset_check_contents(&hs, 1);
+
+	fail_alloc = 0;
+	local.id = 1000;
+	ZBX_TEST_CHECK(NULL != (records[1000] = zbx_hashset_insert(&hs, &local, sizeof(local))));
+	values[1000] = local.value;
+	ZBX_TEST_CHECK(stored + 1 == hs.num_data);
+	hashset_check_contents(&hs, 1);
+
+	zbx_hashset_destroy(&hs);
+}
+
+static void	hashset_bench(const char *name, zbx_hashset_t *hs, int num)
+{
+	test_record_t	local;
+	char		buffer[64];
+	double		sec;
+	int		i, found = 0;
+
+	memset(&local, 0, sizeof(local));
+
+	sec = zbx_time();
+
+	for (i = 0; i < num; i++)
+	{
+		local.id = (zbx_uint64_t)i * 2654435761U;
+		zbx_hashset_insert(hs, &local, sizeof(local));
+	}
+
+	zbx_snprintf(buffer, sizeof(buffer), "%s: insert", name);
+	zbx_test_report(buffer, num, zbx_time() - sec);
+
+	sec = zbx_time();
+
+	for (i = 0; i < num; i++)
+	{
+		local.id = (zbx_uint64_t)i * 2654435761U;
+
+		if (NULL != zbx_hashset_search(hs, &local))
+			found++;
+	}
+
+	zbx_snprintf(buffer, sizeof(buffer), "%s: search hit", name);
+	zbx_test_report(buffer, num, zbx_time() - sec);
+
+	sec = zbx_time();
+
+	for (i = 0; i < num; i++)
+	{
+		local.id = (zbx_uint64_t)i * 2654435761U + 1;
+
+		if (NULL != zbx_hashset_search(hs, &local))
+			found++;
+	}
+
+	zbx_snprintf(buffer, sizeof(buffer), "%s: search miss", name);
+	zbx_test_report(buffer, num, zbx_time() - sec);
+
+	sec = zbx_time();
+
+	for (i = 0; i < num; i++)
+	{
+		local.id = (zbx_uint64_t)i * 2654435761U;
+		zbx_hashset_remove(hs, &local);
+	}
+
+	zbx_snprintf(buffer, sizeof(buffer), "%s: remove", name);
+	zbx_test_report(buffer, num, zbx_time() - sec);
+
+	ZBX_TEST_CHECK(num == found && 0 == hs->num_data);
+}
+
+int	main(int argc, char **argv)
+{
+	zbx_hashset_t	hs;
+	int		num;
+
+	if (0 != (num = zbx_test_bench_num(argc, argv, 1000000)))
+	{
+		zbx_hashset_create(&hs, 100, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+		hashset_bench("hashset chained", &hs, num);
+		zbx_hashset_destroy(&hs);
+
+		zbx_hashset_create_inline(&hs, 100, sizeof(test_record_t), ZBX_DEFAULT_UINT64_HASH_FUNC,
+				ZBX_DEFAULT_UINT64_COMPARE_FUNC, NULL, ZBX_DEFAULT_MEM_MALLOC_FUNC,
+				ZBX_DEFAULT_MEM_REALLOC_FUNC, ZBX_DEFAULT_MEM_FREE_FUNC);
+		hashset_bench("hashset inline", &hs, num);
+		zbx_hashset_destroy(&hs);
+
+		return SUCCEED;
+	}
+
+	zbx_hashset_create(&hs, 10, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	hashset_test_random(&hs, 0);
+	zbx_hashset_destroy(&hs);
+
+	zbx_hashset_create_inline(&hs, 10, sizeof(test_record_t), ZBX_DEFAULT_UINT64_HASH_FUNC,
+			ZBX_DEFAULT_UINT64_COMPARE_FUNC, record_move, ZBX_DEFAULT_MEM_MALLOC_FUNC,
+			ZBX_DEFAULT_MEM_REALLOC_FUNC, ZBX_DEFAULT_MEM_FREE_FUNC);
+	hashset_test_random(&hs, 1);
+	ZBX_TEST_CHECK(0 < moves);
+	zbx_hashset_destroy(&hs);
+
+	hashset_test_grow_fail();
+
+	return SUCCEED;
+}
@@ -0,0 +1,258 @@
+/*
+** ZABBIX
+** Copyright (C) 2000-2010 SIA Zabbix
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**/
+
+#include "common.h"
+#include "db.h"
+
+#include "zbxtest.h"
+
+/* compares the insert paths of the database layer by inserting numeric values into a scratch table, one */
+/* transaction per batch: SQL text as built by DCmass_add_history(), a prepared statement per row and */
+/* zbx_db_bulk_insert() with batches of whole and partial multi-row chunks; needs an existing database, */
+/* not run by "check" */
+
+/* only the backend the tree is configured for is benchmarked, to compare backends build the tree once */
+/* with each of --with-mysql, --with-postgresql and --with-sqlite3 */
+
+#define BENCH_TABLE	"history_bench"
+#define BENCH_BATCH	1000
+
+int	CONFIG_LOG_SLOW_QUERIES = 0;
+
+/* zbxdb calls these on connect, they are provided by zbxdbhigh which needs the whole server */
+int	__zbx_DBexecute(const char *fmt, ...)
+{
+	va_list	args;
+	int	ret;
+
+	va_start(args, fmt);
+	ret = zbx_db_vexecute(fmt, args);
+	va_end(args);
+
+	return ret;
+}
+
+DB_RESULT	__zbx_DBselect(const char *fmt, ...)
+{
+	va_list		args;
+	DB_RESULT	result;
+
+	va_start(args, fmt);
+	result = zbx_db_vselect(fmt, args);
+	va_end(args);
+
+	return result;
+}
+
+DB_ROW	DBfetch(DB_RESULT result)
+{
+	return zbx_db_fetch(result);
+}
+
+void	DBclose()
+{
+	zbx_db_close();
+}
+
+static void	bench_prepare()
+{
+	if (ZBX_DB_OK > DBexecute("create table " BENCH_TABLE " (itemid bigint not null,"
+			"clock integer not null,value double precision not null)"))
+	{
+		fprintf(stderr, "cannot create table " BENCH_TABLE "\n");
+		exit(FAIL);
+	}
+}
+
+static void	bench_insert_sql(int first, int num)
+{
+	static char	*sql = NULL;
+	static int	sql_allocated = 64 * ZBX_KIBIBYTE;
+	int		i, sql_offset = 0;
+
+	if (NULL == sql)
+		sql = zbx_malloc(sql, sql_allocated);
+
+	for (i = first; i < first + num; i++)
+	{
+#ifdef HAVE_MULTIROW_INSERT
+		if (0 == sql_offset)
+		{
+			zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 64,
+					"insert into " BENCH_TABLE " (itemid,clock,value) values ");
+		}
+
+		zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 128, "(" ZBX_FS_UI64 ",%d," ZBX_FS_DBL "),",
+				(zbx_uint64_t)(i % 10000), 1000000000 + i, i * 0.5);
+#else
+		zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 128, "insert into " BENCH_TABLE
+				" (itemid,clock,value) values (" ZBX_FS_UI64 ",%d," ZBX_FS_DBL ");\n",
+				(zbx_uint64_t)(i % 10000), 1000000000 + i, i * 0.5);
+#endif
+	}
+
+#ifdef HAVE_MULTIROW_INSERT
+	sql_offset--;
+	zbx_snprintf_alloc(&sql, &sql_allocated, &sql_offset, 3, ";\n");
+#endif
+	if (ZBX_DB_OK > DBexecute("%s", sql))
+	{
+		fprintf(stderr, "SQL insert failed\n");
+		exit(FAIL);
+	}
+}
+
+#ifdef HAVE_PREPARED_STATEMENTS
+static void	bench_insert_prepared(int first, int num)
+{
+	static const unsigned char	types[] = {ZBX_DB_TYPE_UINT64, ZBX_DB_TYPE_INT, ZBX_DB_TYPE_FLOAT};
+	zbx_db_value_t			values[3];
+	int				i;
+
+	for (i = first; i < first + num; i++)
+	{
+		values[0].ui64 = (zbx_uint64_t)(i % 10000);
+		values[1].i = 1000000000 + i;
+		values[2].dbl = i * 0.5;
+
+		if (1 != zbx_db_execute_prepared("insert into " BENCH_TABLE " (itemid,clock,value) values (?,?,?)",
+				types, values, 3))
+		{
+			fprintf(stderr, "prepared insert failed\n");
+			exit(FAIL);
+		}
+	}
+}
+#endif
+
+#ifdef HAVE_BULK_INSERT
+static void	bench_insert_bulk(int first, int num)
+{
+	static const char		*fields[] = {"itemid", "clock", "value"};
+	static const unsigned char	types[] = {ZBX_DB_TYPE_UINT64, ZBX_DB_TYPE_INT, ZBX_DB_TYPE_FLOAT};
+	static zbx_db_value_t		*values = NULL;
+	int				i;
+
+	if (NULL == values)
+		values = zbx_malloc(values, BENCH_BATCH * 3 * sizeof(zbx_db_value_t));
+
+	for (i = 0; i < num; i++)
+	{
+		values[i * 3].ui64 = (zbx_uint64_t)((first + i) % 10000);
+		values[i * 3 + 1].i = 1000000000 + first + i;
+		values[i * 3 + 2].dbl = (first + i) * 0.5;
+	}
+
+	if (num != zbx_db_bulk_insert(BENCH_TABLE, fields, types, 3, values, num))
+	{
+		fprintf(stderr, "bulk insert failed\n");
+		exit(FAIL);
+	}
+}
+#endif
+
+static void	bench_run(const char *name, void (*insert_func)(int, int), int num, int batch)
+{
+	char	buffer[MAX_STRING_LEN];
+	double	sec;
+	int	i;
+
+	bench_prepare();
+
+	sec = zbx_time();
+
+	for (i = 0; i < num; i += batch)
+	{
+		zbx_db_begin();
+		insert_func(i, MIN(batch, num - i));
+		zbx_db_commit();
+	}
+
+	zbx_snprintf(buffer, sizeof(buffer), "history insert: %s, batch %d", name, batch);
+	zbx_test_report(buffer, num, zbx_time() - sec);
+
+	DBexecute("drop table " BENCH_TABLE);
+}
+
+int	main(int argc, char **argv)
+{
+	char	*host = NULL, *user = NULL, *password = NULL, *dbname = NULL, *dbschema = NULL;
+	int	ch, port = 0, num = 1000000;
+
+	while (-1 != (ch = getopt(argc, argv, "h:u:p:d:s:P:n:")))
+	{
+		switch (ch)
+		{
+			case 'h':
+				host = optarg;
+				break;
+			case 'u':
+				user = optarg;
+				break;
+			case 'p':
+				password = optarg;
+				break;
+			case 'd':
+				dbname = optarg;
+				break;
+			case 's':
+				dbschema = optarg;
+				break;
+			case 'P':
+				port = atoi(optarg);
+				break;
+			case 'n':
+				num = atoi(optarg);
+				break;
+			default:
+				dbname = NULL;
+				optind = argc;
+		}
+	}
+
+	if (NULL == dbname)
+	{
+		fprintf(stderr, "usage: %s -d <database> [-h <host>] [-u <user>] [-p <password>] [-s <schema>]"
+				" [-P <port>] [-n <values>]\n", argv[0]);
+		exit(FAIL);
+	}
+
+#ifdef HAVE_SQLITE3
+	zbx_create_sqlite3_mutex(dbname);
+#endif
+	if (ZBX_DB_OK != zbx_db_connect(host, user, password, dbname, dbschema, NULL, port))
+	{
+		fprintf(stderr, "cannot connect to the database\n");
+		exit(FAIL);
+	}
+
+	bench_run("SQL text", bench_insert_sql, num, BENCH_BATCH);
+#ifdef HAVE_PREPARED_STATEMENTS
+	bench_run("prepared", bench_insert_prepared, num, BENCH_BATCH);
+#endif
+#ifdef HAVE_BULK_INSERT
+	/* whole multi-row chunks and a remainder, whole chunks only, a remainder only */
+	bench_run("bulk", bench_insert_bulk, num, BENCH_BATCH);
+	bench_run("bulk", bench_insert_bulk, num, 512);
+	bench_run("bulk", bench_insert_bulk, num, 100);
+#endif
+	zbx_db_close();
+
+	return SUCCEED;
+}
@@ -0,0 +1,539 @@
+/*
+** ZABBIX
+** Copyright (C) 2000-2010 SIA Zabbix
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**/
+
+#include "common.h"
+
+/* white-box test of the shared memory allocator, it is compiled in to reach the bucket and slab internals */
+#include "../src/libs/zbxmemory/memalloc.c"
+
+#include "zbxtest.h"
+
+#define TEST_MEM_SIZE	(64 * ZBX_MEBIBYTE)
+#define TEST_PTRS_NUM	5000
+
+static unsigned char	*ptrs[TEST_PTRS_NUM];
+static size_t		sizes[TEST_PTRS_NUM];
+
+static zbx_mem_info_t	*memalloc_test_create(int slabs)
+{
+	zbx_mem_info_t	*info;
+
+	zbx_mem_create(&info, IPC_PRIVATE, ZBX_NO_MUTEX, TEST_MEM_SIZE, "test memory", "TestMemorySize");
+
+	if (0 != slabs)
+	{
+		zbx_mem_enable_slabs(info);
+		ZBX_TEST_CHECK(NULL != info->slabs);
+	}
+
+	return info;
+}
+
+static void	memalloc_test_fill(int k)
+{
+	size_t	i;
+
+	for (i = 0; i < sizes[k]; i++)
+		ptrs[k][i] = (unsigned char)(k + i);
+}
+
+static void	memalloc_test_check_data(int k)
+{
+	size_t	i;
+
+	for (i = 0; i < sizes[k]; i++)
+		ZBX_TEST_CHECK((unsigned char)(k + i) == ptrs[k][i]);
+}
+
+static int	memalloc_test_page_list(mem_slab_page_t *page, int class_index, int full)
+{
+	uint32_t	word, bit, free_num;
+	int		num = 0;
+
+	for (; NULL != page; page = page->next)
+	{
+		ZBX_TEST_CHECK(NULL == page->next || page->next->prev == page);
+		ZBX_TEST_CHECK(class_index == (int)page->class_index);
+		ZBX_TEST_CHECK(0 == ((uintptr_t)page & (MEM_SLAB_PAGE_SIZE - 1)));
+
+		for (free_num = 0, word = 0; word < MEM_SLAB_BITMAP_WORDS; word++)
+		{
+			for (bit = 0; bit < 32; bit++)
+			{
+				if (0 != (page->bitmap[word] & ((uint32_t)1 << bit)))
+					free_num++;
+			}
+		}
+
+		ZBX_TEST_CHECK(free_num == page->free_num);
+		ZBX_TEST_CHECK((0 == free_num) == (0 != full));
+
+		num++;
+	}
+
+	return num;
+}
+
+/* checks the page lists and counters of every size class against the pointers allocated by the test */
+static void	memalloc_test_check_slabs(zbx_mem_info_t *info)
+{
+	mem_slab_class_t	*slab_class;
+	mem_slab_page_t		*page;
+	int			i, used[MEM_SLAB_CLASS_COUNT];
+	uint32_t		index;
+
+	memset(used, 0, sizeof(used));
+
+	for (i = 0; i < TEST_PTRS_NUM; i++)
+	{
+		if (NULL == ptrs[i])
+			continue;
+
+		ZBX_TEST_CHECK(0 == ((uintptr_t)ptrs[i] & 7));
+
+		/* small chunks are allowed too, a chunk shrunk by realloc stays a chunk */
+		if (NULL == (page = mem_slab_page_by_ptr(info, ptrs[i])))
+			continue;
+
+		slab_class = (mem_slab_class_t *)info->slabs + page->class_index;
+
+		ZBX_TEST_CHECK(sizes[i] <= MEM_SLAB_MAX_SIZE);
+		ZBX_TEST_CHECK((int)page->class_index == mem_slab_class_by_size(sizes[i]));
+		ZBX_TEST_CHECK(0 == ((void *)ptrs[i] - MEM_SLAB_OBJECTS(page)) % slab_class->object_size);
+
+		index = ((void *)ptrs[i] - MEM_SLAB_OBJECTS(page)) / slab_class->object_size;
+		ZBX_TEST_CHECK(index < slab_class->objects_per_page);
+		ZBX_TEST_CHECK(0 == (page->bitmap[index >> 5] & ((uint32_t)1 << (index & 31))));
+
+		used[page->class_index]++;
+	}
+
+	for (i = 0; NULL != info->slabs && i < MEM_SLAB_CLASS_COUNT; i++)
+	{
+		slab_class = (mem_slab_class_t *)info->slabs + i;
+
+		ZBX_TEST_CHECK(slab_class->pages_num == memalloc_test_page_list(slab_class->partial, i, 0) +
+				memalloc_test_page_list(slab_class->full, i, 1));
+		ZBX_TEST_CHECK(used[i] == slab_class->used_num);
+	}
+}
+
+/* walks all chunks and checks them against the free chunk buckets and their bitmap */
+static void	memalloc_test_check_buckets(zbx_mem_info_t *info)
+{
+	void		*chunk, *next;
+	int		index, bit, free_num = 0, prev_free = 0;
+	uint32_t	free_size = 0, used_size = 0;
+
+	for (chunk = info->lo_bound; chunk < info->hi_bound; chunk = next)
+	{
+		next = chunk + 2 * MEM_SIZE_FIELD + CHUNK_SIZE(chunk);
+
+		ZBX_TEST_CHECK(next <= info->hi_bound);
+		ZBX_TEST_CHECK(*(uint32_t *)chunk == *(uint32_t *)(next - MEM_SIZE_FIELD));
+
+		if (FREE_CHUNK(chunk))
+		{
+			ZBX_TEST_CHECK(0 == prev_free);	/* neighbouring free chunks are always merged */
+			free_size += CHUNK_SIZE(chunk);
+			free_num++;
+		}
+		else
+			used_size += CHUNK_SIZE(chunk);
+
+		prev_free = FREE_CHUNK(chunk);
+	}
+
+	ZBX_TEST_CHECK(chunk == info->hi_bound);
+	ZBX_TEST_CHECK(free_size == info->free_size && used_size == info->used_size);
+
+	for (index = 0; index < MEM_BUCKET_COUNT; index++)
+	{
+		bit = (info->buckets_bitmap[index >> 5] >> (index & 31)) & 1;
+		ZBX_TEST_CHECK(bit == (NULL != info->buckets[index]));
+
+		for (chunk = info->buckets[index]; NULL != chunk; chunk = next)
+		{
+			ZBX_TEST_CHECK(FREE_CHUNK(chunk) && index == mem_bucket_by_size(CHUNK_SIZE(chunk)));
+
+			if (NULL != (next = mem_get_next_chunk(chunk)))
+				ZBX_TEST_CHECK(chunk == mem_get_prev_chunk(next));
+
+			free_num--;
+		}
+	}
+
+	ZBX_TEST_CHECK(0 == free_num);
+}
+
+static void	memalloc_test_check(zbx_mem_info_t *info)
+{
+	memalloc_test_check_buckets(info);
+	memalloc_test_check_slabs(info);
+}
+
+/* random allocations, reallocations and frees, small ones crossing the slab limit in both directions */
+static void	memalloc_test_random(zbx_mem_info_t *info, int iterations)
+{
+	int	i, k, op;
+	size_t	size;
+
+	memset(ptrs, 0, sizeof(ptrs));
+
+	for (i = 0; i < iterations; i++)
+	{
+		k = zbx_test_rand() % TEST_PTRS_NUM;
+		op = zbx_test_rand() % 10;
+		size = 0 == zbx_test_rand() % 3 ? 1 + zbx_test_rand() % 20000 : 1 + zbx_test_rand() % 300;
+
+		if (0 == i % 5000)
+			memalloc_test_check(info);
+
+		if (NULL != ptrs[k])
+			memalloc_test_check_data(k);
+
+		if (4 > op)
+		{
+			if (NULL == ptrs[k] && NULL != (ptrs[k] = zbx_mem_try_malloc(info, size)))
+			{
+				sizes[k] = size;
+				memalloc_test_fill(k);
+			}
+		}
+		else if (7 > op)
+		{
+			if (NULL != ptrs[k])
+			{
+				/* the old contents must survive up to the smaller of the sizes */
+				ptrs[k] = zbx_mem_realloc(info, ptrs[k], size);
+				sizes[k] = MIN(sizes[k], size);
+				memalloc_test_check_data(k);
+				sizes[k] = size;
+				memalloc_test_fill(k);
+			}
+		}
+		else if (9 > op)
+		{
+			if (NULL != ptrs[k])
+				zbx_mem_free(info, ptrs[k]);
+		}
+	}
+
+	memalloc_test_check(info);
+
+	for (k = 0; k < TEST_PTRS_NUM; k++)
+	{
+		if (NULL != ptrs[k])
+			zbx_mem_free(info, ptrs[k]);
+	}
+
+	memalloc_test_check(info);
+}
+
+/* every size falls into the bucket whose range covers it, and the first non-empty bucket is found */
+static void	memalloc_test_bucket_ranges()
+{
+	zbx_mem_info_t	info;
+	uint32_t	bitmap[MEM_BITMAP_WORDS], size;
+	int		index, from, i, j;
+
+	for (index = 1; index < MEM_BUCKET_COUNT; index++)
+		ZBX_TEST_CHECK(mem_bucket_min_size(index - 1) < mem_bucket_min_size(index));
+
+	for (size = MEM_MIN_ALLOC; size < MEM_MAX_SIZE - MEM_MAX_SIZE / 64; size += (size < 4096 ? 8 : size / 64 + 1))
+	{
+		index = mem_bucket_by_size(size);
+
+		ZBX_TEST_CHECK(0 <= index && index < MEM_BUCKET_COUNT);
+		ZBX_TEST_CHECK(mem_bucket_min_size(index) <= size);
+		ZBX_TEST_CHECK(MEM_BUCKET_COUNT - 1 == index || size < mem_bucket_min_size(index + 1));
+
+		if (size < MEM_MAX_BUCKET_SIZE)
+			ZBX_TEST_CHECK(mem_bucket_min_size(index) == size);
+	}
+
+	for (i = 0; i < MEM_BUCKET_COUNT; i++)
+		ZBX_TEST_CHECK(i == mem_bucket_by_size(mem_bucket_min_size(i)));
+
+	ZBX_TEST_CHECK(MEM_BUCKET_COUNT - 1 == mem_bucket_by_size(MEM_MAX_SIZE));
+
+	info.buckets_bitmap = bitmap;
+
+	for (i = 0; i < 10000; i++)
+	{
+		memset(bitmap, 0, sizeof(bitmap));
+
+		for (j = zbx_test_rand() % 4; 0 < j; j--)
+		{
+			index = zbx_test_rand() % MEM_BUCKET_COUNT;
+			bitmap[index >> 5] |= (uint32_t)1 << (index & 31);
+		}
+
+		from = zbx_test_rand() % (MEM_BUCKET_COUNT + 1);
+
+		for (index = from; index < MEM_BUCKET_COUNT; index++)
+		{
+			if (0 != (bitmap[index >> 5] & ((uint32_t)1 << (index & 31))))
+				break;
+		}
+
+		ZBX_TEST_CHECK((MEM_BUCKET_COUNT == index ? FAIL : index) == mem_find_bucket(&info, from));
+	}
+}
+
+/* freed slab pages go back to the shared memory, except the last one of a class */
+static void	memalloc_test_slab_pages()
+{
+	zbx_mem_info_t		*info;
+	mem_slab_class_t	*slab_class;
+	uint32_t		free_size;
+	int			k;
+
+	info = memalloc_test_create(1);
+	slab_class = (mem_slab_class_t *)info->slabs + mem_slab_class_by_size(48);
+	free_size = info->free_size;
+
+	memset(ptrs, 0, sizeof(ptrs));
+
+	for (k = 0; k < TEST_PTRS_NUM; k++)
+	{
+		sizes[k] = 41 + k % 8;
+		ptrs[k] = zbx_mem_malloc(info, NULL, sizes[k]);
+		memalloc_test_fill(k);
+	}
+
+	memalloc_test_check_slabs(info);
+	ZBX_TEST_CHECK(TEST_PTRS_NUM == slab_class->used_num);
+	ZBX_TEST_CHECK(slab_class->pages_num ==
+			(TEST_PTRS_NUM + (int)slab_class->objects_per_page - 1) / (int)slab_class->objects_per_page);
+
+	/* free in a scattered order, so that pages become partial before they become empty */
+	for (k = 0; k < TEST_PTRS_NUM; k++)
+	{
+		memalloc_test_check_data((k * 7) % TEST_PTRS_NUM);
+		zbx_mem_free(info, ptrs[(k * 7) % TEST_PTRS_NUM]);
+	}
+
+	memalloc_test_check_slabs(info);
+	ZBX_TEST_CHECK(0 == slab_class->used_num && 1 == slab_class->pages_num);
+	ZBX_TEST_CHECK(free_size - info->free_size <= 2 * MEM_SLAB_PAGE_SIZE);
+
+	zbx_mem_destroy(info);
+}
+
+static void	memalloc_test_slab_reserve()
+{
+	zbx_mem_info_t		*info;
+	mem_slab_class_t	*slab_class;
+	int			k, pages_num;
+
+	info = memalloc_test_create(1);
+	slab_class = (mem_slab_class_t *)info->slabs + mem_slab_class_by_size(40);
+
+	zbx_mem_slab_reserve(info, 40, TEST_PTRS_NUM);
+	pages_num = slab_class->pages_num;
+	ZBX_TEST_CHECK(pages_num * (int)slab_class->objects_per_page >= TEST_PTRS_NUM);
+	ZBX_TEST_CHECK((pages_num - 1) * (int)slab_class->objects_per_page < TEST_PTRS_NUM);
+
+	/* sizes the slabs do not serve are ignored */
+	zbx_mem_slab_reserve(info, MEM_SLAB_MAX_SIZE + 1, TEST_PTRS_NUM);
+	zbx_mem_slab_reserve(info, 0, TEST_PTRS_NUM);
+
+	memset(ptrs, 0, sizeof(ptrs));
+
+	for (k = 0; k < TEST_PTRS_NUM; k++)
+	{
+		sizes[k] = 40;
+		ptrs[k] = zbx_mem_malloc(info, NULL, sizes[k]);
+		memalloc_test_fill(k);
+	}
+
+	ZBX_TEST_CHECK(pages_num == slab_class->pages_num);
+	memalloc_test_check_slabs(info);
+
+	/* nothing more is reserved while there are enough free objects */
+	zbx_mem_free(info, ptrs[0]);
+	zbx_mem_slab_reserve(info, 40, 1);
+	ZBX_TEST_CHECK(pages_num == slab_class->pages_num);
+
+	zbx_mem_destroy(info);
+}
+
+/* benchmark: small records of a few sizes, like the configuration cache, allocated and freed at random */
+
+#define BENCH_RECORDS_NUM	300000
+
+static void	memalloc_bench_small(int slabs, int num)
+{
+	static const size_t	record_sizes[] = {24, 40, 48, 64, 96, 144, 200};
+
+	zbx_mem_info_t	*info;
+	void		**records;
+	char		name[64];
+	int		i, k, records_num = 0;
+	double		sec;
+
+	info = memalloc_test_create(slabs);
+	records = zbx_malloc(NULL, BENCH_RECORDS_NUM * sizeof(void *));
+	memset(records, 0, BENCH_RECORDS_NUM * sizeof(void *));
+	zbx_test_srand(0);
+
+	sec = zbx_time();
+
+	for (i = 0; i < num; i++)
+	{
+		k = zbx_test_rand() % BENCH_RECORDS_NUM;
+
+		/* keep about two thirds of the records allocated */
+		if (NULL == records[k])
+		{
+			records[k] = zbx_mem_malloc(info, NULL,
+					record_sizes[k % (sizeof(record_sizes) / sizeof(size_t))]);
+			records_num++;
+		}
+		else if (0 == zbx_test_rand() % 2)
+		{
+			zbx_mem_free(info, records[k]);
+			records_num--;
+		}
+	}
+
+	zbx_snprintf(name, sizeof(name), "memalloc small records, slabs %s", 0 != slabs ? "on" : "off");
+	zbx_test_report(name, num, zbx_time() - sec);
+	printf("%-48s %10u bytes taken by %d records\n", name, info->total_size - info->free_size, records_num);
+
+	zbx_free(records);
+	zbx_mem_destroy(info);
+}
+
+/* benchmark: a trace of mixed sizes with FIFO and random lifetimes and growing reallocations, like the */
+/* history cache, to see the speed and the fragmentation it leaves                                        */
+
+#define TRACE_RECORDS_NUM	10000
+
+static size_t	memalloc_trace_size()
+{
+	int	r = zbx_test_rand() % 100;
+
+	if (70 > r)
+		return 16 + zbx_test_rand() % 240;
+
+	if (95 > r)
+		return 256 + zbx_test_rand() % 3840;
+
+	return 4096 + zbx_test_rand() % 61440;
+}
+
+static void	memalloc_bench_trace(int slabs, int num)
+{
+	zbx_mem_info_t	*info;
+	void		**records, *chunk;
+	size_t		*record_sizes;
+	char		name[64];
+	int		i, k, index, chunks_num = 0, failed = 0;
+	uint32_t	largest = 0;
+	double		sec;
+
+	info = memalloc_test_create(slabs);
+	records = zbx_malloc(NULL, TRACE_RECORDS_NUM * sizeof(void *));
+	record_sizes = zbx_malloc(NULL, TRACE_RECORDS_NUM * sizeof(size_t));
+	memset(records, 0, TRACE_RECORDS_NUM * sizeof(void *));
+	zbx_test_srand(0);
+
+	sec = zbx_time();
+
+	for (i = 0; i < num; i++)
+	{
+		/* records are replaced in FIFO order, but some are freed early and some grow */
+		k = i % TRACE_RECORDS_NUM;
+
+		if (NULL != records[k])
+			zbx_mem_free(info, records[k]);
+
+		record_sizes[k] = memalloc_trace_size();
+
+		if (NULL == (records[k] = zbx_mem_try_malloc(info, record_sizes[k])))
+			failed++;
+
+		k = zbx_test_rand() % TRACE_RECORDS_NUM;
+
+		if (NULL == records[k])
+			continue;
+
+		if (0 == zbx_test_rand() % 4)
+		{
+			zbx_mem_free(info, records[k]);
+		}
+		else if (0 == zbx_test_rand() % 2 && 65536 > record_sizes[k])
+		{
+			record_sizes[k] += record_sizes[k] / 2;
+			records[k] = zbx_mem_realloc(info, records[k], record_sizes[k]);
+		}
+	}
+
+	sec = zbx_time() - sec;
+
+	for (index = 0; index < MEM_BUCKET_COUNT; index++)
+	{
+		for (chunk = info->buckets[index]; NULL != chunk; chunk = mem_get_next_chunk(chunk))
+		{
+			largest = MAX(largest, CHUNK_SIZE(chunk));
+			chunks_num++;
+		}
+	}
+
+	zbx_snprintf(name, sizeof(name), "memalloc trace, slabs %s", 0 != slabs ? "on" : "off");
+	zbx_test_report(name, num, sec);
+	printf("%-48s %10u bytes free in %d chunks, largest %u, %d allocations failed\n", name, info->free_size,
+			chunks_num, largest, failed);
+
+	zbx_free(record_sizes);
+	zbx_free(records);
+	zbx_mem_destroy(info);
+}
+
+int	main(int argc, char **argv)
+{
+	zbx_mem_info_t	*info;
+	int		num;
+
+	if (0 != (num = zbx_test_bench_num(argc, argv, 10000000)))
+	{
+		memalloc_bench_small(0, num);
+		memalloc_bench_small(1, num);
+		memalloc_bench_trace(0, num / 5);
+		memalloc_bench_trace(1, num / 5);
+
+		return SUCCEED;
+	}
+
+	info = memalloc_test_create(0);
+	memalloc_test_random(info, 500000);
+	zbx_mem_destroy(info);
+
+	info = memalloc_test_create(1);
+	memalloc_test_random(info, 500000);
+	zbx_mem_destroy(info);
+
+	memalloc_test_bucket_ranges();
+	memalloc_test_slab_pages();
+	memalloc_test_slab_reserve();
+
+	return SUCCEED;
+}
@@ -0,0 +1,281 @@
+/*
+** ZABBIX
+** Copyright (C) 2000-2010 SIA Zabbix
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**/
+
+#include "common.h"
+#include "zbxalgo.h"
+
+#include "zbxtest.h"
+
+/* checks the timer wheel against a plain array of scheduled times and compares its rescheduling speed */
+/* with the binary heap that the poller queues used before                                            */
+
+#define KEYS_NUM	20000
+
+static int	ref_time[KEYS_NUM], ref_id[KEYS_NUM];
+static char	ref_queued[KEYS_NUM];
+
+static void	timerwheel_check_nextcheck(zbx_timer_wheel_t *wheel)
+{
+	int	i, nextcheck, min = INT_MAX;
+
+	for (i = 0; i < KEYS_NUM; i++)
+	{
+		if (0 != ref_queued[i] && ref_time[i] < min)
+			min = ref_time[i];
+	}
+
+	nextcheck = zbx_timer_wheel_nextcheck(wheel);
+
+	if (INT_MAX == min)
+		ZBX_TEST_CHECK(FAIL == nextcheck);
+	else
+		ZBX_TEST_CHECK(nextcheck <= MAX(min, wheel->now));
+}
+
+static void	timerwheel_check_pop(zbx_timer_wheel_t *wheel, int now)
+{
+	zbx_uint64_t	key;
+	int		i;
+
+	while (SUCCEED == zbx_timer_wheel_pop(wheel, now, &key))
+	{
+		ZBX_TEST_CHECK(KEYS_NUM > key && 0 != ref_queued[key] && ref_time[key] <= now);
+		ref_queued[key] = 0;
+	}
+
+	for (i = 0; i < KEYS_NUM; i++)
+		ZBX_TEST_CHECK(0 == ref_queued[i] || ref_time[i] > now);
+}
+
+static void	timerwheel_test_random(zbx_uint64_t seed)
+{
+	zbx_timer_wheel_t	wheel;
+	int			i, k, op, now, num = 0;
+
+	zbx_test_srand(seed);
+	memset(ref_queued, 0, sizeof(ref_queued));
+
+	now = 1000000000 + zbx_test_rand() % 100000;
+	zbx_timer_wheel_create(&wheel, now);
+
+	for (i = 0; i < 500000; i++)
+	{
+		op = zbx_test_rand() % 100;
+		k = zbx_test_rand() % KEYS_NUM;
+
+		if (40 > op)
+		{
+			/* mostly near the current time, sometimes far enough for the upper levels, sometimes past */
+			if (0 == zbx_test_rand() % 4)
+				ref_time[k] = now + zbx_test_rand() % 20000000 - 5;
+			else
+				ref_time[k] = now + zbx_test_rand() % 600 - 5;
+
+			if (0 != ref_queued[k])
+			{
+				zbx_timer_wheel_update(&wheel, ref_id[k], ref_time[k]);
+			}
+			else
+			{
+				ref_id[k] = zbx_timer_wheel_insert(&wheel, k, ref_time[k]);
+				ref_queued[k] = 1;
+			}
+		}
+		else if (43 > op)
+		{
+			if (0 != ref_queued[k])
+			{
+				zbx_timer_wheel_remove(&wheel, ref_id[k]);
+				ref_queued[k] = 0;
+			}
+		}
+		else if (45 > op)
+		{
+			/* move an element to another key, as the item queues do when slots are compacted */
+			if (0 != ref_queued[k] && 0 == ref_queued[KEYS_NUM - 1 - k])
+			{
+				zbx_timer_wheel_set_key(&wheel, ref_id[k], KEYS_NUM - 1 - k);
+				ref_time[KEYS_NUM - 1 - k] = ref_time[k];
+				ref_id[KEYS_NUM - 1 - k] = ref_id[k];
+				ref_queued[KEYS_NUM - 1 - k] = 1;
+				ref_queued[k] = 0;
+			}
+		}
+		else if (50 > op)
+		{
+			now += (0 == zbx_test_rand() % 50 ? zbx_test_rand() % 300000 : zbx_test_rand() % 3);
+		}
+		else if (52 > op)
+		{
+			timerwheel_check_nextcheck(&wheel);
+		}
+		else if (53 > op)
+		{
+			timerwheel_check_pop(&wheel, now);
+		}
+	}
+
+	timerwheel_check_pop(&wheel, now);
+
+	for (k = 0; k < KEYS_NUM; k++)
+		num += ref_queued[k];
+
+	ZBX_TEST_CHECK(num == wheel.elems_num);
+
+	timerwheel_check_pop(&wheel, INT_MAX - 1);
+	ZBX_TEST_CHECK(0 == wheel.elems_num);
+	ZBX_TEST_CHECK(FAIL == zbx_timer_wheel_nextcheck(&wheel));
+
+	zbx_timer_wheel_destroy(&wheel);
+}
+
+/* benchmark: items with delays of 1 to 300 seconds are popped when due and rescheduled, like a poller queue */
+
+#define BENCH_ITEMS	100000
+
+typedef struct
+{
+	int	nextcheck;
+	int	delay;
+	int	id;
+}
+bench_item_t;
+
+static int	bench_item_compare(const void *d1, const void *d2)
+{
+	const zbx_binary_heap_elem_t	*e1 = (const zbx_binary_heap_elem_t *)d1;
+	const zbx_binary_heap_elem_t	*e2 = (const zbx_binary_heap_elem_t *)d2;
+
+	return ((const bench_item_t *)e1->data)->nextcheck - ((const bench_item_t *)e2->data)->nextcheck;
+}
+
+static void	bench_items_init(bench_item_t *items, int now)
+{
+	int	i;
+
+	zbx_test_srand(0);
+
+	for (i = 0; i < BENCH_ITEMS; i++)
+	{
+		items[i].delay = 1 + zbx_test_rand() % 300;
+		items[i].nextcheck = now + zbx_test_rand() % items[i].delay;
+	}
+}
+
+static void	timerwheel_bench(int num)
+{
+	zbx_timer_wheel_t	wheel;
+	bench_item_t		*items;
+	zbx_uint64_t		key;
+	int			i, now = 1000000000, done = 0;
+	double			sec;
+
+	items = zbx_malloc(NULL, BENCH_ITEMS * sizeof(bench_item_t));
+	bench_items_init(items, now);
+
+	zbx_timer_wheel_create(&wheel, now);
+
+	for (i = 0; i < BENCH_ITEMS; i++)
+		items[i].id = zbx_timer_wheel_insert(&wheel, i, items[i].nextcheck);
+
+	sec = zbx_time();
+
+	while (done < num)
+	{
+		/* the popped element is removed, so rescheduling inserts it again */
+		while (done < num && SUCCEED == zbx_timer_wheel_pop(&wheel, now, &key))
+		{
+			items[key].nextcheck += items[key].delay;
+			items[key].id = zbx_timer_wheel_insert(&wheel, key, items[key].nextcheck);
+			done++;
+		}
+
+		now++;
+	}
+
+	zbx_test_report("timer wheel: pop and reschedule", num, zbx_time() - sec);
+
+	zbx_timer_wheel_destroy(&wheel);
+	zbx_free(items);
+}
+
+static void	binaryheap_bench(int num)
+{
+	zbx_binary_heap_t	heap;
+	zbx_binary_heap_elem_t	elem, *min;
+	bench_item_t		*items;
+	int			i, now = 1000000000, done = 0;
+	double			sec;
+
+	items = zbx_malloc(NULL, BENCH_ITEMS * sizeof(bench_item_t));
+	bench_items_init(items, now);
+
+	zbx_binary_heap_create(&heap, bench_item_compare, ZBX_BINARY_HEAP_OPTION_DIRECT);
+
+	for (i = 0; i < BENCH_ITEMS; i++)
+	{
+		elem.key = i;
+		elem.data = &items[i];
+		zbx_binary_heap_insert(&heap, &elem);
+	}
+
+	sec = zbx_time();
+
+	while (done < num)
+	{
+		while (done < num)
+		{
+			min = zbx_binary_heap_find_min(&heap);
+
+			if (((const bench_item_t *)min->data)->nextcheck > now)
+				break;
+
+			elem = *min;
+			items[elem.key].nextcheck += items[elem.key].delay;
+			zbx_binary_heap_update_direct(&heap, &elem);
+			done++;
+		}
+
+		now++;
+	}
+
+	zbx_test_report("binary heap: pop and reschedule", num, zbx_time() - sec);
+
+	zbx_binary_heap_destroy(&heap);
+	zbx_free(items);
+}
+
+int	main(int argc, char **argv)
+{
+	int	num;
+
+	if (0 != (num = zbx_test_bench_num(argc, argv, 2000000)))
+	{
+		timerwheel_bench(num);
+		binaryheap_bench(num);
+
+		return SUCCEED;
+	}
+
+	timerwheel_test_random(1);
+	timerwheel_test_random(2);
+	timerwheel_test_random(3);
+
+	return SUCCEED;
+}
@@ -0,0 +1,80 @@
+/*
+** ZABBIX
+** Copyright (C) 2000-2010 SIA Zabbix
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**/
+
+#include "common.h"
+
+#include "zbxtest.h"
+
+/* the libraries expect every program to define these */
+const char	*progname = "zbxtest";
+const char	title_message[] = "Zabbix tests";
+const char	usage_message[] = "[bench [number]]";
+const char	*help_message[] = {NULL};
+
+static zbx_uint64_t	rand_state = 88172645463325252ULL;
+
+void	zbx_test_fail(const char *file, int line, const char *expr)
+{
+	fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+	exit(FAIL);
+}
+
+/* xorshift64, so that runs are reproducible on every platform */
+zbx_uint64_t	zbx_test_rand()
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+
+	return rand_state;
+}
+
+void	zbx_test_srand(zbx_uint64_t seed)
+{
+	rand_state = (0 == seed ? 88172645463325252ULL : seed);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Function: zbx_test_bench_num                                               *
+ *                                                                            *
+ * Purpose: tell whether the program was started as a benchmark               *
+ *                                                                            *
+ * Parameters: argc, argv  - [IN] program arguments, "bench [number]"         *
+ *             default_num - [IN] number of operations if none is given       *
+ *                                                                            *
+ * Return value: number of operations to benchmark, 0 to run the tests        *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_test_bench_num(int argc, char **argv, int default_num)
+{
+	if (2 > argc || 0 != strcmp(argv[1], "bench"))
+		return 0;
+
+	if (3 > argc)
+		return default_num;
+
+	return atoi(argv[2]);
+}
+
+void	zbx_test_report(const char *name, int num, double sec)
+{
+	printf("%-48s %10d ops %9.3f s %12.0f ops/s\n", name, num, sec, 0 < sec ? num / sec : 0);
+	fflush(stdout);
+}
@@ -0,0 +1,35 @@
+/*
+** ZABBIX
+** Copyright (C) 2000-2010 SIA Zabbix
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**/
+
+#ifndef ZABBIX_ZBXTEST_H
+#define ZABBIX_ZBXTEST_H
+
+/* helpers shared by the standalone tests and benchmarks, see Makefile.am */
+
+#define ZBX_TEST_CHECK(expr)	do { if (!(expr)) zbx_test_fail(__FILE__, __LINE__, #expr); } while (0)
+
+void		zbx_test_fail(const char *file, int line, const char *expr);
+
+zbx_uint64_t	zbx_test_rand();
+void		zbx_test_srand(zbx_uint64_t seed);
+
+int		zbx_test_bench_num(int argc, char **argv, int default_num);
+void		zbx_test_report(const char *name, int num, double sec);
+
+#endif
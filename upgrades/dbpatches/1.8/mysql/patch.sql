@@ -394,3 +394,62 @@ CREATE UNIQUE INDEX user_history_1 on user_history (userid);
 alter table users add rows_per_page           integer         DEFAULT 50      NOT NULL;
 alter table usrgrp add api_access              integer         DEFAULT '0'     NOT NULL;
 alter table usrgrp add debug_mode              integer         DEFAULT '0'     NOT NULL;
+CREATE TABLE write_queue (
+	slotid		integer		DEFAULT '0'	NOT NULL,
+	seq		bigint unsigned		DEFAULT '0'	NOT NULL,
+	PRIMARY KEY (slotid)
+) type=InnoDB;
+CREATE TABLE config_changes (
+	table_name		varchar(64)		DEFAULT ''	NOT NULL,
+	recordid		bigint unsigned		DEFAULT '0'	NOT NULL
+) type=InnoDB;
+CREATE INDEX config_changes_1 on config_changes (table_name,recordid);
+CREATE TRIGGER items_changes_ins AFTER INSERT ON items FOR EACH ROW
+	INSERT INTO config_changes VALUES ('items',NEW.itemid);
+CREATE TRIGGER items_changes_upd AFTER UPDATE ON items FOR EACH ROW
+	INSERT INTO config_changes SELECT 'items',NEW.itemid FROM DUAL WHERE NOT (
+		NEW.hostid<=>OLD.hostid AND NEW.type<=>OLD.type AND NEW.data_type<=>OLD.data_type AND
+		NEW.value_type<=>OLD.value_type AND NEW.key_<=>OLD.key_ AND
+		NEW.snmp_community<=>OLD.snmp_community AND NEW.snmp_oid<=>OLD.snmp_oid AND
+		NEW.snmp_port<=>OLD.snmp_port AND NEW.snmpv3_securityname<=>OLD.snmpv3_securityname AND
+		NEW.snmpv3_securitylevel<=>OLD.snmpv3_securitylevel AND
+		NEW.snmpv3_authpassphrase<=>OLD.snmpv3_authpassphrase AND
+		NEW.snmpv3_privpassphrase<=>OLD.snmpv3_privpassphrase AND
+		NEW.ipmi_sensor<=>OLD.ipmi_sensor AND NEW.delay<=>OLD.delay AND
+		NEW.delay_flex<=>OLD.delay_flex AND NEW.trapper_hosts<=>OLD.trapper_hosts AND
+		NEW.logtimefmt<=>OLD.logtimefmt AND NEW.params<=>OLD.params AND
+		NEW.status<=>OLD.status AND NEW.authtype<=>OLD.authtype AND
+		NEW.username<=>OLD.username AND NEW.password<=>OLD.password AND
+		NEW.publickey<=>OLD.publickey AND NEW.privatekey<=>OLD.privatekey);
+CREATE TRIGGER items_changes_del AFTER DELETE ON items FOR EACH ROW
+	INSERT INTO config_changes VALUES ('items',OLD.itemid);
+CREATE TRIGGER hosts_changes_ins AFTER INSERT ON hosts FOR EACH ROW
+	INSERT INTO config_changes VALUES ('hosts',NEW.hostid);
+CREATE TRIGGER hosts_changes_upd AFTER UPDATE ON hosts FOR EACH ROW
+	INSERT INTO config_changes SELECT 'hosts',NEW.hostid FROM DUAL WHERE NOT (
+		NEW.proxy_hostid<=>OLD.proxy_hostid AND NEW.host<=>OLD.host AND NEW.useip<=>OLD.useip AND
+		NEW.ip<=>OLD.ip AND NEW.dns<=>OLD.dns AND NEW.port<=>OLD.port AND
+		NEW.useipmi<=>OLD.useipmi AND NEW.ipmi_ip<=>OLD.ipmi_ip AND
+		NEW.ipmi_port<=>OLD.ipmi_port AND NEW.ipmi_authtype<=>OLD.ipmi_authtype AND
+		NEW.ipmi_privilege<=>OLD.ipmi_privilege AND NEW.ipmi_username<=>OLD.ipmi_username AND
+		NEW.ipmi_password<=>OLD.ipmi_password AND
+		NEW.maintenance_status<=>OLD.maintenance_status AND
+		NEW.maintenance_type<=>OLD.maintenance_type AND
+		NEW.maintenance_from<=>OLD.maintenance_from AND NEW.status<=>OLD.status);
+CREATE TRIGGER hosts_changes_del AFTER DELETE ON hosts FOR EACH ROW
+	INSERT INTO config_changes VALUES ('hosts',OLD.hostid);
+CREATE TRIGGER triggers_changes_ins AFTER INSERT ON triggers FOR EACH ROW
+	INSERT INTO config_changes VALUES ('triggers',NEW.triggerid);
+CREATE TRIGGER triggers_changes_upd AFTER UPDATE ON triggers FOR EACH ROW
+	INSERT INTO config_changes SELECT 'triggers',NEW.triggerid FROM DUAL WHERE NOT (
+		NEW.expression<=>OLD.expression AND NEW.status<=>OLD.status AND NEW.type<=>OLD.type);
+CREATE TRIGGER triggers_changes_del AFTER DELETE ON triggers FOR EACH ROW
+	INSERT INTO config_changes VALUES ('triggers',OLD.triggerid);
+CREATE TRIGGER functions_changes_ins AFTER INSERT ON functions FOR EACH ROW
+	INSERT INTO config_changes VALUES ('triggers',NEW.triggerid);
+CREATE TRIGGER functions_changes_upd AFTER UPDATE ON functions FOR EACH ROW
+	INSERT INTO config_changes SELECT 'triggers',c.triggerid FROM
+		(SELECT OLD.triggerid AS triggerid UNION SELECT NEW.triggerid) c WHERE NOT (
+		NEW.itemid<=>OLD.itemid AND NEW.triggerid<=>OLD.triggerid);
+CREATE TRIGGER functions_changes_del AFTER DELETE ON functions FOR EACH ROW
+	INSERT INTO config_changes VALUES ('triggers',OLD.triggerid);